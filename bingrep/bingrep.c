@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <assert.h>
 #include <ctype.h>
 #include <getopt.h>
@@ -8,9 +9,29 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "compression/compression.h"
+#include "mips/mips.h"
+#include "regex/regex.h"
+#include "workpool/workpool.h"
+
 /* Size of bad character table, needs a value for every character */
 #define ASIZE (UINT8_MAX + 1)
 
+typedef enum {
+    ENGINE_AUTO,
+    ENGINE_QS,
+    ENGINE_BRUTE,
+    ENGINE_MEMCHR,
+    ENGINE_PACKED,
+    ENGINE_SIMD,
+    ENGINE_TWOWAY,
+    ENGINE_MAX,
+} Engine;
+
 struct {
     unsigned int afterContext;
     unsigned int beforeContext;
@@ -20,7 +41,14 @@ struct {
     size_t length;
     bool text;
     bool untilZero;
-} gOptions = { 2, 2, -1, 1, 0, 0, false, false };
+    bool mips;
+    bool regex;
+    const char* range;
+    const char* xref;
+    Engine engine;
+    size_t duplicates;
+    bool decompress;
+} gOptions = { 2, 2, -1, 1, 0, 0, false, false, false, false, NULL, NULL, ENGINE_AUTO, 0, false };
 
 int currentCount = 0;
 
@@ -167,6 +195,18 @@ struct {
     printSpacing,
 };
 
+/* Offset of the compressed segment being searched with --decompress, or -1 when searching the file itself */
+long gSegmentOffset = -1;
+
+/* Prints where offset j of the buffer is: in the file, or in a segment as [segment:offset in its decompressed data] */
+void printOffset(size_t j) {
+    if (gSegmentOffset >= 0) {
+        printf("[%06lX:%06zX]", gSegmentOffset, j);
+    } else {
+        printf("[%06lX]", gOptions.start + j);
+    }
+}
+
 /* Output function */
 void OUTPUT(unsigned int j, unsigned int m, uint8_t* y, unsigned int n) {
     unsigned int k;
@@ -174,7 +214,8 @@ void OUTPUT(unsigned int j, unsigned int m, uint8_t* y, unsigned int n) {
     unsigned int end = MIN(j + m + gOptions.afterContext, n);
 
     /* Offset */
-    printf("[%06lX]:  ", gOptions.start + j);
+    printOffset(j);
+    printf(":  ");
 
     /* Before context */
     for (k = start; k < end; k++) {
@@ -235,6 +276,29 @@ void preQsBc(uint8_t* x, unsigned int m, int qsBc[]) {
     }
 }
 
+/**
+ * QuickSearch for the next occurrence of x at or after j, with a bad character table from preQsBc
+ *
+ * Returns its offset, or n if there are no more.
+ */
+unsigned int QS_Find(const uint8_t* x, unsigned int m, const int qsBc[], const uint8_t* y, unsigned int n,
+                     unsigned int j) {
+    if (n < m) {
+        return n;
+    }
+    while (j <= n - m) {
+        // printf("%d: %d\n", j, memcmp(x, y + j, m));
+        if (memcmp(x, y + j, m) == 0) {
+            return j;
+        }
+        if (j + m >= n) {
+            break;
+        }
+        j += qsBc[y[j + m]]; /* shift */
+    }
+    return n;
+}
+
 /**
  * QuickSearch implementation
  *
@@ -254,9 +318,8 @@ unsigned int QS(uint8_t* x, unsigned int m, uint8_t* y, unsigned int n) {
 
     /* Searching */
     j = 0;
-    while (j <= n - m) {
-        // printf("%d: %d\n", j, memcmp(x, y + j, m));
-        if (memcmp(x, y + j, m) == 0) {
+    while ((j = QS_Find(x, m, qsBc, y, n, j)) + m <= n) {
+        if (j % gOptions.width == 0) {
             OUTPUT(j, m, y, n);
 
             if (gOptions.maxCount > -1) {
@@ -266,6 +329,9 @@ unsigned int QS(uint8_t* x, unsigned int m, uint8_t* y, unsigned int n) {
                 }
             }
         }
+        if (j + m >= n) {
+            break;
+        }
         j += qsBc[y[j + m]]; /* shift */
     }
     return currentCount;
@@ -293,187 +359,1812 @@ unsigned int BruteForceSearch(uint8_t* x, unsigned int m, uint8_t* y, unsigned i
     return currentCount;
 }
 
-struct option longOpts[] = {
-    { "after-context", required_argument, NULL, 'A' },
-    { "before-context", required_argument, NULL, 'B' },
-    { "max-count", required_argument, NULL, 'm' },
-    { "start", required_argument, NULL, 'S' },
-    { "length", required_argument, NULL, 'N' },
-    { "text", no_argument, NULL, 'a' },
-    // Non-grep args:
-    { "until-zero", no_argument, NULL, 'z' },
-    { "help", no_argument, NULL, 'h' },
-    { "width", no_argument, NULL, 'W' },
-    { 0 },
+/* Engines for plain byte patterns */
+
+const char* engineNames[ENGINE_MAX] = {
+    [ENGINE_AUTO] = "auto",     [ENGINE_QS] = "qs",     [ENGINE_BRUTE] = "brute",   [ENGINE_MEMCHR] = "memchr",
+    [ENGINE_PACKED] = "packed", [ENGINE_SIMD] = "simd", [ENGINE_TWOWAY] = "twoway",
 };
 
-int main(int argc, char** argv) {
-    int opt;
-    FILE* inputFile;
-    uint8_t* fileBuffer;
-    uint8_t* search;
-    int searchLength;
-    unsigned int foundCount = 0;
+/* How much of the input to look at to guess how common each byte is */
+#define SAMPLE_BLOCK_SIZE 0x100
+#define SAMPLE_BLOCK_COUNT 0x100
 
-    /* Parse options */
-    if (argc < 3) {
-        printf("Usage: %s PATTERN FILE", argv[0]);
+/* Bytes are rare enough to filter on if they make up less than 1 / RARE_BYTE_RATIO of the sample */
+#define RARE_BYTE_RATIO 64
+
+/**
+ * Counts the bytes in evenly spaced blocks of y, or all of it if it is small.
+ *
+ * Returns the number of bytes counted.
+ */
+size_t SampleByteFrequencies(const uint8_t* y, size_t n, uint32_t freq[ASIZE]) {
+    size_t stride = n / SAMPLE_BLOCK_COUNT;
+    size_t i;
+    size_t k;
+
+    memset(freq, 0, ASIZE * sizeof(uint32_t));
+    if (n <= SAMPLE_BLOCK_SIZE * SAMPLE_BLOCK_COUNT) {
+        for (i = 0; i < n; i++) {
+            freq[y[i]]++;
+        }
+        return n;
+    }
+    for (i = 0; i < SAMPLE_BLOCK_COUNT; i++) {
+        for (k = 0; k < SAMPLE_BLOCK_SIZE; k++) {
+            freq[y[i * stride + k]]++;
+        }
     }
+    return SAMPLE_BLOCK_SIZE * SAMPLE_BLOCK_COUNT;
+}
 
-    while (true) {
-        int optionIndex = 0;
-        if ((opt = getopt_long(argc, argv, "A:B:m:W:S:N:ahz", longOpts, &optionIndex)) == -1) {
+/* Position in x of the byte least common in the input, other than position exclude */
+size_t RarestByte(const uint8_t* x, size_t m, const uint32_t freq[ASIZE], size_t exclude) {
+    size_t best = (exclude == 0 && m > 1) ? 1 : 0;
+    size_t i;
+
+    for (i = 0; i < m; i++) {
+        if (i != exclude && freq[x[i]] < freq[x[best]]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+typedef struct {
+    Engine engine;
+    const uint8_t* x;
+    size_t m;
+    size_t rare;       /* Positions in x of the bytes to filter on */
+    size_t secondRare;
+    uint64_t packed;   /* Pattern of up to 8 bytes as loaded from memory, and the mask of its bytes */
+    uint64_t packedMask;
+} Searcher;
+
+/**
+ * Chooses how to search for x in y: memchr for a single byte, a filter on the first and last bytes and one 64-bit
+ * compare for up to 8 bytes, and for longer patterns a filter on their two rarest bytes unless they are too common in
+ * the input, in which case Two-Way, whose worst case is linear. QuickSearch and brute force are kept for comparison,
+ * and brute force for widths over 1.
+ */
+Engine PlanEngine(size_t m, const uint8_t* x, const uint32_t freq[ASIZE], size_t sampleSize) {
+    if (gOptions.width > 1) {
+        return ENGINE_BRUTE;
+    }
+    if (m == 1) {
+        return ENGINE_MEMCHR;
+    }
+    if (m <= sizeof(uint64_t)) {
+        return ENGINE_PACKED;
+    }
+    if (freq[x[RarestByte(x, m, freq, m)]] * RARE_BYTE_RATIO <= sampleSize) {
+        return ENGINE_SIMD;
+    }
+    return ENGINE_TWOWAY;
+}
+
+void Searcher_Init(Searcher* searcher, Engine engine, const uint8_t* x, size_t m, const uint32_t freq[ASIZE]) {
+    uint8_t maskBytes[sizeof(uint64_t)] = { 0 };
+
+    searcher->engine = engine;
+    searcher->x = x;
+    searcher->m = m;
+    searcher->rare = RarestByte(x, m, freq, m);
+    searcher->secondRare = RarestByte(x, m, freq, searcher->rare);
+
+    searcher->packed = 0;
+    searcher->packedMask = 0;
+    if (m <= sizeof(uint64_t)) {
+        memcpy(&searcher->packed, x, m);
+        memset(maskBytes, 0xFF, m);
+        memcpy(&searcher->packedMask, maskBytes, sizeof(uint64_t));
+    }
+}
+
+/* Checks for the pattern at y + j, given that it fits */
+static inline bool Searcher_Verify(const Searcher* searcher, const uint8_t* y, size_t n, size_t j) {
+    if (searcher->packedMask != 0 && j + sizeof(uint64_t) <= n) {
+        uint64_t word;
+
+        memcpy(&word, y + j, sizeof(word));
+        return (word & searcher->packedMask) == searcher->packed;
+    }
+    return memcmp(y + j, searcher->x, searcher->m) == 0;
+}
+
+/* Finds the rarest byte with memchr, then checks the rest */
+size_t MemchrNext(const Searcher* searcher, const uint8_t* y, size_t n, size_t j) {
+    size_t m = searcher->m;
+    size_t rare = searcher->rare;
+
+    while (j + m <= n) {
+        const uint8_t* found = memchr(y + j + rare, searcher->x[rare], n - m + 1 - j);
+
+        if (found == NULL) {
             break;
         }
+        j = found - y - rare;
+        if (Searcher_Verify(searcher, y, n, j)) {
+            return j;
+        }
+        j++;
+    }
+    return n;
+}
 
-        switch (opt) {
-            case 'A':
-                if (sscanf(optarg, "%d", &gOptions.afterContext) == 0) {
-                    fprintf(stderr, "-A expects a dec number, found %s", optarg);
-                    return 1;
-                }
-                break;
+#if defined(__SSE2__)
+/**
+ * Compares two bytes of the pattern with the bytes at those positions for 16 possible starts at once, and only checks
+ * the whole pattern where both are equal.
+ */
+static size_t FilterNext(const Searcher* searcher, size_t first, size_t second, const uint8_t* y, size_t n, size_t j) {
+    size_t m = searcher->m;
+    __m128i firstByte = _mm_set1_epi8(searcher->x[first]);
+    __m128i secondByte = _mm_set1_epi8(searcher->x[second]);
+
+    while (j + 16 + m - 1 <= n) {
+        __m128i firstEqual = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(y + j + first)), firstByte);
+        __m128i secondEqual = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(y + j + second)), secondByte);
+        unsigned int candidates = _mm_movemask_epi8(_mm_and_si128(firstEqual, secondEqual));
+
+        while (candidates != 0) {
+            size_t k = j + __builtin_ctz(candidates);
+
+            candidates &= candidates - 1;
+            if (Searcher_Verify(searcher, y, n, k)) {
+                return k;
+            }
+        }
+        j += 16;
+    }
+    return MemchrNext(searcher, y, n, j);
+}
+#endif
+
+/* Filters on the first and last bytes, and checks the rest with one 64-bit compare */
+size_t PackedNext(const Searcher* searcher, const uint8_t* y, size_t n, size_t j) {
+#if defined(__SSE2__)
+    return FilterNext(searcher, 0, searcher->m - 1, y, n, j);
+#else
+    return MemchrNext(searcher, y, n, j);
+#endif
+}
 
-            case 'B':
-                if (sscanf(optarg, "%d", &gOptions.beforeContext) == 0) {
-                    fprintf(stderr, "-B expects a dec number, found %s", optarg);
-                    return 1;
-                }
-                break;
+/* Filters on the two rarest bytes */
+size_t SimdNext(const Searcher* searcher, const uint8_t* y, size_t n, size_t j) {
+#if defined(__SSE2__)
+    return FilterNext(searcher, searcher->rare, searcher->secondRare, y, n, j);
+#else
+    return MemchrNext(searcher, y, n, j);
+#endif
+}
 
-            case 'm':
-                if (sscanf(optarg, "%d", &gOptions.maxCount) == 0) {
-                    fprintf(stderr, "-m expects a dec number, found %s", optarg);
-                    return 1;
-                }
-                break;
+/* glibc's memmem is Crochemore-Perrin Two-Way for needles this long */
+size_t TwoWayNext(const Searcher* searcher, const uint8_t* y, size_t n, size_t j) {
+    const uint8_t* found = memmem(y + j, n - j, searcher->x, searcher->m);
 
-            case 'W':
-                if (sscanf(optarg, "%d", &gOptions.width) == 0) {
-                    fprintf(stderr, "-W expects a dec number, found %s", optarg);
-                    return 1;
-                }
-                break;
+    return (found == NULL) ? n : (size_t)(found - y);
+}
 
-            case 'S':
-                if (sscanf(optarg, "%zX", &gOptions.start) == 0) {
-                    fprintf(stderr, "-W expects a dec number, found %s", optarg);
-                    return 1;
-                }
-                break;
+/**
+ * Searches with one of the engines that find the next match, for every match whose offset is a multiple of the width.
+ *
+ * y is buffer to search
+ * n is length of y
+ */
+unsigned int EngineSearch(const Searcher* searcher, uint8_t* y, unsigned int n) {
+    size_t (*next)(const Searcher*, const uint8_t*, size_t, size_t);
+    size_t m = searcher->m;
+    size_t j = 0;
 
-            case 'N':
-                if (sscanf(optarg, "%zX", &gOptions.length) == 0) {
-                    fprintf(stderr, "-W expects a dec number, found %s", optarg);
-                    return 1;
-                }
-                break;
+    currentCount = 0;
 
-            case 'a':
-                gOptions.text = true;
-                break;
+    switch (searcher->engine) {
+        case ENGINE_MEMCHR:
+            next = MemchrNext;
+            break;
 
-            case 'z':
-                gOptions.untilZero = true;
-                break;
+        case ENGINE_PACKED:
+            next = PackedNext;
+            break;
 
-            case 'h': // Not consistent with grep! Will fix when multi
+        case ENGINE_SIMD:
+            next = SimdNext;
+            break;
 
-                printf("Usage: %s PATTERN FILE", argv[0]);
-                puts("\"grep, but for binary files\".\n"
-                     "By default searches in a binary file for a given string of bytes and prints the\n"
-                     "address and a small amount of context. Most options are taken from grep.\n"
-                     "\n"
-                     "Positional arguments\n"
-                     "  PATTERN                   pattern of bytes to search for. Currently no wildcards\n"
-                     "  FILE                      file to search for pattern\n"
-                     "\n"
-                     "Options\n"
-                     "  -a, --text                treat string/file as ASCII instead of bytes\n"
-                     "  -m, --max-count=NUM       stop after NUM selected lines\n"
-                     "  -B, --before-context=NUM  print NUM lines of leading context\n"
-                     "  -A, --after-context=NUM   print NUM lines of trailing context\n"
-                     "  -h, --help                print this message and exit\n"
-                     "\n"
-                     "Non-grep options\n"
-                     "  -S, --start=HEX           offset at which to start searching\n"
-                     "  -N, --length=HEX          number of bytes to read\n"
-                     "  -z, --until-zero          print text until next string terminator (\\0),"
-                     "                            requires --text\n"
-                     "  -W, --width=NUM           only look for results whose offset is a multiple of\n"
-                     "                            NUM, e.g. a whole number of words\n"
-                     "\n");
+        default:
+            next = TwoWayNext;
+            break;
+    }
 
-                return 1;
+    while (j + m <= n && (j = next(searcher, y, n, j)) + m <= n) {
+        if (j % gOptions.width == 0) {
+            OUTPUT(j, m, y, n);
 
-            default:
-                break;
+            if (gOptions.maxCount > -1) {
+                currentCount++;
+                if (currentCount >= gOptions.maxCount) {
+                    break;
+                }
+            }
         }
+        j++;
     }
+    return currentCount;
+}
 
-    /* Check options */
-    if (gOptions.untilZero && !gOptions.text) {
-        fprintf(stderr, "--until-zero specified without --text\n");
-        return 1;
-    }
+/* Reads a word in the buffer's byte order, to compare against values stored the same way */
+static inline uint32_t LoadWord(const uint8_t* y) {
+    uint32_t word;
 
-    /* Process options and input */
+    memcpy(&word, y, sizeof(word));
+    return word;
+}
 
-    // This makes the search a char array rather than a string, always, but is needed to avoid using the final '\0'
-    searchLength = strlen(argv[optind]);
-    search = malloc(searchLength);
-    // memcpy(search, argv[1], searchLength);
-    if (gOptions.text) {
-        memcpy(search, argv[optind], searchLength);
-    } else {
-        searchLength = BytesFromString(search, argv[optind]);
+/* Converts a big-endian instruction word to how it looks when loaded from the buffer with LoadWord */
+static inline uint32_t StoreOrder(uint32_t word) {
+    uint8_t bytes[4] = { word >> 24, word >> 16, word >> 8, word };
+
+    return LoadWord(bytes);
+}
+
+static inline bool MipsMatchesRest(const uint32_t* values, const uint32_t* masks, size_t count, const uint8_t* y) {
+    size_t i;
+
+    for (i = 1; i < count; i++) {
+        if ((LoadWord(y + 4 * i) & masks[i]) != values[i]) {
+            return false;
+        }
     }
+    return true;
+}
 
-    if ((inputFile = fopen(argv[optind + 1], "rb")) == NULL) {
-        fprintf(stderr, "Failed to open file %s\n", argv[optind + 1]);
-        free(search);
-        return 1;
+/**
+ * Searches for a sequence of masked instruction words, only at offsets in the file that are multiples of the width (a
+ * multiple of 4, 4 unless given). The first instruction is compared against four words at a time, and only where that
+ * matches are the rest checked.
+ *
+ * pattern is the compiled instructions
+ * y is buffer to search, big-endian
+ * n is length of y
+ */
+unsigned int MipsSearch(const MipsPattern* pattern, uint8_t* y, unsigned int n) {
+    size_t count = pattern->count;
+    unsigned int m = 4 * count;
+    uint32_t* values = malloc(count * sizeof(uint32_t));
+    uint32_t* masks = malloc(count * sizeof(uint32_t));
+    unsigned int j = (4 - gOptions.start % 4) % 4;
+    size_t i;
+
+    currentCount = 0;
+
+    for (i = 0; i < count; i++) {
+        masks[i] = StoreOrder(pattern->masks[i]);
+        values[i] = StoreOrder(pattern->values[i]) & masks[i];
     }
 
-    if (gOptions.text) {
-        gPrintInfo.bytePrint = printChar;
-        gPrintInfo.spacePrint = printNothing;
+    if (n < m) {
+        free(values);
+        free(masks);
+        return 0;
     }
 
-    // If output is piped, do not use colour
-    if (isatty(STDOUT_FILENO)) {
-        enableColour();
+#if defined(__SSE2__)
+    {
+        __m128i firstValue = _mm_set1_epi32(values[0]);
+        __m128i firstMask = _mm_set1_epi32(masks[0]);
+
+        while (j + 16 <= n - m + 4) {
+            __m128i words = _mm_loadu_si128((const __m128i*)(y + j));
+            int hits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(words, firstMask), firstValue)));
+
+            while (hits != 0) {
+                unsigned int k = j + 4 * __builtin_ctz(hits);
+
+                hits &= hits - 1;
+                if ((gOptions.start + k) % gOptions.width == 0 && MipsMatchesRest(values, masks, count, y + k)) {
+                    OUTPUT(k, m, y, n);
+
+                    if (gOptions.maxCount > -1) {
+                        currentCount++;
+                        if (currentCount >= gOptions.maxCount) {
+                            free(values);
+                            free(masks);
+                            return currentCount;
+                        }
+                    }
+                }
+            }
+            j += 16;
+        }
     }
+#endif
 
-    // {
-    //     int i;
-    //     printf("%s\n", argv[optind]);
-    //     for (i = 0; i < searchLength; i++) {
-    //         printf("%02X ", search[i]);
-    //     }
-    //     putchar('\n');
-    // }
+    while (j <= n - m) {
+        if ((LoadWord(y + j) & masks[0]) == values[0] && (gOptions.start + j) % gOptions.width == 0 &&
+            MipsMatchesRest(values, masks, count, y + j)) {
+            OUTPUT(j, m, y, n);
 
-    if (gOptions.length == 0) {
-        fseek(inputFile, 0, SEEK_END);
-        gOptions.length = ftell(inputFile);
+            if (gOptions.maxCount > -1) {
+                currentCount++;
+                if (currentCount >= gOptions.maxCount) {
+                    break;
+                }
+            }
+        }
+        j += 4;
     }
-    fseek(inputFile, gOptions.start, SEEK_SET);
-    fileBuffer = malloc(gOptions.length);
-    fread(fileBuffer, gOptions.length, 1, inputFile);
 
-    if (gOptions.width > 1) {
-        // fprintf(stderr, "Using BFS\n");
-        /* Use brute force for more complex searches for simplicity. */
-        foundCount = BruteForceSearch(search, searchLength, fileBuffer, gOptions.length);
-    } else {
-        // fprintf(stderr, "Using QS\n");
-        foundCount = QS(search, searchLength, fileBuffer, gOptions.length);
-    }
+    free(values);
+    free(masks);
+    return currentCount;
+}
+
+/**
+ * Searches for matches of a regular expression, non-overlapping, only at offsets in the file that are multiples of the
+ * width. Each match is the one that ends first, from the leftmost offset it can start at.
+ *
+ * regex is the compiled pattern
+ * y is buffer to search
+ * n is length of y
+ */
+unsigned int RegexSearch(Regex* regex, uint8_t* y, unsigned int n) {
+    unsigned int width = gOptions.width;
+    unsigned int j = (width - gOptions.start % width) % width;
+
+    currentCount = 0;
+
+    while (j < n) {
+        size_t start;
+        long end = Regex_Find(regex, y + j, n - j, width, &start);
+
+        if (end < 0) {
+            break;
+        }
+        OUTPUT(j + start, end - start, y, n);
+
+        if (gOptions.maxCount > -1) {
+            currentCount++;
+            if (currentCount >= gOptions.maxCount) {
+                break;
+            }
+        }
+        j += end;
+        j += (width - (gOptions.start + j) % width) % width;
+    }
+    return currentCount;
+}
+
+/**
+ * Parses a range of 32-bit values given as "LO-HI" in hex, HI not included.
+ *
+ * Returns 0 on success, -1 on failure, which is reported.
+ */
+int ParseRange(const char* range, uint32_t* low, uint32_t* last) {
+    const char* str = range;
+    char* end;
+    unsigned long long lo = strtoull(str, &end, 16);
+    unsigned long long hi;
+
+    if (end == str || *end != '-') {
+        fprintf(stderr, "--range expects LO-HI in hex, found %s\n", range);
+        return -1;
+    }
+    str = end + 1;
+    hi = strtoull(str, &end, 16);
+    if (end == str || *end != '\0' || lo >= hi || hi > 0x100000000ull) {
+        fprintf(stderr, "--range expects LO-HI in hex with LO < HI <= 100000000, found %s\n", range);
+        return -1;
+    }
+    *low = lo;
+    *last = hi - lo - 1;
+    return 0;
+}
+
+/**
+ * Searches for big-endian words in a range of values, e.g. pointers into a segment, at offsets in the file that are
+ * multiples of the width. A value is in the range if it minus low, wrapping around, is at most last.
+ *
+ * y is buffer to search
+ * n is length of y
+ */
+unsigned int RangeSearch(uint32_t low, uint32_t last, uint8_t* y, unsigned int n) {
+    unsigned int width = gOptions.width;
+    unsigned int j = (width - gOptions.start % width) % width;
+
+    currentCount = 0;
+
+#if defined(__SSE2__)
+    /* 16 aligned words at once: byteswap, subtract low, and compare with last, unsigned by flipping the sign bits */
+    if (width == 4) {
+        __m128i lowVec = _mm_set1_epi32(low);
+        __m128i lastVec = _mm_set1_epi32(last ^ 0x80000000);
+        __m128i signBits = _mm_set1_epi32(0x80000000);
+
+        while (j + 64 <= n) {
+            unsigned int hits = 0;
+            int k;
+
+            for (k = 0; k < 4; k++) {
+                __m128i words = _mm_loadu_si128((const __m128i*)(y + j + 16 * k));
+                __m128i outside;
+
+                words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+                words = _mm_shufflehi_epi16(_mm_shufflelo_epi16(words, 0xB1), 0xB1);
+                words = _mm_xor_si128(_mm_sub_epi32(words, lowVec), signBits);
+                outside = _mm_cmpgt_epi32(words, lastVec);
+                hits |= (~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF) << (4 * k);
+            }
+
+            while (hits != 0) {
+                unsigned int offset = j + 4 * __builtin_ctz(hits);
+
+                hits &= hits - 1;
+                OUTPUT(offset, 4, y, n);
+
+                if (gOptions.maxCount > -1) {
+                    currentCount++;
+                    if (currentCount >= gOptions.maxCount) {
+                        return currentCount;
+                    }
+                }
+            }
+            j += 64;
+        }
+    }
+#endif
+
+    while (j + 4 <= n) {
+        uint32_t value = (y[j] << 24) | (y[j + 1] << 16) | (y[j + 2] << 8) | y[j + 3];
+
+        if (value - low <= last) {
+            OUTPUT(j, 4, y, n);
+
+            if (gOptions.maxCount > -1) {
+                currentCount++;
+                if (currentCount >= gOptions.maxCount) {
+                    break;
+                }
+            }
+        }
+        j += width;
+    }
+    return currentCount;
+}
+
+/* Set of addresses to find references to */
+typedef struct {
+    uint32_t* keys;
+    bool* used;
+    size_t mask;
+    uint16_t regions; /* Bit per top nybble of the addresses, to rebuild jump targets from */
+} AddressSet;
+
+static inline size_t AddressSet_Slot(uint32_t address) {
+    return (address * 0x9E3779B1u) >> 7;
+}
+
+void AddressSet_Init(AddressSet* set, size_t count) {
+    size_t size = 16;
+
+    while (size < 2 * count) {
+        size *= 2;
+    }
+    set->keys = calloc(size, sizeof(uint32_t));
+    set->used = calloc(size, sizeof(bool));
+    set->mask = size - 1;
+    set->regions = 0;
+}
+
+void AddressSet_Destroy(AddressSet* set) {
+    free(set->keys);
+    free(set->used);
+}
+
+void AddressSet_Add(AddressSet* set, uint32_t address) {
+    size_t i = AddressSet_Slot(address) & set->mask;
+
+    while (set->used[i]) {
+        if (set->keys[i] == address) {
+            return;
+        }
+        i = (i + 1) & set->mask;
+    }
+    set->keys[i] = address;
+    set->used[i] = true;
+    set->regions |= 1 << (address >> 28);
+}
+
+static inline bool AddressSet_Has(const AddressSet* set, uint32_t address) {
+    size_t i = AddressSet_Slot(address) & set->mask;
+
+    while (set->used[i]) {
+        if (set->keys[i] == address) {
+            return true;
+        }
+        i = (i + 1) & set->mask;
+    }
+    return false;
+}
+
+/**
+ * Reads hex addresses separated by commas, or whitespace too if from a file given as "@FILE", into a set.
+ *
+ * Returns 0 on success, -1 on failure, which is reported.
+ */
+int ParseAddresses(const char* arg, AddressSet* set) {
+    char* text;
+    char* savePtr = NULL;
+    char* token;
+    size_t count = 1;
+    size_t i;
+
+    if (arg[0] == '@') {
+        FILE* file = fopen(arg + 1, "rb");
+        long size;
+
+        if (file == NULL) {
+            fprintf(stderr, "Failed to open file %s\n", arg + 1);
+            return -1;
+        }
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        text = malloc(size + 1);
+        size = fread(text, 1, size, file);
+        text[size] = '\0';
+        fclose(file);
+    } else {
+        text = strdup(arg);
+    }
+
+    for (i = 0; text[i] != '\0'; i++) {
+        count += (text[i] == ',' || text[i] == '\n');
+    }
+    AddressSet_Init(set, count);
+
+    count = 0;
+    for (token = strtok_r(text, ", \t\r\n", &savePtr); token != NULL; token = strtok_r(NULL, ", \t\r\n", &savePtr)) {
+        char* end;
+        unsigned long address = strtoul(token, &end, 16);
+
+        if (end == token || *end != '\0' || address > UINT32_MAX) {
+            fprintf(stderr, "--xref expects hex addresses, found %s\n", token);
+            free(text);
+            AddressSet_Destroy(set);
+            return -1;
+        }
+        AddressSet_Add(set, address);
+        count++;
+    }
+    free(text);
+
+    if (count == 0) {
+        fprintf(stderr, "No addresses given to --xref\n");
+        AddressSet_Destroy(set);
+        return -1;
+    }
+    return 0;
+}
+
+/* Instructions that can use an address, by opcode */
+typedef enum {
+    XREF_NONE,
+    XREF_JUMP,   /* j, jal */
+    XREF_ADD,    /* %lo added to the %hi in rs, result in rt */
+    XREF_OR,     /* %lo or'd with the %hi in rs, result in rt */
+    XREF_LOAD,   /* Loads through %lo(rs) into rt */
+    XREF_ACCESS, /* Stores, or loads to a coprocessor register, through %lo(rs) */
+} XrefKind;
+
+static const struct {
+    const char* name;
+    XrefKind kind;
+} xrefOpcodes[64] = {
+    [0x02] = { "j", XREF_JUMP },      [0x03] = { "jal", XREF_JUMP },    [0x08] = { "addi", XREF_ADD },
+    [0x09] = { "addiu", XREF_ADD },   [0x0D] = { "ori", XREF_OR },      [0x18] = { "daddi", XREF_ADD },
+    [0x19] = { "daddiu", XREF_ADD },  [0x1A] = { "ldl", XREF_LOAD },    [0x1B] = { "ldr", XREF_LOAD },
+    [0x20] = { "lb", XREF_LOAD },     [0x21] = { "lh", XREF_LOAD },     [0x22] = { "lwl", XREF_LOAD },
+    [0x23] = { "lw", XREF_LOAD },     [0x24] = { "lbu", XREF_LOAD },    [0x25] = { "lhu", XREF_LOAD },
+    [0x26] = { "lwr", XREF_LOAD },    [0x27] = { "lwu", XREF_LOAD },    [0x28] = { "sb", XREF_ACCESS },
+    [0x29] = { "sh", XREF_ACCESS },   [0x2A] = { "swl", XREF_ACCESS },  [0x2B] = { "sw", XREF_ACCESS },
+    [0x2C] = { "sdl", XREF_ACCESS },  [0x2D] = { "sdr", XREF_ACCESS },  [0x2E] = { "swr", XREF_ACCESS },
+    [0x31] = { "lwc1", XREF_ACCESS }, [0x35] = { "ldc1", XREF_ACCESS }, [0x37] = { "ld", XREF_LOAD },
+    [0x39] = { "swc1", XREF_ACCESS }, [0x3D] = { "sdc1", XREF_ACCESS }, [0x3F] = { "sd", XREF_ACCESS },
+};
+
+/* Output function for a reference: the instruction, what it is, and the lui it was paired with if any */
+void XREF_OUTPUT(unsigned int j, const char* name, uint32_t address, long luiOffset, uint8_t* y) {
+    printOffset(j);
+    printf(":  %s%02X%02X%02X%02X%s  %s %08X", g_setaf_light_red, y[j], y[j + 1], y[j + 2], y[j + 3], g_sgr0, name,
+           address);
+    if (luiOffset >= 0) {
+        printf(" (lui at ");
+        printOffset(luiOffset);
+        putchar(')');
+    }
+    putchar('\n');
+}
+
+/**
+ * Finds code referring to any of a set of addresses, in one pass over the words of y as big-endian MIPS: j and jal
+ * to them, and %hi/%lo pairs of a lui and an addiu, ori, load or store that add up to them. The last lui into each
+ * register is kept until something else writes to the register, or the function returns.
+ *
+ * y is buffer to search
+ * n is length of y
+ */
+unsigned int XrefSearch(const AddressSet* set, uint8_t* y, unsigned int n) {
+    uint32_t his[32];
+    unsigned int luiOffsets[32];
+    uint32_t pending = 0; /* Registers holding a %hi */
+    int returning = 0;
+    unsigned int j = (4 - gOptions.start % 4) % 4;
+
+    currentCount = 0;
+
+    for (; j + 4 <= n; j += 4) {
+        uint32_t word = (y[j] << 24) | (y[j + 1] << 16) | (y[j + 2] << 8) | y[j + 3];
+        unsigned int op = word >> 26;
+        unsigned int rs = (word >> 21) & 0x1F;
+        unsigned int rt = (word >> 16) & 0x1F;
+        uint32_t imm = word & 0xFFFF;
+        uint32_t written = 0; /* Registers no longer holding a %hi after this */
+        bool found = false;
+        uint32_t address = 0;
+        long luiOffset = -1;
+
+        switch (xrefOpcodes[op].kind) {
+            case XREF_JUMP: {
+                uint32_t target = (word & 0x3FFFFFF) << 2;
+                unsigned int region;
+
+                for (region = 0; region < 16 && !found; region++) {
+                    if ((set->regions >> region) & 1) {
+                        address = (region << 28) | target;
+                        found = AddressSet_Has(set, address);
+                    }
+                }
+                if (op == 0x03) {
+                    written = 1u << 31;
+                }
+                break;
+            }
+
+            case XREF_ADD:
+            case XREF_OR:
+            case XREF_LOAD:
+            case XREF_ACCESS:
+                if ((pending >> rs) & 1) {
+                    address = (xrefOpcodes[op].kind == XREF_OR) ? (his[rs] | imm) : (his[rs] + (int16_t)imm);
+                    luiOffset = luiOffsets[rs];
+                    found = AddressSet_Has(set, address);
+                }
+                if (xrefOpcodes[op].kind != XREF_ACCESS) {
+                    written = 1u << rt;
+                }
+                break;
+
+            case XREF_NONE:
+                if (op == 0x0F) { /* lui */
+                    his[rt] = imm << 16;
+                    luiOffsets[rt] = j;
+                    pending |= 1u << rt;
+                } else if (op == 0x00) {
+                    /* SPECIAL writes rd, if anything */
+                    written = 1u << ((word >> 11) & 0x1F);
+                    if ((word & 0x3F) == 0x08 && rs == 31) { /* jr $ra */
+                        returning = 2;
+                    }
+                } else if ((op >= 0x0A && op <= 0x0E) || op == 0x10 || op == 0x11) {
+                    /* slti ... xori, and moves from coprocessors write rt */
+                    written = 1u << rt;
+                }
+                break;
+        }
+
+        if (found) {
+            XREF_OUTPUT(j, xrefOpcodes[op].name, address, luiOffset, y);
+
+            if (gOptions.maxCount > -1) {
+                currentCount++;
+                if (currentCount >= gOptions.maxCount) {
+                    break;
+                }
+            }
+        }
+
+        pending &= ~written & ~1u;
+        /* The %hi values of a function are gone after its return's delay slot */
+        if (returning != 0 && --returning == 0) {
+            pending = 0;
+        }
+    }
+    return currentCount;
+}
+
+/* Duplicate blocks */
+
+/* Multiplier of the Rabin-Karp hash of windows, modulo 2^32 */
+#define ROLLING_HASH_BASE 0x01000193u
+
+/* Longest window to hash; longer blocks are found from more, sparser windows */
+#define MAX_HASH_WINDOW 32
+
+/* Most earlier windows with the same hash to compare a window with, in case of collisions */
+#define MAX_DUPLICATE_CANDIDATES 16
+
+/* Hash of windows that are all one byte, which are left to the runs */
+#define RUN_HASH UINT32_MAX
+
+/* Copies whose ends are this close are taken to be the same block, with a few bytes that match by chance */
+#define DUPLICATE_END_SLACK 8
+
+typedef struct {
+    uint32_t first;
+    uint32_t length;
+    uint32_t other;  /* Where the same bytes are again */
+    uint32_t period; /* For periodic data, how often it repeats, 1 for runs of one byte; otherwise 0 */
+} Duplicate;
+
+typedef struct {
+    Duplicate* entries;
+    size_t count;
+    size_t capacity;
+} DuplicateList;
+
+static void DuplicateList_Add(DuplicateList* list, uint32_t first, uint32_t length, uint32_t other, uint32_t period) {
+    if (list->count == list->capacity) {
+        list->capacity = 2 * list->capacity + 64;
+        list->entries = realloc(list->entries, list->capacity * sizeof(Duplicate));
+    }
+    list->entries[list->count].first = first;
+    list->entries[list->count].length = length;
+    list->entries[list->count].other = other;
+    list->entries[list->count].period = period;
+    list->count++;
+}
+
+static int CompareDuplicates(const void* a, const void* b) {
+    const Duplicate* x = a;
+    const Duplicate* y = b;
+
+    if (x->first != y->first) {
+        return (x->first < y->first) ? -1 : 1;
+    }
+    if (x->period != y->period) {
+        return (x->period < y->period) ? -1 : 1;
+    }
+    if (x->length != y->length) {
+        return (x->length > y->length) ? -1 : 1;
+    }
+    return (x->other > y->other) - (x->other < y->other);
+}
+
+/* Entries with about the same first copy, as the range common to all of them */
+typedef struct {
+    uint32_t start;
+    uint32_t length;
+    uint32_t period; /* As for Duplicate; periodic data is a group on its own */
+    size_t parent;   /* Earlier group this is a copy of, for union-find, or itself */
+} DuplicateGroup;
+
+/* Where a group is: its start, or where else it is */
+typedef struct {
+    uint32_t offset;
+    size_t group;
+    bool isStart;
+} DuplicateCopy;
+
+/* A group's own start and its copies, sorted by the first group of the block they are copies of */
+typedef struct {
+    uint32_t rootStart;
+    size_t root;
+    uint32_t offset;
+    bool isCopy;
+} DuplicateOffset;
+
+static int CompareDuplicateCopies(const void* a, const void* b) {
+    const DuplicateCopy* x = a;
+    const DuplicateCopy* y = b;
+
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+static int CompareDuplicateOffsets(const void* a, const void* b) {
+    const DuplicateOffset* x = a;
+    const DuplicateOffset* y = b;
+
+    if (x->rootStart != y->rootStart) {
+        return (x->rootStart < y->rootStart) ? -1 : 1;
+    }
+    if (x->root != y->root) {
+        return (x->root < y->root) ? -1 : 1;
+    }
+    if (x->isCopy != y->isCopy) {
+        return x->isCopy ? 1 : -1;
+    }
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+static size_t DuplicateGroup_Find(DuplicateGroup* groups, size_t group) {
+    while (groups[group].parent != group) {
+        groups[group].parent = groups[groups[group].parent].parent;
+        group = groups[group].parent;
+    }
+    return group;
+}
+
+/* Merges the sets of two groups, keeping the one that starts first as the root */
+static void DuplicateGroup_Union(DuplicateGroup* groups, size_t a, size_t b) {
+    a = DuplicateGroup_Find(groups, a);
+    b = DuplicateGroup_Find(groups, b);
+    if (a == b) {
+        return;
+    }
+    if (groups[b].start < groups[a].start || (groups[b].start == groups[a].start && b < a)) {
+        groups[a].parent = b;
+    } else {
+        groups[b].parent = a;
+    }
+}
+
+/* Whether two offsets or lengths are within slack of each other */
+#define WITHIN(a, b, slack) ((a) + (slack) >= (b) && (b) + (slack) >= (a))
+
+/* Stable LSD radix sort, skipping bytes that are the same in every key */
+static void RadixSort64(uint64_t* keys, size_t count) {
+    uint64_t* buffer = malloc(count * sizeof(uint64_t));
+    uint64_t* from = keys;
+    uint64_t* to = buffer;
+    size_t offsets[ASIZE];
+    unsigned int shift;
+    size_t i;
+
+    for (shift = 0; shift < 64 && count != 0; shift += 8) {
+        size_t total = 0;
+        uint64_t* swap;
+
+        memset(offsets, 0, sizeof(offsets));
+        for (i = 0; i < count; i++) {
+            offsets[(from[i] >> shift) & 0xFF]++;
+        }
+        if (offsets[(from[0] >> shift) & 0xFF] == count) {
+            continue;
+        }
+        for (i = 0; i < ASIZE; i++) {
+            size_t bucketCount = offsets[i];
+
+            offsets[i] = total;
+            total += bucketCount;
+        }
+        for (i = 0; i < count; i++) {
+            to[offsets[(from[i] >> shift) & 0xFF]++] = from[i];
+        }
+        swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != keys) {
+        memcpy(keys, from, count * sizeof(uint64_t));
+    }
+    free(buffer);
+}
+
+/* Open-addressing map from a nonzero key to a value, for the end of the last match on each diagonal, and blocks */
+typedef struct {
+    uint32_t* keys;
+    uint32_t* values;
+    size_t mask;
+    size_t count;
+} OffsetMap;
+
+static void OffsetMap_Init(OffsetMap* map) {
+    map->mask = 0x3FF;
+    map->count = 0;
+    map->keys = calloc(map->mask + 1, sizeof(uint32_t));
+    map->values = calloc(map->mask + 1, sizeof(uint32_t));
+}
+
+static void OffsetMap_Destroy(OffsetMap* map) {
+    free(map->keys);
+    free(map->values);
+}
+
+static inline size_t OffsetMap_Find(const OffsetMap* map, uint32_t key) {
+    size_t i = (key * 0x9E3779B1u) & map->mask;
+
+    while (map->keys[i] != 0 && map->keys[i] != key) {
+        i = (i + 1) & map->mask;
+    }
+    return i;
+}
+
+static uint32_t OffsetMap_Get(const OffsetMap* map, uint32_t key) {
+    size_t i = OffsetMap_Find(map, key);
+
+    return (map->keys[i] == key) ? map->values[i] : 0;
+}
+
+static void OffsetMap_Set(OffsetMap* map, uint32_t key, uint32_t value) {
+    size_t i = OffsetMap_Find(map, key);
+
+    if (map->keys[i] == 0) {
+        if (2 * (map->count + 1) > map->mask + 1) {
+            OffsetMap old = *map;
+            size_t k;
+
+            map->mask = 2 * map->mask + 1;
+            map->count = 0;
+            map->keys = calloc(map->mask + 1, sizeof(uint32_t));
+            map->values = calloc(map->mask + 1, sizeof(uint32_t));
+            for (k = 0; k <= old.mask; k++) {
+                if (old.keys[k] != 0) {
+                    OffsetMap_Set(map, old.keys[k], old.values[k]);
+                }
+            }
+            OffsetMap_Destroy(&old);
+            i = OffsetMap_Find(map, key);
+        }
+        map->keys[i] = key;
+        map->count++;
+    }
+    map->values[i] = value;
+}
+
+/* Smallest period of data that repeats every period bytes, which is one of its divisors */
+static uint32_t FindPeriod(const uint8_t* y, size_t length, uint32_t period) {
+    uint32_t divisor;
+
+    for (divisor = 1; divisor < period; divisor++) {
+        if (period % divisor == 0 && memcmp(y, y + divisor, length - divisor) == 0) {
+            return divisor;
+        }
+    }
+    return period;
+}
+
+/**
+ * Picks anchor windows of y by winnowing: the window with the smallest rolling hash among every winnow consecutive
+ * ones. The choice only depends on the bytes, so any block at least window + winnow - 1 long has an anchor at the
+ * same place in every copy.
+ *
+ * Returns the number of anchors, as hash << 32 | offset.
+ */
+static size_t FindAnchors(const uint8_t* y, size_t n, size_t window, size_t winnow, uint64_t** anchors) {
+    uint64_t* deque = malloc(winnow * sizeof(uint64_t)); /* Circular, increasing hash << 32 | offset */
+    size_t head = 0;
+    size_t dequeCount = 0;
+    size_t capacity = n / winnow + 16;
+    size_t count = 0;
+    size_t lastAnchor = SIZE_MAX;
+    size_t sameLength = 0; /* Bytes equal to the last one of the window, up to it */
+    uint32_t basePower = 1;
+    uint32_t hash = 0;
+    size_t i;
+
+    *anchors = malloc(capacity * sizeof(uint64_t));
+    for (i = 0; i < window - 1; i++) {
+        basePower *= ROLLING_HASH_BASE;
+    }
+
+    for (i = 0; i + 1 < window; i++) {
+        hash = hash * ROLLING_HASH_BASE + y[i];
+        sameLength = (i > 0 && y[i] == y[i - 1]) ? sameLength + 1 : 1;
+    }
+    for (i = 0; i + window <= n; i++) {
+        size_t last = i + window - 1;
+        uint64_t entry;
+
+        if (i != 0) {
+            hash -= y[i - 1] * basePower;
+        }
+        hash = hash * ROLLING_HASH_BASE + y[last];
+        sameLength = (last > 0 && y[last] == y[last - 1]) ? sameLength + 1 : 1;
+        entry = ((uint64_t)((sameLength >= window) ? RUN_HASH : hash) << 32) | i;
+
+        if (dequeCount != 0 && (uint32_t)deque[head] + winnow <= i) {
+            head = (head + 1) % winnow;
+            dequeCount--;
+        }
+        /* Hashes that are no smaller than a later one can never be the minimum, ties going to the later one */
+        while (dequeCount != 0 && (deque[(head + dequeCount - 1) % winnow] >> 32) >= (entry >> 32)) {
+            dequeCount--;
+        }
+        deque[(head + dequeCount) % winnow] = entry;
+        dequeCount++;
+
+        if (i + 1 >= winnow && (uint32_t)deque[head] != lastAnchor && (deque[head] >> 32) != RUN_HASH) {
+            lastAnchor = (uint32_t)deque[head];
+            if (count == capacity) {
+                capacity *= 2;
+                *anchors = realloc(*anchors, capacity * sizeof(uint64_t));
+            }
+            (*anchors)[count++] = deque[head];
+        }
+    }
+    free(deque);
+    return count;
+}
+
+/**
+ * Finds every block of at least minLength bytes that appears more than once in y, and prints each once with all the
+ * other places it is. Runs of one byte and other periodic data are listed on their own instead.
+ *
+ * Anchor windows are picked by winnowing, and sorted by hash. Each anchor is compared with the first anchor with the
+ * same hash, and with the previous one to spot periodic data. Matches are extended both ways to their full length in
+ * order of offset, and later matches on the same diagonal (distance between the copies) within one are skipped.
+ * Memory is a few bytes per anchor, about 2 / (minLength - MAX_HASH_WINDOW) of the input for long blocks.
+ *
+ * y is buffer to search
+ * n is length of y
+ */
+unsigned int DuplicateSearch(size_t minLength, uint8_t* y, unsigned int n) {
+    size_t window = MIN(minLength / 2, MAX_HASH_WINDOW);
+    size_t winnow = minLength - window + 1;
+    uint64_t* anchors;
+    size_t anchorCount;
+    uint64_t* pairs;
+    size_t pairCount = 0;
+    DuplicateList found = { NULL, 0, 0 };
+    DuplicateGroup* groups;
+    size_t* groupOf;
+    size_t groupCount = 0;
+    DuplicateCopy* copies;
+    size_t copyCount = 0;
+    DuplicateOffset* offsets;
+    size_t offsetCount = 0;
+    OffsetMap diagonals;
+    size_t periodicEnd = 0;
+    size_t runStart = 0;
+    size_t i;
+    size_t j;
+
+    currentCount = 0;
+    if (n < minLength) {
+        return 0;
+    }
+
+    /* Runs of one byte, which would otherwise match themselves at every distance */
+    for (j = 1; j <= n; j++) {
+        if (j == n || y[j] != y[runStart]) {
+            if (j - runStart >= minLength) {
+                DuplicateList_Add(&found, runStart, j - runStart, 0, 1);
+            }
+            runStart = j;
+        }
+    }
+
+    anchorCount = FindAnchors(y, n, window, winnow, &anchors);
+    RadixSort64(anchors, anchorCount);
+
+    /* Candidate pairs as later << 32 | ~earlier, so the closest earlier one comes first for each later one */
+    pairs = malloc(2 * anchorCount * sizeof(uint64_t));
+    for (i = 0; i < anchorCount; i = j) {
+        uint32_t hash = anchors[i] >> 32;
+
+        for (j = i + 1; j < anchorCount && (anchors[j] >> 32) == hash; j++) {
+            uint32_t later = anchors[j];
+            uint32_t previous = anchors[j - 1];
+            uint32_t first = later;
+            size_t k;
+
+            for (k = i; k < j && k < i + MAX_DUPLICATE_CANDIDATES; k++) {
+                if (memcmp(y + (uint32_t)anchors[k], y + later, window) == 0) {
+                    first = anchors[k];
+                    pairs[pairCount++] = ((uint64_t)later << 32) | (uint32_t)~first;
+                    break;
+                }
+            }
+            if (previous != first && later - previous < minLength &&
+                memcmp(y + previous, y + later, window) == 0) {
+                pairs[pairCount++] = ((uint64_t)later << 32) | (uint32_t)~previous;
+            }
+        }
+    }
+    free(anchors);
+    RadixSort64(pairs, pairCount);
+
+    OffsetMap_Init(&diagonals);
+    for (i = 0; i < pairCount; i++) {
+        size_t later = pairs[i] >> 32;
+        size_t earlier = (uint32_t)~(uint32_t)pairs[i];
+        size_t back = 0;
+        size_t length = window;
+
+        if (later < periodicEnd || OffsetMap_Get(&diagonals, later - earlier) > later) {
+            continue;
+        }
+
+        while (back < earlier && y[earlier - back - 1] == y[later - back - 1]) {
+            back++;
+        }
+        while (later + length < n && y[earlier + length] == y[later + length]) {
+            length++;
+        }
+        OffsetMap_Set(&diagonals, later - earlier, later + length);
+        length += back;
+
+        if (earlier - back + length <= later - back) {
+            if (length >= minLength) {
+                DuplicateList_Add(&found, earlier - back, length, later - back, 0);
+            }
+        } else {
+            /* Overlapping copies are periodic data, which is listed once, and skipped */
+            periodicEnd = later - back + length;
+            DuplicateList_Add(&found, earlier - back, periodicEnd - (earlier - back), 0,
+                              FindPeriod(y + earlier - back, periodicEnd - (earlier - back), later - earlier));
+        }
+    }
+    OffsetMap_Destroy(&diagonals);
+    free(pairs);
+
+    /* Entries whose first copies start and end about the same are one block, the part they have in common */
+    qsort(found.entries, found.count, sizeof(Duplicate), CompareDuplicates);
+    groupOf = malloc((found.count + 1) * sizeof(size_t));
+    groups = malloc((found.count + 1) * sizeof(DuplicateGroup));
+    for (i = 0; i < found.count; i++) {
+        const Duplicate* entry = &found.entries[i];
+        size_t start = entry->first;
+        size_t end = entry->first + entry->length;
+
+        groupOf[i] = groupCount;
+        for (j = i; entry->period == 0 && j > 0 && found.entries[j - 1].first + DUPLICATE_END_SLACK >= start; j--) {
+            const Duplicate* other = &found.entries[j - 1];
+
+            if (other->period == 0 && WITHIN(other->first + other->length, end, DUPLICATE_END_SLACK)) {
+                groupOf[i] = groupOf[j - 1];
+                break;
+            }
+        }
+        if (groupOf[i] != groupCount) {
+            DuplicateGroup* group = &groups[groupOf[i]];
+
+            group->length = MIN(group->start + group->length, end) - MAX(group->start, start);
+            group->start = MAX(group->start, start);
+            continue;
+        }
+
+        groups[groupCount].start = start;
+        groups[groupCount].length = end - start;
+        groups[groupCount].period = entry->period;
+        groups[groupCount].parent = groupCount;
+        groupCount++;
+    }
+
+    /*
+     * Winnowing can pick different anchors near the ends of each copy, so a block may be found as several pairs that
+     * do not share a first copy. Join groups that are about the same length and have copies (or starts) in about the
+     * same place.
+     */
+    copies = malloc((found.count + groupCount + 1) * sizeof(DuplicateCopy));
+    for (i = 0; i < groupCount; i++) {
+        if (groups[i].period == 0) {
+            copies[copyCount].offset = groups[i].start;
+            copies[copyCount].group = i;
+            copies[copyCount].isStart = true;
+            copyCount++;
+        }
+    }
+    for (i = 0; i < found.count; i++) {
+        if (found.entries[i].period == 0) {
+            copies[copyCount].offset = found.entries[i].other + (groups[groupOf[i]].start - found.entries[i].first);
+            copies[copyCount].group = groupOf[i];
+            copies[copyCount].isStart = false;
+            copyCount++;
+        }
+    }
+    qsort(copies, copyCount, sizeof(DuplicateCopy), CompareDuplicateCopies);
+    for (i = 0; i < copyCount; i++) {
+        for (j = i + 1; j < copyCount && copies[j].offset <= copies[i].offset + DUPLICATE_END_SLACK; j++) {
+            if (WITHIN(groups[copies[i].group].length, groups[copies[j].group].length, 2 * DUPLICATE_END_SLACK)) {
+                DuplicateGroup_Union(groups, copies[i].group, copies[j].group);
+            }
+        }
+    }
+
+    /* List every block once, at the start of its first group, with the offsets of all the others */
+    offsets = malloc((groupCount + copyCount + 1) * sizeof(DuplicateOffset));
+    for (i = 0; i < groupCount; i++) {
+        if (groups[i].period != 0) {
+            offsets[offsetCount].rootStart = groups[i].start;
+            offsets[offsetCount].root = i;
+            offsets[offsetCount].offset = groups[i].start;
+            offsets[offsetCount].isCopy = false;
+            offsetCount++;
+        }
+    }
+    for (i = 0; i < copyCount; i++) {
+        size_t root = DuplicateGroup_Find(groups, copies[i].group);
+
+        offsets[offsetCount].rootStart = groups[root].start;
+        offsets[offsetCount].root = root;
+        offsets[offsetCount].offset = copies[i].offset;
+        offsets[offsetCount].isCopy = !(copies[i].isStart && copies[i].group == root);
+        offsetCount++;
+    }
+    qsort(offsets, offsetCount, sizeof(DuplicateOffset), CompareDuplicateOffsets);
+
+    for (i = 0; i < offsetCount; i = j) {
+        const DuplicateGroup* group = &groups[offsets[i].root];
+        uint32_t lastOffset = group->start;
+
+        printOffset(group->start);
+        if (group->period == 1) {
+            printf(":  0x%X bytes of %s%02X%s\n", group->length, g_setaf_light_red, y[group->start], g_sgr0);
+        } else if (group->period != 0) {
+            printf(":  0x%X bytes repeating every 0x%X bytes\n", group->length, group->period);
+        } else {
+            printf(":  0x%X bytes, also at", group->length);
+        }
+        for (j = i + 1; j < offsetCount && offsets[j].root == offsets[i].root; j++) {
+            /* The same copy found from different groups, a few bytes apart */
+            if (WITHIN(offsets[j].offset, lastOffset, DUPLICATE_END_SLACK)) {
+                continue;
+            }
+            lastOffset = offsets[j].offset;
+            printf(" %s", g_setaf_light_red);
+            printOffset(offsets[j].offset);
+            printf("%s", g_sgr0);
+        }
+        if (group->period == 0) {
+            putchar('\n');
+        }
+
+        if (gOptions.maxCount > -1) {
+            currentCount++;
+            if (currentCount >= gOptions.maxCount) {
+                break;
+            }
+        }
+    }
+    free(offsets);
+    free(copies);
+    free(groupOf);
+    free(groups);
+    free(found.entries);
+    return currentCount;
+}
+
+/* Searching */
+
+/* Everything needed to run the search chosen by the options over a buffer */
+typedef struct {
+    uint8_t* search;
+    unsigned int searchLength;
+    Engine engine;
+    const Searcher* searcher;
+    const MipsPattern* mipsPattern;
+    Regex* regex;
+    uint32_t rangeLow;
+    uint32_t rangeLast;
+    const AddressSet* xrefAddresses;
+} Query;
+
+unsigned int SearchBuffer(const Query* query, uint8_t* y, unsigned int n) {
+    if (gOptions.duplicates != 0) {
+        return DuplicateSearch(gOptions.duplicates, y, n);
+    } else if (gOptions.xref != NULL) {
+        return XrefSearch(query->xrefAddresses, y, n);
+    } else if (gOptions.range != NULL) {
+        return RangeSearch(query->rangeLow, query->rangeLast, y, n);
+    } else if (gOptions.mips) {
+        return MipsSearch(query->mipsPattern, y, n);
+    } else if (gOptions.regex) {
+        return RegexSearch(query->regex, y, n);
+    } else if (query->engine == ENGINE_BRUTE) {
+        return BruteForceSearch(query->search, query->searchLength, y, n);
+    } else if (query->engine == ENGINE_QS) {
+        return QS(query->search, query->searchLength, y, n);
+    } else {
+        return EngineSearch(query->searcher, y, n);
+    }
+}
+
+/* Compressed segments */
+
+/* Headers claiming more than this are taken to be chance matches of the magic */
+#define MAX_SEGMENT_SIZE 0x1000000
+
+/* Size of the scratch buffer segments are decompressed into, a batch at a time, unless one needs more */
+#define SEGMENT_BATCH_SIZE 0x2000000
+
+typedef struct {
+    size_t offset;        /* of the header in the buffer */
+    size_t size;          /* decompressed */
+    size_t scratchOffset; /* where it is decompressed to in the scratch buffer */
+    bool decompressed;
+} Segment;
+
+typedef struct {
+    const uint8_t* y;
+    size_t n;
+    Segment* segments;
+    uint8_t* scratch;
+} SegmentJob;
+
+/**
+ * Looks for Yaz0, MIO0 and Yay0 headers at word-aligned offsets. The magic alone is not much to go on, so headers with
+ * an implausible size, or MIO0/Yay0 stream offsets outside the buffer, are skipped, and anything else that is not
+ * really compressed data will fail to decompress.
+ *
+ * Returns number of segments found, in a newly-allocated array.
+ */
+size_t FindSegments(const uint8_t* y, size_t n, Segment** segments) {
+    size_t count = 0;
+    size_t capacity = 0x100;
+    size_t j;
+
+    *segments = malloc(capacity * sizeof(Segment));
+
+    for (j = (4 - gOptions.start % 4) % 4; j + COMPRESSION_HEADER_SIZE <= n; j += 4) {
+        CompressionType type = DetectCompression(y + j, n - j);
+        size_t size;
+
+        if (type == COMPRESSION_NONE) {
+            continue;
+        }
+        size = GetDecompressedSize(y + j, n - j);
+        if (size == 0 || size > MAX_SEGMENT_SIZE) {
+            continue;
+        }
+        if (type != COMPRESSION_YAZ0) {
+            /* Offsets of the back-reference and literal streams */
+            uint32_t links = (y[j + 8] << 24) | (y[j + 9] << 16) | (y[j + 10] << 8) | y[j + 11];
+            uint32_t literals = (y[j + 12] << 24) | (y[j + 13] << 16) | (y[j + 14] << 8) | y[j + 15];
+
+            if (links < COMPRESSION_HEADER_SIZE || links >= n - j || literals < COMPRESSION_HEADER_SIZE ||
+                literals >= n - j) {
+                continue;
+            }
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            *segments = realloc(*segments, capacity * sizeof(Segment));
+        }
+        (*segments)[count].offset = j;
+        (*segments)[count].size = size;
+        (*segments)[count].decompressed = false;
+        count++;
+    }
+
+    return count;
+}
+
+void DecompressSegment(void* arg, size_t index) {
+    SegmentJob* job = arg;
+    Segment* segment = &job->segments[index];
+
+    segment->decompressed = Decompress(job->y + segment->offset, job->n - segment->offset,
+                                       job->scratch + segment->scratchOffset, segment->size) == (int)segment->size;
+}
+
+/**
+ * Runs the search over the decompressed contents of every compressed segment in y, with matches given as the offset
+ * of the segment in the file and the offset in its decompressed data. The segments are decompressed in parallel into
+ * a scratch buffer that is reused for each batch that fits in it, then searched in order so that the output is too.
+ * alreadyFound is what the search of the file itself returned, which counts towards -m as well.
+ *
+ * Returns total of what the searches returned.
+ */
+unsigned int SearchSegments(const Query* query, const uint8_t* y, size_t n, unsigned int alreadyFound) {
+    Segment* segments;
+    size_t segmentCount = FindSegments(y, n, &segments);
+    size_t fileStart = gOptions.start;
+    size_t scratchSize = SEGMENT_BATCH_SIZE;
+    SegmentJob job = { y, n, segments, NULL };
+    int maxCount = gOptions.maxCount;
+    unsigned int foundCount = 0;
+    size_t batchStart;
+    size_t i;
+
+    for (i = 0; i < segmentCount; i++) {
+        scratchSize = MAX(scratchSize, segments[i].size);
+    }
+    job.scratch = malloc(scratchSize);
+
+    /* Offsets within the decompressed data, in particular for alignment, are relative to its start */
+    gOptions.start = 0;
+
+    for (batchStart = 0;
+         batchStart < segmentCount && (maxCount < 0 || alreadyFound + foundCount < (unsigned int)maxCount);) {
+        size_t batchEnd = batchStart;
+        size_t used = 0;
+
+        while (batchEnd < segmentCount && used + segments[batchEnd].size <= scratchSize) {
+            segments[batchEnd].scratchOffset = used;
+            used += segments[batchEnd].size;
+            batchEnd++;
+        }
+
+        job.segments = &segments[batchStart];
+        WorkPool_ParallelFor(0, batchEnd - batchStart, DecompressSegment, &job);
+
+        for (i = batchStart; i < batchEnd; i++) {
+            if (!segments[i].decompressed) {
+                continue;
+            }
+            if (maxCount > -1) {
+                /* Each search counts from zero, so give it only what is left */
+                if (alreadyFound + foundCount >= (unsigned int)maxCount) {
+                    break;
+                }
+                gOptions.maxCount = maxCount - (alreadyFound + foundCount);
+            }
+            gSegmentOffset = fileStart + segments[i].offset;
+            foundCount += SearchBuffer(query, job.scratch + segments[i].scratchOffset, segments[i].size);
+        }
+
+        batchStart = batchEnd;
+    }
+
+    gSegmentOffset = -1;
+    gOptions.start = fileStart;
+    gOptions.maxCount = maxCount;
+    free(job.scratch);
+    free(segments);
+    return foundCount;
+}
+
+struct option longOpts[] = {
+    { "after-context", required_argument, NULL, 'A' },
+    { "before-context", required_argument, NULL, 'B' },
+    { "max-count", required_argument, NULL, 'm' },
+    { "start", required_argument, NULL, 'S' },
+    { "length", required_argument, NULL, 'N' },
+    { "text", no_argument, NULL, 'a' },
+    // Non-grep args:
+    { "until-zero", no_argument, NULL, 'z' },
+    { "help", no_argument, NULL, 'h' },
+    { "width", no_argument, NULL, 'W' },
+    { "mips", no_argument, NULL, 'M' },
+    { "extended-regexp", no_argument, NULL, 'E' },
+    { "range", required_argument, NULL, 'R' },
+    { "xref", required_argument, NULL, 'X' },
+    { "engine", required_argument, NULL, 'e' },
+    { "duplicates", required_argument, NULL, 'D' },
+    { "decompress", no_argument, NULL, 'Z' },
+    { 0 },
+};
+
+int main(int argc, char** argv) {
+    int opt;
+    FILE* inputFile;
+    uint8_t* fileBuffer;
+    uint8_t* search;
+    int searchLength;
+    unsigned int foundCount = 0;
+    MipsPattern mipsPattern = { 0 };
+    Regex* regex = NULL;
+    bool widthSet = false;
+    uint32_t rangeLow;
+    uint32_t rangeLast;
+    int fileIndex;
+    bool patternless;
+    AddressSet xrefAddresses = { 0 };
+    bool engineSet = false;
+    Searcher searcher;
+    Query query;
+    uint32_t freq[ASIZE];
+    size_t sampleSize;
+
+    /* Parse options */
+    if (argc < 3) {
+        printf("Usage: %s PATTERN FILE", argv[0]);
+    }
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "A:B:m:W:S:N:R:X:e:D:ahzMEZ", longOpts, &optionIndex)) == -1) {
+            break;
+        }
+
+        switch (opt) {
+            case 'A':
+                if (sscanf(optarg, "%d", &gOptions.afterContext) == 0) {
+                    fprintf(stderr, "-A expects a dec number, found %s", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'B':
+                if (sscanf(optarg, "%d", &gOptions.beforeContext) == 0) {
+                    fprintf(stderr, "-B expects a dec number, found %s", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'm':
+                if (sscanf(optarg, "%d", &gOptions.maxCount) == 0) {
+                    fprintf(stderr, "-m expects a dec number, found %s", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'W':
+                widthSet = true;
+                if (sscanf(optarg, "%d", &gOptions.width) == 0) {
+                    fprintf(stderr, "-W expects a dec number, found %s", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'S':
+                if (sscanf(optarg, "%zX", &gOptions.start) == 0) {
+                    fprintf(stderr, "-W expects a dec number, found %s", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'N':
+                if (sscanf(optarg, "%zX", &gOptions.length) == 0) {
+                    fprintf(stderr, "-W expects a dec number, found %s", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'a':
+                gOptions.text = true;
+                break;
+
+            case 'z':
+                gOptions.untilZero = true;
+                break;
+
+            case 'M':
+                gOptions.mips = true;
+                break;
+
+            case 'E':
+                gOptions.regex = true;
+                break;
+
+            case 'Z':
+                gOptions.decompress = true;
+                break;
+
+            case 'R':
+                gOptions.range = optarg;
+                break;
+
+            case 'X':
+                gOptions.xref = optarg;
+                break;
+
+            case 'D': {
+                char* end;
+
+                gOptions.duplicates = strtoul(optarg, &end, 0);
+                if (end == optarg || *end != '\0' || gOptions.duplicates < 4 || gOptions.duplicates > UINT32_MAX) {
+                    fprintf(stderr, "-D expects a number of bytes, at least 4, found %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+
+            case 'e':
+                for (gOptions.engine = 0; gOptions.engine < ENGINE_MAX; gOptions.engine++) {
+                    if (strcmp(optarg, engineNames[gOptions.engine]) == 0) {
+                        break;
+                    }
+                }
+                if (gOptions.engine == ENGINE_MAX) {
+                    fprintf(stderr, "--engine expects auto, qs, brute, memchr, packed, simd or twoway, found %s\n",
+                            optarg);
+                    return 1;
+                }
+                engineSet = true;
+                break;
+
+            case 'h': // Not consistent with grep! Will fix when multi
+
+                printf("Usage: %s PATTERN FILE", argv[0]);
+                puts("\"grep, but for binary files\".\n"
+                     "By default searches in a binary file for a given string of bytes and prints the\n"
+                     "address and a small amount of context. Most options are taken from grep.\n"
+                     "\n"
+                     "Positional arguments\n"
+                     "  PATTERN                   pattern of bytes to search for. Currently no wildcards\n"
+                     "  FILE                      file to search for pattern\n"
+                     "\n"
+                     "Options\n"
+                     "  -a, --text                treat string/file as ASCII instead of bytes\n"
+                     "  -E, --extended-regexp     PATTERN is a regular expression of hex bytes: '.' is any\n"
+                     "                            byte, [00-1F 7F] and [^...] are byte classes, and (), |,\n"
+                     "                            *, +, ?, {n,m} are as usual, e.g. '03E00008 (....){0,7}\n"
+                     "                            27BD....'. --text only changes how matches are printed\n"
+                     "  -m, --max-count=NUM       stop after NUM selected lines\n"
+                     "  -B, --before-context=NUM  print NUM lines of leading context\n"
+                     "  -A, --after-context=NUM   print NUM lines of trailing context\n"
+                     "  -h, --help                print this message and exit\n"
+                     "\n"
+                     "Non-grep options\n"
+                     "  -S, --start=HEX           offset at which to start searching\n"
+                     "  -N, --length=HEX          number of bytes to read\n"
+                     "  -z, --until-zero          print text until next string terminator (\\0),"
+                     "                            requires --text\n"
+                     "  -W, --width=NUM           only look for results whose offset is a multiple of\n"
+                     "                            NUM, e.g. a whole number of words\n"
+                     "  -R, --range=LO-HI         instead of PATTERN, look for big-endian words from LO up\n"
+                     "                            to but not including HI (hex), e.g. pointers into\n"
+                     "                            80000000-80800000. Only offsets that are multiples of\n"
+                     "                            --width are searched, 4 unless given\n"
+                     "  -X, --xref=ADDRS          instead of PATTERN, find code using any of ADDRS, hex\n"
+                     "                            addresses separated by commas, or listed in FILE with\n"
+                     "                            @FILE: j/jal to them, and lui paired with addiu, ori,\n"
+                     "                            loads or stores\n"
+                     "  -e, --engine=NAME         how to search for a plain PATTERN: auto (the default,\n"
+                     "                            prints its choice if given), qs, brute, memchr,\n"
+                     "                            packed, simd or twoway\n"
+                     "  -D, --duplicates=NUM      instead of PATTERN, list blocks of at least NUM bytes\n"
+                     "                            that appear more than once, with where else they are,\n"
+                     "                            and runs of one byte that long\n"
+                     "  -Z, --decompress          also search inside Yaz0, MIO0 and Yay0 data in FILE,\n"
+                     "                            with matches at [SEGMENT:OFFSET], where OFFSET is in\n"
+                     "                            the decompressed data of the segment at SEGMENT\n"
+                     "  -M, --mips                PATTERN is MIPS instructions separated by ';', e.g.\n"
+                     "                            'lui $?, 0x8012; addiu $?, $?, ?'. Operands (or whole\n"
+                     "                            instructions) may be '?' to match anything. Only\n"
+                     "                            offsets of a big-endian file that are multiples of\n"
+                     "                            --width are searched, 4 unless given\n"
+                     "\n");
+
+                return 1;
+
+            default:
+                break;
+        }
+    }
+
+    /* Check options */
+    if (gOptions.untilZero && !gOptions.text) {
+        fprintf(stderr, "--until-zero specified without --text\n");
+        return 1;
+    }
+    if (gOptions.mips + gOptions.regex + (gOptions.range != NULL) + (gOptions.xref != NULL) +
+            (gOptions.duplicates != 0) > 1) {
+        fprintf(stderr, "Only one of --mips, --extended-regexp, --range, --xref and --duplicates can be used\n");
+        return 1;
+    }
+    /* There is no PATTERN with --range, --xref or --duplicates */
+    patternless = gOptions.range != NULL || gOptions.xref != NULL || gOptions.duplicates != 0;
+    if (gOptions.text && (gOptions.mips || patternless)) {
+        fprintf(stderr, "--text can only be used with plain patterns and --extended-regexp\n");
+        return 1;
+    }
+    if (gOptions.width < 1) {
+        fprintf(stderr, "--width must be at least 1\n");
+        return 1;
+    }
+
+    fileIndex = patternless ? optind : optind + 1;
+    if (fileIndex >= argc) {
+        fprintf(stderr, "Usage: %s PATTERN FILE\n", argv[0]);
+        return 1;
+    }
+
+    /* Process options and input */
+
+    // This makes the search a char array rather than a string, always, but is needed to avoid using the final '\0'
+    searchLength = strlen(argv[optind]);
+    search = malloc(searchLength);
+    // memcpy(search, argv[1], searchLength);
+    if (gOptions.xref != NULL) {
+        if (ParseAddresses(gOptions.xref, &xrefAddresses) != 0) {
+            free(search);
+            return 1;
+        }
+    } else if (gOptions.range != NULL) {
+        if (ParseRange(gOptions.range, &rangeLow, &rangeLast) != 0) {
+            free(search);
+            return 1;
+        }
+        if (!widthSet) {
+            gOptions.width = 4;
+        }
+    } else if (gOptions.mips) {
+        if (MipsPattern_Compile(&mipsPattern, argv[optind]) != 0) {
+            free(search);
+            return 1;
+        }
+        if (!widthSet) {
+            gOptions.width = 4;
+        } else if (gOptions.width % 4 != 0) {
+            fprintf(stderr, "--width must be a multiple of 4 with --mips, since instructions are words\n");
+            MipsPattern_Destroy(&mipsPattern);
+            free(search);
+            return 1;
+        }
+    } else if (gOptions.regex) {
+        if ((regex = Regex_Compile(argv[optind])) == NULL) {
+            free(search);
+            return 1;
+        }
+    } else if (gOptions.text) {
+        memcpy(search, argv[optind], searchLength);
+    } else if (!patternless) {
+        searchLength = BytesFromString(search, argv[optind]);
+    }
+    if (searchLength <= 0 && !gOptions.mips && !gOptions.regex && !patternless) {
+        fprintf(stderr, "PATTERN is empty\n");
+        free(search);
+        return 1;
+    }
+
+    if ((inputFile = fopen(argv[fileIndex], "rb")) == NULL) {
+        fprintf(stderr, "Failed to open file %s\n", argv[fileIndex]);
+        free(search);
+        MipsPattern_Destroy(&mipsPattern);
+        if (regex != NULL) {
+            Regex_Destroy(regex);
+        }
+        AddressSet_Destroy(&xrefAddresses);
+        return 1;
+    }
+
+    if (gOptions.text) {
+        gPrintInfo.bytePrint = printChar;
+        gPrintInfo.spacePrint = printNothing;
+    }
+
+    // If output is piped, do not use colour
+    if (isatty(STDOUT_FILENO)) {
+        enableColour();
+    }
+
+    // {
+    //     int i;
+    //     printf("%s\n", argv[optind]);
+    //     for (i = 0; i < searchLength; i++) {
+    //         printf("%02X ", search[i]);
+    //     }
+    //     putchar('\n');
+    // }
+
+    if (gOptions.length == 0) {
+        fseek(inputFile, 0, SEEK_END);
+        gOptions.length = ftell(inputFile);
+    }
+    fseek(inputFile, gOptions.start, SEEK_SET);
+    fileBuffer = malloc(gOptions.length);
+    fread(fileBuffer, gOptions.length, 1, inputFile);
+
+    query.search = search;
+    query.searchLength = searchLength;
+    query.searcher = &searcher;
+    query.mipsPattern = &mipsPattern;
+    query.regex = regex;
+    query.rangeLow = rangeLow;
+    query.rangeLast = rangeLast;
+    query.xrefAddresses = &xrefAddresses;
+    query.engine = gOptions.engine;
+    if (!patternless && !gOptions.mips && !gOptions.regex) {
+        sampleSize = SampleByteFrequencies(fileBuffer, gOptions.length, freq);
+        if (query.engine == ENGINE_AUTO) {
+            query.engine = PlanEngine(searchLength, search, freq, sampleSize);
+            if (engineSet) {
+                fprintf(stderr, "Using %s engine\n", engineNames[query.engine]);
+            }
+        }
+        if (query.engine != ENGINE_BRUTE && query.engine != ENGINE_QS) {
+            Searcher_Init(&searcher, query.engine, search, searchLength, freq);
+        }
+    }
+
+    foundCount = SearchBuffer(&query, fileBuffer, gOptions.length);
+    if (gOptions.decompress) {
+        foundCount += SearchSegments(&query, fileBuffer, gOptions.length, foundCount);
+    }
 
     fclose(inputFile);
     free(search);
     free(fileBuffer);
+    MipsPattern_Destroy(&mipsPattern);
+    if (regex != NULL) {
+        Regex_Destroy(regex);
+    }
+    AddressSet_Destroy(&xrefAddresses);
 
     // Ideally we'd return the found count, but this is more compliant with shell conventions
     if (foundCount > 0) {
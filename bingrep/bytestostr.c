@@ -6,12 +6,19 @@
  * @copyright Copyright (c) 2021--2, Elliptic Ellipsis
  * SPDX-identifier: MIT
  */
+#define _GNU_SOURCE
 #include <ctype.h>
+#include <getopt.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <iconv.h>
+#include <time.h>
+
+#include "jis/jis.h"
 
 #define ARRAY_COUNT(arr) (sizeof(arr) / sizeof(arr[0]))
 
@@ -73,7 +80,7 @@ int BytesFromString(uint8_t* byteArray, const char* string) {
             }
         }
         if (parity & 1) {
-            printf("Input \"%s\" has an odd number of nybbles, padding with a leading zero.", string);
+            fprintf(stderr, "Input \"%s\" has an odd number of nybbles, padding with a leading zero.\n", string);
         }
         for (inIndex = 0; inIndex < len; inIndex++) {
             if (isxdigit(string[inIndex])) {
@@ -100,49 +107,180 @@ typedef enum {
     ENCODING_UTF8,
     ENCODING_SHIFT_JIS,
     ENCODING_EUC_JP,
+    ENCODING_MAX,
 } Encoding;
 
-int EncodeBytes(char* outString, uint8_t* byteArray, Encoding inEncoding) {
-    if (byteArray != NULL) {
-        iconv_t conv;
-
-        switch (inEncoding) {
-            case ENCODING_ASCII:
-            case ENCODING_UTF8:
-                strcpy(outString, (char*)byteArray);
-                // printf("%s\n", outString);
-                // printf("%ld\n", strlen(outString));
-                return strlen(outString);
-            case ENCODING_SHIFT_JIS:
-                conv = iconv_open("UTF-8//TRANSLIT", "SHIFT-JIS");
-                break;
-            case ENCODING_EUC_JP:
-                conv = iconv_open("UTF-8//TRANSLIT", "EUC-JP");
-                break;
-            default:
-                fprintf(stderr, "Unknown encoding\n");
-                return -1;
+/* Output is accumulated and written in blocks of at least this size */
+#define OUTPUT_FLUSH_SIZE 0x10000
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+    FILE* file;
+} OutputBuffer;
+
+void OutputBuffer_Init(OutputBuffer* out, FILE* file) {
+    out->capacity = 2 * OUTPUT_FLUSH_SIZE;
+    out->data = malloc(out->capacity);
+    out->size = 0;
+    out->file = file;
+}
+
+void OutputBuffer_Reserve(OutputBuffer* out, size_t extra) {
+    if (out->size + extra > out->capacity) {
+        while (out->size + extra > out->capacity) {
+            out->capacity *= 2;
+        }
+        out->data = realloc(out->data, out->capacity);
+    }
+}
+
+void OutputBuffer_Append(OutputBuffer* out, const char* data, size_t length) {
+    OutputBuffer_Reserve(out, length);
+    memcpy(out->data + out->size, data, length);
+    out->size += length;
+}
+
+void OutputBuffer_Flush(OutputBuffer* out) {
+    if (out->size > 0) {
+        fwrite(out->data, out->size, 1, out->file);
+        out->size = 0;
+    }
+}
+
+/* Only write once there is a large block to write */
+void OutputBuffer_FlushIfFull(OutputBuffer* out) {
+    if (out->size >= OUTPUT_FLUSH_SIZE) {
+        OutputBuffer_Flush(out);
+    }
+}
+
+void OutputBuffer_Destroy(OutputBuffer* out) {
+    OutputBuffer_Flush(out);
+    free(out->data);
+}
+
+/* Conversion descriptors are opened on first use and kept for the rest of the run */
+iconv_t conversions[ENCODING_MAX];
+bool conversionsOpened[ENCODING_MAX];
+
+const char* iconvNames[ENCODING_MAX] = {
+    "ASCII",
+    "UTF-8",
+    "SHIFT-JIS",
+    "EUC-JP",
+};
+
+iconv_t GetConversion(Encoding inEncoding) {
+    if (!conversionsOpened[inEncoding]) {
+        conversions[inEncoding] = iconv_open("UTF-8//TRANSLIT", iconvNames[inEncoding]);
+        conversionsOpened[inEncoding] = true;
+    }
+    return conversions[inEncoding];
+}
+
+void CloseConversions(void) {
+    size_t i;
+
+    for (i = 0; i < ENCODING_MAX; i++) {
+        if (conversionsOpened[i] && conversions[i] != (iconv_t)-1) {
+            iconv_close(conversions[i]);
         }
+        conversionsOpened[i] = false;
+    }
+}
 
-        {
-            size_t inBytes = strlen((char*)byteArray);
-            size_t outBytes = 3 * inBytes; /* Because UTF-8 can be 3 bytes for a 1-byte Shift-JIS character... */
-            char* inPtr = (char*)byteArray;
-            char* outPtr = outString;
+/* Use iconv instead of the built-in decoders for Shift-JIS and EUC-JP */
+bool useIconv = false;
+/* Flags passed to the built-in decoders */
+int decodeFlags = 0;
 
-            if (conv == (iconv_t)-1) {
-                fprintf(stderr, "Conversion invalid\n");
-                return -1;
+typedef size_t (*DecodeFunction)(const uint8_t* src, size_t srcSize, char* dst, int flags, size_t* invalidCount);
+
+DecodeFunction builtinDecoders[ENCODING_MAX] = {
+    NULL,
+    NULL,
+    Sjis_DecodeToUtf8,
+    EucJp_DecodeToUtf8,
+};
+
+/**
+ * Converts length bytes from inEncoding to UTF-8, appending the result to out.
+ *
+ * Returns number of bytes appended, or -1 on failure.
+ */
+int ConvertBytes(OutputBuffer* out, const uint8_t* bytes, size_t length, Encoding inEncoding) {
+    iconv_t conv;
+    char* inPtr = (char*)bytes;
+    size_t inBytes = length;
+    size_t startSize = out->size;
+
+    switch (inEncoding) {
+        case ENCODING_ASCII:
+        case ENCODING_UTF8:
+            OutputBuffer_Append(out, (const char*)bytes, length);
+            return length;
+        case ENCODING_SHIFT_JIS:
+        case ENCODING_EUC_JP:
+            if (!useIconv) {
+                OutputBuffer_Reserve(out, JIS_MAX_UTF8_SIZE(length));
+                out->size += builtinDecoders[inEncoding](bytes, length, out->data + out->size, decodeFlags, NULL);
+                return out->size - startSize;
             }
+            conv = GetConversion(inEncoding);
+            break;
+        default:
+            fprintf(stderr, "Unknown encoding\n");
+            return -1;
+    }
+
+    if (conv == (iconv_t)-1) {
+        fprintf(stderr, "Conversion invalid\n");
+        return -1;
+    }
+
+    /* Return to the initial shift state in case the previous string left it elsewhere */
+    iconv(conv, NULL, NULL, NULL, NULL);
 
-            if (iconv(conv, &inPtr, &inBytes, &outPtr, &outBytes) == (size_t)-1) {
-                fprintf(stderr, "Conversion failed.\n");
-                return -1;
+    while (inBytes > 0) {
+        char* outPtr;
+        size_t outBytes;
+
+        /* Because UTF-8 can be 3 bytes for a 1-byte Shift-JIS character... */
+        OutputBuffer_Reserve(out, 3 * inBytes + 4);
+        outPtr = out->data + out->size;
+        outBytes = out->capacity - out->size;
+
+        if (iconv(conv, &inPtr, &inBytes, &outPtr, &outBytes) == (size_t)-1) {
+            out->size = outPtr - out->data;
+            if (errno == E2BIG) {
+                continue;
             }
+            out->size = startSize;
+            return -1;
         }
+        out->size = outPtr - out->data;
+    }
+
+    return out->size - startSize;
+}
+
+int EncodeBytes(char* outString, uint8_t* byteArray, Encoding inEncoding) {
+    if (byteArray != NULL) {
+        OutputBuffer out;
+        int length;
 
-        iconv_close(conv);
-        return strlen(outString);
+        OutputBuffer_Init(&out, NULL);
+        length = ConvertBytes(&out, byteArray, strlen((char*)byteArray), inEncoding);
+        if (length < 0) {
+            fprintf(stderr, "Conversion failed.\n");
+        } else {
+            memcpy(outString, out.data, length);
+            outString[length] = '\0';
+        }
+        free(out.data);
+        return length;
     }
     return -1;
 }
@@ -190,27 +328,732 @@ Encoding GetEncodingFromString(const char* str) {
     return ret;
 }
 
+/* Remove whitespace so records may be written as e.g. "82 A0 82 A2" */
+void StripWhitespace(char* string) {
+    char* out = string;
+
+    for (; *string != '\0'; string++) {
+        if (!isspace(*string)) {
+            *out++ = *string;
+        }
+    }
+    *out = '\0';
+}
+
+/**
+ * Reads delimiter-separated records from stdin and writes the conversion of each one on its own line.
+ *
+ * If binary is NULL each record is a string of hex digits; otherwise each record is "OFFSET [LENGTH]" in hex, giving
+ * the range of binary to convert, and if LENGTH is omitted the string runs until the next '\0'.
+ *
+ * Returns number of records that failed to convert.
+ */
+int ConvertStream(int delimiter, Encoding inEncoding, const uint8_t* binary, size_t binarySize) {
+    OutputBuffer out;
+    char* record = NULL;
+    size_t recordCapacity = 0;
+    uint8_t* byteArray = NULL;
+    size_t byteArrayCapacity = 0;
+    ssize_t recordLength;
+    int failures = 0;
+    int recordIndex = 0;
+
+    OutputBuffer_Init(&out, stdout);
+
+    while ((recordLength = getdelim(&record, &recordCapacity, delimiter, stdin)) != -1) {
+        const uint8_t* bytes;
+        size_t length;
+
+        if (recordLength > 0 && record[recordLength - 1] == delimiter) {
+            record[--recordLength] = '\0';
+        }
+
+        if (binary != NULL) {
+            unsigned long offset;
+            unsigned long rangeLength;
+            int fieldCount = sscanf(record, "%lx %lx", &offset, &rangeLength);
+
+            if (fieldCount < 1 || offset >= binarySize) {
+                fprintf(stderr, "Record %d: invalid range \"%s\"\n", recordIndex, record);
+                failures++;
+                recordIndex++;
+                continue;
+            }
+            bytes = binary + offset;
+            if (fieldCount == 1) {
+                const uint8_t* end = memchr(bytes, '\0', binarySize - offset);
+
+                length = (end != NULL) ? (size_t)(end - bytes) : binarySize - offset;
+            } else {
+                length = (rangeLength < binarySize - offset) ? rangeLength : binarySize - offset;
+            }
+        } else {
+            StripWhitespace(record);
+            if ((size_t)recordLength / 2 + 2 > byteArrayCapacity) {
+                byteArrayCapacity = recordLength / 2 + 2;
+                byteArray = realloc(byteArray, byteArrayCapacity);
+            }
+            length = BytesFromString(byteArray, record);
+            bytes = byteArray;
+        }
+
+        if (ConvertBytes(&out, bytes, length, inEncoding) < 0) {
+            fprintf(stderr, "Record %d: conversion failed.\n", recordIndex);
+            failures++;
+        }
+        OutputBuffer_Append(&out, "\n", 1);
+        OutputBuffer_FlushIfFull(&out);
+        recordIndex++;
+    }
+
+    OutputBuffer_Destroy(&out);
+    free(record);
+    free(byteArray);
+    return failures;
+}
+
+double GetTime(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+#define BENCHMARK_STRING_COUNT 200000
+#define BENCHMARK_MAX_STRING_LENGTH 48
+
+/**
+ * Builds a corpus of short strings mixing ASCII runs and valid double-byte characters, the shape of typical game text.
+ * 0x5C and 0x7E are avoided since iconv decodes them differently in Shift-JIS.
+ */
+uint8_t* MakeBenchmarkCorpus(Encoding encoding, size_t* offsets, size_t* corpusSize) {
+    uint8_t* corpus = malloc(BENCHMARK_STRING_COUNT * BENCHMARK_MAX_STRING_LENGTH);
+    uint8_t* out = corpus;
+    uint32_t random = 0x12345678;
+    size_t i;
+
+    for (i = 0; i < BENCHMARK_STRING_COUNT; i++) {
+        size_t length = 8 + (i % (BENCHMARK_MAX_STRING_LENGTH - 8 - 1));
+        uint8_t* end = out + length;
+
+        offsets[i] = out - corpus;
+        while (out + 2 <= end) {
+            random = random * 1103515245 + 12345;
+            if ((random >> 28) < 4) {
+                uint8_t c = 0x20 + ((random >> 16) % 0x5E);
+
+                *out++ = (c == 0x5C || c == 0x7E) ? ' ' : c;
+            } else {
+                char decoded[JIS_MAX_UTF8_SIZE(2)];
+                size_t invalid;
+
+                out[0] = 0x81 + ((random >> 8) % 0x7E);
+                out[1] = 0x40 + ((random >> 16) % 0xBD);
+                builtinDecoders[encoding](out, 2, decoded, 0, &invalid);
+                if (invalid == 0 && out[1] != 0x5C && out[1] != 0x7E) {
+                    out += 2;
+                }
+            }
+        }
+    }
+    offsets[i] = out - corpus;
+    *corpusSize = out - corpus;
+
+    return corpus;
+}
+
+/* Returns the best time of three runs over every string in the corpus */
+double TimeDecoding(OutputBuffer* out, const uint8_t* corpus, const size_t* offsets, Encoding encoding) {
+    double best = 0.0;
+    int run;
+    size_t i;
+
+    for (run = 0; run < 3; run++) {
+        double start = GetTime();
+        double time;
+
+        out->size = 0;
+        for (i = 0; i < BENCHMARK_STRING_COUNT; i++) {
+            ConvertBytes(out, corpus + offsets[i], offsets[i + 1] - offsets[i], encoding);
+        }
+        time = GetTime() - start;
+        if (run == 0 || time < best) {
+            best = time;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * Compares throughput of the built-in decoder and iconv on a generated corpus of short strings, and checks they
+ * agree.
+ */
+int RunBenchmark(Encoding encoding) {
+    size_t* offsets = malloc((BENCHMARK_STRING_COUNT + 1) * sizeof(size_t));
+    size_t corpusSize;
+    uint8_t* corpus;
+    OutputBuffer builtinOut;
+    OutputBuffer iconvOut;
+    double builtinTime;
+    double iconvTime;
+    int ret = 0;
+
+    if (builtinDecoders[encoding] == NULL) {
+        fprintf(stderr, "Benchmark requires a multibyte encoding (SJIS or EUC-JP)\n");
+        free(offsets);
+        return 1;
+    }
+
+    corpus = MakeBenchmarkCorpus(encoding, offsets, &corpusSize);
+    OutputBuffer_Init(&builtinOut, NULL);
+    OutputBuffer_Init(&iconvOut, NULL);
+
+    useIconv = false;
+    builtinTime = TimeDecoding(&builtinOut, corpus, offsets, encoding);
+    useIconv = true;
+    iconvTime = TimeDecoding(&iconvOut, corpus, offsets, encoding);
+
+    printf("Corpus:    %d strings, %zu bytes\n", BENCHMARK_STRING_COUNT, corpusSize);
+    printf("Built-in:  %8.2f ms  %8.2f MiB/s\n", builtinTime * 1e3, corpusSize / builtinTime / (1 << 20));
+    printf("iconv:     %8.2f ms  %8.2f MiB/s\n", iconvTime * 1e3, corpusSize / iconvTime / (1 << 20));
+    printf("Speedup:   %8.2fx\n", iconvTime / builtinTime);
+
+    if (builtinOut.size != iconvOut.size || memcmp(builtinOut.data, iconvOut.data, builtinOut.size) != 0) {
+        fprintf(stderr, "Built-in decoder output differs from iconv!\n");
+        ret = 1;
+    }
+
+    free(builtinOut.data);
+    free(iconvOut.data);
+    free(corpus);
+    free(offsets);
+    return ret;
+}
+
+uint8_t* ReadBinaryFile(const char* path, size_t* size) {
+    FILE* file;
+    uint8_t* buffer;
+
+    if ((file = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "Failed to open file %s\n", path);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    buffer = malloc(*size + 1);
+    if (fread(buffer, 1, *size, file) != *size) {
+        fprintf(stderr, "Failed to read file %s\n", path);
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    return buffer;
+}
+
+/* Byte classes for string extraction */
+typedef enum {
+    CLASS_BREAK,     /* Cannot appear in a string */
+    CLASS_SINGLE,    /* Complete character on its own */
+    CLASS_MULTIBYTE, /* Starts a multibyte character */
+    CLASS_TRAIL,     /* Cannot start a character, but may continue one */
+} ByteClass;
+
+uint8_t byteClasses[ENCODING_MAX][256];
+
+void InitByteClasses(void) {
+    size_t c;
+
+    for (c = 0; c < 0x100; c++) {
+        bool printable = (c >= 0x20 && c < 0x7F) || c == '\t';
+
+        byteClasses[ENCODING_ASCII][c] = printable ? CLASS_SINGLE : CLASS_BREAK;
+
+        if (printable) {
+            byteClasses[ENCODING_SHIFT_JIS][c] = CLASS_SINGLE;
+        } else if ((c >= 0x81 && c <= 0x9F) || (c >= 0xE0 && c <= 0xFC)) {
+            byteClasses[ENCODING_SHIFT_JIS][c] = CLASS_MULTIBYTE;
+        } else if (c >= 0xA1 && c <= 0xDF) {
+            /* Half-width katakana: single byte, but not ASCII */
+            byteClasses[ENCODING_SHIFT_JIS][c] = CLASS_MULTIBYTE;
+        } else if (c == 0x80 || c == 0xA0) {
+            byteClasses[ENCODING_SHIFT_JIS][c] = CLASS_TRAIL;
+        } else {
+            byteClasses[ENCODING_SHIFT_JIS][c] = CLASS_BREAK;
+        }
+
+        if (printable) {
+            byteClasses[ENCODING_EUC_JP][c] = CLASS_SINGLE;
+        } else if (c == 0x8E || c == 0x8F || (c >= 0xA1 && c <= 0xFE)) {
+            byteClasses[ENCODING_EUC_JP][c] = CLASS_MULTIBYTE;
+        } else {
+            byteClasses[ENCODING_EUC_JP][c] = CLASS_BREAK;
+        }
+    }
+}
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+/* Lanes where lo <= v <= hi, unsigned */
+static inline __m128i InRange(__m128i v, uint8_t lo, uint8_t hi) {
+    __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(hi - lo)), offset);
+}
+
+/* Bit i set if byte i of the 16 at data can never be part of a string in encoding */
+static uint32_t GetBreakMask(const uint8_t* data, Encoding encoding) {
+    __m128i v = _mm_loadu_si128((const __m128i*)data);
+    __m128i breaks = _mm_or_si128(InRange(v, 0x00, 0x08), InRange(v, 0x0A, 0x1F));
+
+    breaks = _mm_or_si128(breaks, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F)));
+    switch (encoding) {
+        case ENCODING_ASCII:
+            breaks = _mm_or_si128(breaks, InRange(v, 0x80, 0xFF));
+            break;
+        case ENCODING_SHIFT_JIS:
+            breaks = _mm_or_si128(breaks, InRange(v, 0xFD, 0xFF));
+            break;
+        case ENCODING_EUC_JP:
+            breaks = _mm_or_si128(breaks, InRange(v, 0x80, 0x8D));
+            breaks = _mm_or_si128(breaks, InRange(v, 0x90, 0xA0));
+            breaks = _mm_or_si128(breaks, _mm_cmpeq_epi8(v, _mm_set1_epi8(0xFF)));
+            break;
+        default:
+            break;
+    }
+    return _mm_movemask_epi8(breaks);
+}
+#else
+static uint32_t GetBreakMask(const uint8_t* data, Encoding encoding) {
+    uint32_t mask = 0;
+    size_t i;
+
+    for (i = 0; i < 16; i++) {
+        mask |= (uint32_t)(byteClasses[encoding][data[i]] == CLASS_BREAK) << i;
+    }
+    return mask;
+}
+#endif
+
+/**
+ * Skips 16-byte blocks that cannot contain the start of a string of at least minLength characters: those that are
+ * all zero, or so dense with non-text bytes that no gap between them is long enough. Since a character is at least
+ * one byte, a block skipped this way cannot hide a string.
+ *
+ * Returns the position to resume scanning from.
+ */
+size_t SkipNonText(const uint8_t* data, size_t pos, size_t size, Encoding encoding, size_t minLength) {
+    while (pos + 16 <= size) {
+        uint32_t breaks = GetBreakMask(data + pos, encoding);
+        uint32_t gaps = ~breaks & 0xFFFF;
+        size_t i;
+
+        if (breaks == 0) {
+            break;
+        }
+        /* Bit i survives if bytes i to i + minLength - 1 are all possible text */
+        for (i = 1; i < minLength && gaps != 0; i++) {
+            gaps &= gaps >> 1;
+        }
+        if (gaps != 0) {
+            break;
+        }
+        /* Bytes after the last break may start a string that continues into the next block */
+        pos += 32 - __builtin_clz(breaks);
+    }
+    return pos;
+}
+
+void WriteExtractedString(OutputBuffer* out, const uint8_t* data, size_t start, size_t end, Encoding encoding) {
+    static const char* extractNames[ENCODING_MAX] = { "ASCII", "UTF-8", "SJIS", "EUC-JP" };
+    DecodeFunction decode;
+    char* text;
+    size_t textLength;
+    size_t i;
+
+    OutputBuffer_Reserve(out, 32 + 2 * JIS_MAX_UTF8_SIZE(end - start));
+    out->size += sprintf(out->data + out->size, "0x%08zX,%s,\"", start, extractNames[encoding]);
+
+    /* Decode at the far end of the reserved space, then copy down doubling quotes. ASCII decodes the same as
+     * Shift-JIS, backslashes escaped included */
+    text = out->data + out->size + JIS_MAX_UTF8_SIZE(end - start);
+    decode = (encoding == ENCODING_ASCII) ? Sjis_DecodeToUtf8 : builtinDecoders[encoding];
+    textLength = decode(data + start, end - start, text, JIS_ESCAPE_CONTROL, NULL);
+    for (i = 0; i < textLength; i++) {
+        if (text[i] == '"') {
+            out->data[out->size++] = '"';
+        }
+        out->data[out->size++] = text[i];
+    }
+    OutputBuffer_Append(out, "\"\n", 2);
+    OutputBuffer_FlushIfFull(out);
+}
+
+/* Kinds of character, for judging whether a run of valid characters looks like text */
+typedef enum {
+    KIND_LOWER,     /* ASCII lowercase letter */
+    KIND_UPPER,     /* ASCII uppercase letter */
+    KIND_DIGIT,     /* ASCII digit */
+    KIND_SYMBOL,    /* Other printable ASCII, apart from the rare symbols below */
+    KIND_SPACE,     /* Space or tab, which text of any script may contain */
+    KIND_HALFWIDTH, /* Half-width katakana */
+    KIND_FULLWIDTH, /* Full-width symbols, letters and kana, and the common (level 1) kanji */
+    KIND_RARE,      /* Anything else: rare ASCII symbols, Greek, Cyrillic, box drawing, level 2 kanji */
+} CharKind;
+
+/* Classifies the valid character at src, whose first byte is of class CLASS_SINGLE or CLASS_MULTIBYTE */
+CharKind GetCharKind(const uint8_t* src, Encoding encoding) {
+    uint8_t c = src[0];
+
+    if (c < 0x80) {
+        if (islower(c)) {
+            return KIND_LOWER;
+        }
+        if (isupper(c)) {
+            return KIND_UPPER;
+        }
+        if (isdigit(c)) {
+            return KIND_DIGIT;
+        }
+        if (c == ' ' || c == '\t') {
+            return KIND_SPACE;
+        }
+        return (c == '\\' || c == '^' || c == '`' || c == '{' || c == '|' || c == '}' || c == '~' || c == '$')
+                   ? KIND_RARE
+                   : KIND_SYMBOL;
+    }
+    if (encoding == ENCODING_SHIFT_JIS) {
+        if (c >= 0xA1 && c <= 0xDF) {
+            return KIND_HALFWIDTH;
+        }
+        /* Rows 1 to 5 (but not Greek in row 6), and rows 16 to 47 */
+        return (c <= 0x83 || (c >= 0x88 && c <= 0x98)) ? KIND_FULLWIDTH : KIND_RARE;
+    }
+    if (c == 0x8E) {
+        return KIND_HALFWIDTH;
+    }
+    /* EUC-JP has a lead byte per row: rows 1 and 3 to 5, and rows 16 to 47 */
+    return ((c >= 0xA1 && c <= 0xA5 && c != 0xA2) || (c >= 0xB0 && c <= 0xCF)) ? KIND_FULLWIDTH : KIND_RARE;
+}
+
+/* Half-width katakana value of a KIND_HALFWIDTH character, in Shift-JIS */
+uint8_t GetHalfwidth(const uint8_t* src, Encoding encoding) {
+    return (encoding == ENCODING_SHIFT_JIS) ? src[0] : src[1];
+}
+
+/**
+ * Scores how unlike text the character cur of kind is after the character prev of prevKind, ignoring rare characters
+ * in between (prev is NULL at the start of a run). Text mostly sticks to one script and case for several characters
+ * at a time, changing at spaces if anywhere, while random bytes that happen to decode change every character or two.
+ *
+ * Returns 2 for a rare character, 1 for a change between ASCII, half-width and full-width, a lowercase letter followed
+ * by an uppercase one, a letter next to a digit, a letter or digit straight after closing punctuation, or a voiced
+ * sound mark after a kana that cannot take it, and 0 otherwise.
+ */
+size_t GetCharPenalty(const uint8_t* prev, CharKind prevKind, const uint8_t* cur, CharKind kind, Encoding encoding) {
+    if (kind == KIND_RARE) {
+        return 2;
+    }
+    if (prev == NULL || prevKind == KIND_SPACE || kind == KIND_SPACE) {
+        return 0;
+    }
+    if ((prevKind <= KIND_SYMBOL) != (kind <= KIND_SYMBOL) || (kind > KIND_SYMBOL && kind != prevKind)) {
+        return 1;
+    }
+    if (kind == KIND_HALFWIDTH) {
+        uint8_t c = GetHalfwidth(cur, encoding);
+        uint8_t p = GetHalfwidth(prev, encoding);
+
+        /* Dakuten after U, K-, S-, T- or H-row kana; handakuten after H-row kana */
+        if (c == 0xDE) {
+            return !(p == 0xB3 || (p >= 0xB6 && p <= 0xC4) || (p >= 0xCA && p <= 0xCE));
+        }
+        if (c == 0xDF) {
+            return !(p >= 0xCA && p <= 0xCE);
+        }
+        return 0;
+    }
+    if (kind > KIND_DIGIT) {
+        return 0;
+    }
+    if (prevKind == KIND_SYMBOL) {
+        return strchr(",;!?)]>\"", prev[0]) != NULL;
+    }
+    return (prevKind == KIND_LOWER && kind == KIND_UPPER) || ((prevKind == KIND_DIGIT) != (kind == KIND_DIGIT));
+}
+
+/* Characters a string needs per point of penalty from GetCharPenalty() to be reported */
+#define PENALTY_RATIO 6
+
+/* Whether a run of charCount valid characters with the given total penalty is plausibly text */
+bool IsPlausibleText(size_t charCount, size_t penalty) {
+    return PENALTY_RATIO * penalty <= charCount;
+}
+
+/**
+ * Writes every run of at least minLength valid characters in data that looks like text (see IsPlausibleText()) as a
+ * CSV row of offset, encoding and text. Runs with no multibyte characters are reported as ASCII.
+ *
+ * Returns number of strings found.
+ */
+size_t ExtractStrings(const uint8_t* data, size_t size, Encoding encoding, size_t minLength) {
+    const uint8_t* classes = byteClasses[encoding];
+    OutputBuffer out;
+    size_t pos = 0;
+    size_t start = 0;
+    size_t charCount = 0;
+    size_t penalty = 0;
+    const uint8_t* lastChar = NULL;
+    CharKind lastKind = KIND_RARE;
+    bool multibyte = false;
+    size_t found = 0;
+
+    OutputBuffer_Init(&out, stdout);
+
+    while (pos < size) {
+        size_t length = 1;
+        bool valid;
+
+        if (charCount == 0) {
+            pos = SkipNonText(data, pos, size, encoding, minLength);
+            if (pos >= size) {
+                break;
+            }
+            start = pos;
+        }
+
+        switch (classes[data[pos]]) {
+            case CLASS_SINGLE:
+                valid = true;
+                break;
+
+            case CLASS_MULTIBYTE:
+                if (encoding == ENCODING_SHIFT_JIS) {
+                    valid = Sjis_GetCodepoint(data + pos, size - pos, &length) != 0;
+                } else {
+                    valid = EucJp_GetCodepoint(data + pos, size - pos, &length) != 0;
+                }
+                multibyte |= valid;
+                break;
+
+            default:
+                valid = false;
+                break;
+        }
+
+        if (valid) {
+            CharKind kind = GetCharKind(data + pos, encoding);
+
+            penalty += GetCharPenalty(lastChar, lastKind, data + pos, kind, encoding);
+            if (kind != KIND_RARE) {
+                lastChar = data + pos;
+                lastKind = kind;
+            }
+            charCount++;
+            pos += length;
+            continue;
+        }
+
+        if (charCount >= minLength && IsPlausibleText(charCount, penalty)) {
+            WriteExtractedString(&out, data, start, pos, multibyte ? encoding : ENCODING_ASCII);
+            found++;
+        }
+        charCount = 0;
+        penalty = 0;
+        lastChar = NULL;
+        multibyte = false;
+        pos++;
+    }
+
+    if (charCount >= minLength && IsPlausibleText(charCount, penalty)) {
+        WriteExtractedString(&out, data, start, pos, multibyte ? encoding : ENCODING_ASCII);
+        found++;
+    }
+
+    OutputBuffer_Destroy(&out);
+    return found;
+}
+
+struct option longOpts[] = {
+    { "benchmark", no_argument, NULL, 'b' },
+    { "escape-control", no_argument, NULL, 'c' },
+    { "encoding", required_argument, NULL, 'e' },
+    { "file", required_argument, NULL, 'f' },
+    { "iconv", no_argument, NULL, 'i' },
+    { "min-length", required_argument, NULL, 'n' },
+    { "stream", no_argument, NULL, 's' },
+    { "extract", required_argument, NULL, 'x' },
+    { "null-data", no_argument, NULL, 'z' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
+
 int main(int argc, char** argv) {
+    int opt;
     char* bytes;
     size_t length;
     char* outString;
     uint8_t* byteArray;
     Encoding inEncoding = ENCODING_ASCII;
+    const char* encodingString = NULL;
+    const char* binaryPath = NULL;
+    const char* extractPath = NULL;
+    size_t minLength = 4;
+    bool stream = false;
+    bool benchmark = false;
+    int delimiter = '\n';
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "bce:f:in:sx:zh", longOpts, &optionIndex)) == -1) {
+            break;
+        }
+
+        switch (opt) {
+            case 'b':
+                benchmark = true;
+                break;
+
+            case 'c':
+                decodeFlags |= JIS_ESCAPE_CONTROL;
+                break;
+
+            case 'e':
+                encodingString = optarg;
+                break;
+
+            case 'f':
+                binaryPath = optarg;
+                stream = true;
+                break;
+
+            case 'i':
+                useIconv = true;
+                break;
 
-    if (argc < 2) {
+            case 'n':
+                if (sscanf(optarg, "%zu", &minLength) != 1 || minLength == 0) {
+                    fprintf(stderr, "-n expects a positive dec number, found %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 's':
+                stream = true;
+                break;
+
+            case 'x':
+                extractPath = optarg;
+                break;
+
+            case 'z':
+                delimiter = '\0';
+                break;
+
+            case 'h':
+                printf("Usage: %s BYTES [ENCODING]\n"
+                       "       %s -s [-z] [-f FILE] [ENCODING]\n"
+                       "       %s -x FILE [-n NUM] [ENCODING]\n"
+                       "       %s -b ENCODING\n",
+                       argv[0], argv[0], argv[0], argv[0]);
+                puts("Convert bytes in ENCODING (default ASCII) to UTF-8.\n"
+                     "\n"
+                     "Options\n"
+                     "  -e, --encoding=ENCODING   encoding of the input bytes: SJIS, EUC-JP, ASCII or UTF-8\n"
+                     "  -i, --iconv               decode SJIS and EUC-JP with iconv instead of the built-in tables,\n"
+                     "                            which treat 0x00-0x7F as ASCII and write undecodable bytes as \\xNN\n"
+                     "  -c, --escape-control      write control characters as \\xNN and backslashes as \\\\\n"
+                     "                            (built-in decoder only)\n"
+                     "  -b, --benchmark           compare speed of the built-in decoder and iconv on generated text\n"
+                     "  -s, --stream              read newline-separated hex strings from stdin and convert each\n"
+                     "                            one to a line of output\n"
+                     "  -z, --null-data           records read from stdin are separated by '\\0', not newline\n"
+                     "  -f, --file=FILE           records read from stdin are \"OFFSET [LENGTH]\" in hex, giving\n"
+                     "                            ranges of FILE to convert; without LENGTH, convert up to the\n"
+                     "                            next '\\0'. Implies --stream\n"
+                     "  -x, --extract=FILE        print every string in FILE as CSV rows of offset, encoding and\n"
+                     "                            text, like strings(1). ENCODING (default SJIS) may be ASCII,\n"
+                     "                            SJIS or EUC-JP; strings with no multibyte characters are ASCII.\n"
+                     "                            Strings that switch script or case too often, or have many rare\n"
+                     "                            characters, are taken to be random bytes and skipped\n"
+                     "  -n, --min-length=NUM      shortest string to extract, in characters (default 4)\n"
+                     "  -h, --help                print this message and exit\n");
+                return 1;
+
+            default:
+                break;
+        }
+    }
+
+    if (benchmark || extractPath != NULL) {
+        stream = true;
+    }
+
+    if (!stream && optind >= argc) {
         printf("Usage: %s BYTES [ENCODING]\n", argv[0]);
         return 1;
     }
 
-    if (argc == 3) {
-        inEncoding = GetEncodingFromString(argv[2]);
+    if (encodingString == NULL && optind + (stream ? 0 : 1) < argc) {
+        encodingString = argv[optind + (stream ? 0 : 1)];
+    }
+    if (encodingString == NULL && extractPath != NULL) {
+        encodingString = "SJIS";
+    }
+    if (encodingString != NULL) {
+        inEncoding = GetEncodingFromString(encodingString);
         if (inEncoding == ENCODING_INVALID) {
-            fprintf(stderr, "Unknown encoding \"%s\"\n", argv[2]);
+            fprintf(stderr, "Unknown encoding \"%s\"\n", encodingString);
             return 1;
         }
     }
 
-    bytes = argv[1];
+    if (benchmark) {
+        int ret = RunBenchmark(inEncoding);
+
+        CloseConversions();
+        return ret;
+    }
+
+    if (extractPath != NULL) {
+        uint8_t* binary;
+        size_t binarySize;
+
+        if (inEncoding == ENCODING_UTF8) {
+            fprintf(stderr, "Extraction supports ASCII, SJIS and EUC-JP only\n");
+            return 1;
+        }
+        if ((binary = ReadBinaryFile(extractPath, &binarySize)) == NULL) {
+            return 1;
+        }
+        InitByteClasses();
+        ExtractStrings(binary, binarySize, inEncoding, minLength);
+
+        free(binary);
+        return 0;
+    }
+
+    if (stream) {
+        uint8_t* binary = NULL;
+        size_t binarySize = 0;
+        int failures;
+
+        if (binaryPath != NULL && (binary = ReadBinaryFile(binaryPath, &binarySize)) == NULL) {
+            return 1;
+        }
+
+        failures = ConvertStream(delimiter, inEncoding, binary, binarySize);
+
+        CloseConversions();
+        free(binary);
+        return failures != 0;
+    }
+
+    bytes = argv[optind];
     length = strlen(bytes);
     byteArray = malloc(length + 1);
 
@@ -220,6 +1063,7 @@ int main(int argc, char** argv) {
     if (EncodeBytes(outString, byteArray, inEncoding) == -1) {
         free(byteArray);
         free(outString);
+        CloseConversions();
         return 1;
     }
 
@@ -227,6 +1071,7 @@ int main(int argc, char** argv) {
 
     free(byteArray);
     free(outString);
+    CloseConversions();
 
     return 0;
 }
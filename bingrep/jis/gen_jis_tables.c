@@ -0,0 +1,195 @@
+/**
+ * @file gen_jis_tables.c
+ * @brief Generate the two-level decoding and encoding tables used by jis.c.
+ *
+ * Every double-byte (and EUC-JP three-byte) code is run through the host's iconv, and the results are written as C
+ * arrays to stdout (make tables puts them in jis_tables.h, which is checked in). Each lead byte indexes a row of
+ * codepoints; identical rows (in particular the empty ones) are shared. The encoding tables are the same the other way
+ * round: the high byte of a codepoint indexes a row of codes, each the lead byte followed by the trail byte, taking the
+ * first code if several decode to it.
+ *
+ * SPDX-identifier: MIT
+ */
+#include <iconv.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ROWS 256
+
+typedef struct {
+    const char* name;
+    const char* macroName;
+    const char* iconvName;
+    uint8_t prefix; /* Extra byte before lead and trail, 0 if none */
+    uint8_t leadFirst;
+    uint8_t leadLast;
+    uint8_t trailFirst;
+    uint8_t trailLast;
+} TableInfo;
+
+// clang-format off
+TableInfo tables[] = {
+    { "sjis",     "SJIS",       "SHIFT-JIS", 0x00, 0x81, 0xFC, 0x40, 0xFC },
+    { "eucJp",    "EUC_JP",     "EUC-JP",    0x00, 0xA1, 0xFE, 0xA1, 0xFE },
+    { "eucJp212", "EUC_JP_212", "EUC-JP",    0x8F, 0xA1, 0xFE, 0xA1, 0xFE },
+};
+// clang-format on
+
+uint16_t rows[MAX_ROWS][256];
+
+/* Code for each codepoint, 0 if none */
+uint16_t codes[0x10000];
+
+/* Returns the BMP codepoint the sequence decodes to, or 0 if it is invalid or decodes to anything else */
+uint16_t DecodeSequence(iconv_t conv, const uint8_t* sequence, size_t length) {
+    uint8_t out[8];
+    char* inPtr = (char*)sequence;
+    char* outPtr = (char*)out;
+    size_t inBytes = length;
+    size_t outBytes = sizeof(out);
+    uint32_t codepoint;
+
+    iconv(conv, NULL, NULL, NULL, NULL);
+    if (iconv(conv, &inPtr, &inBytes, &outPtr, &outBytes) == (size_t)-1 || inBytes != 0 ||
+        sizeof(out) - outBytes != 4) {
+        return 0;
+    }
+    codepoint = (out[0] << 24) | (out[1] << 16) | (out[2] << 8) | out[3];
+    return (codepoint <= 0xFFFF) ? codepoint : 0;
+}
+
+/* Write the codes collected by WriteTable as rows indexed by the high byte of the codepoint */
+int WriteEncodeTable(const TableInfo* info) {
+    uint8_t highRows[256] = { 0 };
+    size_t rowCount = 1;
+    size_t high;
+    size_t i;
+    size_t j;
+
+    codes[0] = 0;
+    memset(rows, 0, sizeof(rows));
+
+    for (high = 0; high < 256; high++) {
+        for (i = 0; i < rowCount; i++) {
+            if (memcmp(rows[i], &codes[high << 8], sizeof(rows[i])) == 0) {
+                break;
+            }
+        }
+        if (i == rowCount) {
+            if (rowCount == MAX_ROWS) {
+                fprintf(stderr, "Too many rows encoding to %s\n", info->iconvName);
+                return -1;
+            }
+            memcpy(rows[rowCount++], &codes[high << 8], sizeof(rows[i]));
+        }
+        highRows[high] = i;
+    }
+
+    printf("static const uint8_t %sEncodeHighRows[256] = {", info->name);
+    for (i = 0; i < 256; i++) {
+        printf("%s%3u,", (i % 16 == 0) ? "\n    " : " ", highRows[i]);
+    }
+    printf("\n};\n\n");
+
+    printf("static const uint16_t %sEncodeRows[%zu][256] = {\n", info->name, rowCount);
+    for (i = 0; i < rowCount; i++) {
+        printf("    {");
+        for (j = 0; j < 256; j++) {
+            printf("%s0x%04X,", (j % 12 == 0) ? "\n        " : " ", rows[i][j]);
+        }
+        printf("\n    },\n");
+    }
+    printf("};\n\n");
+
+    return 0;
+}
+
+int WriteTable(const TableInfo* info) {
+    iconv_t conv = iconv_open("UTF-32BE", info->iconvName);
+    size_t trailCount = info->trailLast - info->trailFirst + 1;
+    uint8_t leadRows[256] = { 0 };
+    size_t rowCount = 1;
+    unsigned int lead;
+    unsigned int trail;
+    size_t i;
+    size_t j;
+
+    if (conv == (iconv_t)-1) {
+        fprintf(stderr, "Host iconv does not support %s\n", info->iconvName);
+        return -1;
+    }
+
+    memset(rows, 0, sizeof(rows));
+    memset(codes, 0, sizeof(codes));
+
+    for (lead = info->leadFirst; lead <= info->leadLast; lead++) {
+        for (trail = info->trailFirst; trail <= info->trailLast; trail++) {
+            uint8_t sequence[3];
+            size_t length = 0;
+
+            if (info->prefix != 0) {
+                sequence[length++] = info->prefix;
+            }
+            sequence[length++] = lead;
+            sequence[length++] = trail;
+            rows[rowCount][trail - info->trailFirst] = DecodeSequence(conv, sequence, length);
+            if (codes[rows[rowCount][trail - info->trailFirst]] == 0) {
+                codes[rows[rowCount][trail - info->trailFirst]] = (lead << 8) | trail;
+            }
+        }
+
+        /* Share the row if an identical one exists already */
+        for (i = 0; i < rowCount; i++) {
+            if (memcmp(rows[i], rows[rowCount], trailCount * sizeof(uint16_t)) == 0) {
+                break;
+            }
+        }
+        if (i == rowCount) {
+            rowCount++;
+        } else {
+            memset(rows[rowCount], 0, sizeof(rows[rowCount]));
+        }
+        leadRows[lead] = i;
+    }
+
+    iconv_close(conv);
+
+    printf("#define %s_TRAIL_FIRST 0x%02X\n", info->macroName, info->trailFirst);
+    printf("#define %s_TRAIL_LAST 0x%02X\n\n", info->macroName, info->trailLast);
+
+    printf("static const uint8_t %sLeadRows[256] = {", info->name);
+    for (i = 0; i < 256; i++) {
+        printf("%s%3u,", (i % 16 == 0) ? "\n    " : " ", leadRows[i]);
+    }
+    printf("\n};\n\n");
+
+    printf("static const uint16_t %sRows[%zu][%zu] = {\n", info->name, rowCount, trailCount);
+    for (i = 0; i < rowCount; i++) {
+        printf("    {");
+        for (j = 0; j < trailCount; j++) {
+            printf("%s0x%04X,", (j % 12 == 0) ? "\n        " : " ", rows[i][j]);
+        }
+        printf("\n    },\n");
+    }
+    printf("};\n\n");
+
+    return WriteEncodeTable(info);
+}
+
+int main(void) {
+    size_t i;
+
+    printf("/* Generated by gen_jis_tables.c, do not edit */\n\n");
+    printf("#pragma once\n\n");
+    printf("#include <stdint.h>\n\n");
+
+    for (i = 0; i < sizeof(tables) / sizeof(tables[0]); i++) {
+        if (WriteTable(&tables[i]) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,452 @@
+/**
+ * @file jis.c
+ * @brief Table-driven Shift-JIS and EUC-JP to UTF-8 decoders, and encoders back again.
+ *
+ * Unlike iconv, bytes 0x00-0x7F are always treated as ASCII (N64 games use 0x5C and 0x7E as backslash and tilde,
+ * not yen and overline), and sequences that do not decode are written as \xNN escapes rather than failing the whole
+ * string, since game text is full of custom control codes. When control codes are escaped too, a backslash is written
+ * as \\, so that the text reads back unambiguously.
+ *
+ * SPDX-identifier: MIT
+ */
+#include "jis.h"
+
+#include <string.h>
+
+#include "jis_tables.h"
+
+#define HIGH_BITS 0x8080808080808080ULL
+#define LOW_BITS 0x0101010101010101ULL
+
+#define IS_CONTROL(c) (((c) < 0x20) || ((c) == 0x7F))
+
+/* ASCII that JIS_ESCAPE_CONTROL escapes */
+#define IS_ESCAPED(c) (IS_CONTROL(c) || ((c) == '\\'))
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+static char* WriteEscape(char* dst, uint8_t byte) {
+    if (byte == '\\') {
+        dst[0] = '\\';
+        dst[1] = '\\';
+        return dst + 2;
+    }
+    dst[0] = '\\';
+    dst[1] = 'x';
+    dst[2] = hexDigits[byte >> 4];
+    dst[3] = hexDigits[byte & 0xF];
+    return dst + 4;
+}
+
+/* All codepoints in the tables are in the BMP, so at most 3 bytes */
+static char* WriteUtf8(char* dst, uint16_t codepoint) {
+    if (codepoint < 0x80) {
+        *dst++ = codepoint;
+    } else if (codepoint < 0x800) {
+        *dst++ = 0xC0 | (codepoint >> 6);
+        *dst++ = 0x80 | (codepoint & 0x3F);
+    } else {
+        *dst++ = 0xE0 | (codepoint >> 12);
+        *dst++ = 0x80 | ((codepoint >> 6) & 0x3F);
+        *dst++ = 0x80 | (codepoint & 0x3F);
+    }
+    return dst;
+}
+
+/**
+ * Copies the run of plain ASCII starting at src, 8 bytes at a time while possible.
+ *
+ * Returns the length of the run copied.
+ */
+static size_t CopyAsciiRun(const uint8_t* src, size_t srcSize, char* dst, int flags) {
+    size_t i = 0;
+
+    while (i + 8 <= srcSize) {
+        uint64_t word;
+        uint64_t special;
+
+        memcpy(&word, src + i, sizeof(word));
+        special = word & HIGH_BITS;
+        if (flags & JIS_ESCAPE_CONTROL) {
+            /* High bit of each byte less than 0x20 or equal to 0x7F or 0x5C */
+            special |= (word - 0x20 * LOW_BITS) & ~word & HIGH_BITS;
+            special |= ((word ^ (0x7F * LOW_BITS)) - LOW_BITS) & ~(word ^ (0x7F * LOW_BITS)) & HIGH_BITS;
+            special |= ((word ^ (0x5C * LOW_BITS)) - LOW_BITS) & ~(word ^ (0x5C * LOW_BITS)) & HIGH_BITS;
+        }
+        if (special != 0) {
+            break;
+        }
+        memcpy(dst + i, &word, sizeof(word));
+        i += 8;
+    }
+
+    for (; i < srcSize; i++) {
+        uint8_t c = src[i];
+
+        if ((c & 0x80) || ((flags & JIS_ESCAPE_CONTROL) && IS_ESCAPED(c))) {
+            break;
+        }
+        dst[i] = c;
+    }
+
+    return i;
+}
+
+/**
+ * Looks up the non-ASCII Shift-JIS character at the start of src, setting length to the number of bytes it uses.
+ *
+ * Returns its codepoint, or 0 if it is not a valid character.
+ */
+uint16_t Sjis_GetCodepoint(const uint8_t* src, size_t srcSize, size_t* length) {
+    uint8_t c = src[0];
+
+    if (c >= 0xA1 && c <= 0xDF) {
+        /* Half-width katakana */
+        *length = 1;
+        return 0xFF61 + (c - 0xA1);
+    }
+    *length = 2;
+    if (srcSize < 2 || src[1] < SJIS_TRAIL_FIRST || src[1] > SJIS_TRAIL_LAST) {
+        return 0;
+    }
+    return sjisRows[sjisLeadRows[c]][src[1] - SJIS_TRAIL_FIRST];
+}
+
+/**
+ * Looks up the non-ASCII EUC-JP character at the start of src, setting length to the number of bytes it uses.
+ *
+ * Returns its codepoint, or 0 if it is not a valid character.
+ */
+uint16_t EucJp_GetCodepoint(const uint8_t* src, size_t srcSize, size_t* length) {
+    uint8_t c = src[0];
+
+    if (c == 0x8E) {
+        /* Single shift 2: half-width katakana */
+        *length = 2;
+        if (srcSize < 2 || src[1] < 0xA1 || src[1] > 0xDF) {
+            return 0;
+        }
+        return 0xFF61 + (src[1] - 0xA1);
+    }
+    if (c == 0x8F) {
+        /* Single shift 3: JIS X 0212 */
+        *length = 3;
+        if (srcSize < 3 || src[2] < EUC_JP_212_TRAIL_FIRST || src[2] > EUC_JP_212_TRAIL_LAST) {
+            return 0;
+        }
+        return eucJp212Rows[eucJp212LeadRows[src[1]]][src[2] - EUC_JP_212_TRAIL_FIRST];
+    }
+    *length = 2;
+    if (srcSize < 2 || src[1] < EUC_JP_TRAIL_FIRST || src[1] > EUC_JP_TRAIL_LAST) {
+        return 0;
+    }
+    return eucJpRows[eucJpLeadRows[c]][src[1] - EUC_JP_TRAIL_FIRST];
+}
+
+/**
+ * Decodes srcSize bytes of Shift-JIS into dst, which must have room for JIS_MAX_UTF8_SIZE(srcSize) bytes.
+ * invalidCount, if not NULL, is set to the number of bytes that had to be escaped because they did not decode.
+ *
+ * Returns number of bytes written (no terminator is added).
+ */
+size_t Sjis_DecodeToUtf8(const uint8_t* src, size_t srcSize, char* dst, int flags, size_t* invalidCount) {
+    char* out = dst;
+    size_t invalid = 0;
+    size_t i = 0;
+
+    while (i < srcSize) {
+        uint8_t c = src[i];
+
+        if (c < 0x80) {
+            if ((flags & JIS_ESCAPE_CONTROL) && IS_ESCAPED(c)) {
+                out = WriteEscape(out, c);
+                i++;
+            } else {
+                size_t run = CopyAsciiRun(src + i, srcSize - i, out, flags);
+
+                out += run;
+                i += run;
+            }
+        } else {
+            size_t length;
+            uint16_t codepoint = Sjis_GetCodepoint(src + i, srcSize - i, &length);
+
+            if (codepoint != 0) {
+                out = WriteUtf8(out, codepoint);
+                i += length;
+            } else {
+                out = WriteEscape(out, c);
+                invalid++;
+                i++;
+            }
+        }
+    }
+
+    if (invalidCount != NULL) {
+        *invalidCount = invalid;
+    }
+    return out - dst;
+}
+
+/**
+ * Decodes srcSize bytes of EUC-JP into dst, which must have room for JIS_MAX_UTF8_SIZE(srcSize) bytes.
+ * invalidCount, if not NULL, is set to the number of bytes that had to be escaped because they did not decode.
+ *
+ * Returns number of bytes written (no terminator is added).
+ */
+size_t EucJp_DecodeToUtf8(const uint8_t* src, size_t srcSize, char* dst, int flags, size_t* invalidCount) {
+    char* out = dst;
+    size_t invalid = 0;
+    size_t i = 0;
+
+    while (i < srcSize) {
+        uint8_t c = src[i];
+        uint16_t codepoint;
+        size_t length;
+
+        if (c < 0x80) {
+            if ((flags & JIS_ESCAPE_CONTROL) && IS_ESCAPED(c)) {
+                out = WriteEscape(out, c);
+                i++;
+            } else {
+                size_t run = CopyAsciiRun(src + i, srcSize - i, out, flags);
+
+                out += run;
+                i += run;
+            }
+            continue;
+        }
+
+        codepoint = EucJp_GetCodepoint(src + i, srcSize - i, &length);
+        if (codepoint != 0) {
+            out = WriteUtf8(out, codepoint);
+            i += length;
+        } else {
+            out = WriteEscape(out, c);
+            invalid++;
+            i++;
+        }
+    }
+
+    if (invalidCount != NULL) {
+        *invalidCount = invalid;
+    }
+    return out - dst;
+}
+
+/* Encoding */
+
+#define INVALID_CODEPOINT UINT32_MAX
+
+/**
+ * Reads the UTF-8 sequence at the start of src, setting length to the number of bytes it uses.
+ *
+ * Returns its codepoint, or INVALID_CODEPOINT if it is malformed or cut off.
+ */
+static uint32_t ReadUtf8(const uint8_t* src, size_t srcSize, size_t* length) {
+    uint8_t c = src[0];
+    uint32_t codepoint;
+    uint32_t minimum;
+    size_t i;
+
+    if (c < 0x80) {
+        *length = 1;
+        return c;
+    } else if (c >= 0xC2 && c < 0xE0) {
+        *length = 2;
+        codepoint = c & 0x1F;
+        minimum = 0x80;
+    } else if (c >= 0xE0 && c < 0xF0) {
+        *length = 3;
+        codepoint = c & 0xF;
+        minimum = 0x800;
+    } else if (c >= 0xF0 && c < 0xF5) {
+        *length = 4;
+        codepoint = c & 0x7;
+        minimum = 0x10000;
+    } else {
+        *length = 1;
+        return INVALID_CODEPOINT;
+    }
+
+    if (srcSize < *length) {
+        return INVALID_CODEPOINT;
+    }
+    for (i = 1; i < *length; i++) {
+        if ((src[i] & 0xC0) != 0x80) {
+            return INVALID_CODEPOINT;
+        }
+        codepoint = (codepoint << 6) | (src[i] & 0x3F);
+    }
+    return (codepoint >= minimum && codepoint <= 0x10FFFF) ? codepoint : INVALID_CODEPOINT;
+}
+
+/**
+ * Copies the run of plain ASCII starting at src, 8 bytes at a time while possible, stopping at a backslash if escapes
+ * are being read.
+ *
+ * Returns the length of the run copied.
+ */
+static size_t CopyUtf8AsciiRun(const uint8_t* src, size_t srcSize, uint8_t* dst, int flags) {
+    size_t i = 0;
+
+    while (i + 8 <= srcSize) {
+        uint64_t word;
+        uint64_t special;
+
+        memcpy(&word, src + i, sizeof(word));
+        special = word & HIGH_BITS;
+        if (flags & JIS_ESCAPE_CONTROL) {
+            /* High bit of each byte equal to '\\' */
+            special |= ((word ^ ('\\' * LOW_BITS)) - LOW_BITS) & ~(word ^ ('\\' * LOW_BITS)) & HIGH_BITS;
+        }
+        if (special != 0) {
+            break;
+        }
+        memcpy(dst + i, &word, sizeof(word));
+        i += 8;
+    }
+
+    for (; i < srcSize; i++) {
+        uint8_t c = src[i];
+
+        if ((c & 0x80) || ((flags & JIS_ESCAPE_CONTROL) && c == '\\')) {
+            break;
+        }
+        dst[i] = c;
+    }
+
+    return i;
+}
+
+static int HexDigitValue(uint8_t c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Reads the escape at the start of src, which begins with a backslash, setting length to the number of bytes it uses.
+ * Anything that is not \xNN or \\ is a backslash on its own.
+ *
+ * Returns the byte it stands for.
+ */
+static uint8_t ReadEscape(const uint8_t* src, size_t srcSize, size_t* length) {
+    if (srcSize >= 4 && src[1] == 'x' && HexDigitValue(src[2]) >= 0 && HexDigitValue(src[3]) >= 0) {
+        *length = 4;
+        return (HexDigitValue(src[2]) << 4) | HexDigitValue(src[3]);
+    }
+    *length = (srcSize >= 2 && src[1] == '\\') ? 2 : 1;
+    return '\\';
+}
+
+/**
+ * Encodes UTF-8 into Shift-JIS in dst, which must have room for srcSize bytes (no character gets longer), stopping
+ * early at the first character that is malformed or has no Shift-JIS code. srcUsed is set to how much of src was
+ * encoded, so the caller can deal with that character and carry on from the next.
+ *
+ * Returns number of bytes written.
+ */
+size_t Sjis_EncodeFromUtf8(const char* src, size_t srcSize, uint8_t* dst, int flags, size_t* srcUsed) {
+    const uint8_t* in = (const uint8_t*)src;
+    uint8_t* out = dst;
+    size_t i = 0;
+
+    while (i < srcSize) {
+        uint32_t codepoint;
+        uint16_t code;
+        size_t length;
+
+        if (in[i] < 0x80) {
+            if ((flags & JIS_ESCAPE_CONTROL) && in[i] == '\\') {
+                *out++ = ReadEscape(in + i, srcSize - i, &length);
+                i += length;
+            } else {
+                size_t run = CopyUtf8AsciiRun(in + i, srcSize - i, out, flags);
+
+                out += run;
+                i += run;
+            }
+            continue;
+        }
+
+        codepoint = ReadUtf8(in + i, srcSize - i, &length);
+        if (codepoint >= 0xFF61 && codepoint <= 0xFF9F) {
+            /* Half-width katakana */
+            *out++ = 0xA1 + (codepoint - 0xFF61);
+        } else if (codepoint <= 0xFFFF &&
+                   (code = sjisEncodeRows[sjisEncodeHighRows[codepoint >> 8]][codepoint & 0xFF]) != 0) {
+            *out++ = code >> 8;
+            *out++ = code & 0xFF;
+        } else {
+            break;
+        }
+        i += length;
+    }
+
+    *srcUsed = i;
+    return out - dst;
+}
+
+/**
+ * Encodes UTF-8 into EUC-JP in dst, which must have room for JIS_MAX_ENCODED_SIZE(srcSize) bytes (a JIS X 0212
+ * character is half as long again as its UTF-8), stopping early at the first character that is malformed or has no
+ * EUC-JP code. srcUsed is set to how much of src was encoded, so the caller can deal with that character and carry on
+ * from the next. JIS X 0208 is preferred to JIS X 0212 for characters in both.
+ *
+ * Returns number of bytes written.
+ */
+size_t EucJp_EncodeFromUtf8(const char* src, size_t srcSize, uint8_t* dst, int flags, size_t* srcUsed) {
+    const uint8_t* in = (const uint8_t*)src;
+    uint8_t* out = dst;
+    size_t i = 0;
+
+    while (i < srcSize) {
+        uint32_t codepoint;
+        uint16_t code;
+        size_t length;
+
+        if (in[i] < 0x80) {
+            if ((flags & JIS_ESCAPE_CONTROL) && in[i] == '\\') {
+                *out++ = ReadEscape(in + i, srcSize - i, &length);
+                i += length;
+            } else {
+                size_t run = CopyUtf8AsciiRun(in + i, srcSize - i, out, flags);
+
+                out += run;
+                i += run;
+            }
+            continue;
+        }
+
+        codepoint = ReadUtf8(in + i, srcSize - i, &length);
+        if (codepoint >= 0xFF61 && codepoint <= 0xFF9F) {
+            /* Single shift 2: half-width katakana */
+            *out++ = 0x8E;
+            *out++ = 0xA1 + (codepoint - 0xFF61);
+        } else if (codepoint <= 0xFFFF &&
+                   (code = eucJpEncodeRows[eucJpEncodeHighRows[codepoint >> 8]][codepoint & 0xFF]) != 0) {
+            *out++ = code >> 8;
+            *out++ = code & 0xFF;
+        } else if (codepoint <= 0xFFFF &&
+                   (code = eucJp212EncodeRows[eucJp212EncodeHighRows[codepoint >> 8]][codepoint & 0xFF]) != 0) {
+            /* Single shift 3: JIS X 0212 */
+            *out++ = 0x8F;
+            *out++ = code >> 8;
+            *out++ = code & 0xFF;
+        } else {
+            break;
+        }
+        i += length;
+    }
+
+    *srcUsed = i;
+    return out - dst;
+}
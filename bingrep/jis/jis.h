@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Escape control characters (0x00-0x1F, 0x7F) as \xNN and backslashes as \\ instead of copying them through, or when
+ * encoding, turn those escapes back into bytes */
+#define JIS_ESCAPE_CONTROL (1 << 0)
+
+/* Largest output a decode of srcSize bytes can produce: every byte escaped as \xNN */
+#define JIS_MAX_UTF8_SIZE(srcSize) (4 * (srcSize))
+
+/* Largest output an encode of srcSize bytes of UTF-8 can produce: JIS X 0212 characters take 3 bytes in EUC-JP, but
+ * may be only 2 bytes of UTF-8 */
+#define JIS_MAX_ENCODED_SIZE(srcSize) (3 * (srcSize) / 2 + 1)
+
+uint16_t Sjis_GetCodepoint(const uint8_t* src, size_t srcSize, size_t* length);
+uint16_t EucJp_GetCodepoint(const uint8_t* src, size_t srcSize, size_t* length);
+
+size_t Sjis_DecodeToUtf8(const uint8_t* src, size_t srcSize, char* dst, int flags, size_t* invalidCount);
+size_t EucJp_DecodeToUtf8(const uint8_t* src, size_t srcSize, char* dst, int flags, size_t* invalidCount);
+
+size_t Sjis_EncodeFromUtf8(const char* src, size_t srcSize, uint8_t* dst, int flags, size_t* srcUsed);
+size_t EucJp_EncodeFromUtf8(const char* src, size_t srcSize, uint8_t* dst, int flags, size_t* srcUsed);
@@ -0,0 +1,564 @@
+/**
+ * @file mips.c
+ * @brief Assembles MIPS instructions with wildcard operands into value/mask words to search for.
+ *
+ * Instructions are separated by ';' or newlines, and operands by commas. An operand of "?" (or "$?" for a register)
+ * matches anything, including a whole offset(base), and an instruction of just "?" matches any instruction. Numbers are
+ * C-style, and may be negative. Jump targets are addresses, and branch targets the raw 16-bit offset field.
+ *
+ * The pseudo-instructions nop, move, li, b, bal, beqz, bnez, beqzl and bnezl are accepted too. move matches addu, or
+ * and daddu from $zero, and li either addiu or ori from $zero where both would load the same value, since different
+ * assemblers pick different ones.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include "mips.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_COUNT(arr) (sizeof(arr) / sizeof(arr[0]))
+
+#define MAX_OPERANDS 4
+#define MAX_INSTRUCTION_LENGTH 128
+
+/**
+ * Operand kinds, one character each in MipsOpcode.operands:
+ *   d, s, t  general purpose registers in the rd, rs and rt fields
+ *   D, S, T  floating point registers in the fd, fs and ft fields
+ *   c        coprocessor register number in the rd field
+ *   a        shift amount
+ *   i        16-bit immediate
+ *   b        branch offset (the 16-bit field itself)
+ *   j        jump target address
+ *   m        memory operand, offset(base): 16-bit immediate and rs
+ */
+typedef struct {
+    const char* name;
+    uint32_t value; /* Opcode bits, with every operand field zero */
+    const char* operands;
+} MipsOpcode;
+
+#define SPECIAL(funct) (funct)
+#define REGIMM(rt) ((1 << 26) | ((rt) << 16))
+#define OP(op) ((uint32_t)(op) << 26)
+#define COP0(rs) (OP(0x10) | ((rs) << 21))
+#define COP1(rs) (OP(0x11) | ((rs) << 21))
+#define COP1_S(funct) (COP1(0x10) | (funct))
+#define COP1_D(funct) (COP1(0x11) | (funct))
+#define COP1_W(funct) (COP1(0x14) | (funct))
+
+static const MipsOpcode opcodes[] = {
+    /* SPECIAL */
+    { "nop", 0, "" },
+    { "sll", SPECIAL(0x00), "dta" },
+    { "srl", SPECIAL(0x02), "dta" },
+    { "sra", SPECIAL(0x03), "dta" },
+    { "sllv", SPECIAL(0x04), "dts" },
+    { "srlv", SPECIAL(0x06), "dts" },
+    { "srav", SPECIAL(0x07), "dts" },
+    { "jr", SPECIAL(0x08), "s" },
+    { "jalr", SPECIAL(0x09), "ds" },
+    { "syscall", SPECIAL(0x0C), "" },
+    { "break", SPECIAL(0x0D), "" },
+    { "sync", SPECIAL(0x0F), "" },
+    { "mfhi", SPECIAL(0x10), "d" },
+    { "mthi", SPECIAL(0x11), "s" },
+    { "mflo", SPECIAL(0x12), "d" },
+    { "mtlo", SPECIAL(0x13), "s" },
+    { "dsllv", SPECIAL(0x14), "dts" },
+    { "dsrlv", SPECIAL(0x16), "dts" },
+    { "dsrav", SPECIAL(0x17), "dts" },
+    { "mult", SPECIAL(0x18), "st" },
+    { "multu", SPECIAL(0x19), "st" },
+    { "div", SPECIAL(0x1A), "st" },
+    { "divu", SPECIAL(0x1B), "st" },
+    { "dmult", SPECIAL(0x1C), "st" },
+    { "dmultu", SPECIAL(0x1D), "st" },
+    { "ddiv", SPECIAL(0x1E), "st" },
+    { "ddivu", SPECIAL(0x1F), "st" },
+    { "add", SPECIAL(0x20), "dst" },
+    { "addu", SPECIAL(0x21), "dst" },
+    { "move", SPECIAL(0x21), "ds" },
+    { "sub", SPECIAL(0x22), "dst" },
+    { "subu", SPECIAL(0x23), "dst" },
+    { "and", SPECIAL(0x24), "dst" },
+    { "or", SPECIAL(0x25), "dst" },
+    { "xor", SPECIAL(0x26), "dst" },
+    { "nor", SPECIAL(0x27), "dst" },
+    { "slt", SPECIAL(0x2A), "dst" },
+    { "sltu", SPECIAL(0x2B), "dst" },
+    { "dadd", SPECIAL(0x2C), "dst" },
+    { "daddu", SPECIAL(0x2D), "dst" },
+    { "dsub", SPECIAL(0x2E), "dst" },
+    { "dsubu", SPECIAL(0x2F), "dst" },
+    { "dsll", SPECIAL(0x38), "dta" },
+    { "dsrl", SPECIAL(0x3A), "dta" },
+    { "dsra", SPECIAL(0x3B), "dta" },
+    { "dsll32", SPECIAL(0x3C), "dta" },
+    { "dsrl32", SPECIAL(0x3E), "dta" },
+    { "dsra32", SPECIAL(0x3F), "dta" },
+
+    /* REGIMM */
+    { "bltz", REGIMM(0x00), "sb" },
+    { "bgez", REGIMM(0x01), "sb" },
+    { "bltzl", REGIMM(0x02), "sb" },
+    { "bgezl", REGIMM(0x03), "sb" },
+    { "bltzal", REGIMM(0x10), "sb" },
+    { "bgezal", REGIMM(0x11), "sb" },
+    { "bal", REGIMM(0x11), "b" },
+
+    /* Jumps, branches and immediates */
+    { "j", OP(0x02), "j" },
+    { "jal", OP(0x03), "j" },
+    { "beq", OP(0x04), "stb" },
+    { "beqz", OP(0x04), "sb" },
+    { "b", OP(0x04), "b" },
+    { "bne", OP(0x05), "stb" },
+    { "bnez", OP(0x05), "sb" },
+    { "blez", OP(0x06), "sb" },
+    { "bgtz", OP(0x07), "sb" },
+    { "addi", OP(0x08), "tsi" },
+    { "addiu", OP(0x09), "tsi" },
+    { "slti", OP(0x0A), "tsi" },
+    { "sltiu", OP(0x0B), "tsi" },
+    { "andi", OP(0x0C), "tsi" },
+    { "ori", OP(0x0D), "tsi" },
+    { "xori", OP(0x0E), "tsi" },
+    { "lui", OP(0x0F), "ti" },
+    { "li", OP(0x09), "ti" },
+    { "beql", OP(0x14), "stb" },
+    { "beqzl", OP(0x14), "sb" },
+    { "bnel", OP(0x15), "stb" },
+    { "bnezl", OP(0x15), "sb" },
+    { "blezl", OP(0x16), "sb" },
+    { "bgtzl", OP(0x17), "sb" },
+    { "daddi", OP(0x18), "tsi" },
+    { "daddiu", OP(0x19), "tsi" },
+
+    /* Loads and stores */
+    { "ldl", OP(0x1A), "tm" },
+    { "ldr", OP(0x1B), "tm" },
+    { "lb", OP(0x20), "tm" },
+    { "lh", OP(0x21), "tm" },
+    { "lwl", OP(0x22), "tm" },
+    { "lw", OP(0x23), "tm" },
+    { "lbu", OP(0x24), "tm" },
+    { "lhu", OP(0x25), "tm" },
+    { "lwr", OP(0x26), "tm" },
+    { "lwu", OP(0x27), "tm" },
+    { "sb", OP(0x28), "tm" },
+    { "sh", OP(0x29), "tm" },
+    { "swl", OP(0x2A), "tm" },
+    { "sw", OP(0x2B), "tm" },
+    { "sdl", OP(0x2C), "tm" },
+    { "sdr", OP(0x2D), "tm" },
+    { "swr", OP(0x2E), "tm" },
+    { "cache", OP(0x2F), "tm" },
+    { "ll", OP(0x30), "tm" },
+    { "lwc1", OP(0x31), "Tm" },
+    { "lld", OP(0x34), "tm" },
+    { "ldc1", OP(0x35), "Tm" },
+    { "ld", OP(0x37), "tm" },
+    { "sc", OP(0x38), "tm" },
+    { "swc1", OP(0x39), "Tm" },
+    { "scd", OP(0x3C), "tm" },
+    { "sdc1", OP(0x3D), "Tm" },
+    { "sd", OP(0x3F), "tm" },
+
+    /* COP0 */
+    { "mfc0", COP0(0x00), "tc" },
+    { "mtc0", COP0(0x04), "tc" },
+    { "tlbr", COP0(0x10) | 0x01, "" },
+    { "tlbwi", COP0(0x10) | 0x02, "" },
+    { "tlbwr", COP0(0x10) | 0x06, "" },
+    { "tlbp", COP0(0x10) | 0x08, "" },
+    { "eret", COP0(0x10) | 0x18, "" },
+
+    /* COP1 */
+    { "mfc1", COP1(0x00), "tS" },
+    { "dmfc1", COP1(0x01), "tS" },
+    { "cfc1", COP1(0x02), "tS" },
+    { "mtc1", COP1(0x04), "tS" },
+    { "dmtc1", COP1(0x05), "tS" },
+    { "ctc1", COP1(0x06), "tS" },
+    { "bc1f", COP1(0x08) | (0 << 16), "b" },
+    { "bc1t", COP1(0x08) | (1 << 16), "b" },
+    { "bc1fl", COP1(0x08) | (2 << 16), "b" },
+    { "bc1tl", COP1(0x08) | (3 << 16), "b" },
+    { "add.s", COP1_S(0x00), "DST" },
+    { "sub.s", COP1_S(0x01), "DST" },
+    { "mul.s", COP1_S(0x02), "DST" },
+    { "div.s", COP1_S(0x03), "DST" },
+    { "sqrt.s", COP1_S(0x04), "DS" },
+    { "abs.s", COP1_S(0x05), "DS" },
+    { "mov.s", COP1_S(0x06), "DS" },
+    { "neg.s", COP1_S(0x07), "DS" },
+    { "round.w.s", COP1_S(0x0C), "DS" },
+    { "trunc.w.s", COP1_S(0x0D), "DS" },
+    { "ceil.w.s", COP1_S(0x0E), "DS" },
+    { "floor.w.s", COP1_S(0x0F), "DS" },
+    { "cvt.d.s", COP1_S(0x21), "DS" },
+    { "cvt.w.s", COP1_S(0x24), "DS" },
+    { "c.eq.s", COP1_S(0x32), "ST" },
+    { "c.lt.s", COP1_S(0x3C), "ST" },
+    { "c.le.s", COP1_S(0x3E), "ST" },
+    { "add.d", COP1_D(0x00), "DST" },
+    { "sub.d", COP1_D(0x01), "DST" },
+    { "mul.d", COP1_D(0x02), "DST" },
+    { "div.d", COP1_D(0x03), "DST" },
+    { "sqrt.d", COP1_D(0x04), "DS" },
+    { "abs.d", COP1_D(0x05), "DS" },
+    { "mov.d", COP1_D(0x06), "DS" },
+    { "neg.d", COP1_D(0x07), "DS" },
+    { "round.w.d", COP1_D(0x0C), "DS" },
+    { "trunc.w.d", COP1_D(0x0D), "DS" },
+    { "ceil.w.d", COP1_D(0x0E), "DS" },
+    { "floor.w.d", COP1_D(0x0F), "DS" },
+    { "cvt.s.d", COP1_D(0x20), "DS" },
+    { "cvt.w.d", COP1_D(0x24), "DS" },
+    { "c.eq.d", COP1_D(0x32), "ST" },
+    { "c.lt.d", COP1_D(0x3C), "ST" },
+    { "c.le.d", COP1_D(0x3E), "ST" },
+    { "cvt.s.w", COP1_W(0x20), "DS" },
+    { "cvt.d.w", COP1_W(0x21), "DS" },
+};
+
+/* Opcode bits that may be anything, for pseudo-instructions with several encodings */
+static const struct {
+    const char* name;
+    uint32_t ignored;
+} alternativeEncodings[] = {
+    { "move", 0xC },     /* addu, or (0x25) or daddu (0x2D), and 0x29 is not an instruction */
+    { "li", OP(0x04) }, /* addiu or ori (0x0D), depending on the value */
+};
+
+static uint32_t GetIgnoredBits(const char* name) {
+    size_t i;
+
+    for (i = 0; i < ARRAY_COUNT(alternativeEncodings); i++) {
+        if (strcmp(alternativeEncodings[i].name, name) == 0) {
+            return alternativeEncodings[i].ignored;
+        }
+    }
+    return 0;
+}
+
+static const char* gprNames[] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3", "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0",   "s1", "s2", "s3", "s4", "s5", "s6", "s7", "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra",
+};
+
+/* Fields an operand kind fills in: shift and mask of the field */
+typedef struct {
+    char kind;
+    uint8_t shift;
+    uint32_t mask;
+} OperandField;
+
+static const OperandField operandFields[] = {
+    { 'd', 11, 0x1F }, { 's', 21, 0x1F }, { 't', 16, 0x1F }, { 'D', 6, 0x1F },     { 'S', 11, 0x1F },
+    { 'T', 16, 0x1F }, { 'c', 11, 0x1F }, { 'a', 6, 0x1F },  { 'i', 0, 0xFFFF },  { 'b', 0, 0xFFFF },
+    { 'j', 0, 0x3FFFFFF },
+};
+
+/* Every field of an instruction is compared, except the operand fields that are wildcards */
+#define FULL_MASK 0xFFFFFFFF
+
+static const OperandField* FindOperandField(char kind) {
+    size_t i;
+
+    for (i = 0; i < ARRAY_COUNT(operandFields); i++) {
+        if (operandFields[i].kind == kind) {
+            return &operandFields[i];
+        }
+    }
+    return NULL;
+}
+
+static bool IsWildcard(const char* operand) {
+    return strcmp(operand, "?") == 0 || strcmp(operand, "$?") == 0;
+}
+
+/**
+ * Parses a register: "$" followed by a number or, for general purpose registers, a name ("s8" is another name for
+ * "fp"); floating point registers are "$f" and a number.
+ *
+ * Returns the register number, or -1 if it is not one.
+ */
+static int ParseRegister(const char* operand, bool floatingPoint) {
+    char* end;
+    long number;
+    size_t i;
+
+    if (operand[0] != '$') {
+        return -1;
+    }
+    operand++;
+
+    if (floatingPoint) {
+        if (operand[0] != 'f') {
+            return -1;
+        }
+        operand++;
+    } else if (!isdigit((unsigned char)operand[0])) {
+        if (strcmp(operand, "s8") == 0) {
+            return 30;
+        }
+        for (i = 0; i < ARRAY_COUNT(gprNames); i++) {
+            if (strcmp(operand, gprNames[i]) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    number = strtol(operand, &end, 10);
+    return (end != operand && *end == '\0' && number >= 0 && number < 32) ? number : -1;
+}
+
+static bool ParseNumber(const char* operand, long long* value) {
+    char* end;
+
+    *value = strtoll(operand, &end, 0);
+    return end != operand && *end == '\0';
+}
+
+/**
+ * Fills in one operand of kind, setting its field in value and clearing it in mask if it is a wildcard.
+ *
+ * Returns 0 on success, -1 if the operand does not fit, which is reported.
+ */
+static int AssembleOperand(char kind, const char* operand, uint32_t* value, uint32_t* mask) {
+    const OperandField* field = FindOperandField(kind);
+    long long number;
+
+    if (IsWildcard(operand)) {
+        *mask &= ~(field->mask << field->shift);
+        return 0;
+    }
+
+    switch (kind) {
+        case 'd':
+        case 's':
+        case 't':
+        case 'D':
+        case 'S':
+        case 'T':
+            number = ParseRegister(operand, isupper((unsigned char)kind));
+            if (number < 0) {
+                fprintf(stderr, "Expected a %sregister, found '%s'\n",
+                        isupper((unsigned char)kind) ? "floating point " : "", operand);
+                return -1;
+            }
+            break;
+
+        case 'c':
+            number = ParseRegister(operand, false);
+            if (number < 0 && (!ParseNumber(operand, &number) || number < 0 || number > 31)) {
+                fprintf(stderr, "Expected a coprocessor register, found '%s'\n", operand);
+                return -1;
+            }
+            break;
+
+        case 'a':
+            if (!ParseNumber(operand, &number) || number < 0 || number > 31) {
+                fprintf(stderr, "Expected a shift amount from 0 to 31, found '%s'\n", operand);
+                return -1;
+            }
+            break;
+
+        case 'i':
+        case 'b':
+            if (!ParseNumber(operand, &number) || number < -0x8000 || number > 0xFFFF) {
+                fprintf(stderr, "Expected a 16-bit number, found '%s'\n", operand);
+                return -1;
+            }
+            break;
+
+        case 'j':
+            if (!ParseNumber(operand, &number) || number < 0 || number > 0xFFFFFFFFll || (number & 3) != 0) {
+                fprintf(stderr, "Expected a word-aligned jump target address, found '%s'\n", operand);
+                return -1;
+            }
+            number >>= 2;
+            break;
+
+        default:
+            return -1;
+    }
+
+    *value |= ((uint32_t)number & field->mask) << field->shift;
+    return 0;
+}
+
+/* Splits "offset(base)" into its parts, in place. Not for wildcards, which stand for the whole operand. */
+static int SplitMemoryOperand(char* operand, char** offset, char** base) {
+    char* open = strchr(operand, '(');
+    size_t length = strlen(operand);
+
+    if (open == NULL || length == 0 || operand[length - 1] != ')') {
+        fprintf(stderr, "Expected offset(base), found '%s'\n", operand);
+        return -1;
+    }
+    *open = '\0';
+    operand[length - 1] = '\0';
+    *offset = (open == operand) ? "0" : operand;
+    *base = open + 1;
+    return 0;
+}
+
+static char* Trim(char* str) {
+    char* end;
+
+    while (isspace((unsigned char)*str)) {
+        str++;
+    }
+    end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    *end = '\0';
+    return str;
+}
+
+/**
+ * Assembles one instruction, e.g. "lui $?, 0x8012", into a value and mask.
+ *
+ * Returns 0 on success, -1 on failure, which is reported.
+ */
+static int AssembleInstruction(char* instruction, uint32_t* value, uint32_t* mask) {
+    char* mnemonic = instruction;
+    char* operandText;
+    char* operands[MAX_OPERANDS];
+    size_t operandCount = 0;
+    const MipsOpcode* opcode = NULL;
+    char* savePtr = NULL;
+    char* operand;
+    size_t i;
+
+    if (strcmp(instruction, "?") == 0) {
+        *value = 0;
+        *mask = 0;
+        return 0;
+    }
+
+    for (operandText = mnemonic; *operandText != '\0' && !isspace((unsigned char)*operandText); operandText++) {
+    }
+    if (*operandText != '\0') {
+        *operandText++ = '\0';
+    }
+    for (operand = strtok_r(operandText, ",", &savePtr); operand != NULL; operand = strtok_r(NULL, ",", &savePtr)) {
+        if (operandCount == MAX_OPERANDS) {
+            fprintf(stderr, "Too many operands for %s\n", mnemonic);
+            return -1;
+        }
+        operands[operandCount++] = Trim(operand);
+    }
+
+    for (i = 0; i < strlen(mnemonic); i++) {
+        mnemonic[i] = tolower((unsigned char)mnemonic[i]);
+    }
+    for (i = 0; i < ARRAY_COUNT(opcodes); i++) {
+        if (strcmp(opcodes[i].name, mnemonic) == 0) {
+            opcode = &opcodes[i];
+            break;
+        }
+    }
+    if (opcode == NULL) {
+        fprintf(stderr, "Unknown instruction '%s'\n", mnemonic);
+        return -1;
+    }
+    if (operandCount != strlen(opcode->operands)) {
+        fprintf(stderr, "%s takes %zu operands, found %zu\n", mnemonic, strlen(opcode->operands), operandCount);
+        return -1;
+    }
+
+    *value = opcode->value;
+    *mask = FULL_MASK & ~GetIgnoredBits(opcode->name);
+    for (i = 0; i < operandCount; i++) {
+        char kind = opcode->operands[i];
+
+        if (kind == 'm' && IsWildcard(operands[i])) {
+            *mask &= ~((FindOperandField('i')->mask << FindOperandField('i')->shift) |
+                       (FindOperandField('s')->mask << FindOperandField('s')->shift));
+        } else if (kind == 'm') {
+            char* offset;
+            char* base;
+
+            if (SplitMemoryOperand(operands[i], &offset, &base) != 0 ||
+                AssembleOperand('i', Trim(offset), value, mask) != 0 ||
+                AssembleOperand('s', Trim(base), value, mask) != 0) {
+                return -1;
+            }
+        } else if (AssembleOperand(kind, operands[i], value, mask) != 0) {
+            return -1;
+        }
+    }
+
+    if (strcmp(opcode->name, "li") == 0 && !IsWildcard(operands[1])) {
+        long long number;
+
+        /* Negative numbers can only be addiu, and those from 0x8000 up only ori */
+        ParseNumber(operands[1], &number);
+        if (number < 0) {
+            *mask |= GetIgnoredBits(opcode->name);
+        } else if (number > 0x7FFF) {
+            *value |= GetIgnoredBits(opcode->name);
+            *mask |= GetIgnoredBits(opcode->name);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Compiles a sequence of instructions with wildcards, e.g. "lui $?, 0x8012; addiu $?, $?, ?", into a pattern.
+ *
+ * Returns 0 on success, -1 on failure, which is reported.
+ */
+int MipsPattern_Compile(MipsPattern* pattern, const char* source) {
+    char* copy = strdup(source);
+    char* savePtr = NULL;
+    char* instruction;
+    size_t capacity = 0;
+
+    memset(pattern, 0, sizeof(*pattern));
+    for (instruction = strtok_r(copy, ";\n", &savePtr); instruction != NULL;
+         instruction = strtok_r(NULL, ";\n", &savePtr)) {
+        instruction = Trim(instruction);
+        if (*instruction == '\0') {
+            continue;
+        }
+
+        if (pattern->count == capacity) {
+            capacity = 2 * capacity + 8;
+            pattern->values = realloc(pattern->values, capacity * sizeof(uint32_t));
+            pattern->masks = realloc(pattern->masks, capacity * sizeof(uint32_t));
+        }
+        if (AssembleInstruction(instruction, &pattern->values[pattern->count], &pattern->masks[pattern->count]) != 0) {
+            free(copy);
+            MipsPattern_Destroy(pattern);
+            return -1;
+        }
+        pattern->count++;
+    }
+    free(copy);
+
+    if (pattern->count == 0) {
+        fprintf(stderr, "No instructions in pattern\n");
+        return -1;
+    }
+    return 0;
+}
+
+void MipsPattern_Destroy(MipsPattern* pattern) {
+    free(pattern->values);
+    free(pattern->masks);
+    pattern->values = NULL;
+    pattern->masks = NULL;
+    pattern->count = 0;
+}
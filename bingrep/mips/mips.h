@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Instruction i matches word w if (w & masks[i]) == values[i] */
+typedef struct {
+    uint32_t* values;
+    uint32_t* masks;
+    size_t count;
+} MipsPattern;
+
+int MipsPattern_Compile(MipsPattern* pattern, const char* source);
+void MipsPattern_Destroy(MipsPattern* pattern);
@@ -0,0 +1,876 @@
+/**
+ * @file regex.c
+ * @brief Byte-oriented regular expressions, matched by a DFA built lazily from a Thompson NFA.
+ *
+ * The dialect works on bytes written in hex, like the rest of bingrep, and whitespace between items is ignored:
+ *   3C0E       the bytes 0x3C, 0x0E
+ *   .          any byte
+ *   [00-1F 7F] any of the listed bytes or ranges; [^...] any byte not listed
+ *   (...)      grouping
+ *   a|b        alternation
+ *   * + ?      repetition: any number, at least one, at most one
+ *   {n} {n,} {n,m}  bounded repetition
+ * e.g. "03E00008 (....){0,7} 27BD...." is a jr $ra followed within 8 words by an addiu $sp, $sp.
+ *
+ * DFA states are sets of NFA states, only created when a byte first leads to them, and kept in a cache that is
+ * flushed if it fills up, so memory is bounded however many states the pattern could need.
+ *
+ * Searching is one forward pass that adds the start state again at every offset a match may start at, so every start
+ * is tried at once and stops at the first offset where a match ends. A second DFA, of the pattern reversed, is then run
+ * backwards from there to find where the leftmost of the matches ending there starts. Each byte is read at most twice
+ * per search, however much the pattern can repeat.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include "regex.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Bounds on patterns, so {n,m} cannot blow up the NFA */
+#define MAX_REPEAT 1000
+#define MAX_NFA_STATES 0x10000
+
+/* DFA states kept before the cache is flushed: 4 MiB of transitions */
+#define MAX_DFA_STATES 0x1000
+#define DFA_HASH_SIZE (2 * MAX_DFA_STATES)
+
+#define DFA_DEAD 0
+#define DFA_START 1
+
+#define MAX_PREFIX_LENGTH 0x100
+
+typedef struct {
+    uint8_t bits[32];
+} ByteSet;
+
+static inline bool ByteSet_Has(const ByteSet* set, uint8_t byte) {
+    return (set->bits[byte >> 3] >> (byte & 7)) & 1;
+}
+
+static inline void ByteSet_Add(ByteSet* set, uint8_t byte) {
+    set->bits[byte >> 3] |= 1 << (byte & 7);
+}
+
+/* Parse tree */
+
+typedef enum {
+    NODE_EMPTY,
+    NODE_BYTES,
+    NODE_CONCAT,
+    NODE_ALT,
+    NODE_REPEAT,
+} NodeKind;
+
+typedef struct {
+    NodeKind kind;
+    int left; /* Only child of NODE_REPEAT */
+    int right;
+    int min;
+    int max; /* -1 for unbounded */
+    ByteSet bytes;
+} Node;
+
+/* NFA */
+
+typedef enum {
+    NFA_BYTES, /* Consumes a byte in bytes, then goes to out */
+    NFA_EMPTY, /* Goes to out */
+    NFA_SPLIT, /* Goes to both out and out1 */
+    NFA_MATCH,
+} NfaKind;
+
+typedef struct {
+    NfaKind kind;
+    int out;
+    int out1;
+    ByteSet bytes;
+} NfaState;
+
+/* DFA */
+
+typedef struct {
+    size_t setStart; /* Index in setPool of its NFA_BYTES states, sorted */
+    int setCount;
+    bool match;
+    uint32_t hash;
+    int hashNext;
+} DfaState;
+
+struct Regex {
+    bool reversed; /* Matches the pattern backwards, concatenations in the opposite order */
+    Regex* reverse; /* The pattern reversed, NULL in the reversed one */
+
+    NfaState* nfa;
+    int nfaCount;
+    int nfaCapacity;
+    int nfaStart;
+
+    DfaState* dfa;
+    int dfaCount;
+    int* transitions; /* 256 per DFA state, -1 if not yet computed */
+    int* restarts; /* Per DFA state, the state with the start state added to it, -1 if not yet computed */
+    int* hashHeads;
+    int* setPool;
+    size_t setPoolCount;
+    size_t setPoolCapacity;
+
+    /* Scratch for building sets */
+    uint32_t* marks;
+    uint32_t generation;
+    int* stack;
+    int* set;
+    int setCount;
+    bool setMatch;
+
+    uint8_t prefix[MAX_PREFIX_LENGTH];
+    size_t prefixLength;
+};
+
+/* Parsing */
+
+typedef struct {
+    const char* p;
+    Node* nodes;
+    int count;
+    int capacity;
+} Parser;
+
+static int Parser_NewNode(Parser* parser, NodeKind kind, int left, int right) {
+    Node* node;
+
+    if (parser->count == parser->capacity) {
+        parser->capacity = 2 * parser->capacity + 16;
+        parser->nodes = realloc(parser->nodes, parser->capacity * sizeof(Node));
+    }
+    node = &parser->nodes[parser->count];
+    memset(node, 0, sizeof(*node));
+    node->kind = kind;
+    node->left = left;
+    node->right = right;
+    return parser->count++;
+}
+
+static void Parser_SkipSpace(Parser* parser) {
+    while (isspace((unsigned char)*parser->p)) {
+        parser->p++;
+    }
+}
+
+static int HexDigit(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 0xA;
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 0xA;
+    }
+    return -1;
+}
+
+/* Reads two hex digits. Returns the byte, or -1 if there are not two, which is reported */
+static int Parser_Byte(Parser* parser) {
+    int high = HexDigit(parser->p[0]);
+    int low = (high < 0) ? -1 : HexDigit(parser->p[1]);
+
+    if (low < 0) {
+        fprintf(stderr, "Expected a byte as two hex digits at '%s'\n", parser->p);
+        return -1;
+    }
+    parser->p += 2;
+    return (high << 4) | low;
+}
+
+static int Parser_Alternation(Parser* parser);
+
+static int Parser_Class(Parser* parser, ByteSet* bytes) {
+    bool negate = false;
+    int i;
+
+    parser->p++;
+    if (*parser->p == '^') {
+        negate = true;
+        parser->p++;
+    }
+    while (true) {
+        int first;
+        int last;
+
+        Parser_SkipSpace(parser);
+        if (*parser->p == ']') {
+            parser->p++;
+            break;
+        }
+        if ((first = Parser_Byte(parser)) < 0) {
+            return -1;
+        }
+        last = first;
+        Parser_SkipSpace(parser);
+        if (*parser->p == '-') {
+            parser->p++;
+            Parser_SkipSpace(parser);
+            if ((last = Parser_Byte(parser)) < 0) {
+                return -1;
+            }
+            if (last < first) {
+                fprintf(stderr, "Byte range %02X-%02X is backwards\n", first, last);
+                return -1;
+            }
+        }
+        for (i = first; i <= last; i++) {
+            ByteSet_Add(bytes, i);
+        }
+    }
+    if (negate) {
+        for (i = 0; i < 32; i++) {
+            bytes->bits[i] = ~bytes->bits[i];
+        }
+    }
+    return 0;
+}
+
+static int Parser_Atom(Parser* parser) {
+    int node;
+    int byte;
+
+    switch (*parser->p) {
+        case '(':
+            parser->p++;
+            if ((node = Parser_Alternation(parser)) < 0) {
+                return -1;
+            }
+            Parser_SkipSpace(parser);
+            if (*parser->p != ')') {
+                fprintf(stderr, "Missing ')'\n");
+                return -1;
+            }
+            parser->p++;
+            return node;
+
+        case '.':
+            parser->p++;
+            node = Parser_NewNode(parser, NODE_BYTES, -1, -1);
+            memset(&parser->nodes[node].bytes, 0xFF, sizeof(ByteSet));
+            return node;
+
+        case '[':
+            node = Parser_NewNode(parser, NODE_BYTES, -1, -1);
+            if (Parser_Class(parser, &parser->nodes[node].bytes) != 0) {
+                return -1;
+            }
+            return node;
+
+        default:
+            if ((byte = Parser_Byte(parser)) < 0) {
+                return -1;
+            }
+            node = Parser_NewNode(parser, NODE_BYTES, -1, -1);
+            ByteSet_Add(&parser->nodes[node].bytes, byte);
+            return node;
+    }
+}
+
+static int Parser_Count(Parser* parser, int* count) {
+    char* end;
+    long value = strtol(parser->p, &end, 10);
+
+    if (end == parser->p || value < 0 || value > MAX_REPEAT) {
+        fprintf(stderr, "Expected a repetition count from 0 to %d at '%s'\n", MAX_REPEAT, parser->p);
+        return -1;
+    }
+    parser->p = end;
+    *count = value;
+    return 0;
+}
+
+static int Parser_Repeat(Parser* parser) {
+    int node = Parser_Atom(parser);
+
+    while (node >= 0) {
+        int min;
+        int max;
+
+        Parser_SkipSpace(parser);
+        switch (*parser->p) {
+            case '*':
+                min = 0;
+                max = -1;
+                break;
+
+            case '+':
+                min = 1;
+                max = -1;
+                break;
+
+            case '?':
+                min = 0;
+                max = 1;
+                break;
+
+            case '{':
+                parser->p++;
+                if (Parser_Count(parser, &min) != 0) {
+                    return -1;
+                }
+                max = min;
+                if (*parser->p == ',') {
+                    parser->p++;
+                    max = -1;
+                    if (*parser->p != '}' && Parser_Count(parser, &max) != 0) {
+                        return -1;
+                    }
+                }
+                if (*parser->p != '}' || (max >= 0 && max < min)) {
+                    fprintf(stderr, "Invalid repetition, expected {n}, {n,} or {n,m} with n <= m\n");
+                    return -1;
+                }
+                break;
+
+            default:
+                return node;
+        }
+        parser->p++;
+        node = Parser_NewNode(parser, NODE_REPEAT, node, -1);
+        parser->nodes[node].min = min;
+        parser->nodes[node].max = max;
+    }
+    return node;
+}
+
+static int Parser_Concatenation(Parser* parser) {
+    int node = -1;
+
+    while (true) {
+        int next;
+
+        Parser_SkipSpace(parser);
+        if (*parser->p == '\0' || *parser->p == '|' || *parser->p == ')') {
+            break;
+        }
+        if ((next = Parser_Repeat(parser)) < 0) {
+            return -1;
+        }
+        node = (node < 0) ? next : Parser_NewNode(parser, NODE_CONCAT, node, next);
+    }
+    return (node < 0) ? Parser_NewNode(parser, NODE_EMPTY, -1, -1) : node;
+}
+
+static int Parser_Alternation(Parser* parser) {
+    int node = Parser_Concatenation(parser);
+
+    while (node >= 0 && *parser->p == '|') {
+        int next;
+
+        parser->p++;
+        if ((next = Parser_Concatenation(parser)) < 0) {
+            return -1;
+        }
+        node = Parser_NewNode(parser, NODE_ALT, node, next);
+    }
+    return node;
+}
+
+/* NFA construction */
+
+static int Nfa_NewState(Regex* regex, NfaKind kind) {
+    NfaState* state;
+
+    if (regex->nfaCount == MAX_NFA_STATES) {
+        return -1;
+    }
+    if (regex->nfaCount == regex->nfaCapacity) {
+        regex->nfaCapacity = 2 * regex->nfaCapacity + 16;
+        regex->nfa = realloc(regex->nfa, regex->nfaCapacity * sizeof(NfaState));
+    }
+    state = &regex->nfa[regex->nfaCount];
+    memset(state, 0, sizeof(*state));
+    state->kind = kind;
+    state->out = -1;
+    state->out1 = -1;
+    return regex->nfaCount++;
+}
+
+/**
+ * Builds the NFA fragment for a node.
+ *
+ * Returns its start state and puts its NFA_EMPTY end state, whose out is still to be set, in end; -1 if the NFA
+ * would be too big.
+ */
+static int Nfa_Compile(Regex* regex, const Node* nodes, int index, int* end) {
+    const Node* node = &nodes[index];
+    int start;
+    int current;
+    int fragment;
+    int fragmentEnd;
+    int split;
+    int i;
+
+    switch (node->kind) {
+        case NODE_EMPTY:
+            start = Nfa_NewState(regex, NFA_EMPTY);
+            *end = start;
+            return start;
+
+        case NODE_BYTES:
+            if ((start = Nfa_NewState(regex, NFA_BYTES)) < 0 || (*end = Nfa_NewState(regex, NFA_EMPTY)) < 0) {
+                return -1;
+            }
+            regex->nfa[start].bytes = node->bytes;
+            regex->nfa[start].out = *end;
+            return start;
+
+        case NODE_CONCAT:
+            if ((start = Nfa_Compile(regex, nodes, regex->reversed ? node->right : node->left, &current)) < 0 ||
+                (fragment = Nfa_Compile(regex, nodes, regex->reversed ? node->left : node->right, end)) < 0) {
+                return -1;
+            }
+            regex->nfa[current].out = fragment;
+            return start;
+
+        case NODE_ALT:
+            if ((start = Nfa_NewState(regex, NFA_SPLIT)) < 0 || (*end = Nfa_NewState(regex, NFA_EMPTY)) < 0) {
+                return -1;
+            }
+            if ((fragment = Nfa_Compile(regex, nodes, node->left, &fragmentEnd)) < 0) {
+                return -1;
+            }
+            regex->nfa[start].out = fragment;
+            regex->nfa[fragmentEnd].out = *end;
+            if ((fragment = Nfa_Compile(regex, nodes, node->right, &fragmentEnd)) < 0) {
+                return -1;
+            }
+            regex->nfa[start].out1 = fragment;
+            regex->nfa[fragmentEnd].out = *end;
+            return start;
+
+        case NODE_REPEAT:
+            if ((start = Nfa_NewState(regex, NFA_EMPTY)) < 0) {
+                return -1;
+            }
+            current = start;
+            for (i = 0; i < node->min; i++) {
+                if ((fragment = Nfa_Compile(regex, nodes, node->left, &fragmentEnd)) < 0) {
+                    return -1;
+                }
+                regex->nfa[current].out = fragment;
+                current = fragmentEnd;
+            }
+
+            if (node->max < 0) {
+                /* Loop back to the split after each pass */
+                if ((split = Nfa_NewState(regex, NFA_SPLIT)) < 0 ||
+                    (fragment = Nfa_Compile(regex, nodes, node->left, &fragmentEnd)) < 0 ||
+                    (*end = Nfa_NewState(regex, NFA_EMPTY)) < 0) {
+                    return -1;
+                }
+                regex->nfa[current].out = split;
+                regex->nfa[split].out = fragment;
+                regex->nfa[split].out1 = *end;
+                regex->nfa[fragmentEnd].out = split;
+                return start;
+            }
+
+            /* Each optional pass can be skipped straight to the end of it */
+            for (; i < node->max; i++) {
+                int skip;
+
+                if ((split = Nfa_NewState(regex, NFA_SPLIT)) < 0 ||
+                    (fragment = Nfa_Compile(regex, nodes, node->left, &fragmentEnd)) < 0 ||
+                    (skip = Nfa_NewState(regex, NFA_EMPTY)) < 0) {
+                    return -1;
+                }
+                regex->nfa[current].out = split;
+                regex->nfa[split].out = fragment;
+                regex->nfa[split].out1 = skip;
+                regex->nfa[fragmentEnd].out = skip;
+                current = skip;
+            }
+            *end = current;
+            return start;
+    }
+    return -1;
+}
+
+/**
+ * Appends the bytes every match of a node starts with to prefix.
+ *
+ * Returns true if that is all the node matches, so the prefix can carry on into what follows it.
+ */
+static bool FindPrefix(const Node* nodes, int index, uint8_t* prefix, size_t* length) {
+    const Node* node = &nodes[index];
+    int byte = -1;
+    int i;
+
+    switch (node->kind) {
+        case NODE_EMPTY:
+            return true;
+
+        case NODE_BYTES:
+            for (i = 0; i <= UINT8_MAX; i++) {
+                if (ByteSet_Has(&node->bytes, i)) {
+                    if (byte >= 0) {
+                        return false;
+                    }
+                    byte = i;
+                }
+            }
+            if (byte < 0 || *length == MAX_PREFIX_LENGTH) {
+                return false;
+            }
+            prefix[(*length)++] = byte;
+            return true;
+
+        case NODE_CONCAT:
+            return FindPrefix(nodes, node->left, prefix, length) && FindPrefix(nodes, node->right, prefix, length);
+
+        case NODE_REPEAT:
+            for (i = 0; i < node->min; i++) {
+                if (!FindPrefix(nodes, node->left, prefix, length)) {
+                    return false;
+                }
+            }
+            return node->min == node->max;
+
+        case NODE_ALT:
+            return false;
+    }
+    return false;
+}
+
+/* DFA construction */
+
+/* Adds the states reachable from state without consuming a byte to the scratch set */
+static void Dfa_AddClosure(Regex* regex, int state) {
+    int stackCount = 0;
+
+    regex->stack[stackCount++] = state;
+    while (stackCount > 0) {
+        int current = regex->stack[--stackCount];
+        const NfaState* nfaState;
+
+        if (regex->marks[current] == regex->generation) {
+            continue;
+        }
+        regex->marks[current] = regex->generation;
+        nfaState = &regex->nfa[current];
+
+        switch (nfaState->kind) {
+            case NFA_BYTES:
+                regex->set[regex->setCount++] = current;
+                break;
+
+            case NFA_EMPTY:
+                regex->stack[stackCount++] = nfaState->out;
+                break;
+
+            case NFA_SPLIT:
+                regex->stack[stackCount++] = nfaState->out1;
+                regex->stack[stackCount++] = nfaState->out;
+                break;
+
+            case NFA_MATCH:
+                regex->setMatch = true;
+                break;
+        }
+    }
+}
+
+static void Dfa_BeginSet(Regex* regex) {
+    regex->setCount = 0;
+    regex->setMatch = false;
+    regex->generation++;
+}
+
+static int CompareInts(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+static uint32_t Dfa_HashSet(const int* set, int count, bool match) {
+    uint32_t hash = 2166136261u ^ match;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        hash = (hash ^ set[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void Dfa_Reset(Regex* regex) {
+    regex->dfaCount = 0;
+    regex->setPoolCount = 0;
+    memset(regex->hashHeads, 0xFF, DFA_HASH_SIZE * sizeof(int));
+}
+
+/* Finds the DFA state for the scratch set, creating it if it is new. The cache must have room for it */
+static int Dfa_FindOrAddSet(Regex* regex) {
+    uint32_t hash;
+    int index;
+    DfaState* state;
+
+    qsort(regex->set, regex->setCount, sizeof(int), CompareInts);
+    hash = Dfa_HashSet(regex->set, regex->setCount, regex->setMatch);
+
+    for (index = regex->hashHeads[hash % DFA_HASH_SIZE]; index >= 0; index = regex->dfa[index].hashNext) {
+        state = &regex->dfa[index];
+        if (state->hash == hash && state->match == regex->setMatch && state->setCount == regex->setCount &&
+            memcmp(&regex->setPool[state->setStart], regex->set, regex->setCount * sizeof(int)) == 0) {
+            return index;
+        }
+    }
+
+    if (regex->setPoolCount + regex->setCount > regex->setPoolCapacity) {
+        regex->setPoolCapacity = 2 * (regex->setPoolCount + regex->setCount);
+        regex->setPool = realloc(regex->setPool, regex->setPoolCapacity * sizeof(int));
+    }
+    index = regex->dfaCount++;
+    state = &regex->dfa[index];
+    state->setStart = regex->setPoolCount;
+    state->setCount = regex->setCount;
+    state->match = regex->setMatch;
+    state->hash = hash;
+    state->hashNext = regex->hashHeads[hash % DFA_HASH_SIZE];
+    regex->hashHeads[hash % DFA_HASH_SIZE] = index;
+    memcpy(&regex->setPool[regex->setPoolCount], regex->set, regex->setCount * sizeof(int));
+    regex->setPoolCount += regex->setCount;
+
+    /* The dead state stays dead, others are filled in as they are first needed */
+    memset(&regex->transitions[index << 8], (index == DFA_DEAD) ? 0 : 0xFF, 0x100 * sizeof(int));
+    regex->restarts[index] = -1;
+    return index;
+}
+
+/* Puts the dead and start states back in an empty cache */
+static void Dfa_AddInitialStates(Regex* regex) {
+    Dfa_BeginSet(regex);
+    Dfa_FindOrAddSet(regex);
+
+    Dfa_BeginSet(regex);
+    Dfa_AddClosure(regex, regex->nfaStart);
+    Dfa_FindOrAddSet(regex);
+}
+
+/**
+ * Finds the DFA state for the scratch set, flushing the cache first if it is full, so the states from before are no
+ * longer valid, except DFA_DEAD and DFA_START. flushed is set if it was.
+ */
+static int Dfa_AddScratchSet(Regex* regex, bool* flushed) {
+    *flushed = regex->dfaCount == MAX_DFA_STATES;
+    if (*flushed) {
+        int* set = malloc(regex->setCount * sizeof(int));
+        int setCount = regex->setCount;
+        bool setMatch = regex->setMatch;
+
+        memcpy(set, regex->set, setCount * sizeof(int));
+        Dfa_Reset(regex);
+        Dfa_AddInitialStates(regex);
+        memcpy(regex->set, set, setCount * sizeof(int));
+        regex->setCount = setCount;
+        regex->setMatch = setMatch;
+        free(set);
+    }
+    return Dfa_FindOrAddSet(regex);
+}
+
+/**
+ * Works out which state a DFA state goes to on a byte, and caches it.
+ *
+ * If the cache is full it is flushed, so the states from before are no longer valid, except DFA_DEAD and DFA_START.
+ */
+static int Dfa_Step(Regex* regex, int from, uint8_t byte) {
+    int count = regex->dfa[from].setCount;
+    bool flushed;
+    int i;
+    int to;
+
+    Dfa_BeginSet(regex);
+    for (i = 0; i < count; i++) {
+        const NfaState* nfaState = &regex->nfa[regex->setPool[regex->dfa[from].setStart + i]];
+
+        if (ByteSet_Has(&nfaState->bytes, byte)) {
+            Dfa_AddClosure(regex, nfaState->out);
+        }
+    }
+
+    to = Dfa_AddScratchSet(regex, &flushed);
+    if (!flushed) {
+        regex->transitions[(from << 8) | byte] = to;
+    }
+    return to;
+}
+
+/* Works out the state with a match starting at the current offset added to a DFA state, and caches it, as Dfa_Step */
+static int Dfa_Restart(Regex* regex, int from) {
+    int count = regex->dfa[from].setCount;
+    bool flushed;
+    int i;
+    int to;
+
+    Dfa_BeginSet(regex);
+    for (i = 0; i < count; i++) {
+        Dfa_AddClosure(regex, regex->setPool[regex->dfa[from].setStart + i]);
+    }
+    Dfa_AddClosure(regex, regex->nfaStart);
+    regex->setMatch |= regex->dfa[from].match;
+
+    to = Dfa_AddScratchSet(regex, &flushed);
+    if (!flushed) {
+        regex->restarts[from] = to;
+    }
+    return to;
+}
+
+/* Builds the NFA and an empty DFA cache for a parsed pattern. Returns NULL if the NFA would be too big */
+static Regex* Regex_Build(const Node* nodes, int root, bool reversed) {
+    Regex* regex = calloc(1, sizeof(Regex));
+    int end;
+    int match;
+
+    regex->reversed = reversed;
+    if ((regex->nfaStart = Nfa_Compile(regex, nodes, root, &end)) < 0 ||
+        (match = Nfa_NewState(regex, NFA_MATCH)) < 0) {
+        Regex_Destroy(regex);
+        return NULL;
+    }
+    regex->nfa[end].out = match;
+
+    regex->marks = calloc(regex->nfaCount, sizeof(uint32_t));
+    /* Every state is expanded once and pushes at most two others */
+    regex->stack = malloc((2 * regex->nfaCount + 1) * sizeof(int));
+    regex->set = malloc(regex->nfaCount * sizeof(int));
+    regex->dfa = malloc(MAX_DFA_STATES * sizeof(DfaState));
+    regex->transitions = malloc(MAX_DFA_STATES * 0x100 * sizeof(int));
+    regex->restarts = malloc(MAX_DFA_STATES * sizeof(int));
+    regex->hashHeads = malloc(DFA_HASH_SIZE * sizeof(int));
+
+    Dfa_Reset(regex);
+    Dfa_AddInitialStates(regex);
+    return regex;
+}
+
+/**
+ * Compiles a pattern in the dialect described at the top of this file.
+ *
+ * Returns NULL if it is not valid, which is reported.
+ */
+Regex* Regex_Compile(const char* pattern) {
+    Parser parser = { pattern, NULL, 0, 0 };
+    Regex* regex;
+    int root;
+
+    root = Parser_Alternation(&parser);
+    if (root >= 0 && *parser.p != '\0') {
+        fprintf(stderr, "Unmatched ')'\n");
+        root = -1;
+    }
+    if (root < 0) {
+        free(parser.nodes);
+        return NULL;
+    }
+
+    if ((regex = Regex_Build(parser.nodes, root, false)) == NULL ||
+        (regex->reverse = Regex_Build(parser.nodes, root, true)) == NULL) {
+        fprintf(stderr, "Pattern is too big, try smaller repetition counts\n");
+        free(parser.nodes);
+        if (regex != NULL) {
+            Regex_Destroy(regex);
+        }
+        return NULL;
+    }
+    FindPrefix(parser.nodes, root, regex->prefix, &regex->prefixLength);
+    free(parser.nodes);
+    return regex;
+}
+
+void Regex_Destroy(Regex* regex) {
+    if (regex->reverse != NULL) {
+        Regex_Destroy(regex->reverse);
+    }
+    free(regex->nfa);
+    free(regex->dfa);
+    free(regex->transitions);
+    free(regex->restarts);
+    free(regex->hashHeads);
+    free(regex->setPool);
+    free(regex->marks);
+    free(regex->stack);
+    free(regex->set);
+    free(regex);
+}
+
+/**
+ * Finds the first offset from k in y, of length n, that is a multiple of width and where a match could start: where
+ * the bytes every match starts with are, if there are any. Returns n if there is none.
+ */
+static size_t NextStart(const Regex* regex, const uint8_t* y, size_t n, size_t k, size_t width) {
+    const uint8_t* found;
+
+    k += (width - k % width) % width;
+    if (regex->prefixLength == 0) {
+        return (k < n) ? k : n;
+    }
+    while (k < n && (found = memmem(y + k, n - k, regex->prefix, regex->prefixLength)) != NULL) {
+        k = found - y;
+        if (k % width == 0) {
+            return k;
+        }
+        k += width - k % width;
+    }
+    return n;
+}
+
+/**
+ * Finds the match in y, of length n, that ends first, of those starting at offsets that are multiples of width. If
+ * several end there, the one that starts first is taken. Empty matches are not counted.
+ *
+ * Returns the offset the match ends at and puts the one it starts at in start, or returns -1 if there is none.
+ */
+long Regex_Find(Regex* regex, const uint8_t* y, size_t n, size_t width, size_t* start) {
+    Regex* reverse = regex->reverse;
+    int state = DFA_DEAD;
+    size_t end = 0;
+    size_t k = 0;
+
+    while (end == 0) {
+        int next;
+
+        /* Nothing is in progress, so skip to where the next match could start */
+        if (state == DFA_DEAD) {
+            k = NextStart(regex, y, n, k, width);
+        }
+        if (k == n) {
+            return -1;
+        }
+        if (k % width == 0) {
+            next = regex->restarts[state];
+            state = (next < 0) ? Dfa_Restart(regex, state) : next;
+        }
+
+        next = regex->transitions[(state << 8) | y[k]];
+        state = (next < 0) ? Dfa_Step(regex, state, y[k]) : next;
+        k++;
+        if (regex->dfa[state].match) {
+            end = k;
+        }
+    }
+
+    /* Read the match back to where it starts */
+    state = DFA_START;
+    for (k = end; k > 0; k--) {
+        int next = reverse->transitions[(state << 8) | y[k - 1]];
+
+        state = (next < 0) ? Dfa_Step(reverse, state, y[k - 1]) : next;
+        if (state == DFA_DEAD) {
+            break;
+        }
+        if (reverse->dfa[state].match && (k - 1) % width == 0) {
+            *start = k - 1;
+        }
+    }
+    return end;
+}
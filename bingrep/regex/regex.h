@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Regex Regex;
+
+Regex* Regex_Compile(const char* pattern);
+void Regex_Destroy(Regex* regex);
+
+long Regex_Find(Regex* regex, const uint8_t* y, size_t n, size_t width, size_t* start);
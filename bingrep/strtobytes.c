@@ -1,25 +1,417 @@
+/**
+ * @file strtobytes.c
+ * @brief Convert UTF-8 text to bytes in a certain encoding, the reverse of bytestostr.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jis/jis.h"
+
+#define ARRAY_COUNT(arr) (sizeof(arr) / sizeof(arr[0]))
+
+typedef enum {
+    ENCODING_INVALID = -1,
+    ENCODING_ASCII,
+    ENCODING_UTF8,
+    ENCODING_SHIFT_JIS,
+    ENCODING_EUC_JP,
+    ENCODING_MAX,
+} Encoding;
+
+// clang-format off
+struct {
+    const char* name;
+    const Encoding num;
+} encodingNames[] = {
+    { "SJIS", ENCODING_SHIFT_JIS },
+    { "SHIFTJIS", ENCODING_SHIFT_JIS },
+    { "SHIFT_JIS", ENCODING_SHIFT_JIS },
+    { "SHIFT-JIS", ENCODING_SHIFT_JIS },
+    { "EUCJP", ENCODING_EUC_JP },
+    { "EUC-JP", ENCODING_EUC_JP },
+    { "EUC_JP", ENCODING_EUC_JP },
+    { "ASCII", ENCODING_ASCII },
+    { "UTF-8", ENCODING_UTF8 },
+    { "UTF8", ENCODING_UTF8 },
+    { "UTF_8", ENCODING_UTF8 },
+    { "", ENCODING_INVALID },
+};
+// clang-format on
+
+Encoding GetEncodingFromString(const char* str) {
+    char* upper = malloc(strlen(str) + 1);
+    char* ptr;
+    size_t i;
+    Encoding ret = ENCODING_INVALID;
+
+    strcpy(upper, str);
+
+    for (ptr = upper; *ptr != '\0'; ptr++) {
+        *ptr = toupper(*ptr);
+    }
+
+    for (i = 0; i < ARRAY_COUNT(encodingNames); i++) {
+        if (strcmp(upper, encodingNames[i].name) == 0) {
+            ret = encodingNames[i].num;
+            break;
+        }
+    }
+
+    free(upper);
+    return ret;
+}
+
+typedef size_t (*EncodeFunction)(const char* src, size_t srcSize, uint8_t* dst, int flags, size_t* srcUsed);
+
+/* Copies UTF-8 text up to the first character that is not ASCII, like the encoders in jis.c stop at one they cannot
+ * encode */
+size_t Ascii_EncodeFromUtf8(const char* src, size_t srcSize, uint8_t* dst, int flags, size_t* srcUsed) {
+    size_t i;
+
+    (void)flags;
+    for (i = 0; i < srcSize && (uint8_t)src[i] < 0x80; i++) {
+        dst[i] = src[i];
+    }
+    *srcUsed = i;
+    return i;
+}
+
+EncodeFunction builtinEncoders[ENCODING_MAX] = {
+    Ascii_EncodeFromUtf8,
+    NULL,
+    Sjis_EncodeFromUtf8,
+    EucJp_EncodeFromUtf8,
+};
+
+const char* encodingDisplayNames[ENCODING_MAX] = { "ASCII", "UTF-8", "Shift-JIS", "EUC-JP" };
+
+/* Flags passed to the built-in encoders */
+int encodeFlags = 0;
+
+/* Line of the input that encoding has reached, for error messages */
+size_t lineNumber = 1;
+
+/* Counts the newlines in text, to keep lineNumber up to date */
+void CountLines(const char* text, size_t length) {
+    const char* end = text + length;
+
+    while ((text = memchr(text, '\n', end - text)) != NULL) {
+        lineNumber++;
+        text++;
+    }
+}
+
+/**
+ * Reports the character at the start of text that could not be encoded.
+ *
+ * Returns its length, so that it can be skipped.
+ */
+size_t ReportUnencodable(const char* text, size_t length, Encoding encoding) {
+    const uint8_t* bytes = (const uint8_t*)text;
+    size_t charLength;
+    size_t i;
+
+    if (bytes[0] >= 0xC2 && bytes[0] < 0xE0) {
+        charLength = 2;
+    } else if (bytes[0] >= 0xE0 && bytes[0] < 0xF0) {
+        charLength = 3;
+    } else if (bytes[0] >= 0xF0 && bytes[0] < 0xF5) {
+        charLength = 4;
+    } else {
+        charLength = 0;
+    }
+
+    for (i = 1; i < charLength; i++) {
+        if (i >= length || (bytes[i] & 0xC0) != 0x80) {
+            charLength = 0;
+            break;
+        }
+    }
+
+    if (charLength == 0) {
+        fprintf(stderr, "Line %zu: invalid UTF-8 byte 0x%02X, skipping.\n", lineNumber, bytes[0]);
+        return 1;
+    }
+    fprintf(stderr, "Line %zu: '%.*s' has no %s encoding, skipping.\n", lineNumber, (int)charLength, text,
+            encodingDisplayNames[encoding]);
+    return charLength;
+}
+
+/**
+ * Encodes length bytes of UTF-8 text into dst, which must have room for JIS_MAX_ENCODED_SIZE(length) bytes, since
+ * EUC-JP can be longer than the UTF-8 it came from. Characters that cannot be encoded are reported and left out.
+ *
+ * Returns number of bytes written. failures is increased by the number of characters left out.
+ */
+size_t EncodeText(const char* text, size_t length, uint8_t* dst, Encoding encoding, size_t* failures) {
+    EncodeFunction encode = builtinEncoders[encoding];
+    uint8_t* out = dst;
+
+    if (encode == NULL) {
+        memcpy(dst, text, length);
+        CountLines(text, length);
+        return length;
+    }
+
+    while (length > 0) {
+        size_t used;
+        size_t skip;
+
+        out += encode(text, length, out, encodeFlags, &used);
+        CountLines(text, used);
+        text += used;
+        length -= used;
+        if (length == 0) {
+            break;
+        }
+
+        skip = ReportUnencodable(text, length, encoding);
+        (*failures)++;
+        text += skip;
+        length -= skip;
+    }
+
+    return out - dst;
+}
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+char* WriteHex(char* dst, const uint8_t* bytes, size_t length) {
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        *dst++ = hexDigits[bytes[i] >> 4];
+        *dst++ = hexDigits[bytes[i] & 0xF];
+    }
+    return dst;
+}
+
+/**
+ * Reads all of file into a newly-allocated buffer, so that pipes can be read as well as regular files.
+ *
+ * Returns the buffer, or NULL on failure.
+ */
+char* ReadWholeFile(FILE* file, size_t* size) {
+    size_t capacity = 0x10000;
+    char* buffer = malloc(capacity);
+    size_t read;
+
+    *size = 0;
+    while ((read = fread(buffer + *size, 1, capacity - *size, file)) > 0) {
+        *size += read;
+        if (*size == capacity) {
+            capacity *= 2;
+            buffer = realloc(buffer, capacity);
+        }
+    }
+    if (ferror(file)) {
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+/**
+ * Encodes all of text and writes it to output in one go. In binary mode the encoded bytes are written as they are,
+ * newlines included; otherwise each line of text becomes a line of hex digits, as bytestostr -s reads them.
+ *
+ * Returns number of characters that could not be encoded.
+ */
+size_t ConvertText(const char* text, size_t size, Encoding encoding, bool binary, FILE* output) {
+    uint8_t* encoded = malloc(JIS_MAX_ENCODED_SIZE(size) + 1);
+    size_t failures = 0;
+
+    if (binary) {
+        size_t length = EncodeText(text, size, encoded, encoding, &failures);
+
+        fwrite(encoded, 1, length, output);
+    } else {
+        /* Two digits per encoded byte, and a newline for the last line if it had none */
+        char* hex = malloc(2 * JIS_MAX_ENCODED_SIZE(size) + 1);
+        char* out = hex;
+        size_t pos = 0;
+
+        while (pos < size) {
+            const char* newline = memchr(text + pos, '\n', size - pos);
+            size_t lineLength = (newline != NULL) ? (size_t)(newline - (text + pos)) : size - pos;
+            size_t textLength = lineLength;
+            size_t length;
+
+            /* Scripts edited on Windows have CRLF line endings */
+            if (textLength > 0 && text[pos + textLength - 1] == '\r') {
+                textLength--;
+            }
+            length = EncodeText(text + pos, textLength, encoded, encoding, &failures);
+
+            out = WriteHex(out, encoded, length);
+            *out++ = '\n';
+            lineNumber++;
+            pos += lineLength + 1;
+        }
+
+        fwrite(hex, 1, out - hex, output);
+        free(hex);
+    }
+
+    free(encoded);
+    return failures;
+}
+
+struct option longOpts[] = {
+    { "binary", no_argument, NULL, 'b' },
+    { "escape-control", no_argument, NULL, 'c' },
+    { "encoding", required_argument, NULL, 'e' },
+    { "file", required_argument, NULL, 'f' },
+    { "output", required_argument, NULL, 'o' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
 
 int main(int argc, char** argv) {
+    int opt;
+    Encoding encoding = ENCODING_ASCII;
+    const char* encodingString = NULL;
+    const char* inputPath = NULL;
+    const char* outputPath = NULL;
+    bool binary = false;
     char* string;
-    if (argc < 2) {
-        printf("Usage: %s STRING", argv[0]);
+    uint8_t* encoded;
+    size_t length;
+    size_t failures = 0;
+    size_t i;
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "bce:f:o:h", longOpts, &optionIndex)) == -1) {
+            break;
+        }
+
+        switch (opt) {
+            case 'b':
+                binary = true;
+                break;
+
+            case 'c':
+                encodeFlags |= JIS_ESCAPE_CONTROL;
+                break;
+
+            case 'e':
+                encodingString = optarg;
+                break;
+
+            case 'f':
+                inputPath = optarg;
+                break;
+
+            case 'o':
+                outputPath = optarg;
+                break;
+
+            case 'h':
+                printf("Usage: %s STRING [ENCODING]\n"
+                       "       %s -f FILE [-b] [-o FILE] [ENCODING]\n",
+                       argv[0], argv[0]);
+                puts("Convert UTF-8 text to bytes in ENCODING (default ASCII).\n"
+                     "\n"
+                     "Options\n"
+                     "  -e, --encoding=ENCODING   encoding of the output bytes: SJIS, EUC-JP, ASCII or UTF-8\n"
+                     "  -c, --escape-control      read \\xNN in the text as the byte NN, and \\\\ as a backslash,\n"
+                     "                            for control codes (SJIS and EUC-JP only)\n"
+                     "  -f, --file=FILE           convert the whole of FILE ('-' for stdin), writing each line as a\n"
+                     "                            line of hex digits that bytestostr -s can read back\n"
+                     "  -b, --binary              with -f, write the encoded bytes themselves instead of hex\n"
+                     "  -o, --output=FILE         with -f, write to FILE instead of stdout\n"
+                     "  -h, --help                print this message and exit\n");
+                return 1;
+
+            default:
+                break;
+        }
+    }
+
+    if (inputPath == NULL && optind >= argc) {
+        printf("Usage: %s STRING [ENCODING]\n", argv[0]);
         return 1;
     }
 
-    string = argv[1];
-    while (*string != '\0') {
-        printf("%c  ", *string);
-        string++;
+    if (encodingString == NULL && optind + (inputPath != NULL ? 0 : 1) < argc) {
+        encodingString = argv[optind + (inputPath != NULL ? 0 : 1)];
+    }
+    if (encodingString != NULL) {
+        encoding = GetEncodingFromString(encodingString);
+        if (encoding == ENCODING_INVALID) {
+            fprintf(stderr, "Unknown encoding \"%s\"\n", encodingString);
+            return 1;
+        }
+    }
+
+    if (inputPath != NULL) {
+        FILE* input = stdin;
+        FILE* output = stdout;
+        char* text;
+        size_t size;
+        bool written;
+
+        if (strcmp(inputPath, "-") != 0 && (input = fopen(inputPath, "rb")) == NULL) {
+            fprintf(stderr, "Failed to open file %s\n", inputPath);
+            return 1;
+        }
+        text = ReadWholeFile(input, &size);
+        if (input != stdin) {
+            fclose(input);
+        }
+        if (text == NULL) {
+            fprintf(stderr, "Failed to read file %s\n", inputPath);
+            return 1;
+        }
+
+        if (outputPath != NULL && (output = fopen(outputPath, "wb")) == NULL) {
+            fprintf(stderr, "Failed to open file %s\n", outputPath);
+            free(text);
+            return 1;
+        }
+
+        failures = ConvertText(text, size, encoding, binary, output);
+        free(text);
+
+        /* Buffered output is only written by fclose or fflush, which can fail too */
+        written = !ferror(output);
+        if ((output != stdout) ? fclose(output) != 0 : fflush(output) != 0) {
+            written = false;
+        }
+        if (!written) {
+            fprintf(stderr, "Failed to write file %s\n", (outputPath != NULL) ? outputPath : "stdout");
+            return 1;
+        }
+        return failures != 0;
+    }
+
+    string = argv[optind];
+    length = strlen(string);
+    encoded = malloc(JIS_MAX_ENCODED_SIZE(length) + 1);
+    length = EncodeText(string, length, encoded, encoding, &failures);
+
+    /* Line the characters up with their bytes when there is one of each */
+    if (encoding == ENCODING_ASCII || encoding == ENCODING_UTF8) {
+        for (i = 0; i < length; i++) {
+            printf("%c  ", encoded[i]);
+        }
+        puts("\\0");
     }
-    puts("\\0");
 
-    string = argv[1];
-    while (*string != '\0') {
-        printf("%02X ", *string);
-        string++;
+    for (i = 0; i < length; i++) {
+        printf("%02X ", encoded[i]);
     }
     puts("00");
 
-    return 0;
+    free(encoded);
+    return failures != 0;
 }
@@ -4,12 +4,9 @@ colorama.init()
 
 import argparse
 import os
-import re
 import collections
 
-regex_fileDataEntry = re.compile(r"^\s+(?P<section>[^\s]+)\s+(?P<vram>0x[^\s]+)\s+(?P<size>0x[^\s]+)\s+(?P<name>[^\s]+)$")
-regex_bssEntry = re.compile(r"^\s+(?P<vram>0x[^\s]+)\s+(?P<name>[^\s]+)$")
-regex_label = re.compile(r"^(?P<name>L[0-9A-F]{8})$")
+import mapfile
 
 
 File = collections.namedtuple("File", ["name", "vram", "bssVariables"])
@@ -18,51 +15,19 @@ Variable = collections.namedtuple("Variable", ["name", "vram"])
 Compared = collections.namedtuple("Compared", ["expected", "build", "diff"])
 
 
-def parseMapFile(mapPath: str):
-    with open(mapPath) as f:
-        mapData = f.read()
-        startIndex = mapData.find("..makerom")
-        mapData = mapData[startIndex:]
-    # print(len(mapData))
-
+def parseMapFile(mapPath: str, useSnapshot: bool = False):
     filesList = list()
 
-    inFile = False
-
-    mapLines = mapData.split("\n")
-    for line in mapLines:
-        if inFile:
-            if line.startswith("                "):
-                entryMatch = regex_bssEntry.search(line)
-
-                # Find function
-                if entryMatch is not None:
-                    varName = entryMatch["name"]
-                    varVram = int(entryMatch["vram"], 16)
-
-                    # Filter out jump table labels
-                    labelMatch = regex_label.search(varName)
-                    if labelMatch is None:
-                        filesList[-1].bssVariables[varName] = varVram # append(Variable(varName, varVram))
-                    # print(hex(funcVram), funcName)
-
-            else:
-                inFile = False
-        else:
-            if line.startswith(" .bss "):
-                inFile = False
-                entryMatch = regex_fileDataEntry.search(line)
-
-                # Find file
-                if entryMatch is not None:
-                    name = "/".join(entryMatch["name"].split("/")[2:])
-                    name = ".".join(name.split(".")[:-1])
-                    size = int(entryMatch["size"], 16)
-                    vram = int(entryMatch["vram"], 16)
-
-                    if size > 0:
-                        inFile = True
-                        filesList.append(File(name, vram, collections.OrderedDict()))
+    for entry in mapfile.MapFile(mapPath, "..makerom", filterLabels=True, sectionFilter=".bss", useSnapshot=useSnapshot).entries:
+        # Find file
+        name = "/".join(entry.name.split("/")[2:])
+        name = ".".join(name.split(".")[:-1])
+
+        if entry.size > 0:
+            bssVariables = collections.OrderedDict()
+            for symbol in entry.symbols:
+                bssVariables[symbol.name] = symbol.vram
+            filesList.append(File(name, entry.vram, bssVariables))
 
     resultFileDict = dict()
 
@@ -78,7 +43,7 @@ def parseMapFile(mapPath: str):
     return resultFileDict
 
 
-def compareMapFiles(mapFileBuild: str, mapFileExpected: str):
+def compareMapFiles(mapFileBuild: str, mapFileExpected: str, useSnapshot: bool = True):
     isOkay = dict()
 
     print("Build mapfile:    " + mapFileBuild, file=os.sys.stderr)
@@ -86,7 +51,7 @@ def compareMapFiles(mapFileBuild: str, mapFileExpected: str):
     print("", file=os.sys.stderr)
 
     buildMap = parseMapFile(mapFileBuild)
-    expectedMap = parseMapFile(mapFileExpected)
+    expectedMap = parseMapFile(mapFileExpected, useSnapshot)
 
     comparedDict = collections.OrderedDict()
 
@@ -163,9 +128,10 @@ def main():
     parser.add_argument("mapFileExpected", help="Path to the expected map file.")
     parser.add_argument("-a", "--print-all", help="Print all bss, not just non-matching.", action="store_true")
     parser.add_argument("-n", "--no-fun-allowed", help="Remove amusing messages.", action="store_true")
+    parser.add_argument("-S", "--no-snapshot", help="Parse the expected map file instead of loading the snapshot saved next to it, and do not save one.", action="store_true")
     args = parser.parse_args()
 
-    isOkay, comparedDict = compareMapFiles(args.mapfile, args.mapFileExpected)
+    isOkay, comparedDict = compareMapFiles(args.mapfile, args.mapFileExpected, not args.no_snapshot)
 
     if printCsv(isOkay, comparedDict, args.print_all):
         print(colorama.Fore.LIGHTGREEN_EX + "  GOOD" + colorama.Style.RESET_ALL)
@@ -0,0 +1,589 @@
+/**
+ * @file dataextract.c
+ * @brief Native version of data_extractor.py: prints an array of structs from a binary file as C initialisers.
+ *
+ * The Python struct format is compiled once into a list of fields with their offsets, widths, signedness and byte
+ * order, and the file is mapped into memory, so every element is decoded by the same short loop over the fields and
+ * written straight into an output buffer. A batch file of many extractions can be run in one go.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define OUTPUT_BUFFER_SIZE 0x40000
+/* Enough for a row of one field: ", -0x8000000000000000" */
+#define MAX_FIELD_TEXT 24
+
+typedef enum {
+    /* By width, then byte order, then signedness, so the loader can be picked with arithmetic */
+    LOAD_U8,
+    LOAD_S8,
+    LOAD_BOOL,
+    LOAD_U16_LE,
+    LOAD_S16_LE,
+    LOAD_U16_BE,
+    LOAD_S16_BE,
+    LOAD_U32_LE,
+    LOAD_S32_LE,
+    LOAD_U32_BE,
+    LOAD_S32_BE,
+    LOAD_U64_LE,
+    LOAD_S64_LE,
+    LOAD_U64_BE,
+    LOAD_S64_BE,
+} LoadKind;
+
+typedef struct {
+    uint32_t offset; /* From the start of the element */
+    LoadKind kind;
+    bool isSigned;
+} Field;
+
+/* A struct format compiled into the fields it reads */
+typedef struct {
+    Field* fields;
+    size_t fieldCount;
+    size_t fieldCapacity;
+    size_t size; /* Of one element, what struct.calcsize() gives */
+} Layout;
+
+typedef struct {
+    char* data;
+    size_t length;
+    FILE* file;
+} OutputBuffer;
+
+static void Output_Flush(OutputBuffer* out) {
+    fwrite(out->data, 1, out->length, out->file);
+    out->length = 0;
+}
+
+static void Output_Append(OutputBuffer* out, const char* str, size_t length) {
+    if (out->length + length > OUTPUT_BUFFER_SIZE) {
+        Output_Flush(out);
+    }
+    memcpy(out->data + out->length, str, length);
+    out->length += length;
+}
+
+/**
+ * Writes value in the form Python's hex() gives: lowercase, no leading zeroes, and a minus sign before the 0x for
+ * negative numbers. Returns the number of characters written, at most 19.
+ */
+static size_t FormatHex(char* dst, uint64_t value, bool isNegative) {
+    static const char digits[] = "0123456789abcdef";
+    char reversed[16];
+    size_t count = 0;
+    size_t length = 0;
+
+    if (isNegative) {
+        dst[length++] = '-';
+        value = -value;
+    }
+    dst[length++] = '0';
+    dst[length++] = 'x';
+    do {
+        reversed[count++] = digits[value & 0xF];
+        value >>= 4;
+    } while (value != 0);
+    while (count != 0) {
+        dst[length++] = reversed[--count];
+    }
+    return length;
+}
+
+static void Layout_AddField(Layout* layout, size_t offset, LoadKind kind, bool isSigned) {
+    if (layout->fieldCount == layout->fieldCapacity) {
+        layout->fieldCapacity = 2 * layout->fieldCapacity + 8;
+        layout->fields = realloc(layout->fields, layout->fieldCapacity * sizeof(Field));
+    }
+    layout->fields[layout->fieldCount].offset = offset;
+    layout->fields[layout->fieldCount].kind = kind;
+    layout->fields[layout->fieldCount].isSigned = isSigned;
+    layout->fieldCount++;
+}
+
+/**
+ * Compiles a Python struct format into layout, with the same sizes, alignment and byte order struct.calcsize() and
+ * struct.unpack() would use on this machine. Only integer and bool fields are accepted, since the script passes every
+ * value to hex().
+ *
+ * Returns 0 on success, -1 on an invalid or unsupported format, which is reported.
+ */
+int Layout_Compile(Layout* layout, const char* format) {
+    bool native = true;
+    bool bigEndian = false;
+    size_t offset = 0;
+    const char* p = format;
+
+    memset(layout, 0, sizeof(*layout));
+
+    switch (*p) {
+        case '@':
+            p++;
+            break;
+
+        case '=':
+            native = false;
+            p++;
+            break;
+
+        case '<':
+            native = false;
+            p++;
+            break;
+
+        case '>':
+        case '!':
+            native = false;
+            bigEndian = true;
+            p++;
+            break;
+
+        default:
+            break;
+    }
+    if (native || format[0] == '=') {
+        uint16_t probe = 1;
+
+        bigEndian = *(uint8_t*)&probe == 0;
+    }
+
+    while (*p != '\0') {
+        size_t count = 1;
+        size_t width;
+        size_t alignment;
+        bool isSigned = false;
+        size_t i;
+
+        if (isspace((unsigned char)*p)) {
+            p++;
+            continue;
+        }
+        if (isdigit((unsigned char)*p)) {
+            count = strtoul(p, (char**)&p, 10);
+            if (*p == '\0') {
+                fprintf(stderr, "Format '%s': repeat count given without format specifier\n", format);
+                return -1;
+            }
+        }
+
+        switch (*p) {
+            case 'x':
+            case 'b':
+            case 'B':
+            case '?':
+                width = 1;
+                alignment = 1;
+                break;
+
+            case 'h':
+            case 'H':
+                width = 2;
+                alignment = native ? _Alignof(short) : 1;
+                break;
+
+            case 'i':
+            case 'I':
+                width = native ? sizeof(int) : 4;
+                alignment = native ? _Alignof(int) : 1;
+                break;
+
+            case 'l':
+            case 'L':
+                width = native ? sizeof(long) : 4;
+                alignment = native ? _Alignof(long) : 1;
+                break;
+
+            case 'q':
+            case 'Q':
+                width = 8;
+                alignment = native ? _Alignof(long long) : 1;
+                break;
+
+            case 'n':
+            case 'N':
+            case 'P':
+                if (!native) {
+                    fprintf(stderr, "Format '%s': '%c' is only allowed in native mode\n", format, *p);
+                    return -1;
+                }
+                width = (*p == 'P') ? sizeof(void*) : sizeof(size_t);
+                alignment = (*p == 'P') ? _Alignof(void*) : _Alignof(size_t);
+                break;
+
+            case 'c':
+            case 's':
+            case 'p':
+            case 'e':
+            case 'f':
+            case 'd':
+                fprintf(stderr, "Format '%s': '%c' fields cannot be printed in hex\n", format, *p);
+                return -1;
+
+            default:
+                fprintf(stderr, "Format '%s': bad char '%c' in struct format\n", format, *p);
+                return -1;
+        }
+
+        isSigned = (*p == 'b' || *p == 'h' || *p == 'i' || *p == 'l' || *p == 'q' || *p == 'n');
+        offset = (offset + alignment - 1) / alignment * alignment;
+        if (*p == 'x') {
+            offset += count;
+        } else {
+            for (i = 0; i < count; i++, offset += width) {
+                LoadKind kind;
+
+                if (*p == '?') {
+                    kind = LOAD_BOOL;
+                } else if (width == 1) {
+                    kind = isSigned ? LOAD_S8 : LOAD_U8;
+                } else {
+                    /* LOAD_U16_LE, LOAD_U32_LE and LOAD_U64_LE are 4 apart */
+                    kind = LOAD_U16_LE + 4 * ((width == 2) ? 0 : (width == 4) ? 1 : 2) + 2 * bigEndian + isSigned;
+                }
+                Layout_AddField(layout, offset, kind, isSigned);
+            }
+        }
+        p++;
+    }
+
+    layout->size = offset;
+    return 0;
+}
+
+void Layout_Destroy(Layout* layout) {
+    free(layout->fields);
+}
+
+static uint16_t Load16(const uint8_t* src, bool bigEndian) {
+    return bigEndian ? (src[0] << 8) | src[1] : src[0] | (src[1] << 8);
+}
+
+static uint32_t Load32(const uint8_t* src, bool bigEndian) {
+    return bigEndian ? ((uint32_t)src[0] << 24) | (src[1] << 16) | (src[2] << 8) | src[3]
+                     : src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+static uint64_t Load64(const uint8_t* src, bool bigEndian) {
+    return bigEndian ? ((uint64_t)Load32(src, true) << 32) | Load32(src + 4, true)
+                     : Load32(src, false) | ((uint64_t)Load32(src + 4, false) << 32);
+}
+
+/**
+ * Prints count elements of layout from data as "{ 0x.., 0x.. }," lines, like the script.
+ */
+void ExtractArray(OutputBuffer* out, const uint8_t* data, const Layout* layout, size_t count) {
+    char* dst = out->data + out->length;
+    char* const flushPoint = out->data + OUTPUT_BUFFER_SIZE - MAX_FIELD_TEXT;
+    size_t i;
+    size_t j;
+
+    /* Output_Append may have left the buffer fuller than the checks below allow for */
+    if (dst >= flushPoint) {
+        Output_Flush(out);
+        dst = out->data;
+    }
+
+    for (i = 0; i < count; i++, data += layout->size) {
+        *dst++ = '{';
+        *dst++ = ' ';
+        for (j = 0; j < layout->fieldCount; j++) {
+            const Field* field = &layout->fields[j];
+            const uint8_t* src = data + field->offset;
+            uint64_t value;
+
+            switch (field->kind) {
+                case LOAD_U8:
+                    value = src[0];
+                    break;
+
+                case LOAD_S8:
+                    value = (int64_t)(int8_t)src[0];
+                    break;
+
+                case LOAD_BOOL:
+                    value = src[0] != 0;
+                    break;
+
+                case LOAD_U16_LE:
+                    value = Load16(src, false);
+                    break;
+
+                case LOAD_S16_LE:
+                    value = (int64_t)(int16_t)Load16(src, false);
+                    break;
+
+                case LOAD_U16_BE:
+                    value = Load16(src, true);
+                    break;
+
+                case LOAD_S16_BE:
+                    value = (int64_t)(int16_t)Load16(src, true);
+                    break;
+
+                case LOAD_U32_LE:
+                    value = Load32(src, false);
+                    break;
+
+                case LOAD_S32_LE:
+                    value = (int64_t)(int32_t)Load32(src, false);
+                    break;
+
+                case LOAD_U32_BE:
+                    value = Load32(src, true);
+                    break;
+
+                case LOAD_S32_BE:
+                    value = (int64_t)(int32_t)Load32(src, true);
+                    break;
+
+                case LOAD_U64_LE:
+                case LOAD_S64_LE:
+                    value = Load64(src, false);
+                    break;
+
+                case LOAD_U64_BE:
+                case LOAD_S64_BE:
+                default:
+                    value = Load64(src, true);
+                    break;
+            }
+
+            if (j != 0) {
+                *dst++ = ',';
+                *dst++ = ' ';
+            }
+            dst += FormatHex(dst, value, field->isSigned && (int64_t)value < 0);
+            if (dst >= flushPoint) {
+                out->length = dst - out->data;
+                Output_Flush(out);
+                dst = out->data;
+            }
+        }
+        memcpy(dst, " },\n", 4);
+        dst += 4;
+        if (dst >= flushPoint) {
+            out->length = dst - out->data;
+            Output_Flush(out);
+            dst = out->data;
+        }
+    }
+    out->length = dst - out->data;
+}
+
+/**
+ * Compiles format and prints count elements of it from offset in data, checking they are all inside it.
+ *
+ * Returns 0 on success, -1 on failure, which is reported.
+ */
+int Extract(OutputBuffer* out, const uint8_t* data, size_t dataSize, size_t offset, const char* format, size_t count) {
+    Layout layout;
+
+    if (Layout_Compile(&layout, format) != 0) {
+        Layout_Destroy(&layout);
+        return -1;
+    }
+    if (offset > dataSize || (layout.size != 0 && count > (dataSize - offset) / layout.size)) {
+        fprintf(stderr, "%zu elements of '%s' (0x%zX bytes each) at 0x%zX run past the end of the file (0x%zX bytes)\n",
+                count, format, layout.size, offset, dataSize);
+        Layout_Destroy(&layout);
+        return -1;
+    }
+
+    ExtractArray(out, data + offset, &layout, count);
+    Layout_Destroy(&layout);
+    return 0;
+}
+
+/* Parses the whole of string as a number in base. Returns 0 on success, -1 if it is not one or does not fit. */
+static int ParseSize(const char* string, int base, size_t* value) {
+    char* end;
+
+    errno = 0;
+    *value = strtoull(string, &end, base);
+    if (string[0] == '\0' || string[0] == '-' || isspace((unsigned char)string[0]) || *end != '\0' || errno == ERANGE) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Runs every extraction in the batch file at path, one per line as "OFFSET FORMAT COUNT" with the same meaning as the
+ * arguments, each printed after a comment holding that line. Empty lines and lines starting with '#' are skipped.
+ *
+ * Returns 0 on success, -1 if any extraction failed.
+ */
+int RunBatch(OutputBuffer* out, const uint8_t* data, size_t dataSize, const char* path) {
+    FILE* batchFile = fopen(path, "r");
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    size_t lineNumber = 0;
+    int ret = 0;
+
+    if (batchFile == NULL) {
+        fprintf(stderr, "Failed to open batch file %s\n", path);
+        return -1;
+    }
+
+    while (getline(&line, &lineCapacity, batchFile) >= 0) {
+        char* savePtr = NULL;
+        char* offsetString = strtok_r(line, " \t\r\n", &savePtr);
+        char* format = strtok_r(NULL, " \t\r\n", &savePtr);
+        char* countString = strtok_r(NULL, " \t\r\n", &savePtr);
+        char* comment;
+        size_t offset;
+        size_t count;
+
+        lineNumber++;
+        if (offsetString == NULL || offsetString[0] == '#') {
+            continue;
+        }
+        if (countString == NULL || strtok_r(NULL, " \t\r\n", &savePtr) != NULL) {
+            fprintf(stderr, "%s:%zu: expected OFFSET FORMAT COUNT\n", path, lineNumber);
+            ret = -1;
+            continue;
+        }
+        if (ParseSize(offsetString, 16, &offset) != 0) {
+            fprintf(stderr, "%s:%zu: bad offset '%s'\n", path, lineNumber, offsetString);
+            ret = -1;
+            continue;
+        }
+        if (ParseSize(countString, 10, &count) != 0) {
+            fprintf(stderr, "%s:%zu: bad count '%s'\n", path, lineNumber, countString);
+            ret = -1;
+            continue;
+        }
+
+        comment = malloc(strlen(offsetString) + strlen(format) + strlen(countString) + sizeof("/*    */\n"));
+        Output_Append(out, comment, sprintf(comment, "/* %s %s %s */\n", offsetString, format, countString));
+        free(comment);
+        if (Extract(out, data, dataSize, offset, format, count) != 0) {
+            ret = -1;
+        }
+    }
+
+    free(line);
+    fclose(batchFile);
+    return ret;
+}
+
+/* Maps the whole file at path read-only; an empty file gives a NULL mapping. Returns 0 on success, -1 on failure. */
+static int MapWholeFile(const char* path, void** data, size_t* size) {
+    int fd;
+    struct stat fileStat;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    *size = fileStat.st_size;
+    *data = NULL;
+    if (*size != 0) {
+        *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    return (*data == MAP_FAILED) ? -1 : 0;
+}
+
+const struct option longOptions[] = {
+    { "batch", required_argument, NULL, 'b' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
+
+int main(int argc, char** argv) {
+    int opt;
+    const char* batchPath = NULL;
+    size_t offset = 0;
+    size_t count = 0;
+    void* data;
+    size_t dataSize;
+    OutputBuffer out;
+    int ret;
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "b:h", longOptions, &optionIndex)) == EOF) {
+            break;
+        }
+
+        switch (opt) {
+            case 'b':
+                batchPath = optarg;
+                break;
+
+            case 'h':
+                fprintf(stderr, "%s FILE OFFSET FORMAT COUNT\n%s -b BATCH FILE\n", argv[0], argv[0]);
+                puts("Extract an array of data from a binary file using a specified format.\n"
+                     "Arguments:\n"
+                     "  FILE    Binary file to extract from.\n"
+                     "  OFFSET  Address into binary to start extraction, in hex.\n"
+                     "  FORMAT  Python format-reading string denoting the structure of one element.\n"
+                     "  COUNT   Number of entries to extract.\n"
+                     "Options:\n"
+                     "  -b, --batch BATCH  Run the extractions in BATCH, one 'OFFSET FORMAT COUNT' per line.\n"
+                     "  -h, --help         Display this message and exit.\n");
+                return 1;
+
+            default:
+                fprintf(stderr, "Getopt returned character code: 0x%X", opt);
+        }
+    }
+
+    if (argc - optind != ((batchPath != NULL) ? 1 : 4)) {
+        fprintf(stderr, "Wrong number of arguments, see %s --help\n", argv[0]);
+        return 1;
+    }
+    if (batchPath == NULL) {
+        if (ParseSize(argv[optind + 1], 16, &offset) != 0) {
+            fprintf(stderr, "Bad offset '%s'\n", argv[optind + 1]);
+            return 1;
+        }
+        if (ParseSize(argv[optind + 3], 10, &count) != 0) {
+            fprintf(stderr, "Bad count '%s'\n", argv[optind + 3]);
+            return 1;
+        }
+    }
+
+    if (MapWholeFile(argv[optind], &data, &dataSize) != 0) {
+        fprintf(stderr, "Failed to read %s\n", argv[optind]);
+        return 1;
+    }
+    if (data != NULL) {
+        madvise(data, dataSize, MADV_SEQUENTIAL);
+    }
+
+    out.data = malloc(OUTPUT_BUFFER_SIZE);
+    out.length = 0;
+    out.file = stdout;
+    if (batchPath != NULL) {
+        ret = RunBatch(&out, data, dataSize, batchPath);
+    } else {
+        ret = Extract(&out, data, dataSize, offset, argv[optind + 2], count);
+    }
+    Output_Flush(&out);
+    fflush(stdout);
+
+    free(out.data);
+    if (data != NULL) {
+        munmap(data, dataSize);
+    }
+    return (ret == 0) ? 0 : 1;
+}
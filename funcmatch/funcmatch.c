@@ -0,0 +1,625 @@
+/**
+ * @file funcmatch.c
+ * @brief Finds the functions of one ROM in another version of it, ignoring the addresses that move between versions.
+ *
+ * The functions are taken from the map file of the source ROM. Their instructions are compared with the fields that
+ * relocations fill in (jump targets, lui and addiu immediates, and load/store offsets not relative to $sp) masked
+ * out. The target ROM is indexed once: every run of WINDOW_LENGTH instructions is hashed with a rolling hash, and the
+ * smallest hash of each WINNOW_LENGTH consecutive windows is kept as a fingerprint. A function then votes for the
+ * places in the target where its fingerprints occur, and the best voted places are scored by how many masked
+ * instructions they have in common with it. Functions are matched in parallel. Those shorter than WINDOW_LENGTH
+ * instructions have no fingerprints, and are listed without a match.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapfile.h"
+#include "romfile/romfile.h"
+#include "workpool/workpool.h"
+
+/* Instructions hashed together */
+#define WINDOW_LENGTH 8
+/* Consecutive windows of which the smallest hash is kept */
+#define WINNOW_LENGTH 4
+/* Fingerprints found more often than this in the target (padding, nops) say nothing about where a function is */
+#define MAX_FINGERPRINT_HITS 64
+/* Places scored per function, by votes */
+#define MAX_SCORED_CANDIDATES 16
+
+#define HASH_PRIME 0x100000001B3ull
+
+#define REG_SP 29
+
+#define USAGE "%s -m MAPFILE [-s STRING] [-c NUM] [-t MIN] [-j NUM] [-S] SOURCEROM TARGETROM [FUNCTION...]\n"
+
+typedef struct {
+    uint32_t hash;
+    uint32_t position; /* In instructions from the start of the ROM */
+} Fingerprint;
+
+/* Fingerprints of the target ROM, bucketed by the low bits of their hash */
+typedef struct {
+    uint32_t* masked; /* Masked instructions of the whole ROM */
+    size_t wordCount;
+    uint32_t* windowHashes;
+    Fingerprint* fingerprints;
+    uint32_t* bucketStarts; /* bucketCount + 1 of them */
+    uint32_t bucketMask;
+} TargetIndex;
+
+typedef struct {
+    const char* name; /* In the map */
+    uint32_t rom;
+    uint32_t size;
+} Function;
+
+typedef struct {
+    uint32_t rom;
+    uint32_t votes;
+    double similarity;
+    bool exact;
+} Candidate;
+
+typedef struct {
+    const uint8_t* sourceRom;
+    const uint8_t* targetRom;
+    TargetIndex* index;
+    Function* functions;
+    Candidate* results; /* candidateCount for each function, rom 0xFFFFFFFF where there are fewer */
+    size_t candidateCount;
+} MatchJob;
+
+/**
+ * Zeroes the parts of a MIPS instruction that differ between versions of a ROM because something moved: the targets
+ * of j and jal, the immediates of lui and addiu that make up addresses, and the offsets of loads and stores, except
+ * those from $sp, which stay the same.
+ */
+static inline uint32_t MaskInstruction(uint32_t word) {
+    uint32_t opcode = word >> 26;
+    uint32_t rs = (word >> 21) & 0x1F;
+
+    switch (opcode) {
+        case 0x02: /* j */
+        case 0x03: /* jal */
+            return word & 0xFC000000;
+
+        case 0x0F: /* lui */
+            return word & 0xFFFF0000;
+
+        case 0x09: /* addiu */
+        case 0x20: /* lb */
+        case 0x21: /* lh */
+        case 0x22: /* lwl */
+        case 0x23: /* lw */
+        case 0x24: /* lbu */
+        case 0x25: /* lhu */
+        case 0x26: /* lwr */
+        case 0x27: /* lwu */
+        case 0x28: /* sb */
+        case 0x29: /* sh */
+        case 0x2A: /* swl */
+        case 0x2B: /* sw */
+        case 0x2E: /* swr */
+        case 0x31: /* lwc1 */
+        case 0x35: /* ldc1 */
+        case 0x37: /* ld */
+        case 0x39: /* swc1 */
+        case 0x3D: /* sdc1 */
+        case 0x3F: /* sd */
+            return (rs == REG_SP) ? word : (word & 0xFFFF0000);
+
+        default:
+            return word;
+    }
+}
+
+/* Spreads the bits of a window hash so the smallest ones are not biased towards any instruction */
+static inline uint32_t MixHash(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return (uint32_t)hash;
+}
+
+/* HASH_PRIME to the power WINDOW_LENGTH - 1, for taking the first instruction out of a rolling hash */
+static uint64_t GetLeadingPower(void) {
+    uint64_t power = 1;
+    int i;
+
+    for (i = 0; i < WINDOW_LENGTH - 1; i++) {
+        power *= HASH_PRIME;
+    }
+    return power;
+}
+
+/**
+ * Hashes every run of WINDOW_LENGTH instructions of masked, count - WINDOW_LENGTH + 1 of them, into hashes.
+ */
+void HashWindows(const uint32_t* masked, size_t count, uint32_t* hashes) {
+    uint64_t leadingPower = GetLeadingPower();
+    uint64_t hash = 0;
+    size_t i;
+
+    if (count < WINDOW_LENGTH) {
+        return;
+    }
+    for (i = 0; i < WINDOW_LENGTH; i++) {
+        hash = hash * HASH_PRIME + masked[i];
+    }
+    hashes[0] = MixHash(hash);
+    for (i = WINDOW_LENGTH; i < count; i++) {
+        hash = (hash - masked[i - WINDOW_LENGTH] * leadingPower) * HASH_PRIME + masked[i];
+        hashes[i - WINDOW_LENGTH + 1] = MixHash(hash);
+    }
+}
+
+/**
+ * Picks the fingerprints of hashCount window hashes: the smallest hash of every WINNOW_LENGTH consecutive ones (the
+ * last of equal ones), each once. Two runs of instructions sharing at least WINDOW_LENGTH + WINNOW_LENGTH - 1
+ * instructions then share a fingerprint.
+ *
+ * Returns the number of fingerprints, written to positions as indices into hashes.
+ */
+size_t Winnow(const uint32_t* hashes, size_t hashCount, uint32_t* positions) {
+    size_t winnowLength = (hashCount < WINNOW_LENGTH) ? hashCount : WINNOW_LENGTH;
+    size_t count = 0;
+    size_t minimum = SIZE_MAX;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i + winnowLength <= hashCount; i++) {
+        if (minimum == SIZE_MAX || minimum < i) {
+            /* The last minimum left the span, look through all of it again */
+            minimum = i;
+            for (j = i + 1; j < i + winnowLength; j++) {
+                if (hashes[j] <= hashes[minimum]) {
+                    minimum = j;
+                }
+            }
+        } else if (hashes[i + winnowLength - 1] <= hashes[minimum]) {
+            minimum = i + winnowLength - 1;
+        }
+
+        if (count == 0 || positions[count - 1] != minimum) {
+            positions[count++] = minimum;
+        }
+    }
+    return count;
+}
+
+typedef struct {
+    const uint8_t* rom;
+    TargetIndex* index;
+    size_t chunkLength; /* In instructions */
+} IndexJob;
+
+/* Masks the instructions of one chunk of the target ROM */
+void MaskChunk(void* arg, size_t chunk) {
+    IndexJob* job = arg;
+    TargetIndex* index = job->index;
+    size_t start = chunk * job->chunkLength;
+    size_t end = (start + job->chunkLength < index->wordCount) ? start + job->chunkLength : index->wordCount;
+    size_t i;
+
+    for (i = start; i < end; i++) {
+        index->masked[i] = MaskInstruction(ReadBE32(job->rom + 4 * i));
+    }
+}
+
+/* Hashes the windows starting in one chunk, which run into the next */
+void HashChunk(void* arg, size_t chunk) {
+    IndexJob* job = arg;
+    TargetIndex* index = job->index;
+    size_t start = chunk * job->chunkLength;
+    size_t end = start + job->chunkLength + WINDOW_LENGTH - 1;
+
+    if (end > index->wordCount) {
+        end = index->wordCount;
+    }
+    HashWindows(&index->masked[start], end - start, &index->windowHashes[start]);
+}
+
+/**
+ * Indexes the fingerprints of a big-endian ROM, masking and hashing it in parallel.
+ */
+void TargetIndex_Build(TargetIndex* index, const uint8_t* rom, size_t romSize, int threadCount) {
+    IndexJob job = { rom, index, 0x40000 };
+    size_t chunkCount;
+    size_t hashCount;
+    size_t fingerprintCount;
+    size_t bucketCount = 1;
+    uint32_t* positions;
+    size_t i;
+
+    index->wordCount = romSize / 4;
+    index->masked = malloc((index->wordCount + 1) * sizeof(uint32_t));
+    index->windowHashes = malloc((index->wordCount + 1) * sizeof(uint32_t));
+    chunkCount = (index->wordCount + job.chunkLength - 1) / job.chunkLength;
+    WorkPool_ParallelFor(threadCount, chunkCount, MaskChunk, &job);
+    WorkPool_ParallelFor(threadCount, chunkCount, HashChunk, &job);
+
+    hashCount = (index->wordCount >= WINDOW_LENGTH) ? index->wordCount - WINDOW_LENGTH + 1 : 0;
+    positions = malloc((hashCount + 1) * sizeof(uint32_t));
+    fingerprintCount = Winnow(index->windowHashes, hashCount, positions);
+
+    /* Bucket them by hash with a counting sort */
+    while (bucketCount < fingerprintCount) {
+        bucketCount *= 2;
+    }
+    index->bucketMask = bucketCount - 1;
+    index->bucketStarts = calloc(bucketCount + 1, sizeof(uint32_t));
+    index->fingerprints = malloc((fingerprintCount + 1) * sizeof(Fingerprint));
+    for (i = 0; i < fingerprintCount; i++) {
+        index->bucketStarts[(index->windowHashes[positions[i]] & index->bucketMask) + 1]++;
+    }
+    for (i = 0; i < bucketCount; i++) {
+        index->bucketStarts[i + 1] += index->bucketStarts[i];
+    }
+    for (i = 0; i < fingerprintCount; i++) {
+        uint32_t hash = index->windowHashes[positions[i]];
+        Fingerprint* fingerprint = &index->fingerprints[index->bucketStarts[hash & index->bucketMask]++];
+
+        fingerprint->hash = hash;
+        fingerprint->position = positions[i];
+    }
+    /* Filling moved each start to the next bucket's, so shift them back */
+    memmove(&index->bucketStarts[1], &index->bucketStarts[0], bucketCount * sizeof(uint32_t));
+    index->bucketStarts[0] = 0;
+
+    free(positions);
+}
+
+void TargetIndex_Destroy(TargetIndex* index) {
+    free(index->masked);
+    free(index->windowHashes);
+    free(index->fingerprints);
+    free(index->bucketStarts);
+}
+
+static int CompareUint32(const void* a, const void* b) {
+    uint32_t valueA = *(const uint32_t*)a;
+    uint32_t valueB = *(const uint32_t*)b;
+
+    return (valueA > valueB) - (valueA < valueB);
+}
+
+static int CompareCandidateVotes(const void* a, const void* b) {
+    const Candidate* candidateA = a;
+    const Candidate* candidateB = b;
+
+    if (candidateA->votes != candidateB->votes) {
+        return (candidateA->votes < candidateB->votes) ? 1 : -1;
+    }
+    return (candidateA->rom > candidateB->rom) - (candidateA->rom < candidateB->rom);
+}
+
+static int CompareCandidateScores(const void* a, const void* b) {
+    const Candidate* candidateA = a;
+    const Candidate* candidateB = b;
+
+    if (candidateA->similarity != candidateB->similarity) {
+        return (candidateA->similarity < candidateB->similarity) ? 1 : -1;
+    }
+    return CompareCandidateVotes(a, b);
+}
+
+/**
+ * Finds the places in the target ROM most like one function, and stores the best job->candidateCount of them.
+ */
+void MatchFunction(void* arg, size_t functionIndex) {
+    MatchJob* job = arg;
+    const TargetIndex* index = job->index;
+    const Function* function = &job->functions[functionIndex];
+    Candidate* results = &job->results[functionIndex * job->candidateCount];
+    size_t wordCount = function->size / 4;
+    size_t hashCount;
+    uint32_t* masked;
+    uint32_t* hashes;
+    uint32_t* positions;
+    uint32_t* starts = NULL;
+    size_t startCount = 0;
+    size_t startCapacity = 0;
+    Candidate* candidates;
+    size_t candidateCount = 0;
+    size_t fingerprintCount;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < job->candidateCount; i++) {
+        results[i].rom = 0xFFFFFFFF;
+    }
+    if (wordCount < WINDOW_LENGTH) {
+        return;
+    }
+
+    hashCount = wordCount - WINDOW_LENGTH + 1;
+    masked = malloc(wordCount * sizeof(uint32_t));
+    hashes = malloc(hashCount * sizeof(uint32_t));
+    positions = malloc(hashCount * sizeof(uint32_t));
+
+    for (i = 0; i < wordCount; i++) {
+        masked[i] = MaskInstruction(ReadBE32(job->sourceRom + function->rom + 4 * i));
+    }
+    HashWindows(masked, wordCount, hashes);
+    fingerprintCount = Winnow(hashes, hashCount, positions);
+
+    /* Each fingerprint found in the target votes for where the function would start there */
+    for (i = 0; i < fingerprintCount; i++) {
+        uint32_t hash = hashes[positions[i]];
+        uint32_t bucket = hash & index->bucketMask;
+        size_t hitCount = 0;
+
+        for (j = index->bucketStarts[bucket]; j < index->bucketStarts[bucket + 1]; j++) {
+            hitCount += index->fingerprints[j].hash == hash;
+        }
+        if (hitCount > MAX_FINGERPRINT_HITS) {
+            continue;
+        }
+        for (j = index->bucketStarts[bucket]; j < index->bucketStarts[bucket + 1]; j++) {
+            const Fingerprint* fingerprint = &index->fingerprints[j];
+
+            if (fingerprint->hash != hash || fingerprint->position < positions[i] ||
+                fingerprint->position - positions[i] + wordCount > index->wordCount) {
+                continue;
+            }
+            if (startCount == startCapacity) {
+                startCapacity = 2 * startCapacity + 16;
+                starts = realloc(starts, startCapacity * sizeof(uint32_t));
+            }
+            starts[startCount++] = fingerprint->position - positions[i];
+        }
+    }
+
+    qsort(starts, startCount, sizeof(uint32_t), CompareUint32);
+    candidates = malloc((startCount + 1) * sizeof(Candidate));
+    for (i = 0; i < startCount; i = j) {
+        for (j = i + 1; j < startCount && starts[j] == starts[i]; j++) {
+        }
+        candidates[candidateCount].rom = 4 * starts[i];
+        candidates[candidateCount].votes = j - i;
+        candidateCount++;
+    }
+    qsort(candidates, candidateCount, sizeof(Candidate), CompareCandidateVotes);
+    if (candidateCount > MAX_SCORED_CANDIDATES) {
+        candidateCount = MAX_SCORED_CANDIDATES;
+    }
+
+    for (i = 0; i < candidateCount; i++) {
+        const uint32_t* targetMasked = &index->masked[candidates[i].rom / 4];
+        size_t same = 0;
+
+        for (j = 0; j < wordCount; j++) {
+            same += masked[j] == targetMasked[j];
+        }
+        candidates[i].similarity = (double)same / wordCount;
+        candidates[i].exact = memcmp(job->sourceRom + function->rom, job->targetRom + candidates[i].rom,
+                                     function->size) == 0;
+    }
+    qsort(candidates, candidateCount, sizeof(Candidate), CompareCandidateScores);
+    memcpy(results, candidates,
+           ((candidateCount < job->candidateCount) ? candidateCount : job->candidateCount) * sizeof(Candidate));
+
+    free(candidates);
+    free(starts);
+    free(positions);
+    free(hashes);
+    free(masked);
+}
+
+/**
+ * Collects the functions of the .text sections of map that lie in a ROM of romSize bytes, each running to the next
+ * symbol or the end of its file. If wanted is not NULL, only symbols whose string index is marked in it are kept.
+ *
+ * Returns the number of functions.
+ */
+size_t CollectFunctions(const MapFile* map, size_t romSize, const bool* wanted, Function** functions) {
+    uint32_t* indices = malloc((map->entryCount + 1) * sizeof(uint32_t));
+    size_t indexCount = MapFile_FindEntriesInSection(map, ".text", indices);
+    size_t count = 0;
+    size_t i;
+    size_t j;
+
+    *functions = malloc((map->symbolCount + 1) * sizeof(Function));
+    for (i = 0; i < indexCount; i++) {
+        const MapFileEntry* entry = &map->entries[indices[i]];
+
+        for (j = 0; j < entry->symbolCount; j++) {
+            const MapSymbol* symbol = &map->symbols[entry->firstSymbol + j];
+            uint64_t end = (j + 1 < entry->symbolCount) ? map->symbols[entry->firstSymbol + j + 1].vram
+                                                        : entry->vram + entry->size;
+            uint64_t rom = entry->rom + (symbol->vram - entry->vram);
+            uint64_t size = (end > symbol->vram) ? (end - symbol->vram) & ~(uint64_t)3 : 0;
+
+            if ((wanted != NULL && !wanted[symbol->name]) || size == 0 || rom % 4 != 0 || rom + size > romSize) {
+                continue;
+            }
+            (*functions)[count].name = MapFile_GetString(map, symbol->name);
+            (*functions)[count].rom = rom;
+            (*functions)[count].size = size;
+            count++;
+        }
+    }
+
+    free(indices);
+    return count;
+}
+
+const struct option longOptions[] = {
+    { "map", required_argument, NULL, 'm' },
+    { "start", required_argument, NULL, 's' },
+    { "candidates", required_argument, NULL, 'c' },
+    { "threshold", required_argument, NULL, 't' },
+    { "jobs", required_argument, NULL, 'j' },
+    { "no-snapshot", no_argument, NULL, 'S' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
+
+int main(int argc, char** argv) {
+    int opt;
+    const char* mapPath = NULL;
+    const char* startMarker = NULL;
+    size_t candidateCount = 1;
+    double threshold = 0.0;
+    int threadCount = 0;
+    bool useSnapshot = true;
+    static char outputBuffer[0x10000];
+    uint8_t* sourceRom;
+    uint8_t* targetRom;
+    size_t sourceSize;
+    size_t targetSize;
+    MapFile map;
+    bool* wanted = NULL;
+    TargetIndex index;
+    MatchJob job;
+    size_t functionCount;
+    size_t shortCount = 0;
+    size_t i;
+    size_t j;
+    int ret;
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "m:s:c:t:j:Sh", longOptions, &optionIndex)) == EOF) {
+            break;
+        }
+
+        switch (opt) {
+            case 'm':
+                mapPath = optarg;
+                break;
+
+            case 's':
+                startMarker = optarg;
+                break;
+
+            case 'c':
+                candidateCount = strtoul(optarg, NULL, 0);
+                break;
+
+            case 't':
+                threshold = strtod(optarg, NULL);
+                break;
+
+            case 'j':
+                threadCount = strtol(optarg, NULL, 0);
+                break;
+
+            case 'S':
+                useSnapshot = false;
+                break;
+
+            case 'h':
+                fprintf(stderr, USAGE, argv[0]);
+                puts("Finds the functions of SOURCEROM in TARGETROM, another version of the same game, ignoring the\n"
+                     "addresses that move between versions. Prints, for each function, where it is in SOURCEROM and\n"
+                     "the most similar places in TARGETROM as CSV. Without FUNCTION names, every function in the\n"
+                     ".text sections of the map is looked for.\n"
+                     "Options:\n"
+                     "  -m, --map MAPFILE      Map file of SOURCEROM, giving the functions\n"
+                     "  -s, --start STRING     Start parsing the map at the first occurrence of STRING\n"
+                     "  -c, --candidates NUM   Places to print for each function (default: 1)\n"
+                     "  -t, --threshold MIN    Leave out places with less than MIN of the instructions the same,\n"
+                     "                         between 0 and 1 (default: 0)\n"
+                     "  -j, --jobs NUM         Number of functions to look for at once (default: one per CPU)\n"
+                     "  -S, --no-snapshot      Parse the map file instead of loading the snapshot saved next to it,\n"
+                     "                         and do not save one\n"
+                     "  -h, --help             Display this message and exit.\n");
+                return 1;
+
+            default:
+                fprintf(stderr, "Getopt returned character code: 0x%X", opt);
+        }
+    }
+
+    if (mapPath == NULL || argc - optind < 2) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 1;
+    }
+    if (candidateCount == 0) {
+        candidateCount = 1;
+    }
+
+    if ((sourceRom = ReadRom(argv[optind], &sourceSize, NULL)) == NULL) {
+        return 1;
+    }
+    if ((targetRom = ReadRom(argv[optind + 1], &targetSize, NULL)) == NULL) {
+        free(sourceRom);
+        return 1;
+    }
+    ret = useSnapshot ? MapFile_ParseCached(&map, mapPath, startMarker, MAPFILE_FILTER_LABELS, NULL)
+                      : MapFile_Parse(&map, mapPath, startMarker, MAPFILE_FILTER_LABELS);
+    if (ret != 0) {
+        free(sourceRom);
+        free(targetRom);
+        return 1;
+    }
+
+    if (argc - optind > 2) {
+        wanted = calloc(map.stringCount + 1, sizeof(bool));
+        for (i = optind + 2; i < (size_t)argc; i++) {
+            uint32_t name = MapFile_FindString(&map, argv[i]);
+
+            if (name == MAPFILE_NONE) {
+                fprintf(stderr, "warning: %s is not in %s\n", argv[i], mapPath);
+            } else {
+                wanted[name] = true;
+            }
+        }
+    }
+
+    TargetIndex_Build(&index, targetRom, targetSize, threadCount);
+
+    job.sourceRom = sourceRom;
+    job.targetRom = targetRom;
+    job.index = &index;
+    job.candidateCount = candidateCount;
+    functionCount = CollectFunctions(&map, sourceSize, wanted, &job.functions);
+    for (i = 0; i < functionCount; i++) {
+        shortCount += job.functions[i].size < 4 * WINDOW_LENGTH;
+    }
+    if (shortCount != 0) {
+        fprintf(stderr, "%zu functions are shorter than %d instructions and are listed without a match\n", shortCount,
+                WINDOW_LENGTH);
+    }
+    job.results = malloc((functionCount * candidateCount + 1) * sizeof(Candidate));
+    WorkPool_ParallelFor(threadCount, functionCount, MatchFunction, &job);
+
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+    puts("Function,ROM,Size,Match ROM,Similarity,Exact");
+    for (i = 0; i < functionCount; i++) {
+        const Function* function = &job.functions[i];
+        bool printed = false;
+
+        for (j = 0; j < candidateCount; j++) {
+            const Candidate* candidate = &job.results[i * candidateCount + j];
+
+            if (candidate->rom == 0xFFFFFFFF || candidate->similarity < threshold) {
+                break;
+            }
+            printf("%s,%08X,%X,%08X,%.3f,%s\n", function->name, function->rom, function->size, candidate->rom,
+                   candidate->similarity, candidate->exact ? "yes" : "no");
+            printed = true;
+        }
+        if (!printed) {
+            printf("%s,%08X,%X,,,\n", function->name, function->rom, function->size);
+        }
+    }
+    fflush(stdout);
+
+    free(job.results);
+    free(job.functions);
+    free(wanted);
+    TargetIndex_Destroy(&index);
+    MapFile_Destroy(&map);
+    free(sourceRom);
+    free(targetRom);
+    return 0;
+}
@@ -0,0 +1,313 @@
+/**
+ * @file funcsizes.c
+ * @brief Native version of get_function_sizes.py: collects the sizes of the functions of a decomp project as CSV.
+ *
+ * Instead of the objdump listings the script reads, the sizes of the built functions come straight from the symbol
+ * tables of the object files under build/src/. With --non-matching, the instructions in asm/non_matchings/ are counted
+ * instead. Either way, the files are read in parallel.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sizes.h"
+#include "workpool/workpool.h"
+
+typedef struct {
+    WorkPool* pool;
+    const char* root; /* Ends with a '/' */
+    pthread_mutex_t lock;
+    SizeEntry* entries;
+    size_t entryCount;
+    size_t entryCapacity;
+} Scan;
+
+typedef struct {
+    Scan* scan;
+    char* path; /* Starts with root */
+    FunctionSize* function; /* Where ScanAsmFile() writes the count */
+} ScanTask;
+
+void Scan_AddEntry(Scan* scan, SizeEntry* entry) {
+    pthread_mutex_lock(&scan->lock);
+    if (scan->entryCount == scan->entryCapacity) {
+        scan->entryCapacity = 2 * scan->entryCapacity + 64;
+        scan->entries = realloc(scan->entries, scan->entryCapacity * sizeof(SizeEntry));
+    }
+    scan->entries[scan->entryCount++] = *entry;
+    pthread_mutex_unlock(&scan->lock);
+}
+
+/* Summarises one object file, named after its path relative to the build folder without the extension */
+void ScanObjectFile(void* arg) {
+    ScanTask* task = arg;
+    SizeEntry entry = { 0 };
+
+    if (SizeEntry_ReadObject(&entry, task->path) != 0) {
+        /* Already reported */
+    } else if (entry.functionCount == 0) {
+        free(entry.functions);
+    } else {
+        entry.name = strndup(task->path + strlen(task->scan->root), strrchr(task->path, '.') - task->path -
+                                                                        strlen(task->scan->root));
+        Scan_AddEntry(task->scan, &entry);
+    }
+
+    free(task->path);
+    free(task);
+}
+
+static void Scan_Submit(Scan* scan, WorkFunction func, char* path, FunctionSize* function) {
+    ScanTask* task = malloc(sizeof(ScanTask));
+
+    task->scan = scan;
+    task->path = path;
+    task->function = function;
+    WorkPool_Submit(scan->pool, func, task);
+}
+
+/**
+ * Lists a folder of the build tree, queueing a task for each subfolder and object file in it. Like the script, only
+ * looks at the files in subfolders of the build folder, not at the ones directly in it.
+ */
+void ScanBuildFolder(void* arg) {
+    ScanTask* task = arg;
+    bool isRoot = strcmp(task->path, task->scan->root) == 0;
+    DIR* dir = opendir(task->path);
+    struct dirent* dirEntry;
+
+    if (dir == NULL) {
+        if (isRoot) {
+            fprintf(stderr, "Failed to open %s\n", task->path);
+        }
+        free(task->path);
+        free(task);
+        return;
+    }
+
+    while ((dirEntry = readdir(dir)) != NULL) {
+        const char* name = dirEntry->d_name;
+        char* path;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        path = malloc(strlen(task->path) + strlen(name) + 2);
+        sprintf(path, "%s%s", task->path, name);
+        if (IsFolder(dirEntry, path)) {
+            strcat(path, "/");
+            Scan_Submit(task->scan, ScanBuildFolder, path, NULL);
+        } else if (!isRoot && EndsWith(name, ".o") && !EndsWith(name, "_reloc.o")) {
+            Scan_Submit(task->scan, ScanObjectFile, path, NULL);
+        } else {
+            free(path);
+        }
+    }
+    closedir(dir);
+
+    free(task->path);
+    free(task);
+}
+
+void ScanAsmFile(void* arg) {
+    ScanTask* task = arg;
+
+    SizeEntry_CountAsmFile(task->function, task->path);
+    free(task->path);
+    free(task);
+}
+
+/**
+ * Lists a folder of non-matching functions, queueing a task for each subfolder and for counting each file. Every
+ * folder but the top one with files in it becomes an entry named after the folder, with a function for each file.
+ */
+void ScanAsmFolder(void* arg) {
+    ScanTask* task = arg;
+    bool isRoot = strcmp(task->path, task->scan->root) == 0;
+    DIR* dir = opendir(task->path);
+    struct dirent* dirEntry;
+    SizeEntry entry = { 0 };
+    char** files = NULL;
+    size_t capacity = 0;
+    size_t i;
+
+    if (dir == NULL) {
+        if (isRoot) {
+            fprintf(stderr, "Failed to open %s\n", task->path);
+        }
+        free(task->path);
+        free(task);
+        return;
+    }
+
+    while ((dirEntry = readdir(dir)) != NULL) {
+        const char* name = dirEntry->d_name;
+        char* path;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        path = malloc(strlen(task->path) + strlen(name) + 2);
+        sprintf(path, "%s%s", task->path, name);
+        if (IsFolder(dirEntry, path)) {
+            strcat(path, "/");
+            Scan_Submit(task->scan, ScanAsmFolder, path, NULL);
+        } else if (!isRoot) {
+            if (entry.functionCount == capacity) {
+                capacity = 2 * capacity + 64;
+                files = realloc(files, capacity * sizeof(char*));
+            }
+            files[entry.functionCount++] = path;
+        } else {
+            free(path);
+        }
+    }
+    closedir(dir);
+
+    if (entry.functionCount != 0) {
+        const char* end = task->path + strlen(task->path) - 1;
+        const char* start = end;
+
+        while (start > task->path && start[-1] != '/') {
+            start--;
+        }
+        entry.name = strndup(start, end - start);
+        entry.path = task->path;
+        entry.functions = calloc(entry.functionCount, sizeof(FunctionSize));
+        for (i = 0; i < entry.functionCount; i++) {
+            entry.functions[i].name = strdup(files[i] + strlen(task->path));
+            Scan_Submit(task->scan, ScanAsmFile, files[i], &entry.functions[i]);
+        }
+        Scan_AddEntry(task->scan, &entry);
+    } else {
+        free(task->path);
+    }
+
+    free(files);
+    free(task);
+}
+
+const struct option longOptions[] = {
+    { "directory", required_argument, NULL, 'd' },
+    { "function-lines", no_argument, NULL, 'f' },
+    { "ignore", required_argument, NULL, 'i' },
+    { "include-only", required_argument, NULL, 'I' },
+    { "jobs", required_argument, NULL, 'j' },
+    { "non-matching", no_argument, NULL, 'n' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
+
+int main(int argc, char** argv) {
+    int opt;
+    const char* directory = ".";
+    bool functionLines = false;
+    bool nonMatching = false;
+    const char* ignorePath = NULL;
+    const char* includeOnlyPath = NULL;
+    int threadCount = 0;
+    NameList ignored = { 0 };
+    NameList includeOnly = { 0 };
+    Scan scan = { 0 };
+    static char outputBuffer[0x10000];
+    char* root;
+    size_t i;
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "d:fi:I:j:nh", longOptions, &optionIndex)) == EOF) {
+            break;
+        }
+
+        switch (opt) {
+            case 'd':
+                directory = optarg;
+                break;
+
+            case 'f':
+                functionLines = true;
+                break;
+
+            case 'i':
+                ignorePath = optarg;
+                break;
+
+            case 'I':
+                includeOnlyPath = optarg;
+                break;
+
+            case 'j':
+                threadCount = strtol(optarg, NULL, 0);
+                break;
+
+            case 'n':
+                nonMatching = true;
+                break;
+
+            case 'h':
+                fprintf(stderr, "%s [-d DIR] [-n] [-f] [-i FILE] [-I FILE] [-j NUM]\n", argv[0]);
+                puts("Collects the sizes of the functions of a decomp project, and prints them in CSV format.\n"
+                     "The sizes come from the symbol tables of the object files in DIR/build/src/.\n"
+                     "Options:\n"
+                     "  -d, --directory DIR      Root of the project (default: the current folder).\n"
+                     "  -n, --non-matching       Count the instructions of the non-matching functions in\n"
+                     "                           DIR/asm/non_matchings/ instead.\n"
+                     "  -f, --function-lines     Print the size of every function instead of a summary.\n"
+                     "  -i, --ignore FILE        Leave out the files named in the first column of FILE.\n"
+                     "  -I, --include-only FILE  Only print the files named in the first column of FILE.\n"
+                     "  -j, --jobs NUM           Number of files to read at once (default: one per CPU).\n"
+                     "  -h, --help               Display this message and exit.\n");
+                return 1;
+
+            default:
+                fprintf(stderr, "Getopt returned character code: 0x%X", opt);
+        }
+    }
+
+    if ((ignorePath != NULL && NameList_Read(&ignored, ignorePath) != 0) ||
+        (includeOnlyPath != NULL && NameList_Read(&includeOnly, includeOnlyPath) != 0)) {
+        NameList_Destroy(&ignored);
+        return 1;
+    }
+
+    root = malloc(strlen(directory) + sizeof("/asm/non_matchings/"));
+    sprintf(root, "%s%s%s", directory, EndsWith(directory, "/") ? "" : "/",
+            nonMatching ? "asm/non_matchings/" : "build/src/");
+
+    scan.root = root;
+    pthread_mutex_init(&scan.lock, NULL);
+    if ((scan.pool = WorkPool_Create(threadCount)) == NULL) {
+        fprintf(stderr, "Failed to start worker threads\n");
+        return 1;
+    }
+    Scan_Submit(&scan, nonMatching ? ScanAsmFolder : ScanBuildFolder, strdup(root), NULL);
+    WorkPool_Wait(scan.pool);
+    WorkPool_Destroy(scan.pool);
+    pthread_mutex_destroy(&scan.lock);
+
+    for (i = 0; i < scan.entryCount; i++) {
+        SizeEntry_Summarise(&scan.entries[i], !nonMatching);
+    }
+
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+    SizeEntries_Print(stdout, scan.entries, scan.entryCount, functionLines, &ignored, &includeOnly);
+    fflush(stdout);
+
+    for (i = 0; i < scan.entryCount; i++) {
+        SizeEntry_Destroy(&scan.entries[i]);
+    }
+    free(scan.entries);
+    free(root);
+    NameList_Destroy(&ignored);
+    NameList_Destroy(&includeOnly);
+    return 0;
+}
@@ -0,0 +1,1173 @@
+/**
+ * @file progressd.c
+ * @brief Keeps the function size statistics of a decomp project up to date while it is worked on, and answers queries
+ * for them over a Unix socket.
+ *
+ * build/src/, asm/non_matchings/ and the folder of the map file are watched with inotify. When an object file, asm file
+ * or the map changes, only that file is read again, so answering a query never walks the tree or parses the map. The
+ * answers are the CSVs funcsizes.elf and get_map_functions_sizes.py print.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "mapfile.h"
+#include "sizes.h"
+
+#define TREE_WATCH_MASK \
+    (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#define MAP_WATCH_MASK \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/* How often to look again for a folder that is missing, in milliseconds */
+#define RETRY_INTERVAL 1000
+
+#define MAX_QUERY_LENGTH 256
+
+typedef enum {
+    TREE_BUILD,
+    TREE_ASM,
+    TREE_MAX,
+    TREE_NONE = -1,
+} TreeKind;
+
+typedef struct EntryNode {
+    struct EntryNode* next;
+    SizeEntry entry;
+} EntryNode;
+
+/* Chained hash table of the entries of a tree, by the path of the object file or asm folder they were made from */
+typedef struct {
+    EntryNode** buckets;
+    size_t bucketCount;
+    size_t count;
+} EntryTable;
+
+typedef struct {
+    char* root; /* Ends with a '/' */
+    bool attached;
+    EntryTable entries;
+} Tree;
+
+typedef struct {
+    char* path; /* Ends with a '/', NULL if the watch is not in use */
+    TreeKind tree;
+    bool mapFolder;
+} Watch;
+
+typedef struct {
+    const char* name; /* In map */
+    uint64_t vram;
+    int64_t size;
+} MapFunction;
+
+/* A file of the .text section of the map, or all the files of a folder together */
+typedef struct {
+    char* name;
+    uint64_t vram;
+    int64_t size;
+    size_t firstFunction;
+    size_t functionCount;
+} MapSizeFile;
+
+typedef struct {
+    char* path;
+    char* folder; /* Ends with a '/' */
+    const char* baseName;
+    const char* startMarker;
+    int watch;
+    bool loaded;
+    MapFile map;
+    MapFunction* functions;
+    size_t functionCount;
+    MapSizeFile* files;
+    size_t fileCount;
+    MapFunction* folderFunctions;
+    MapSizeFile* folders; /* Functions index into folderFunctions */
+    size_t folderCount;
+} MapState;
+
+typedef struct {
+    int inotifyFd;
+    Tree trees[TREE_MAX];
+    Watch* watches; /* By watch descriptor */
+    size_t watchCapacity;
+    MapState map;
+} Daemon;
+
+static volatile sig_atomic_t sQuit = 0;
+
+static void HandleSignal(int signal) {
+    (void)signal;
+    sQuit = 1;
+}
+
+static bool StartsWith(const char* str, const char* prefix) {
+    return strncmp(str, prefix, strlen(prefix)) == 0;
+}
+
+/* Returns folder + name + suffix, to free() */
+static char* JoinPath(const char* folder, const char* name, const char* suffix) {
+    char* path = malloc(strlen(folder) + strlen(name) + strlen(suffix) + 1);
+
+    sprintf(path, "%s%s%s", folder, name, suffix);
+    return path;
+}
+
+/* Entries */
+
+static uint32_t HashPath(const char* path) {
+    uint32_t hash = 2166136261u;
+
+    for (; *path != '\0'; path++) {
+        hash = (hash ^ (uint8_t)*path) * 16777619u;
+    }
+    return hash;
+}
+
+EntryNode* EntryTable_Find(const EntryTable* table, const char* path) {
+    EntryNode* node;
+
+    if (table->bucketCount == 0) {
+        return NULL;
+    }
+    for (node = table->buckets[HashPath(path) & (table->bucketCount - 1)]; node != NULL; node = node->next) {
+        if (strcmp(node->entry.path, path) == 0) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Returns the node for path, adding an empty one if there is none.
+ */
+EntryNode* EntryTable_Insert(EntryTable* table, const char* path) {
+    EntryNode* node = EntryTable_Find(table, path);
+    size_t bucket;
+    size_t i;
+
+    if (node != NULL) {
+        return node;
+    }
+
+    if (table->count >= table->bucketCount) {
+        size_t newCount = (table->bucketCount == 0) ? 256 : 2 * table->bucketCount;
+        EntryNode** newBuckets = calloc(newCount, sizeof(EntryNode*));
+
+        for (i = 0; i < table->bucketCount; i++) {
+            while (table->buckets[i] != NULL) {
+                node = table->buckets[i];
+                table->buckets[i] = node->next;
+                bucket = HashPath(node->entry.path) & (newCount - 1);
+                node->next = newBuckets[bucket];
+                newBuckets[bucket] = node;
+            }
+        }
+        free(table->buckets);
+        table->buckets = newBuckets;
+        table->bucketCount = newCount;
+    }
+
+    node = calloc(1, sizeof(EntryNode));
+    node->entry.path = strdup(path);
+    bucket = HashPath(path) & (table->bucketCount - 1);
+    node->next = table->buckets[bucket];
+    table->buckets[bucket] = node;
+    table->count++;
+    return node;
+}
+
+static void EntryTable_RemoveFromBucket(EntryTable* table, size_t bucket, const char* path, bool isPrefix) {
+    EntryNode** link = &table->buckets[bucket];
+
+    while (*link != NULL) {
+        EntryNode* node = *link;
+
+        if (isPrefix ? StartsWith(node->entry.path, path) : strcmp(node->entry.path, path) == 0) {
+            *link = node->next;
+            SizeEntry_Destroy(&node->entry);
+            free(node);
+            table->count--;
+        } else {
+            link = &node->next;
+        }
+    }
+}
+
+void EntryTable_Remove(EntryTable* table, const char* path) {
+    if (table->bucketCount != 0) {
+        EntryTable_RemoveFromBucket(table, HashPath(path) & (table->bucketCount - 1), path, false);
+    }
+}
+
+/* Removes the entries of every file and folder inside folder, which ends with a '/' */
+void EntryTable_RemoveFolder(EntryTable* table, const char* folder) {
+    size_t i;
+
+    for (i = 0; i < table->bucketCount; i++) {
+        EntryTable_RemoveFromBucket(table, i, folder, true);
+    }
+}
+
+/* Copies of the entries for printing, still owned by the table */
+SizeEntry* EntryTable_Collect(const EntryTable* table) {
+    SizeEntry* entries = malloc((table->count + 1) * sizeof(SizeEntry));
+    size_t count = 0;
+    size_t i;
+    EntryNode* node;
+
+    for (i = 0; i < table->bucketCount; i++) {
+        for (node = table->buckets[i]; node != NULL; node = node->next) {
+            entries[count++] = node->entry;
+        }
+    }
+    return entries;
+}
+
+/**
+ * Reads the object file at path into the build tree again, named like funcsizes.elf does. Object files that cannot be
+ * read or have no functions have no entry.
+ */
+void Daemon_UpdateObjectFile(Daemon* daemon, const char* path) {
+    Tree* tree = &daemon->trees[TREE_BUILD];
+    SizeEntry entry = { 0 };
+    EntryNode* node;
+
+    if (SizeEntry_ReadObject(&entry, path) != 0 || entry.functionCount == 0) {
+        SizeEntry_Destroy(&entry);
+        EntryTable_Remove(&tree->entries, path);
+        return;
+    }
+
+    node = EntryTable_Insert(&tree->entries, path);
+    entry.path = node->entry.path;
+    node->entry.path = NULL;
+    SizeEntry_Destroy(&node->entry);
+    entry.name = strndup(path + strlen(tree->root), strrchr(path, '.') - path - strlen(tree->root));
+    SizeEntry_Summarise(&entry, true);
+    node->entry = entry;
+}
+
+/**
+ * Counts the instructions of the asm file name in folder again, or removes it if it is gone, and updates the entry of
+ * the folder.
+ */
+void Daemon_UpdateAsmFile(Daemon* daemon, const char* folder, const char* name, bool removed) {
+    Tree* tree = &daemon->trees[TREE_ASM];
+    EntryNode* node = removed ? EntryTable_Find(&tree->entries, folder) : EntryTable_Insert(&tree->entries, folder);
+    SizeEntry* entry;
+    char* path;
+    size_t i;
+
+    if (node == NULL) {
+        return;
+    }
+    entry = &node->entry;
+    if (entry->name == NULL) {
+        const char* end = folder + strlen(folder) - 1;
+        const char* start = end;
+
+        while (start > folder && start[-1] != '/') {
+            start--;
+        }
+        entry->name = strndup(start, end - start);
+    }
+
+    for (i = 0; i < entry->functionCount; i++) {
+        if (strcmp(entry->functions[i].name, name) == 0) {
+            break;
+        }
+    }
+
+    path = JoinPath(folder, name, "");
+    if (!removed && i == entry->functionCount) {
+        entry->functions = realloc(entry->functions, (entry->functionCount + 1) * sizeof(FunctionSize));
+        entry->functions[entry->functionCount].name = strdup(name);
+        entry->functions[entry->functionCount].lines = 0;
+        entry->functionCount++;
+    }
+    if (i < entry->functionCount && (removed || SizeEntry_CountAsmFile(&entry->functions[i], path) != 0)) {
+        free(entry->functions[i].name);
+        memmove(&entry->functions[i], &entry->functions[i + 1], (entry->functionCount - i - 1) * sizeof(FunctionSize));
+        entry->functionCount--;
+    }
+    free(path);
+
+    if (entry->functionCount == 0) {
+        EntryTable_Remove(&tree->entries, folder);
+    } else {
+        SizeEntry_Summarise(entry, false);
+    }
+}
+
+/* Trees */
+
+static Watch* Daemon_GetWatch(Daemon* daemon, int wd) {
+    if (wd < 0) {
+        return NULL;
+    }
+    if ((size_t)wd >= daemon->watchCapacity) {
+        size_t newCapacity = 2 * wd + 64;
+
+        daemon->watches = realloc(daemon->watches, newCapacity * sizeof(Watch));
+        memset(&daemon->watches[daemon->watchCapacity], 0, (newCapacity - daemon->watchCapacity) * sizeof(Watch));
+        daemon->watchCapacity = newCapacity;
+    }
+    return &daemon->watches[wd];
+}
+
+/**
+ * Starts watching folder, which ends with a '/', for tree or as the folder of the map file. A folder watched for both
+ * keeps both.
+ *
+ * Returns the watch descriptor, or -1 if the folder cannot be watched.
+ */
+int Daemon_AddWatch(Daemon* daemon, const char* folder, TreeKind tree, bool mapFolder) {
+    uint32_t mask = (tree != TREE_NONE ? TREE_WATCH_MASK : 0) | (mapFolder ? MAP_WATCH_MASK : 0) | IN_MASK_ADD;
+    int wd = inotify_add_watch(daemon->inotifyFd, folder, mask);
+    Watch* watch = Daemon_GetWatch(daemon, wd);
+
+    if (watch == NULL) {
+        return -1;
+    }
+    if (watch->path == NULL) {
+        watch->path = strdup(folder);
+        watch->tree = TREE_NONE;
+    }
+    if (tree != TREE_NONE) {
+        watch->tree = tree;
+    }
+    watch->mapFolder |= mapFolder;
+    return wd;
+}
+
+static void Daemon_ForgetWatch(Daemon* daemon, int wd) {
+    Watch* watch = &daemon->watches[wd];
+
+    free(watch->path);
+    watch->path = NULL;
+    watch->tree = TREE_NONE;
+    watch->mapFolder = false;
+}
+
+/**
+ * Forgets folder, which ends with a '/', and everything in it: their entries in tree, and the watches for tree on
+ * them, unless they are also the folder of the map.
+ */
+void Daemon_RemoveFolder(Daemon* daemon, TreeKind tree, const char* folder) {
+    size_t wd;
+
+    EntryTable_RemoveFolder(&daemon->trees[tree].entries, folder);
+    for (wd = 0; wd < daemon->watchCapacity; wd++) {
+        Watch* watch = &daemon->watches[wd];
+
+        if (watch->path == NULL || watch->tree != tree || !StartsWith(watch->path, folder)) {
+            continue;
+        }
+        if (watch->mapFolder) {
+            /* Replacing the mask leaves only the events the map needs */
+            watch->tree = TREE_NONE;
+            inotify_add_watch(daemon->inotifyFd, watch->path, MAP_WATCH_MASK);
+        } else {
+            inotify_rm_watch(daemon->inotifyFd, wd);
+            Daemon_ForgetWatch(daemon, wd);
+        }
+    }
+}
+
+void Daemon_UpdateFile(Daemon* daemon, TreeKind tree, const char* folder, const char* name, bool removed) {
+    char* path;
+
+    if (tree == TREE_ASM) {
+        if (strcmp(folder, daemon->trees[tree].root) != 0) {
+            Daemon_UpdateAsmFile(daemon, folder, name, removed);
+        }
+        return;
+    }
+
+    /* Like the script, only the files in subfolders of the build folder count */
+    if (strcmp(folder, daemon->trees[tree].root) == 0 || !EndsWith(name, ".o") || EndsWith(name, "_reloc.o")) {
+        return;
+    }
+    path = JoinPath(folder, name, "");
+    if (removed) {
+        EntryTable_Remove(&daemon->trees[tree].entries, path);
+    } else {
+        Daemon_UpdateObjectFile(daemon, path);
+    }
+    free(path);
+}
+
+/**
+ * Watches folder, which ends with a '/', and reads everything in it. The watch is added before the folder is listed,
+ * so no file written in between is missed.
+ */
+void Daemon_ScanFolder(Daemon* daemon, TreeKind tree, const char* folder) {
+    DIR* dir;
+    struct dirent* dirEntry;
+
+    if (Daemon_AddWatch(daemon, folder, tree, false) < 0 || (dir = opendir(folder)) == NULL) {
+        return;
+    }
+
+    while ((dirEntry = readdir(dir)) != NULL) {
+        const char* name = dirEntry->d_name;
+        char* path;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        path = JoinPath(folder, name, "/");
+        path[strlen(path) - 1] = '\0';
+        if (IsFolder(dirEntry, path)) {
+            strcat(path, "/");
+            Daemon_ScanFolder(daemon, tree, path);
+        } else {
+            Daemon_UpdateFile(daemon, tree, folder, name, false);
+        }
+        free(path);
+    }
+    closedir(dir);
+}
+
+/* Starts following tree if its root folder exists, reading it from scratch */
+void Daemon_AttachTree(Daemon* daemon, TreeKind tree) {
+    struct stat rootStat;
+
+    if (stat(daemon->trees[tree].root, &rootStat) != 0 || !S_ISDIR(rootStat.st_mode)) {
+        return;
+    }
+    Daemon_RemoveFolder(daemon, tree, daemon->trees[tree].root);
+    daemon->trees[tree].attached = true;
+    Daemon_ScanFolder(daemon, tree, daemon->trees[tree].root);
+}
+
+void Daemon_DetachTree(Daemon* daemon, TreeKind tree) {
+    Daemon_RemoveFolder(daemon, tree, daemon->trees[tree].root);
+    daemon->trees[tree].attached = false;
+}
+
+/* Map */
+
+static void MapState_Clear(MapState* state) {
+    size_t i;
+
+    if (!state->loaded) {
+        return;
+    }
+    for (i = 0; i < state->fileCount; i++) {
+        free(state->files[i].name);
+    }
+    for (i = 0; i < state->folderCount; i++) {
+        free(state->folders[i].name);
+    }
+    free(state->functions);
+    free(state->files);
+    free(state->folderFunctions);
+    free(state->folders);
+    MapFile_Destroy(&state->map);
+    state->functions = state->folderFunctions = NULL;
+    state->files = state->folders = NULL;
+    state->functionCount = state->fileCount = state->folderCount = 0;
+    state->loaded = false;
+}
+
+/* The name get_map_functions_sizes.py gives an object file: without the first two folders and the extension */
+static char* GetMapFileName(const char* path) {
+    const char* start = path;
+    const char* dot;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if ((start = strchr(start, '/')) == NULL) {
+            return strdup("");
+        }
+        start++;
+    }
+    dot = strrchr(start, '.');
+    return (dot != NULL) ? strndup(start, dot - start) : strdup("");
+}
+
+static int64_t FloorDivide(int64_t a, int64_t b) {
+    return (a / b) - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+static size_t GetFolderLength(const char* name) {
+    const char* slash = strrchr(name, '/');
+
+    return (slash != NULL) ? (size_t)(slash - name) : 0;
+}
+
+static const MapSizeFile* sSortFiles;
+
+static bool IsSameFolder(const char* nameA, const char* nameB) {
+    size_t length = GetFolderLength(nameA);
+
+    return GetFolderLength(nameB) == length && strncmp(nameA, nameB, length) == 0;
+}
+
+/* Orders files by folder, keeping the order of the map inside each folder */
+static int CompareFileFolders(const void* a, const void* b) {
+    size_t indexA = *(const size_t*)a;
+    size_t indexB = *(const size_t*)b;
+    const char* nameA = sSortFiles[indexA].name;
+    const char* nameB = sSortFiles[indexB].name;
+    size_t lengthA = GetFolderLength(nameA);
+    size_t lengthB = GetFolderLength(nameB);
+    int cmp = strncmp(nameA, nameB, (lengthA < lengthB) ? lengthA : lengthB);
+
+    if (cmp == 0) {
+        cmp = (lengthA > lengthB) - (lengthA < lengthB);
+    }
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (indexA > indexB) - (indexA < indexB);
+}
+
+/* Run of files of one folder in the sorted order */
+typedef struct {
+    size_t start;
+    size_t count;
+} FolderRun;
+
+static const size_t* sSortOrder;
+
+static int CompareFolderRuns(const void* a, const void* b) {
+    size_t firstA = sSortOrder[((const FolderRun*)a)->start];
+    size_t firstB = sSortOrder[((const FolderRun*)b)->start];
+
+    return (firstA > firstB) - (firstA < firstB);
+}
+
+/**
+ * Puts the files of each folder together into one, like mixFolders(): folders come in the order their first file is
+ * in, with the vram of that file, and the sizes and functions of all of them.
+ */
+void MapState_MixFolders(MapState* state) {
+    size_t* order = malloc((state->fileCount + 1) * sizeof(size_t));
+    FolderRun* runs = malloc((state->fileCount + 1) * sizeof(FolderRun));
+    size_t runCount = 0;
+    size_t functionCount = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < state->fileCount; i++) {
+        order[i] = i;
+    }
+    sSortFiles = state->files;
+    qsort(order, state->fileCount, sizeof(size_t), CompareFileFolders);
+    for (i = 0; i < state->fileCount; i++) {
+        if (runCount != 0 && IsSameFolder(state->files[order[runs[runCount - 1].start]].name,
+                                          state->files[order[i]].name)) {
+            runs[runCount - 1].count++;
+        } else {
+            runs[runCount].start = i;
+            runs[runCount].count = 1;
+            runCount++;
+        }
+    }
+    sSortOrder = order;
+    qsort(runs, runCount, sizeof(FolderRun), CompareFolderRuns);
+
+    state->folders = malloc((runCount + 1) * sizeof(MapSizeFile));
+    state->folderFunctions = malloc((state->functionCount + 1) * sizeof(MapFunction));
+    for (i = 0; i < runCount; i++) {
+        const MapSizeFile* first = &state->files[order[runs[i].start]];
+        MapSizeFile* folder = &state->folders[state->folderCount++];
+
+        folder->name = strndup(first->name, GetFolderLength(first->name));
+        folder->vram = first->vram;
+        folder->size = 0;
+        folder->firstFunction = functionCount;
+        for (j = 0; j < runs[i].count; j++) {
+            const MapSizeFile* file = &state->files[order[runs[i].start + j]];
+
+            folder->size += file->size;
+            memcpy(&state->folderFunctions[functionCount], &state->functions[file->firstFunction],
+                   file->functionCount * sizeof(MapFunction));
+            functionCount += file->functionCount;
+        }
+        folder->functionCount = functionCount - folder->firstFunction;
+    }
+
+    free(runs);
+    free(order);
+}
+
+/**
+ * Parses the map file again and works out what get_map_functions_sizes.py would print for it: every file of the .text
+ * section with any code and any symbols, with the sizes of the functions going by the address of the next one.
+ *
+ * Returns 0 on success, -1 if the map cannot be read.
+ */
+int MapState_Load(MapState* state) {
+    uint32_t* indices;
+    size_t indexCount;
+    size_t i;
+    size_t j;
+
+    MapState_Clear(state);
+    if (MapFile_Parse(&state->map, state->path, state->startMarker, MAPFILE_FILTER_LABELS) != 0) {
+        return -1;
+    }
+    state->loaded = true;
+
+    indices = malloc((state->map.entryCount + 1) * sizeof(uint32_t));
+    indexCount = MapFile_FindEntriesInSection(&state->map, ".text", indices);
+    state->files = malloc((indexCount + 1) * sizeof(MapSizeFile));
+    state->functions = malloc((state->map.symbolCount + 1) * sizeof(MapFunction));
+
+    for (i = 0; i < indexCount; i++) {
+        const MapFileEntry* entry = &state->map.entries[indices[i]];
+        int64_t size = entry->size / 4;
+        int64_t accumulatedSize = 0;
+        MapSizeFile* file;
+
+        if (size <= 0 || entry->symbolCount == 0) {
+            continue;
+        }
+
+        file = &state->files[state->fileCount++];
+        file->name = GetMapFileName(MapFile_GetString(&state->map, entry->name));
+        file->vram = entry->vram;
+        file->size = size;
+        file->firstFunction = state->functionCount;
+        file->functionCount = entry->symbolCount;
+
+        for (j = 0; j < entry->symbolCount; j++) {
+            const MapSymbol* symbol = &state->map.symbols[entry->firstSymbol + j];
+            MapFunction* function = &state->functions[state->functionCount++];
+
+            function->name = MapFile_GetString(&state->map, symbol->name);
+            function->vram = symbol->vram;
+            if (j + 1 < entry->symbolCount) {
+                function->size = FloorDivide((int64_t)(state->map.symbols[entry->firstSymbol + j + 1].vram -
+                                                       symbol->vram), 4);
+                accumulatedSize += function->size;
+            } else {
+                function->size = size - accumulatedSize;
+            }
+        }
+    }
+    free(indices);
+
+    MapState_MixFolders(state);
+    return 0;
+}
+
+/* Queries */
+
+void PrintMapSizes(FILE* out, const MapSizeFile* files, size_t fileCount, const MapFunction* functions,
+                   bool printVram) {
+    size_t i;
+    size_t j;
+
+    if (printVram) {
+        fputs("VRAM,", out);
+    }
+    fputs("File,Num functions,Max size,Total size,Average size\n", out);
+    for (i = 0; i < fileCount; i++) {
+        const MapSizeFile* file = &files[i];
+        int64_t maxSize = 0;
+
+        for (j = 0; j < file->functionCount; j++) {
+            if (functions[file->firstFunction + j].size > maxSize) {
+                maxSize = functions[file->firstFunction + j].size;
+            }
+        }
+        if (printVram) {
+            fprintf(out, "%08llX,", (unsigned long long)file->vram);
+        }
+        fprintf(out, "%s,%zu,%lld,%lld,%.2f\n", file->name, file->functionCount, (long long)maxSize,
+                (long long)file->size, (double)file->size / file->functionCount);
+    }
+}
+
+void PrintMapFunctions(FILE* out, const MapSizeFile* files, size_t fileCount, const MapFunction* functions) {
+    size_t i;
+    size_t j;
+
+    fputs("File,Function name,VRAM,Size in words\n", out);
+    for (i = 0; i < fileCount; i++) {
+        for (j = 0; j < files[i].functionCount; j++) {
+            const MapFunction* function = &functions[files[i].firstFunction + j];
+
+            fprintf(out, "%s,%s,%08llX,%lld\n", files[i].name, function->name, (unsigned long long)function->vram,
+                    (long long)function->size);
+        }
+    }
+}
+
+static bool HasWord(char** words, size_t count, const char* word) {
+    size_t i;
+
+    for (i = 1; i < count; i++) {
+        if (strcmp(words[i], word) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Answers one query line:
+ *   build [functions]             what funcsizes.elf [-f] prints
+ *   nonmatching [functions]       what funcsizes.elf -n [-f] prints
+ *   map [same-folder] [functions] what get_map_functions_sizes.py [--same-folder] [--functions] prints
+ *   status                        what is being followed
+ * Anything else is answered with a line starting with "error: ".
+ */
+void Daemon_Answer(Daemon* daemon, char* query, FILE* out) {
+    char* words[8];
+    size_t wordCount = 0;
+    char* savePtr = NULL;
+    char* word;
+    size_t i;
+
+    for (word = strtok_r(query, " \t\r\n", &savePtr); word != NULL && wordCount < 8;
+         word = strtok_r(NULL, " \t\r\n", &savePtr)) {
+        words[wordCount++] = word;
+    }
+    for (i = 1; i < wordCount; i++) {
+        if (strcmp(words[i], "functions") != 0 && strcmp(words[i], "same-folder") != 0) {
+            fprintf(out, "error: unknown option '%s'\n", words[i]);
+            return;
+        }
+    }
+
+    if (wordCount == 0) {
+        fputs("error: empty query\n", out);
+    } else if (strcmp(words[0], "build") == 0 || strcmp(words[0], "nonmatching") == 0) {
+        Tree* tree = &daemon->trees[(words[0][0] == 'b') ? TREE_BUILD : TREE_ASM];
+        SizeEntry* entries;
+
+        if (!tree->attached) {
+            fprintf(out, "error: %s does not exist\n", tree->root);
+            return;
+        }
+        entries = EntryTable_Collect(&tree->entries);
+        SizeEntries_Print(out, entries, tree->entries.count, HasWord(words, wordCount, "functions"), NULL, NULL);
+        free(entries);
+    } else if (strcmp(words[0], "map") == 0) {
+        MapState* state = &daemon->map;
+        bool sameFolder = HasWord(words, wordCount, "same-folder");
+
+        if (state->path == NULL) {
+            fputs("error: no map file given\n", out);
+        } else if (!state->loaded) {
+            fprintf(out, "error: %s could not be read\n", state->path);
+        } else if (HasWord(words, wordCount, "functions")) {
+            PrintMapFunctions(out, sameFolder ? state->folders : state->files,
+                              sameFolder ? state->folderCount : state->fileCount,
+                              sameFolder ? state->folderFunctions : state->functions);
+        } else {
+            PrintMapSizes(out, sameFolder ? state->folders : state->files,
+                          sameFolder ? state->folderCount : state->fileCount,
+                          sameFolder ? state->folderFunctions : state->functions, !sameFolder);
+        }
+    } else if (strcmp(words[0], "status") == 0) {
+        for (i = 0; i < TREE_MAX; i++) {
+            fprintf(out, "%s: %s, %zu entries\n", daemon->trees[i].root,
+                    daemon->trees[i].attached ? "watched" : "missing", daemon->trees[i].entries.count);
+        }
+        if (daemon->map.path != NULL) {
+            fprintf(out, "%s: %s, %zu files\n", daemon->map.path, daemon->map.loaded ? "loaded" : "missing",
+                    daemon->map.fileCount);
+        }
+    } else {
+        fprintf(out, "error: unknown query '%s'\n", words[0]);
+    }
+}
+
+/* Reads one query line from a client and writes the answer back before closing the connection */
+void Daemon_ServeClient(Daemon* daemon, int clientFd) {
+    struct timeval timeout = { .tv_sec = 1 };
+    char query[MAX_QUERY_LENGTH + 1];
+    size_t length = 0;
+    char* answer = NULL;
+    size_t answerSize = 0;
+    size_t written = 0;
+    FILE* out;
+
+    /* A client that never finishes its query, or never reads the answer, must not hold up the others */
+    setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(clientFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    while (length < MAX_QUERY_LENGTH && memchr(query, '\n', length) == NULL) {
+        ssize_t got = read(clientFd, query + length, MAX_QUERY_LENGTH - length);
+
+        if (got <= 0) {
+            break;
+        }
+        length += got;
+    }
+    query[length] = '\0';
+
+    out = open_memstream(&answer, &answerSize);
+    Daemon_Answer(daemon, query, out);
+    fclose(out);
+
+    while (written < answerSize) {
+        ssize_t sent = write(clientFd, answer + written, answerSize - written);
+
+        /* Timed out or gone: drop the rest of the answer */
+        if (sent <= 0) {
+            break;
+        }
+        written += sent;
+    }
+    free(answer);
+    close(clientFd);
+}
+
+/* Events */
+
+void Daemon_HandleEvent(Daemon* daemon, const struct inotify_event* event) {
+    Watch* watch = Daemon_GetWatch(daemon, event->wd);
+    MapState* state = &daemon->map;
+    TreeKind tree;
+
+    if (watch == NULL || watch->path == NULL) {
+        return;
+    }
+    tree = watch->tree;
+
+    if (watch->mapFolder && event->len != 0 && strcmp(event->name, state->baseName) == 0) {
+        if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+            if (MapState_Load(state) != 0) {
+                fprintf(stderr, "Failed to read map file %s\n", state->path);
+            }
+        } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            MapState_Clear(state);
+        }
+    }
+
+    if (event->mask & IN_IGNORED) {
+        if (watch->mapFolder) {
+            state->watch = -1;
+            MapState_Clear(state);
+        }
+        if (tree != TREE_NONE && strcmp(watch->path, daemon->trees[tree].root) == 0) {
+            Daemon_ForgetWatch(daemon, event->wd);
+            Daemon_DetachTree(daemon, tree);
+        } else {
+            Daemon_ForgetWatch(daemon, event->wd);
+        }
+        return;
+    }
+    if (tree == TREE_NONE) {
+        return;
+    }
+
+    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        /* Whatever is at the old path now is found again by the retry */
+        if (strcmp(watch->path, daemon->trees[tree].root) == 0) {
+            Daemon_DetachTree(daemon, tree);
+        }
+    } else if (event->len == 0) {
+        return;
+    } else if (event->mask & IN_ISDIR) {
+        char* folder = JoinPath(watch->path, event->name, "/");
+
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            Daemon_ScanFolder(daemon, tree, folder);
+        } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            Daemon_RemoveFolder(daemon, tree, folder);
+        }
+        free(folder);
+    } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        Daemon_UpdateFile(daemon, tree, watch->path, event->name, false);
+    } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        Daemon_UpdateFile(daemon, tree, watch->path, event->name, true);
+    }
+}
+
+/* Reads everything again, for when the kernel dropped events */
+void Daemon_Rescan(Daemon* daemon) {
+    int i;
+
+    for (i = 0; i < TREE_MAX; i++) {
+        Daemon_DetachTree(daemon, i);
+        Daemon_AttachTree(daemon, i);
+    }
+    if (daemon->map.path != NULL && MapState_Load(&daemon->map) != 0) {
+        MapState_Clear(&daemon->map);
+    }
+}
+
+void Daemon_ReadEvents(Daemon* daemon) {
+    char buffer[0x10000] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    ssize_t offset;
+
+    while ((length = read(daemon->inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (offset = 0; offset < length;) {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                Daemon_Rescan(daemon);
+            } else {
+                Daemon_HandleEvent(daemon, event);
+            }
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+/* Attaches the trees and the map folder that are missing, if they exist now */
+void Daemon_Retry(Daemon* daemon) {
+    MapState* state = &daemon->map;
+    int i;
+
+    for (i = 0; i < TREE_MAX; i++) {
+        if (!daemon->trees[i].attached) {
+            Daemon_AttachTree(daemon, i);
+        }
+    }
+    if (state->path != NULL && state->watch < 0 &&
+        (state->watch = Daemon_AddWatch(daemon, state->folder, TREE_NONE, true)) >= 0) {
+        MapState_Load(state);
+    }
+}
+
+static bool Daemon_IsComplete(const Daemon* daemon) {
+    int i;
+
+    for (i = 0; i < TREE_MAX; i++) {
+        if (!daemon->trees[i].attached) {
+            return false;
+        }
+    }
+    return daemon->map.path == NULL || daemon->map.watch >= 0;
+}
+
+/* Client */
+
+int SendQuery(const char* socketPath, const char* query) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    char buffer[0x10000];
+    bool isFirst = true;
+    bool isError = false;
+    ssize_t got;
+    int fd;
+
+    strcpy(address.sun_path, socketPath);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Failed to connect to %s: %s\n", socketPath, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+    if (write(fd, query, strlen(query)) < 0 || write(fd, "\n", 1) < 0) {
+        fprintf(stderr, "Failed to send query to %s\n", socketPath);
+        close(fd);
+        return 1;
+    }
+
+    while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+        /* Errors are a single line, so they start the answer */
+        if (isFirst && got >= 7 && memcmp(buffer, "error: ", 7) == 0) {
+            isError = true;
+        }
+        fwrite(buffer, 1, got, isError ? stderr : stdout);
+        isFirst = false;
+    }
+    close(fd);
+    return isError ? 1 : 0;
+}
+
+const struct option longOptions[] = {
+    { "directory", required_argument, NULL, 'd' },
+    { "map", required_argument, NULL, 'm' },
+    { "starting-point", required_argument, NULL, 'p' },
+    { "socket", required_argument, NULL, 's' },
+    { "query", required_argument, NULL, 'q' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
+
+int main(int argc, char** argv) {
+    int opt;
+    const char* directory = ".";
+    const char* socketPath = NULL;
+    const char* query = NULL;
+    char* defaultSocketPath;
+    Daemon daemon = { 0 };
+    MapState* state = &daemon.map;
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    struct pollfd pollFds[2];
+    int listenFd;
+    const char* separator;
+    int i;
+
+    state->startMarker = "\n build/";
+    state->watch = -1;
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "d:m:p:s:q:h", longOptions, &optionIndex)) == EOF) {
+            break;
+        }
+
+        switch (opt) {
+            case 'd':
+                directory = optarg;
+                break;
+
+            case 'm':
+                state->path = optarg;
+                break;
+
+            case 'p':
+                state->startMarker = optarg;
+                break;
+
+            case 's':
+                socketPath = optarg;
+                break;
+
+            case 'q':
+                query = optarg;
+                break;
+
+            case 'h':
+                fprintf(stderr, "%s [-d DIR] [-m MAPFILE] [-p MARKER] [-s SOCKET] [-q QUERY]\n", argv[0]);
+                puts("Follows the function sizes of a decomp project as it changes, and answers queries for them.\n"
+                     "DIR/build/src/, DIR/asm/non_matchings/ and the map file are watched, and only what changes in\n"
+                     "them is read again.\n"
+                     "Options:\n"
+                     "  -d, --directory DIR          Root of the project (default: the current folder).\n"
+                     "  -m, --map MAPFILE            Map file to follow, for the map query.\n"
+                     "  -p, --starting-point MARKER  Where in the map to start reading (default: \"\\n build/\").\n"
+                     "  -s, --socket SOCKET          Unix socket to answer on (default: DIR/progressd.sock).\n"
+                     "  -q, --query QUERY            Send QUERY to a running daemon and print its answer instead.\n"
+                     "  -h, --help                   Display this message and exit.\n"
+                     "Queries:\n"
+                     "  build [functions]              Sizes of the built functions, like funcsizes.elf [-f].\n"
+                     "  nonmatching [functions]        Sizes of the non-matchings, like funcsizes.elf -n [-f].\n"
+                     "  map [same-folder] [functions]  Sizes from the map, like get_map_functions_sizes.py.\n"
+                     "  status                         What is being followed.\n");
+                return 1;
+
+            default:
+                fprintf(stderr, "Getopt returned character code: 0x%X", opt);
+        }
+    }
+
+    separator = EndsWith(directory, "/") ? "" : "/";
+    defaultSocketPath = JoinPath(directory, separator, "progressd.sock");
+    if (socketPath == NULL) {
+        socketPath = defaultSocketPath;
+    }
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long\n", socketPath);
+        return 1;
+    }
+
+    if (query != NULL) {
+        int ret = SendQuery(socketPath, query);
+
+        free(defaultSocketPath);
+        return ret;
+    }
+
+    daemon.trees[TREE_BUILD].root = JoinPath(directory, separator, "build/src/");
+    daemon.trees[TREE_ASM].root = JoinPath(directory, separator, "asm/non_matchings/");
+    if (state->path != NULL) {
+        const char* slash = strrchr(state->path, '/');
+
+        state->folder = (slash != NULL) ? strndup(state->path, slash - state->path + 1) : strdup("./");
+        state->baseName = (slash != NULL) ? slash + 1 : state->path;
+    }
+
+    if ((daemon.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        fprintf(stderr, "Failed to start inotify: %s\n", strerror(errno));
+        return 1;
+    }
+
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+    if ((listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+        bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 16) != 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", socketPath, strerror(errno));
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+
+    Daemon_Retry(&daemon);
+    for (i = 0; i < TREE_MAX; i++) {
+        if (!daemon.trees[i].attached) {
+            fprintf(stderr, "%s does not exist yet, waiting for it\n", daemon.trees[i].root);
+        }
+    }
+
+    pollFds[0].fd = daemon.inotifyFd;
+    pollFds[0].events = POLLIN;
+    pollFds[1].fd = listenFd;
+    pollFds[1].events = POLLIN;
+    while (!sQuit) {
+        int ready = poll(pollFds, 2, Daemon_IsComplete(&daemon) ? -1 : RETRY_INTERVAL);
+
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "poll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (pollFds[0].revents & POLLIN) {
+            Daemon_ReadEvents(&daemon);
+        }
+        if (!Daemon_IsComplete(&daemon)) {
+            Daemon_Retry(&daemon);
+        }
+        if (pollFds[1].revents & POLLIN) {
+            int clientFd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+
+            if (clientFd >= 0) {
+                Daemon_ServeClient(&daemon, clientFd);
+            }
+        }
+    }
+
+    close(listenFd);
+    unlink(socketPath);
+    for (i = 0; i < TREE_MAX; i++) {
+        Daemon_RemoveFolder(&daemon, i, "");
+        free(daemon.trees[i].entries.buckets);
+        free(daemon.trees[i].root);
+    }
+    close(daemon.inotifyFd);
+    for (i = 0; (size_t)i < daemon.watchCapacity; i++) {
+        free(daemon.watches[i].path);
+    }
+    free(daemon.watches);
+    MapState_Clear(state);
+    free(state->folder);
+    free(defaultSocketPath);
+    return 0;
+}
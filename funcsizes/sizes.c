@@ -0,0 +1,521 @@
+/**
+ * @file sizes.c
+ * @brief Function sizes of object files and asm files, shared by funcsizes and progressd.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include "sizes.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Symbol that starts a function in an objdump listing */
+typedef struct {
+    uint32_t index;
+    uint32_t section;
+    uint32_t value;
+    uint32_t size;
+    uint32_t name; /* Offset in the string table */
+    bool isFunc;
+    bool isGlobal;
+} ElfFunction;
+
+/* Readers for the fields of an ELF file in either byte order */
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    bool bigEndian;
+} ElfFile;
+
+static uint16_t Elf_Read16(const ElfFile* elf, size_t offset) {
+    const uint8_t* p = elf->data + offset;
+
+    return elf->bigEndian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static uint32_t Elf_Read32(const ElfFile* elf, size_t offset) {
+    const uint8_t* p = elf->data + offset;
+
+    return elf->bigEndian ? ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+                          : ((uint32_t)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+/* Whether name is a jump table label like L80979A80, which the script does not count as a function */
+static bool IsSwitchCaseLabel(const char* name) {
+    int i;
+
+    if (name[0] != 'L') {
+        return false;
+    }
+    for (i = 1; i <= 8; i++) {
+        if (!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'A' && name[i] <= 'F') ||
+              (name[i] >= 'a' && name[i] <= 'f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Orders symbols by address, and those at the same address by which one objdump names the function after */
+static int CompareElfFunctions(const void* a, const void* b) {
+    const ElfFunction* funcA = a;
+    const ElfFunction* funcB = b;
+
+    if (funcA->section != funcB->section) {
+        return (funcA->section < funcB->section) ? -1 : 1;
+    }
+    if (funcA->value != funcB->value) {
+        return (funcA->value < funcB->value) ? -1 : 1;
+    }
+    if (funcA->isFunc != funcB->isFunc) {
+        return funcA->isFunc ? -1 : 1;
+    }
+    if (funcA->isGlobal != funcB->isGlobal) {
+        return funcA->isGlobal ? -1 : 1;
+    }
+    return (funcA->index < funcB->index) ? -1 : (funcA->index > funcB->index);
+}
+
+static int CompareFunctionNames(const void* a, const void* b) {
+    const FunctionSize* const* funcA = a;
+    const FunctionSize* const* funcB = b;
+    int cmp = strcmp((*funcA)->name, (*funcB)->name);
+
+    /* Keep equal names in the order they were found */
+    return (cmp != 0) ? cmp : (*funcA < *funcB) ? -1 : (*funcA > *funcB);
+}
+
+/**
+ * Merges functions with the same name like the script's dictionary does: the first one keeps its place and takes the
+ * size of the last one.
+ *
+ * Returns the new number of functions.
+ */
+size_t MergeDuplicateFunctions(FunctionSize* functions, size_t count) {
+    FunctionSize** sorted = malloc(count * sizeof(FunctionSize*));
+    size_t kept = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < count; i++) {
+        sorted[i] = &functions[i];
+    }
+    qsort(sorted, count, sizeof(FunctionSize*), CompareFunctionNames);
+
+    for (i = 0; i < count; i = j) {
+        for (j = i + 1; j < count && strcmp(sorted[i]->name, sorted[j]->name) == 0; j++) {
+            sorted[i]->lines = sorted[j]->lines;
+            free(sorted[j]->name);
+            sorted[j]->name = NULL;
+        }
+    }
+    free(sorted);
+
+    for (i = 0; i < count; i++) {
+        if (functions[i].name != NULL) {
+            functions[kept++] = functions[i];
+        }
+    }
+    return kept;
+}
+
+/**
+ * Finds the functions in the code sections of a 32-bit ELF object and how many instructions each has: st_size for
+ * sized STT_FUNC symbols, and the distance to the next symbol for the labels hand-written assembly uses. Jump table
+ * labels are left out, so their code counts towards the function they are in, as in the listings the script reads.
+ *
+ * Returns the number of functions written to *functions, or -1 if the file is not an ELF object this understands.
+ */
+ssize_t ReadElfFunctions(const uint8_t* data, size_t size, FunctionSize** functions) {
+    ElfFile elf = { data, size, false };
+    uint32_t shoff;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint32_t symtabOffset = 0;
+    uint32_t symtabSize = 0;
+    uint32_t strtabOffset = 0;
+    uint32_t strtabSize = 0;
+    ElfFunction* symbols;
+    size_t symbolCount = 0;
+    size_t count = 0;
+    size_t i;
+
+    if (size < sizeof(Elf32_Ehdr) || memcmp(data, ELFMAG, SELFMAG) != 0 || data[EI_CLASS] != ELFCLASS32) {
+        return -1;
+    }
+    elf.bigEndian = data[EI_DATA] == ELFDATA2MSB;
+
+    shoff = Elf_Read32(&elf, offsetof(Elf32_Ehdr, e_shoff));
+    shentsize = Elf_Read16(&elf, offsetof(Elf32_Ehdr, e_shentsize));
+    shnum = Elf_Read16(&elf, offsetof(Elf32_Ehdr, e_shnum));
+    if (shentsize < sizeof(Elf32_Shdr) || shoff > size || shnum > (size - shoff) / shentsize) {
+        return -1;
+    }
+
+#define SECTION_FIELD(index, field) Elf_Read32(&elf, shoff + (size_t)(index)*shentsize + offsetof(Elf32_Shdr, field))
+
+    for (i = 0; i < shnum; i++) {
+        if (SECTION_FIELD(i, sh_type) == SHT_SYMTAB) {
+            uint32_t link = SECTION_FIELD(i, sh_link);
+
+            symtabOffset = SECTION_FIELD(i, sh_offset);
+            symtabSize = SECTION_FIELD(i, sh_size);
+            if (link >= shnum) {
+                return -1;
+            }
+            strtabOffset = SECTION_FIELD(link, sh_offset);
+            strtabSize = SECTION_FIELD(link, sh_size);
+            break;
+        }
+    }
+    if (symtabOffset > size || symtabSize > size - symtabOffset || strtabOffset > size ||
+        strtabSize > size - strtabOffset || strtabSize == 0 || data[strtabOffset + strtabSize - 1] != '\0') {
+        return -1;
+    }
+
+    symbols = malloc((symtabSize / sizeof(Elf32_Sym) + 1) * sizeof(ElfFunction));
+    for (i = 1; i < symtabSize / sizeof(Elf32_Sym); i++) {
+        size_t symbol = symtabOffset + i * sizeof(Elf32_Sym);
+        uint32_t name = Elf_Read32(&elf, symbol + offsetof(Elf32_Sym, st_name));
+        uint8_t info = data[symbol + offsetof(Elf32_Sym, st_info)];
+        uint16_t section = Elf_Read16(&elf, symbol + offsetof(Elf32_Sym, st_shndx));
+
+        if ((ELF32_ST_TYPE(info) != STT_FUNC && ELF32_ST_TYPE(info) != STT_NOTYPE) || section == SHN_UNDEF ||
+            section >= shnum || name == 0 || name >= strtabSize ||
+            !(SECTION_FIELD(section, sh_flags) & SHF_EXECINSTR) ||
+            IsSwitchCaseLabel((const char*)data + strtabOffset + name)) {
+            continue;
+        }
+
+        symbols[symbolCount].index = i;
+        symbols[symbolCount].section = section;
+        symbols[symbolCount].value = Elf_Read32(&elf, symbol + offsetof(Elf32_Sym, st_value));
+        symbols[symbolCount].size = Elf_Read32(&elf, symbol + offsetof(Elf32_Sym, st_size));
+        symbols[symbolCount].name = name;
+        symbols[symbolCount].isFunc = ELF32_ST_TYPE(info) == STT_FUNC;
+        symbols[symbolCount].isGlobal = ELF32_ST_BIND(info) != STB_LOCAL;
+        symbolCount++;
+    }
+    qsort(symbols, symbolCount, sizeof(ElfFunction), CompareElfFunctions);
+
+    *functions = malloc((symbolCount + 1) * sizeof(FunctionSize));
+    for (i = 0; i < symbolCount; i++) {
+        const ElfFunction* func = &symbols[i];
+        uint32_t end;
+
+        /* objdump only names one symbol at each address */
+        if (i != 0 && symbols[i - 1].section == func->section && symbols[i - 1].value == func->value) {
+            continue;
+        }
+
+        if (func->isFunc && func->size != 0) {
+            end = func->value + func->size;
+        } else {
+            size_t next = i + 1;
+
+            while (next < symbolCount && symbols[next].section == func->section && symbols[next].value == func->value) {
+                next++;
+            }
+            if (next < symbolCount && symbols[next].section == func->section) {
+                end = symbols[next].value;
+            } else {
+                end = SECTION_FIELD(func->section, sh_addr) + SECTION_FIELD(func->section, sh_size);
+            }
+        }
+
+        (*functions)[count].name = strdup((const char*)data + strtabOffset + func->name);
+        (*functions)[count].lines = (end > func->value) ? (end - func->value) / 4 : 0;
+        count++;
+    }
+
+#undef SECTION_FIELD
+
+    free(symbols);
+    return MergeDuplicateFunctions(*functions, count);
+}
+
+/**
+ * Maps the whole file at path into memory. An empty file gives a NULL mapping.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int MapWholeFile(const char* path, void** data, size_t* size) {
+    int fd;
+    struct stat fileStat;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    *size = fileStat.st_size;
+    *data = NULL;
+    if (*size != 0) {
+        *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    return (*data == MAP_FAILED) ? -1 : 0;
+}
+
+void UnmapFile(void* data, size_t size) {
+    if (data != NULL) {
+        munmap(data, size);
+    }
+}
+
+bool EndsWith(const char* str, const char* suffix) {
+    size_t length = strlen(str);
+    size_t suffixLength = strlen(suffix);
+
+    return length >= suffixLength && strcmp(str + length - suffixLength, suffix) == 0;
+}
+
+/* Whether the entry of a folder listing at path is a folder itself. Symbolic links to folders are not followed. */
+bool IsFolder(const struct dirent* dirEntry, const char* path) {
+    struct stat fileStat;
+
+    if (dirEntry->d_type != DT_UNKNOWN) {
+        return dirEntry->d_type == DT_DIR;
+    }
+    return lstat(path, &fileStat) == 0 && S_ISDIR(fileStat.st_mode);
+}
+
+/**
+ * Counts the lines starting with a slash, an asterisk and a space, which in the asm files of non_matchings are the
+ * instructions. Like Python's readlines(), a line may end with "\r" as well as "\n".
+ */
+size_t CountInstructionLines(const uint8_t* data, size_t size) {
+    size_t count = 0;
+    size_t i = 1;
+
+    if (size < 3) {
+        return 0;
+    }
+    if (data[0] == '/' && data[1] == '*' && data[2] == ' ') {
+        count++;
+    }
+
+#if defined(__SSE2__)
+    /* Compare 16 line starts at a time: each lane checks its own byte, the one before and the two after */
+    for (; i + 2 + 16 <= size; i += 16) {
+        __m128i prev = _mm_loadu_si128((const __m128i*)(data + i - 1));
+        __m128i first = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i second = _mm_loadu_si128((const __m128i*)(data + i + 1));
+        __m128i third = _mm_loadu_si128((const __m128i*)(data + i + 2));
+        __m128i lineStart =
+            _mm_or_si128(_mm_cmpeq_epi8(prev, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(prev, _mm_set1_epi8('\r')));
+        __m128i prefix = _mm_and_si128(_mm_cmpeq_epi8(first, _mm_set1_epi8('/')),
+                                       _mm_and_si128(_mm_cmpeq_epi8(second, _mm_set1_epi8('*')),
+                                                     _mm_cmpeq_epi8(third, _mm_set1_epi8(' '))));
+
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_and_si128(lineStart, prefix)));
+    }
+#endif
+
+    for (; i + 2 < size; i++) {
+        if ((data[i - 1] == '\n' || data[i - 1] == '\r') && data[i] == '/' && data[i + 1] == '*' &&
+            data[i + 2] == ' ') {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Reads the functions of the object file at path into entry, printing why if it cannot.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int SizeEntry_ReadObject(SizeEntry* entry, const char* path) {
+    void* data;
+    size_t size;
+    ssize_t count;
+
+    if (MapWholeFile(path, &data, &size) != 0) {
+        fprintf(stderr, "Failed to read %s\n", path);
+        return -1;
+    }
+    count = (data != NULL) ? ReadElfFunctions(data, size, &entry->functions) : -1;
+    UnmapFile(data, size);
+
+    if (count < 0) {
+        fprintf(stderr, "%s is not a 32-bit ELF object\n", path);
+        return -1;
+    }
+    entry->functionCount = count;
+    return 0;
+}
+
+/**
+ * Counts the instructions in the asm file at path into function, printing why if it cannot.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int SizeEntry_CountAsmFile(FunctionSize* function, const char* path) {
+    void* data;
+    size_t size;
+
+    if (MapWholeFile(path, &data, &size) != 0) {
+        fprintf(stderr, "Failed to read %s\n", path);
+        return -1;
+    }
+    function->lines = (data != NULL) ? CountInstructionLines(data, size) : 0;
+    UnmapFile(data, size);
+    return 0;
+}
+
+/**
+ * Fills in the summary of an entry: the script gives the number of functions in an object file, or of files in a
+ * folder of non-matchings, the largest one, the total, rounded up to a multiple of four for object files, and the
+ * average.
+ */
+void SizeEntry_Summarise(SizeEntry* entry, bool roundTotal) {
+    uint64_t total = 0;
+    size_t i;
+
+    entry->maxSize = 0;
+    for (i = 0; i < entry->functionCount; i++) {
+        total += entry->functions[i].lines;
+        if (entry->functions[i].lines > entry->maxSize) {
+            entry->maxSize = entry->functions[i].lines;
+        }
+    }
+
+    entry->count = entry->functionCount;
+    entry->totalSize = roundTotal ? (total + 3) / 4 * 4 : total;
+    entry->averageSize = (double)entry->totalSize / entry->count;
+}
+
+void SizeEntry_Destroy(SizeEntry* entry) {
+    size_t i;
+
+    for (i = 0; i < entry->functionCount; i++) {
+        free(entry->functions[i].name);
+    }
+    free(entry->functions);
+    free(entry->name);
+    free(entry->path);
+}
+
+
+static int CompareStrings(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int CompareEntries(const void* a, const void* b) {
+    const SizeEntry* entryA = a;
+    const SizeEntry* entryB = b;
+    int cmp = strcmp(entryA->name, entryB->name);
+
+    if (cmp != 0 || entryA->path == NULL || entryB->path == NULL) {
+        return cmp;
+    }
+    return strcmp(entryA->path, entryB->path);
+}
+
+/**
+ * Reads the names in the first column of the file at path, like get_list_from_file().
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int NameList_Read(NameList* list, const char* path) {
+    FILE* file = fopen(path, "r");
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    size_t capacity = 0;
+    ssize_t length;
+
+    list->names = NULL;
+    list->count = 0;
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return -1;
+    }
+
+    while ((length = getline(&line, &lineCapacity, file)) >= 0) {
+        char* start = line;
+        char* end = line + length;
+
+        while (start < end && (*start == ' ' || (*start >= '\t' && *start <= '\r'))) {
+            start++;
+        }
+        while (end > start && (end[-1] == ' ' || (end[-1] >= '\t' && end[-1] <= '\r'))) {
+            end--;
+        }
+        *end = '\0';
+        start[strcspn(start, ",")] = '\0';
+
+        if (list->count == capacity) {
+            capacity = 2 * capacity + 64;
+            list->names = realloc(list->names, capacity * sizeof(char*));
+        }
+        list->names[list->count++] = strdup(start);
+    }
+    free(line);
+    fclose(file);
+
+    qsort(list->names, list->count, sizeof(char*), CompareStrings);
+    return 0;
+}
+
+bool NameList_Contains(const NameList* list, const char* name) {
+    return list->count != 0 && bsearch(&name, list->names, list->count, sizeof(char*), CompareStrings) != NULL;
+}
+
+void NameList_Destroy(NameList* list) {
+    size_t i;
+
+    for (i = 0; i < list->count; i++) {
+        free(list->names[i]);
+    }
+    free(list->names);
+}
+
+/**
+ * Sorts entries by name and prints them as the script does, either a summary row for each or a row for each of their
+ * functions. Entries named in ignored, or not named in includeOnly if it has any names, are left out; either may be
+ * NULL.
+ */
+void SizeEntries_Print(FILE* out, SizeEntry* entries, size_t count, bool functionLines, const NameList* ignored,
+                       const NameList* includeOnly) {
+    size_t i;
+    size_t j;
+
+    qsort(entries, count, sizeof(SizeEntry), CompareEntries);
+
+    fputs(functionLines ? "File,Function_name,Lines\n" : "File,Num functions,Max size,Total size,Average size\n", out);
+    for (i = 0; i < count; i++) {
+        const SizeEntry* entry = &entries[i];
+
+        /* Folders of non-matchings with the same name replace each other in the script; keep the last by path */
+        if (i + 1 < count && strcmp(entry->name, entries[i + 1].name) == 0) {
+            continue;
+        }
+        if ((ignored != NULL && NameList_Contains(ignored, entry->name)) ||
+            (includeOnly != NULL && includeOnly->count != 0 && !NameList_Contains(includeOnly, entry->name))) {
+            continue;
+        }
+
+        if (functionLines) {
+            for (j = 0; j < entry->functionCount; j++) {
+                fprintf(out, "%s,%s,%u\n", entry->name, entry->functions[j].name, entry->functions[j].lines);
+            }
+        } else {
+            fprintf(out, "%s,%u,%u,%u,%.2f\n", entry->name, entry->count, entry->maxSize, entry->totalSize,
+                    entry->averageSize);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+typedef struct {
+    char* name;
+    uint32_t lines;
+} FunctionSize;
+
+/* One row of the summary, with the functions it is made of */
+typedef struct {
+    char* name;
+    char* path; /* Object file or folder of non-matchings it was made from */
+    FunctionSize* functions;
+    size_t functionCount;
+    uint32_t count;
+    uint32_t maxSize;
+    uint32_t totalSize;
+    double averageSize;
+} SizeEntry;
+
+/* Names read from the first column of a CSV, sorted so they can be binary searched */
+typedef struct {
+    char** names;
+    size_t count;
+} NameList;
+
+ssize_t ReadElfFunctions(const uint8_t* data, size_t size, FunctionSize** functions);
+size_t CountInstructionLines(const uint8_t* data, size_t size);
+
+int SizeEntry_ReadObject(SizeEntry* entry, const char* path);
+int SizeEntry_CountAsmFile(FunctionSize* function, const char* path);
+void SizeEntry_Summarise(SizeEntry* entry, bool roundTotal);
+void SizeEntry_Destroy(SizeEntry* entry);
+void SizeEntries_Print(FILE* out, SizeEntry* entries, size_t count, bool functionLines, const NameList* ignored,
+                       const NameList* includeOnly);
+
+int NameList_Read(NameList* list, const char* path);
+bool NameList_Contains(const NameList* list, const char* name);
+void NameList_Destroy(NameList* list);
+
+int MapWholeFile(const char* path, void** data, size_t* size);
+void UnmapFile(void* data, size_t size);
+bool EndsWith(const char* str, const char* suffix);
+bool IsFolder(const struct dirent* dirEntry, const char* path);
@@ -4,13 +4,10 @@ from __future__ import annotations
 
 import argparse
 import dataclasses
-import re
 import collections
 
+import mapfile
 
-regex_fileDataEntry = re.compile(r"^\s+(?P<section>[^\s]+)\s+(?P<vram>0x[^\s]+)\s+(?P<size>0x[^\s]+)\s+(?P<name>[^\s]+)$")
-regex_functionEntry = re.compile(r"^\s+(?P<vram>0x[^\s]+)\s+(?P<name>[^\s]+)$")
-regex_label = re.compile(r"^(?P<name>L[0-9A-F]{8})$")
 
 @dataclasses.dataclass
 class Function:
@@ -26,51 +23,18 @@ class File:
     functions: list[Function]
 
 
-def parseMapFile(mapPath: str, startingPoint: str) -> list[File]:
-    with open(mapPath) as f:
-        mapData = f.read()
-        startIndex = mapData.find(startingPoint)
-        mapData = mapData[startIndex:]
-    # print(len(mapData))
-
+def parseMapFile(mapPath: str, startingPoint: str, useSnapshot: bool = True) -> list[File]:
     filesList: list[File] = list()
 
-    inFile = False
-
-    mapLines = mapData.split("\n")
-    for line in mapLines:
-        if inFile:
-            if line.startswith("                "):
-                entryMatch = regex_functionEntry.search(line)
-
-                # Find function
-                if entryMatch is not None:
-                    funcName = entryMatch["name"]
-                    funcVram = int(entryMatch["vram"], 16)
-
-                    # Filter out jump table's labels
-                    labelMatch = regex_label.search(funcName)
-                    if labelMatch is None:
-                        filesList[-1].functions.append(Function(funcName, funcVram, -1))
-                    # print(hex(funcVram), funcName)
-
-            else:
-                inFile = False
-        else:
-            if line.startswith(" .text "):
-                inFile = False
-                entryMatch = regex_fileDataEntry.search(line)
-
-                # Find file
-                if entryMatch is not None:
-                    name = "/".join(entryMatch["name"].split("/")[2:])
-                    name = ".".join(name.split(".")[:-1])
-                    size = int(entryMatch["size"], 16) // 4
-                    vram = int(entryMatch["vram"], 16)
-
-                    if size > 0:
-                        inFile = True
-                        filesList.append(File(name, vram, size, list()))
+    for entry in mapfile.MapFile(mapPath, startingPoint, filterLabels=True, sectionFilter=".text", useSnapshot=useSnapshot).entries:
+        # Find file
+        name = "/".join(entry.name.split("/")[2:])
+        name = ".".join(name.split(".")[:-1])
+        size = entry.size // 4
+
+        if size > 0:
+            functions = [Function(symbol.name, symbol.vram, -1) for symbol in entry.symbols]
+            filesList.append(File(name, entry.vram, size, functions))
 
     resultFileList: list[File] = list()
 
@@ -209,9 +173,10 @@ def main():
     parser.add_argument("--same-folder", help="Mix files in the same folder.", action="store_true")
     parser.add_argument("--functions", help="Prints the size of every function instead of a summary.", action="store_true")
     parser.add_argument("--starting-point", default="\n build/")
+    parser.add_argument("--no-snapshot", help="Parse the map file instead of loading the snapshot saved next to it, and do not save one.", action="store_true")
     args = parser.parse_args()
 
-    filesList = parseMapFile(args.mapfile, args.starting_point)
+    filesList = parseMapFile(args.mapfile, args.starting_point, not args.no_snapshot)
 
     if args.same_folder:
         filesList = mixFolders(filesList)
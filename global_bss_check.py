@@ -4,12 +4,9 @@ colorama.init()
 
 import argparse
 import os
-import re
 import collections
 
-regex_fileDataEntry = re.compile(r"^\s+(?P<section>[^\s]+)\s+(?P<vram>0x[^\s]+)\s+(?P<size>0x[^\s]+)\s+(?P<name>[^\s]+)$")
-regex_bssEntry = re.compile(r"^\s+(?P<vram>0x[^\s]+)\s+(?P<name>[^\s]+)$")
-regex_label = re.compile(r"^(?P<name>L[0-9A-F]{8})$")
+import mapfile
 
 
 File = collections.namedtuple("File", ["name", "vram", "bssVariables"])
@@ -19,62 +16,24 @@ Variable = collections.namedtuple("Variable", ["name", "vram"])
 
 VarInfo = collections.namedtuple("Variable", ["file", "vram"])
 
-def parseMapFile(mapPath: str):
-    with open(mapPath) as f:
-        mapData = f.read()
-        startIndex = mapData.find("..makerom")
-        mapData = mapData[startIndex:]
-    # print(len(mapData))
-
-    filesList = list()
-
+def parseMapFile(mapPath: str, useSnapshot: bool = False):
     symbolsDict = collections.OrderedDict()
 
-    inFile = False
-    currentFile = ""
-
-    mapLines = mapData.split("\n")
-    for line in mapLines:
-        if inFile:
-            if line.startswith("                "):
-                entryMatch = regex_bssEntry.search(line)
+    for entry in mapfile.MapFile(mapPath, "..makerom", filterLabels=True, sectionFilter=".bss", useSnapshot=useSnapshot).entries:
+        # Find file
+        name = "/".join(entry.name.split("/")[1:])
 
-                # Find variable
-                if entryMatch is not None:
-                    varName = entryMatch["name"]
-                    varVram = int(entryMatch["vram"], 16)
+        # mapfile only contains .o files, so just strip the last character to replace it
+        # we assume all the .c files are in the src folder, and all others are .s (true for OoT/MM)
+        if name.split("/")[0] == "src":
+            name = name[:-1] + "c"
+        else:
+            name = name[:-1] + "s"
 
-                    # Filter out jump table labels
-                    labelMatch = regex_label.search(varName)
-                    if labelMatch is None:
-                        symbolsDict[varName] = VarInfo( currentFile, varVram )
-                        # print( symbolsDict[varName] )
+        if entry.size > 0:
+            for symbol in entry.symbols:
+                symbolsDict[symbol.name] = VarInfo( name, symbol.vram )
 
-            else:
-                inFile = False
-        else:
-            if line.startswith(" .bss "):
-                inFile = False
-                entryMatch = regex_fileDataEntry.search(line)
-
-                # Find file
-                if entryMatch is not None:
-                    name = "/".join(entryMatch["name"].split("/")[1:])
-
-                    # mapfile only contains .o files, so just strip the last character to replace it
-                    # we assume all the .c files are in the src folder, and all others are .s (true for OoT/MM)
-                    if name.split("/")[0] == "src":
-                        name = name[:-1] + "c"
-                    else:
-                        name = name[:-1] + "s"
-
-                    size = int(entryMatch["size"], 16)
-                    vram = int(entryMatch["vram"], 16)
-
-                    if size > 0:
-                        inFile = True
-                        currentFile = name
-                        
     # print(symbolsDict)
     # resultFileDict = dict()
 
@@ -92,7 +51,7 @@ def parseMapFile(mapPath: str):
 
 Compared = collections.namedtuple("Compared", [ "buildAddress", "buildFile", "expectedAddress", "expectedFile", "diff"])
 
-def compareMapFiles(mapFileBuild: str, mapFileExpected: str):
+def compareMapFiles(mapFileBuild: str, mapFileExpected: str, useSnapshot: bool = True):
     badFiles = set()
     missingFiles = set()
 
@@ -109,7 +68,7 @@ def compareMapFiles(mapFileBuild: str, mapFileExpected: str):
         exit(1)
 
     buildMap = parseMapFile(mapFileBuild)
-    expectedMap = parseMapFile(mapFileExpected)
+    expectedMap = parseMapFile(mapFileExpected, useSnapshot)
 
     comparedDict = collections.OrderedDict()
 
@@ -172,12 +131,13 @@ def main():
     parser.add_argument("mapFileExpected", help="Path to the expected map file. Optional, default is 'expected/mapFile'.", nargs="?", default="")
     parser.add_argument("-a", "--print-all", help="Print all bss, not just non-matching.", action="store_true")
     parser.add_argument("-n", "--no-fun-allowed", help="Remove amusing messages.", action="store_true")
+    parser.add_argument("-S", "--no-snapshot", help="Parse the expected map file instead of loading the snapshot saved next to it, and do not save one.", action="store_true")
     args = parser.parse_args()
 
     if args.mapFileExpected == "":
         args.mapFileExpected = os.path.join("expected", args.mapFile)
 
-    badFiles, missingFiles, comparedDict = compareMapFiles(args.mapFile, args.mapFileExpected)
+    badFiles, missingFiles, comparedDict = compareMapFiles(args.mapFile, args.mapFileExpected, not args.no_snapshot)
     printCsv(badFiles, missingFiles, comparedDict, args.print_all)
 
     if len(badFiles) + len(missingFiles) != 0:
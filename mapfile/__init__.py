@@ -0,0 +1,250 @@
+"""
+GNU ld map file parser shared by the map-reading scripts.
+
+Uses libmapfile.so from this folder (build it with `make -C mapfile`) if it is there, and an equivalent, slower, pure
+Python parser otherwise.
+
+With useSnapshot, the native parser keeps a binary snapshot of the parsed map next to the map file and loads that
+instead of parsing the map again as long as the map text has not changed.
+"""
+
+from __future__ import annotations
+
+import ctypes
+import dataclasses
+import os
+import struct
+
+
+FILTER_LABELS = 1 << 0
+
+
+@dataclasses.dataclass
+class Symbol:
+    name: str
+    vram: int
+
+@dataclasses.dataclass
+class FileEntry:
+    section: str
+    name: str
+    vram: int
+    size: int
+    rom: int
+    symbols: list[Symbol]
+
+@dataclasses.dataclass
+class Section:
+    name: str
+    vram: int
+    size: int
+    rom: int
+    entries: list[FileEntry]
+
+
+class _MapFileStruct(ctypes.Structure):
+    _fields_ = [
+        ("strings", ctypes.c_void_p),
+        ("stringsSize", ctypes.c_size_t),
+        ("stringsCapacity", ctypes.c_size_t),
+        ("stringOffsets", ctypes.c_void_p),
+        ("stringCount", ctypes.c_size_t),
+        ("stringOffsetsCapacity", ctypes.c_size_t),
+        ("sections", ctypes.c_void_p),
+        ("sectionCount", ctypes.c_size_t),
+        ("sectionCapacity", ctypes.c_size_t),
+        ("entries", ctypes.c_void_p),
+        ("entryCount", ctypes.c_size_t),
+        ("entryCapacity", ctypes.c_size_t),
+        ("symbols", ctypes.c_void_p),
+        ("symbolCount", ctypes.c_size_t),
+        ("symbolCapacity", ctypes.c_size_t),
+    ]
+
+# Layouts of MapSection, MapFileEntry and MapSymbol in mapfile.h
+_sectionFormat = struct.Struct("=IIIIQQQ")
+_entryFormat = struct.Struct("=IIIIIIQQQ")
+_symbolFormat = struct.Struct("=IIQ")
+
+
+def _loadLibrary():
+    libPath = os.path.join(os.path.dirname(os.path.abspath(__file__)), "libmapfile.so")
+    try:
+        lib = ctypes.CDLL(libPath)
+    except OSError:
+        return None
+
+    lib.MapFile_Load.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int]
+    lib.MapFile_Load.restype = ctypes.POINTER(_MapFileStruct)
+    lib.MapFile_LoadCached.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p]
+    lib.MapFile_LoadCached.restype = ctypes.POINTER(_MapFileStruct)
+    lib.MapFile_Free.argtypes = [ctypes.POINTER(_MapFileStruct)]
+    lib.MapFile_Free.restype = None
+    lib.MapFile_FindEntriesInSection.argtypes = [ctypes.POINTER(_MapFileStruct), ctypes.c_char_p, ctypes.POINTER(ctypes.c_uint32)]
+    lib.MapFile_FindEntriesInSection.restype = ctypes.c_size_t
+    return lib
+
+_lib = _loadLibrary()
+
+
+def _isLabel(name: str) -> bool:
+    return len(name) == 9 and name[0] == "L" and all(c in "0123456789ABCDEF" for c in name[1:])
+
+
+class MapFile:
+    def __init__(self, mapPath: str, startMarker: str|None = None, filterLabels: bool = False, sectionFilter: str|None = None, useSnapshot: bool = False):
+        """
+        Parses the map file at mapPath, starting from the first occurrence of startMarker if it is given.
+        If sectionFilter is given, only file entries for input sections with that name are kept.
+        If useSnapshot is set, the map is loaded from its snapshot if that is up to date, and a new snapshot is saved
+        otherwise; it makes no difference without libmapfile.so.
+        """
+        self.sections: list[Section] = list()
+        self.entries: list[FileEntry] = list()
+
+        flags = FILTER_LABELS if filterLabels else 0
+
+        if _lib is not None:
+            self._parseNative(mapPath, startMarker, flags, sectionFilter, useSnapshot)
+        else:
+            self._parsePython(mapPath, startMarker, flags, sectionFilter)
+
+    def _parseNative(self, mapPath: str, startMarker: str|None, flags: int, sectionFilter: str|None, useSnapshot: bool):
+        marker = startMarker.encode() if startMarker is not None else None
+        if useSnapshot:
+            mapPtr = _lib.MapFile_LoadCached(mapPath.encode(), marker, flags, None)
+        else:
+            mapPtr = _lib.MapFile_Load(mapPath.encode(), marker, flags)
+        if not mapPtr:
+            raise OSError(f"Failed to parse map file {mapPath}")
+
+        try:
+            native = mapPtr.contents
+            # Names are stored one after another in index order, so they can all be decoded at once
+            strings = ctypes.string_at(native.strings, native.stringsSize) if native.stringsSize else b""
+            names = strings.decode(errors="replace").split("\0")
+
+            entryData = ctypes.string_at(native.entries, native.entryCount * _entryFormat.size) if native.entryCount else b""
+            symbolData = ctypes.string_at(native.symbols, native.symbolCount * _symbolFormat.size) if native.symbolCount else b""
+
+            if sectionFilter is not None:
+                indexArray = (ctypes.c_uint32 * max(native.entryCount, 1))()
+                indexCount = _lib.MapFile_FindEntriesInSection(mapPtr, sectionFilter.encode(), indexArray)
+                entryIndices = indexArray[:indexCount]
+            else:
+                entryIndices = range(native.entryCount)
+
+            entryPositions: dict[int, int] = dict()
+            for index in entryIndices:
+                name, section, _, firstSymbol, symbolCount, _, vram, size, rom = _entryFormat.unpack_from(entryData, index * _entryFormat.size)
+                symbolBytes = symbolData[firstSymbol * _symbolFormat.size:(firstSymbol + symbolCount) * _symbolFormat.size]
+                symbols = [Symbol(names[symbolName], symbolVram) for symbolName, _, symbolVram in _symbolFormat.iter_unpack(symbolBytes)]
+                entryPositions[index] = len(self.entries)
+                self.entries.append(FileEntry(names[section], names[name], vram, size, rom, symbols))
+
+            for name, firstEntry, entryCount, _, vram, size, rom in self._unpack(native.sections, native.sectionCount, _sectionFormat):
+                entries = [self.entries[entryPositions[index]] for index in range(firstEntry, firstEntry+entryCount) if index in entryPositions]
+                self.sections.append(Section(names[name], vram, size, rom, entries))
+        finally:
+            _lib.MapFile_Free(mapPtr)
+
+    @staticmethod
+    def _unpack(address: int, count: int, format: struct.Struct) -> list[tuple]:
+        if count == 0:
+            return list()
+        return list(format.iter_unpack(ctypes.string_at(address, count * format.size)))
+
+    def _parsePython(self, mapPath: str, startMarker: str|None, flags: int, sectionFilter: str|None):
+        # Follows MapFile_ParseBuffer() in mapfile.c
+        with open(mapPath) as f:
+            mapData = f.read()
+        if startMarker is not None:
+            startIndex = mapData.find(startMarker)
+            if startIndex < 0:
+                return
+            mapData = mapData[startIndex:]
+
+        def parseHex(token: str) -> int|None:
+            if len(token) < 3 or not token.startswith("0x"):
+                return None
+            try:
+                return int(token[2:], 16)
+            except ValueError:
+                return None
+
+        def parseSection(name: str, tokens: list[str]) -> Section|None:
+            if len(tokens) < 2:
+                return None
+            vram = parseHex(tokens[0])
+            size = parseHex(tokens[1])
+            if vram is None or size is None:
+                return None
+            rom = vram
+            if len(tokens) == 5 and tokens[2] == "load" and parseHex(tokens[4]) is not None:
+                rom = parseHex(tokens[4])
+            return Section(name, vram, size, rom, list())
+
+        def addEntry(sectionName: str, tokens: list[str]) -> FileEntry|None:
+            if len(tokens) != 3:
+                return None
+            vram = parseHex(tokens[0])
+            size = parseHex(tokens[1])
+            if vram is None or size is None:
+                return None
+            rom = vram
+            if len(self.sections) != 0:
+                section = self.sections[-1]
+                rom = section.rom + (vram - section.vram)
+            entry = FileEntry(sectionName, tokens[2], vram, size, rom, list())
+            if sectionFilter is None or sectionName == sectionFilter:
+                if len(self.sections) != 0:
+                    self.sections[-1].entries.append(entry)
+                self.entries.append(entry)
+            return entry
+
+        currentEntry: FileEntry|None = None
+        pendingSection: str|None = None
+        pendingEntry: str|None = None
+
+        for line in mapData.split("\n"):
+            prevSection = pendingSection
+            prevEntry = pendingEntry
+            pendingSection = None
+            pendingEntry = None
+
+            tokens = line.split()
+            indent = len(line) - len(line.lstrip(" "))
+
+            if len(tokens) == 0:
+                currentEntry = None
+            elif indent == 0:
+                currentEntry = None
+                if tokens[0].startswith("*"):
+                    continue
+                if len(tokens) == 1:
+                    pendingSection = tokens[0]
+                else:
+                    section = parseSection(tokens[0], tokens[1:])
+                    if section is not None:
+                        self.sections.append(section)
+            elif indent == 1:
+                currentEntry = None
+                if tokens[0].startswith("*"):
+                    continue
+                if len(tokens) == 1:
+                    pendingEntry = tokens[0]
+                else:
+                    currentEntry = addEntry(tokens[0], tokens[1:])
+            elif indent >= 16:
+                if prevSection is not None:
+                    section = parseSection(prevSection, tokens)
+                    if section is not None:
+                        self.sections.append(section)
+                elif prevEntry is not None:
+                    currentEntry = addEntry(prevEntry, tokens)
+                elif currentEntry is not None and len(tokens) == 2:
+                    vram = parseHex(tokens[0])
+                    if vram is not None and not ((flags & FILTER_LABELS) and _isLabel(tokens[1])):
+                        currentEntry.symbols.append(Symbol(tokens[1], vram))
+            else:
+                currentEntry = None
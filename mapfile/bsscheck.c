@@ -0,0 +1,759 @@
+/**
+ * @file bsscheck.c
+ * @brief Check that bss has not been reordered by comparing the build map file with the expected one.
+ *
+ * Native version of global_bss_check.py, and of check_bss.py with --per-file.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mapfile.h"
+
+/* The ANSI sequences colorama uses. Only written when the stream is a terminal, as colorama strips them otherwise. */
+#define FORE_RED "\x1B[31m"
+#define FORE_GREEN "\x1B[32m"
+#define FORE_YELLOW "\x1B[33m"
+#define FORE_CYAN "\x1B[36m"
+#define FORE_RESET "\x1B[39m"
+#define FORE_LIGHTRED "\x1B[91m"
+#define FORE_LIGHTGREEN "\x1B[92m"
+#define FORE_LIGHTWHITE "\x1B[97m"
+#define BACK_RED "\x1B[41m"
+#define BACK_BLACK "\x1B[40m"
+#define BACK_RESET "\x1B[49m"
+#define RESET_ALL "\x1B[0m"
+
+typedef struct {
+    bool printAll;
+    bool noFun;
+    bool perFile;
+    bool noSnapshot;
+    bool colourOut;
+    bool colourErr;
+} Options;
+
+Options gOptions = { 0 };
+
+#define OUT(code) (gOptions.colourOut ? (code) : "")
+#define ERR(code) (gOptions.colourErr ? (code) : "")
+
+/* Map file to parse on its own thread */
+typedef struct {
+    const char* path;
+    bool useSnapshot;
+    MapFile map;
+    int result;
+} MapJob;
+
+/**
+ * Bss symbols of a map by name. A scope collects the symbols of some file entries: a name seen again in the same scope
+ * replaces the earlier symbol's value but keeps its position, like assigning to an existing key of a Python dict.
+ *
+ * Names are looked up through the map's intern table, so once a name has been found everything else is indexed by its
+ * string index.
+ */
+typedef struct {
+    const MapFile* map;
+    uint32_t* latest; /* By string index: last symbol with that name in the current scope */
+    uint32_t* stamps; /* By string index: scope in which latest was written */
+    uint32_t* order;  /* String indices of the names in the current scope, in order of first appearance */
+    size_t orderCount;
+    uint32_t stamp;
+} SymbolIndex;
+
+/* Open-addressing set of strings owned elsewhere, remembering the order they were added in, with a value for each */
+typedef struct {
+    const char** names;
+    uint32_t* hashes;
+    uint32_t* values;
+    size_t count;
+    size_t namesCapacity;
+    uint32_t* slots; /* Index into names + 1, 0 for empty */
+    size_t slotCapacity;
+} NameTable;
+
+static uint32_t HashName(const char* name) {
+    uint32_t hash = 2166136261u;
+
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (uint8_t)*name) * 16777619u;
+    }
+    return hash;
+}
+
+static size_t NameTable_FindSlot(const NameTable* table, const char* name, uint32_t hash) {
+    size_t slot = hash & (table->slotCapacity - 1);
+
+    while (table->slots[slot] != 0) {
+        size_t index = table->slots[slot] - 1;
+
+        if (table->hashes[index] == hash && strcmp(table->names[index], name) == 0) {
+            break;
+        }
+        slot = (slot + 1) & (table->slotCapacity - 1);
+    }
+    return slot;
+}
+
+/**
+ * Returns the position of name in the table, or MAPFILE_NONE if it is not there.
+ */
+uint32_t NameTable_Find(const NameTable* table, const char* name) {
+    size_t slot;
+
+    if (table->slotCapacity == 0) {
+        return MAPFILE_NONE;
+    }
+    slot = NameTable_FindSlot(table, name, HashName(name));
+    return (table->slots[slot] != 0) ? table->slots[slot] - 1 : MAPFILE_NONE;
+}
+
+/**
+ * Sets the value of name, adding it to the end of the table if it is not there already.
+ *
+ * Returns true if name was added.
+ */
+bool NameTable_Set(NameTable* table, const char* name, uint32_t value) {
+    uint32_t hash = HashName(name);
+    size_t slot;
+    size_t i;
+
+    /* Keep the load factor at most 1/2 */
+    if (2 * (table->count + 1) > table->slotCapacity) {
+        table->slotCapacity = (table->slotCapacity == 0) ? 256 : 2 * table->slotCapacity;
+        free(table->slots);
+        table->slots = calloc(table->slotCapacity, sizeof(uint32_t));
+
+        for (i = 0; i < table->count; i++) {
+            slot = table->hashes[i] & (table->slotCapacity - 1);
+            while (table->slots[slot] != 0) {
+                slot = (slot + 1) & (table->slotCapacity - 1);
+            }
+            table->slots[slot] = i + 1;
+        }
+    }
+
+    slot = NameTable_FindSlot(table, name, hash);
+    if (table->slots[slot] != 0) {
+        table->values[table->slots[slot] - 1] = value;
+        return false;
+    }
+
+    if (table->count == table->namesCapacity) {
+        table->namesCapacity = (table->namesCapacity == 0) ? 256 : 2 * table->namesCapacity;
+        table->names = realloc(table->names, table->namesCapacity * sizeof(const char*));
+        table->hashes = realloc(table->hashes, table->namesCapacity * sizeof(uint32_t));
+        table->values = realloc(table->values, table->namesCapacity * sizeof(uint32_t));
+    }
+    table->names[table->count] = name;
+    table->hashes[table->count] = hash;
+    table->values[table->count] = value;
+    table->slots[slot] = ++table->count;
+    return true;
+}
+
+void NameTable_Destroy(NameTable* table) {
+    free(table->names);
+    free(table->hashes);
+    free(table->values);
+    free(table->slots);
+}
+
+void SymbolIndex_Init(SymbolIndex* index, const MapFile* map) {
+    index->map = map;
+    index->latest = malloc((map->stringCount + 1) * sizeof(uint32_t));
+    index->stamps = calloc(map->stringCount + 1, sizeof(uint32_t));
+    index->order = malloc((map->stringCount + 1) * sizeof(uint32_t));
+    index->orderCount = 0;
+    index->stamp = 0;
+}
+
+/* Starts a new scope, forgetting the symbols added so far */
+void SymbolIndex_Begin(SymbolIndex* index) {
+    index->stamp++;
+    index->orderCount = 0;
+}
+
+void SymbolIndex_AddEntry(SymbolIndex* index, uint32_t entryIndex) {
+    const MapFileEntry* entry = &index->map->entries[entryIndex];
+    uint32_t i;
+
+    for (i = entry->firstSymbol; i < entry->firstSymbol + entry->symbolCount; i++) {
+        uint32_t name = index->map->symbols[i].name;
+
+        if (index->stamps[name] != index->stamp) {
+            index->stamps[name] = index->stamp;
+            index->order[index->orderCount++] = name;
+        }
+        index->latest[name] = i;
+    }
+}
+
+/**
+ * Returns the symbol called name in the current scope, or NULL if there is none.
+ */
+const MapSymbol* SymbolIndex_Find(const SymbolIndex* index, const char* name) {
+    uint32_t string = MapFile_FindString(index->map, name);
+
+    if (string == MAPFILE_NONE || index->stamps[string] != index->stamp) {
+        return NULL;
+    }
+    return &index->map->symbols[index->latest[string]];
+}
+
+const MapSymbol* SymbolIndex_Get(const SymbolIndex* index, size_t position) {
+    return &index->map->symbols[index->latest[index->order[position]]];
+}
+
+void SymbolIndex_Destroy(SymbolIndex* index) {
+    free(index->latest);
+    free(index->stamps);
+    free(index->order);
+}
+
+static bool IsBssEntry(const MapFileEntry* entry, uint32_t bssName) {
+    return bssName != MAPFILE_NONE && entry->section == bssName && entry->size > 0;
+}
+
+/**
+ * Name global_bss_check.py gives the source of an object file: drop the build folder, and replace the last character
+ * with c for files in src/ and s for everything else.
+ */
+char* GetSourceName(const char* path) {
+    const char* slash = strchr(path, '/');
+    const char* name = (slash != NULL) ? slash + 1 : "";
+    size_t length = strlen(name);
+    char* result = malloc(length + 2);
+    bool isSrc = strncmp(name, "src", 3) == 0 && (name[3] == '/' || name[3] == '\0');
+
+    if (length != 0) {
+        memcpy(result, name, length - 1);
+    }
+    result[(length != 0) ? length - 1 : 0] = isSrc ? 'c' : 's';
+    result[(length != 0) ? length : 1] = '\0';
+    return result;
+}
+
+/**
+ * Name check_bss.py gives an object file: drop the first two folders and the extension.
+ */
+char* GetStemName(const char* path) {
+    const char* name = strchr(path, '/');
+    const char* dot;
+
+    name = (name != NULL) ? strchr(name + 1, '/') : NULL;
+    if (name == NULL) {
+        return strdup("");
+    }
+    name++;
+    dot = strrchr(name, '.');
+    return strndup(name, (dot != NULL) ? (size_t)(dot - name) : 0);
+}
+
+/* Writes value in hex like Python's {:X}, which keeps the sign */
+void PrintSignedHex(FILE* file, int64_t value) {
+    if (value < 0) {
+        fprintf(file, "-%llX", (unsigned long long)-(uint64_t)value);
+    } else {
+        fprintf(file, "%llX", (unsigned long long)value);
+    }
+}
+
+void* ParseMapThread(void* arg) {
+    MapJob* job = arg;
+
+    if (job->useSnapshot) {
+        job->result = MapFile_ParseCached(&job->map, job->path, "..makerom", MAPFILE_FILTER_LABELS, NULL);
+    } else {
+        job->result = MapFile_Parse(&job->map, job->path, "..makerom", MAPFILE_FILTER_LABELS);
+    }
+    return NULL;
+}
+
+/**
+ * Parses both map files, the expected one on a second thread. Unless told otherwise the expected map, which rarely
+ * changes, is loaded from its snapshot.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int ParseMapFiles(MapJob* build, MapJob* expected) {
+    pthread_t thread;
+    bool threaded = pthread_create(&thread, NULL, ParseMapThread, expected) == 0;
+
+    if (!threaded) {
+        ParseMapThread(expected);
+    }
+    ParseMapThread(build);
+    if (threaded) {
+        pthread_join(thread, NULL);
+    }
+
+    if (build->result != 0 || expected->result != 0) {
+        if (build->result == 0) {
+            MapFile_Destroy(&build->map);
+        }
+        if (expected->result == 0) {
+            MapFile_Destroy(&expected->map);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Gives every bss entry of map its file name, leaving the others NULL.
+ */
+char** GetEntryNames(const MapFile* map, char* (*getName)(const char* path)) {
+    char** names = calloc(map->entryCount + 1, sizeof(char*));
+    uint32_t bssName = MapFile_FindString(map, ".bss");
+    size_t i;
+
+    for (i = 0; i < map->entryCount; i++) {
+        if (IsBssEntry(&map->entries[i], bssName)) {
+            names[i] = getName(MapFile_GetString(map, map->entries[i].name));
+        }
+    }
+    return names;
+}
+
+void FreeEntryNames(const MapFile* map, char** names) {
+    size_t i;
+
+    for (i = 0; i < map->entryCount; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+/**
+ * Collects all the bss symbols of map into one scope of index.
+ */
+void IndexBssSymbols(SymbolIndex* index, const MapFile* map) {
+    uint32_t bssName = MapFile_FindString(map, ".bss");
+    size_t i;
+
+    SymbolIndex_Init(index, map);
+    SymbolIndex_Begin(index);
+    for (i = 0; i < map->entryCount; i++) {
+        if (IsBssEntry(&map->entries[i], bssName)) {
+            SymbolIndex_AddEntry(index, i);
+        }
+    }
+}
+
+void PrintGlobalRow(const char* symbol, const MapSymbol* build, const char* buildFile, const MapSymbol* expected,
+                    const char* expectedFile, const NameTable* badFiles) {
+    int64_t diff;
+
+    if (build == NULL || expected == NULL) {
+        printf("%s,", symbol);
+        if (build != NULL) {
+            printf("%llX,%s,-1,,", (unsigned long long)build->vram, buildFile);
+        } else {
+            printf("-1,,%llX,%s,", (unsigned long long)expected->vram, expectedFile);
+        }
+        printf("Unknown,%sMISSING%s\n", OUT(FORE_YELLOW), OUT(FORE_RESET));
+        return;
+    }
+
+    diff = (int64_t)(build->vram - expected->vram);
+    if (diff == 0 && !gOptions.printAll && NameTable_Find(badFiles, buildFile) == MAPFILE_NONE &&
+        NameTable_Find(badFiles, expectedFile) == MAPFILE_NONE) {
+        return;
+    }
+
+    printf("%s,%llX,%s,%llX,%s,", symbol, (unsigned long long)build->vram, buildFile,
+           (unsigned long long)expected->vram, expectedFile);
+    PrintSignedHex(stdout, diff);
+    if (diff == 0) {
+        printf(",%sGOOD%s", OUT(FORE_GREEN), OUT(FORE_RESET));
+    } else {
+        printf(",%sBAD%s", OUT(FORE_RED), OUT(FORE_RESET));
+    }
+    if (strcmp(buildFile, expectedFile) != 0) {
+        printf("%s MOVED%s", OUT(FORE_CYAN), OUT(FORE_RESET));
+    }
+    putchar('\n');
+}
+
+/**
+ * Compares the bss symbols of the whole map, like global_bss_check.py.
+ *
+ * Returns 0 if all of them are where they should be, 1 otherwise.
+ */
+int CheckGlobalBss(const MapFile* buildMap, const MapFile* expectedMap) {
+    SymbolIndex build;
+    SymbolIndex expected;
+    char** buildNames = GetEntryNames(buildMap, GetSourceName);
+    char** expectedNames = GetEntryNames(expectedMap, GetSourceName);
+    NameTable badFiles = { 0 };
+    NameTable missingFiles = { 0 };
+    size_t i;
+
+    IndexBssSymbols(&build, buildMap);
+    IndexBssSymbols(&expected, expectedMap);
+
+    /* Find the bad files first: good symbols are printed only if they share a file with a bad one */
+    for (i = 0; i < build.orderCount; i++) {
+        const MapSymbol* buildSymbol = SymbolIndex_Get(&build, i);
+        const MapSymbol* expectedSymbol = SymbolIndex_Find(&expected, MapFile_GetString(buildMap, build.order[i]));
+
+        if (expectedSymbol == NULL) {
+            NameTable_Set(&missingFiles, buildNames[buildSymbol->entry], 0);
+        } else if (buildSymbol->vram != expectedSymbol->vram) {
+            NameTable_Set(&badFiles, buildNames[buildSymbol->entry], 0);
+        }
+    }
+
+    puts("Symbol Name,Build Address,Build File,Expected Address,Expected File,Difference,GOOD/BAD/MISSING");
+    for (i = 0; i < build.orderCount; i++) {
+        const char* symbol = MapFile_GetString(buildMap, build.order[i]);
+        const MapSymbol* buildSymbol = SymbolIndex_Get(&build, i);
+        const MapSymbol* expectedSymbol = SymbolIndex_Find(&expected, symbol);
+
+        PrintGlobalRow(symbol, buildSymbol, buildNames[buildSymbol->entry], expectedSymbol,
+                       (expectedSymbol != NULL) ? expectedNames[expectedSymbol->entry] : "", &badFiles);
+    }
+    for (i = 0; i < expected.orderCount; i++) {
+        const char* symbol = MapFile_GetString(expectedMap, expected.order[i]);
+        const MapSymbol* expectedSymbol = SymbolIndex_Get(&expected, i);
+
+        if (SymbolIndex_Find(&build, symbol) == NULL) {
+            NameTable_Set(&missingFiles, expectedNames[expectedSymbol->entry], 0);
+            PrintGlobalRow(symbol, NULL, "", expectedSymbol, expectedNames[expectedSymbol->entry], &badFiles);
+        }
+    }
+
+    if (badFiles.count + missingFiles.count != 0) {
+        fputs("\n", stderr);
+    }
+
+    if (badFiles.count != 0) {
+        printf("%s  BAD%s\n", OUT(FORE_RED), OUT(RESET_ALL));
+        fflush(stdout);
+
+        for (i = 0; i < badFiles.count; i++) {
+            fprintf(stderr, "bss reordering in %s\n", badFiles.names[i]);
+        }
+        fputs("\n", stderr);
+
+        if (!gOptions.noFun) {
+            fprintf(stderr, "%s  BSS is REORDERED!!\n  Oh! MY GOD!!%s\n\n", ERR(FORE_LIGHTWHITE), ERR(RESET_ALL));
+        }
+    }
+
+    if (missingFiles.count != 0) {
+        printf("%s  MISSING%s\n", OUT(FORE_YELLOW), OUT(RESET_ALL));
+        fflush(stdout);
+
+        for (i = 0; i < missingFiles.count; i++) {
+            fprintf(stderr, "Symbols missing from %s\n", missingFiles.names[i]);
+        }
+        fputs("\n", stderr);
+
+        if (!gOptions.noFun) {
+            fprintf(stderr, "%s  Error, should (not) be in here %s\n\n", ERR(FORE_LIGHTWHITE), ERR(RESET_ALL));
+        }
+
+        fputs("Some files appear to be missing symbols. Have they been renamed or declared as static? You may need to "
+              "remake 'expected'\n",
+              stderr);
+    }
+    fflush(stdout);
+
+    i = badFiles.count + missingFiles.count;
+
+    NameTable_Destroy(&badFiles);
+    NameTable_Destroy(&missingFiles);
+    SymbolIndex_Destroy(&build);
+    SymbolIndex_Destroy(&expected);
+    FreeEntryNames(buildMap, buildNames);
+    FreeEntryNames(expectedMap, expectedNames);
+
+    if (i != 0) {
+        return 1;
+    }
+
+    fprintf(stderr, "\n%s  GOOD%s\n", ERR(FORE_GREEN), ERR(RESET_ALL));
+    if (gOptions.noFun) {
+        return 0;
+    }
+    fprintf(stderr,
+            "\n%s"
+            "%s                                  %s\n"
+            "%s         CONGRATURATIONS!         %s\n"
+            "%s    All global BSS is correct.    %s\n"
+            "%s             THANK YOU!           %s\n"
+            "%s      You are great decomper!     %s\n"
+            "%s                                  %s\n",
+            ERR(FORE_LIGHTWHITE), ERR(BACK_RED), ERR(BACK_RESET), ERR(BACK_RED), ERR(BACK_RESET), ERR(BACK_RED),
+            ERR(BACK_RESET), ERR(BACK_RED), ERR(BACK_RESET), ERR(BACK_RED), ERR(BACK_RESET), ERR(BACK_RED),
+            ERR(RESET_ALL));
+    return 0;
+}
+
+/**
+ * Indexes the files of map with bss symbols by name. A later entry with the same name replaces the earlier one.
+ */
+void IndexBssFiles(NameTable* files, const MapFile* map, char** names) {
+    size_t i;
+
+    for (i = 0; i < map->entryCount; i++) {
+        if (names[i] != NULL && map->entries[i].symbolCount != 0) {
+            NameTable_Set(files, names[i], i);
+        }
+    }
+}
+
+/**
+ * Compares the bss symbols file by file, like check_bss.py.
+ *
+ * Returns 0 if all of them are where they should be, 1 otherwise.
+ */
+int CheckBssPerFile(const MapFile* buildMap, const MapFile* expectedMap, const char* buildPath) {
+    SymbolIndex build;
+    SymbolIndex expected;
+    char** buildNames = GetEntryNames(buildMap, GetStemName);
+    char** expectedNames = GetEntryNames(expectedMap, GetStemName);
+    NameTable buildFiles = { 0 };
+    NameTable expectedFiles = { 0 };
+    /* Files found in both maps, with whether all their symbols match */
+    NameTable comparedFiles = { 0 };
+    bool allGood = true;
+    size_t i;
+    size_t j;
+
+    IndexBssFiles(&buildFiles, buildMap, buildNames);
+    IndexBssFiles(&expectedFiles, expectedMap, expectedNames);
+    SymbolIndex_Init(&build, buildMap);
+    SymbolIndex_Init(&expected, expectedMap);
+
+    for (i = 0; i < expectedFiles.count; i++) {
+        const char* fileName = expectedFiles.names[i];
+        uint32_t buildFile = NameTable_Find(&buildFiles, fileName);
+        bool okay = true;
+
+        if (buildFile == MAPFILE_NONE) {
+            fprintf(stderr, "File '%s' not found in '%s'. Has it been renamed?\n", fileName, buildPath);
+            continue;
+        }
+
+        SymbolIndex_Begin(&build);
+        SymbolIndex_AddEntry(&build, buildFiles.values[buildFile]);
+        SymbolIndex_Begin(&expected);
+        SymbolIndex_AddEntry(&expected, expectedFiles.values[i]);
+
+        for (j = 0; j < expected.orderCount; j++) {
+            const char* symbol = MapFile_GetString(expectedMap, expected.order[j]);
+            const MapSymbol* buildSymbol = SymbolIndex_Find(&build, symbol);
+
+            if (buildSymbol == NULL) {
+                fprintf(stderr, "Variable %s not found in %s, file %s . Has it been renamed?\n", symbol, buildPath,
+                        fileName);
+            } else if (buildSymbol->vram != SymbolIndex_Get(&expected, j)->vram) {
+                okay = false;
+            }
+        }
+        NameTable_Set(&comparedFiles, fileName, okay);
+        allGood &= okay;
+    }
+
+    puts("File,Symbol Name,Expected,Build,Difference,GOOD/BAD");
+    for (i = 0; i < comparedFiles.count; i++) {
+        const char* fileName = comparedFiles.names[i];
+
+        if (comparedFiles.values[i] && !gOptions.printAll) {
+            continue;
+        }
+
+        SymbolIndex_Begin(&build);
+        SymbolIndex_AddEntry(&build, buildFiles.values[NameTable_Find(&buildFiles, fileName)]);
+        SymbolIndex_Begin(&expected);
+        SymbolIndex_AddEntry(&expected, expectedFiles.values[NameTable_Find(&expectedFiles, fileName)]);
+
+        for (j = 0; j < expected.orderCount; j++) {
+            const MapSymbol* expectedSymbol = SymbolIndex_Get(&expected, j);
+            const char* symbol = MapFile_GetString(expectedMap, expected.order[j]);
+            const MapSymbol* buildSymbol = SymbolIndex_Find(&build, symbol);
+            int64_t diff;
+
+            if (buildSymbol == NULL) {
+                continue;
+            }
+            diff = (int64_t)(buildSymbol->vram - expectedSymbol->vram);
+            printf("%s,%s,%llX,%llX,", fileName, symbol, (unsigned long long)expectedSymbol->vram,
+                   (unsigned long long)buildSymbol->vram);
+            PrintSignedHex(stdout, diff);
+            printf(",%s%s%s\n", (diff == 0) ? OUT(FORE_GREEN) : OUT(FORE_RED), (diff == 0) ? "GOOD" : "BAD",
+                   OUT(RESET_ALL));
+        }
+    }
+
+    if (allGood) {
+        printf("%s  GOOD%s\n", OUT(FORE_LIGHTGREEN), OUT(RESET_ALL));
+        fflush(stdout);
+        if (!gOptions.noFun) {
+            fprintf(stderr,
+                    "\n%s"
+                    "%s                           %s\n"
+                    "%s     CONGRATURATIONS!      %s\n"
+                    "%s    All BSS is correct.    %s\n"
+                    "%s        THANK YOU!         %s\n"
+                    "%s  You are great decomper!  %s\n"
+                    "%s                           %s\n",
+                    ERR(FORE_LIGHTWHITE), ERR(BACK_RED), ERR(BACK_BLACK), ERR(BACK_RED), ERR(BACK_BLACK),
+                    ERR(BACK_RED), ERR(BACK_BLACK), ERR(BACK_RED), ERR(BACK_BLACK), ERR(BACK_RED), ERR(BACK_BLACK),
+                    ERR(BACK_RED), ERR(RESET_ALL));
+        }
+    } else {
+        bool first = true;
+
+        fflush(stdout);
+        fprintf(stderr, "\n%sBAD%s\n", ERR(FORE_LIGHTRED), ERR(RESET_ALL));
+        for (i = 0; i < comparedFiles.count; i++) {
+            if (!comparedFiles.values[i]) {
+                fprintf(stderr, "%s  ReOrdering in %s", first ? "" : "\n  ", comparedFiles.names[i]);
+                first = false;
+            }
+        }
+        fputs("\n", stderr);
+
+        if (!gOptions.noFun) {
+            fprintf(stderr, "%s  BSS is REORDERED!!\n  Oh! MY GOD!!%s\n", ERR(FORE_LIGHTWHITE), ERR(RESET_ALL));
+        }
+    }
+    fflush(stdout);
+
+    NameTable_Destroy(&buildFiles);
+    NameTable_Destroy(&expectedFiles);
+    NameTable_Destroy(&comparedFiles);
+    SymbolIndex_Destroy(&build);
+    SymbolIndex_Destroy(&expected);
+    FreeEntryNames(buildMap, buildNames);
+    FreeEntryNames(expectedMap, expectedNames);
+
+    return allGood ? 0 : 1;
+}
+
+const struct option longOptions[] = {
+    { "print-all", no_argument, NULL, 'a' },
+    { "no-fun-allowed", no_argument, NULL, 'n' },
+    { "per-file", no_argument, NULL, 'f' },
+    { "no-snapshot", no_argument, NULL, 'S' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
+
+int main(int argc, char** argv) {
+    int opt;
+    MapJob build = { 0 };
+    MapJob expected = { 0 };
+    char* defaultExpectedPath = NULL;
+    static char outputBuffer[0x10000];
+    int ret;
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "anfSh", longOptions, &optionIndex)) == EOF) {
+            break;
+        }
+
+        switch (opt) {
+            case 'a':
+                gOptions.printAll = true;
+                break;
+
+            case 'n':
+                gOptions.noFun = true;
+                break;
+
+            case 'f':
+                gOptions.perFile = true;
+                break;
+
+            case 'S':
+                gOptions.noSnapshot = true;
+                break;
+
+            case 'h':
+                fprintf(stderr, "%s [-a] [-n] [-f] [-S] MAPFILE [EXPECTED_MAPFILE]\n", argv[0]);
+                puts("Check that bss has not been reordered, by comparing the addresses of the bss symbols in MAPFILE\n"
+                     "with the ones in EXPECTED_MAPFILE (default: expected/MAPFILE).\n"
+                     "Prints a CSV of the symbols; exits with 1 if any of them moved or is missing, 0 otherwise.\n"
+                     "N.B. Since this reads the map files, it can only see globally visible bss; in-function static\n"
+                     "bss must be examined with other tools.\n"
+                     "Options:\n"
+                     "  -a, --print-all       Print all bss, not just non-matching.\n"
+                     "  -n, --no-fun-allowed  Remove amusing messages.\n"
+                     "  -f, --per-file        Compare the symbols file by file, like check_bss.py, instead of\n"
+                     "                        across the whole map, like global_bss_check.py.\n"
+                     "  -S, --no-snapshot     Parse the expected map file instead of loading the snapshot saved\n"
+                     "                        next to it, and do not save one.\n"
+                     "  -h, --help            Display this message and exit.\n");
+                return 1;
+
+            default:
+                fprintf(stderr, "Getopt returned character code: 0x%X", opt);
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "%s [-a] [-n] [-f] [-S] MAPFILE [EXPECTED_MAPFILE]\n", argv[0]);
+        return 1;
+    }
+
+    build.path = argv[optind];
+    if (optind + 1 < argc && argv[optind + 1][0] != '\0') {
+        expected.path = argv[optind + 1];
+    } else {
+        defaultExpectedPath = malloc(strlen("expected/") + strlen(build.path) + 1);
+        sprintf(defaultExpectedPath, "expected/%s", build.path);
+        expected.path = defaultExpectedPath;
+    }
+
+    expected.useSnapshot = !gOptions.noSnapshot;
+    gOptions.colourOut = isatty(STDOUT_FILENO);
+    gOptions.colourErr = isatty(STDERR_FILENO);
+
+    fprintf(stderr, "Build mapfile:    %s\nExpected mapfile: %s\n\n", build.path, expected.path);
+
+    if (access(build.path, F_OK) != 0) {
+        fprintf(stderr, "%serror%s: mapfile not found at %s. Did you enter the correct path?\n",
+                ERR(FORE_LIGHTRED), ERR(FORE_RESET), build.path);
+        free(defaultExpectedPath);
+        return 1;
+    }
+    if (access(expected.path, F_OK) != 0) {
+        fprintf(stderr,
+                "%serror%s: expected mapfile not found at %s. Is 'expected' missing or in a different folder?\n",
+                ERR(FORE_LIGHTRED), ERR(FORE_RESET), expected.path);
+        free(defaultExpectedPath);
+        return 1;
+    }
+
+    if (ParseMapFiles(&build, &expected) != 0) {
+        free(defaultExpectedPath);
+        return 1;
+    }
+
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+    if (gOptions.perFile) {
+        ret = CheckBssPerFile(&build.map, &expected.map, build.path);
+    } else {
+        ret = CheckGlobalBss(&build.map, &expected.map);
+    }
+
+    MapFile_Destroy(&build.map);
+    MapFile_Destroy(&expected.map);
+    free(defaultExpectedPath);
+    return ret;
+}
@@ -0,0 +1,490 @@
+/**
+ * @file mapfile.c
+ * @brief Parser for GNU ld map files.
+ *
+ * The map is mapped into memory and split into lines and whitespace-separated tokens in place. Only names are
+ * copied, once each, into an interned string table; sections, file entries and symbols go into flat arrays.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include "mapfile.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_TOKENS 6
+
+/* Symbol lines and continuations of wrapped lines are indented this far */
+#define SYMBOL_INDENT 16
+
+typedef struct {
+    const char* start;
+    size_t length;
+} Token;
+
+typedef struct {
+    size_t indent;
+    size_t count; /* May exceed MAX_TOKENS, only the first MAX_TOKENS are stored */
+    Token tokens[MAX_TOKENS];
+} Line;
+
+/* Grows array (of elements of size elementSize) so it can hold at least one more than count */
+static void* Reserve(void* array, size_t* capacity, size_t count, size_t elementSize) {
+    if (count >= *capacity) {
+        *capacity = (*capacity == 0) ? 256 : 2 * *capacity;
+        array = realloc(array, *capacity * elementSize);
+    }
+    return array;
+}
+
+static uint32_t HashString(const char* str, size_t length) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void GrowInternTable(MapFile* map) {
+    size_t i;
+
+    map->internCapacity = (map->internCapacity == 0) ? 1024 : 2 * map->internCapacity;
+    free(map->internTable);
+    free(map->internHashes);
+    map->internTable = calloc(map->internCapacity, sizeof(uint32_t));
+    map->internHashes = malloc(map->internCapacity * sizeof(uint32_t));
+
+    for (i = 0; i < map->stringCount; i++) {
+        const char* str = map->strings + map->stringOffsets[i];
+        uint32_t hash = HashString(str, strlen(str));
+        size_t slot = hash & (map->internCapacity - 1);
+
+        while (map->internTable[slot] != 0) {
+            slot = (slot + 1) & (map->internCapacity - 1);
+        }
+        map->internTable[slot] = i + 1;
+        map->internHashes[slot] = hash;
+    }
+}
+
+/**
+ * Finds the slot in the intern table holding str, or the empty slot where it would go. A table without empty slots,
+ * which only a corrupt snapshot can have, is probed at most once per slot.
+ *
+ * Returns the slot, or internCapacity if str is not in a full table.
+ */
+static size_t FindInternSlot(const MapFile* map, const char* str, size_t length, uint32_t hash) {
+    size_t slot = hash & (map->internCapacity - 1);
+    size_t probes;
+
+    for (probes = 0; map->internTable[slot] != 0; probes++) {
+        const char* candidate = map->strings + map->stringOffsets[map->internTable[slot] - 1];
+
+        /* Comparing hashes first saves looking at the string table for most collisions */
+        if (map->internHashes[slot] == hash && strncmp(candidate, str, length) == 0 && candidate[length] == '\0') {
+            return slot;
+        }
+        if (probes + 1 == map->internCapacity) {
+            return map->internCapacity;
+        }
+        slot = (slot + 1) & (map->internCapacity - 1);
+    }
+    return slot;
+}
+
+/**
+ * Adds a copy of the first length characters of str to the string table, unless it is already there.
+ *
+ * Returns its index.
+ */
+uint32_t MapFile_Intern(MapFile* map, const char* str, size_t length) {
+    uint32_t hash = HashString(str, length);
+    size_t slot;
+
+    /* Keep the load factor at most one half */
+    if (2 * (map->stringCount + 1) > map->internCapacity) {
+        GrowInternTable(map);
+    }
+
+    slot = FindInternSlot(map, str, length, hash);
+    if (map->internTable[slot] != 0) {
+        return map->internTable[slot] - 1;
+    }
+
+    if (map->stringsSize + length + 1 > map->stringsCapacity) {
+        while (map->stringsSize + length + 1 > map->stringsCapacity) {
+            map->stringsCapacity = (map->stringsCapacity == 0) ? 0x10000 : 2 * map->stringsCapacity;
+        }
+        map->strings = realloc(map->strings, map->stringsCapacity);
+    }
+    map->stringOffsets =
+        Reserve(map->stringOffsets, &map->stringOffsetsCapacity, map->stringCount, sizeof(uint32_t));
+
+    memcpy(map->strings + map->stringsSize, str, length);
+    map->strings[map->stringsSize + length] = '\0';
+    map->stringOffsets[map->stringCount] = map->stringsSize;
+    map->stringsSize += length + 1;
+    map->internTable[slot] = map->stringCount + 1;
+    map->internHashes[slot] = hash;
+
+    return map->stringCount++;
+}
+
+/**
+ * Looks up str in the string table without adding it.
+ *
+ * Returns its index, or MAPFILE_NONE if it does not occur in the map.
+ */
+uint32_t MapFile_FindString(const MapFile* map, const char* str) {
+    size_t length = strlen(str);
+    size_t slot = FindInternSlot(map, str, length, HashString(str, length));
+
+    return (slot < map->internCapacity && map->internTable[slot] != 0) ? map->internTable[slot] - 1 : MAPFILE_NONE;
+}
+
+/**
+ * Writes the indices of the file entries for input sections named sectionName into indices, which must have room for
+ * entryCount of them.
+ *
+ * Returns number of indices written.
+ */
+size_t MapFile_FindEntriesInSection(const MapFile* map, const char* sectionName, uint32_t* indices) {
+    uint32_t section = MapFile_FindString(map, sectionName);
+    size_t count = 0;
+    size_t i;
+
+    if (section == MAPFILE_NONE) {
+        return 0;
+    }
+    for (i = 0; i < map->entryCount; i++) {
+        if (map->entries[i].section == section) {
+            indices[count++] = i;
+        }
+    }
+    return count;
+}
+
+const char* MapFile_GetString(const MapFile* map, uint32_t index) {
+    return map->strings + map->stringOffsets[index];
+}
+
+/* Jump table labels look like L80001234 */
+int MapFile_IsLabel(const char* name) {
+    size_t i;
+
+    if (name[0] != 'L') {
+        return 0;
+    }
+    for (i = 1; i < 9; i++) {
+        if (!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'A' && name[i] <= 'F'))) {
+            return 0;
+        }
+    }
+    return name[9] == '\0';
+}
+static void SplitLine(Line* line, const char* start, const char* end) {
+    const char* p = start;
+
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    line->indent = p - start;
+    line->count = 0;
+
+    while (p < end) {
+        const char* tokenStart;
+
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+            p++;
+        }
+        if (p >= end) {
+            break;
+        }
+        tokenStart = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r') {
+            p++;
+        }
+        if (line->count < MAX_TOKENS) {
+            line->tokens[line->count].start = tokenStart;
+            line->tokens[line->count].length = p - tokenStart;
+        }
+        line->count++;
+    }
+}
+
+/* Parses a token of the form 0x1234ABCD. Returns true if it is one */
+static bool ParseHex(const Token* token, uint64_t* value) {
+    uint64_t result = 0;
+    size_t i;
+
+    if (token->length < 3 || token->start[0] != '0' || token->start[1] != 'x') {
+        return false;
+    }
+    for (i = 2; i < token->length; i++) {
+        char c = token->start[i];
+
+        if (c >= '0' && c <= '9') {
+            result = (result << 4) | (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            result = (result << 4) | (c - 'a' + 0xA);
+        } else if (c >= 'A' && c <= 'F') {
+            result = (result << 4) | (c - 'A' + 0xA);
+        } else {
+            return false;
+        }
+    }
+    *value = result;
+    return true;
+}
+
+/* Parses "VRAM SIZE [load address ROM]" starting at tokens[first] into section. Returns true if the line matched */
+static bool ParseSectionAddresses(const Line* line, size_t first, MapSection* section) {
+    uint64_t rom;
+
+    if (line->count < first + 2 || !ParseHex(&line->tokens[first], &section->vram) ||
+        !ParseHex(&line->tokens[first + 1], &section->size)) {
+        return false;
+    }
+    section->rom = section->vram;
+    if (line->count == first + 5 && line->tokens[first + 2].length == 4 &&
+        memcmp(line->tokens[first + 2].start, "load", 4) == 0 && ParseHex(&line->tokens[first + 4], &rom)) {
+        section->rom = rom;
+    }
+    return true;
+}
+
+static void AddSection(MapFile* map, const MapSection* section) {
+    map->sections = Reserve(map->sections, &map->sectionCapacity, map->sectionCount, sizeof(MapSection));
+    map->sections[map->sectionCount] = *section;
+    map->sections[map->sectionCount].firstEntry = map->entryCount;
+    map->sections[map->sectionCount].entryCount = 0;
+    map->sectionCount++;
+}
+
+/* Parses "VRAM SIZE NAME" starting at tokens[first]. Returns true if the line matched */
+static bool AddFileEntry(MapFile* map, const Line* line, size_t first, const Token* sectionName) {
+    MapFileEntry entry;
+
+    if (line->count != first + 3 || !ParseHex(&line->tokens[first], &entry.vram) ||
+        !ParseHex(&line->tokens[first + 1], &entry.size)) {
+        return false;
+    }
+
+    entry.section = MapFile_Intern(map, sectionName->start, sectionName->length);
+    entry.name = MapFile_Intern(map, line->tokens[first + 2].start, line->tokens[first + 2].length);
+    entry.firstSymbol = map->symbolCount;
+    entry.symbolCount = 0;
+    entry.padding = 0;
+    entry.rom = entry.vram;
+    entry.outputSection = MAPFILE_NONE;
+    if (map->sectionCount != 0) {
+        MapSection* section = &map->sections[map->sectionCount - 1];
+
+        entry.outputSection = map->sectionCount - 1;
+        entry.rom = section->rom + (entry.vram - section->vram);
+        section->entryCount++;
+    }
+
+    map->entries = Reserve(map->entries, &map->entryCapacity, map->entryCount, sizeof(MapFileEntry));
+    map->entries[map->entryCount++] = entry;
+    return true;
+}
+
+static bool IsLabelToken(const Token* token) {
+    char name[10];
+
+    if (token->length != 9) {
+        return false;
+    }
+    memcpy(name, token->start, 9);
+    name[9] = '\0';
+    return MapFile_IsLabel(name);
+}
+
+static void AddSymbol(MapFile* map, const Token* name, uint64_t vram, int flags) {
+    MapSymbol symbol;
+
+    if ((flags & MAPFILE_FILTER_LABELS) && IsLabelToken(name)) {
+        return;
+    }
+    symbol.name = MapFile_Intern(map, name->start, name->length);
+    symbol.entry = map->entryCount - 1;
+    symbol.vram = vram;
+
+    map->symbols = Reserve(map->symbols, &map->symbolCapacity, map->symbolCount, sizeof(MapSymbol));
+    map->symbols[map->symbolCount++] = symbol;
+    map->entries[symbol.entry].symbolCount++;
+}
+
+/**
+ * Parses a map file already in memory, starting from the first occurrence of startMarker (or the beginning if it is
+ * NULL). If startMarker does not occur, nothing is parsed.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int MapFile_ParseBuffer(MapFile* map, const char* data, size_t size, const char* startMarker, int flags) {
+    const char* p = data;
+    const char* end = data + size;
+    bool inEntry = false;
+    Token pendingSection = { NULL, 0 };
+    Token pendingEntry = { NULL, 0 };
+    Line line;
+
+    memset(map, 0, sizeof(*map));
+    GrowInternTable(map);
+
+    if (startMarker != NULL) {
+        p = memmem(data, size, startMarker, strlen(startMarker));
+        if (p == NULL) {
+            return 0;
+        }
+    }
+
+    while (p < end) {
+        const char* lineEnd = memchr(p, '\n', end - p);
+        Token prevSection = pendingSection;
+        Token prevEntry = pendingEntry;
+
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+        SplitLine(&line, p, lineEnd);
+        p = lineEnd + 1;
+
+        pendingSection.start = NULL;
+        pendingEntry.start = NULL;
+
+        if (line.count == 0) {
+            inEntry = false;
+        } else if (line.indent == 0) {
+            MapSection section;
+
+            inEntry = false;
+            if (line.tokens[0].start[0] == '*') {
+                continue;
+            }
+            if (line.count == 1) {
+                /* Long names are put on a line of their own, with the rest on the next line */
+                pendingSection = line.tokens[0];
+            } else if (ParseSectionAddresses(&line, 1, &section)) {
+                section.name = MapFile_Intern(map, line.tokens[0].start, line.tokens[0].length);
+                AddSection(map, &section);
+            }
+        } else if (line.indent == 1) {
+            inEntry = false;
+            if (line.tokens[0].start[0] == '*') {
+                continue;
+            }
+            if (line.count == 1) {
+                pendingEntry = line.tokens[0];
+            } else {
+                inEntry = AddFileEntry(map, &line, 1, &line.tokens[0]);
+            }
+        } else if (line.indent >= SYMBOL_INDENT) {
+            MapSection section;
+            uint64_t vram;
+
+            if (prevSection.start != NULL) {
+                if (ParseSectionAddresses(&line, 0, &section)) {
+                    section.name = MapFile_Intern(map, prevSection.start, prevSection.length);
+                    AddSection(map, &section);
+                }
+            } else if (prevEntry.start != NULL) {
+                inEntry = AddFileEntry(map, &line, 0, &prevEntry);
+            } else if (inEntry && line.count == 2 && ParseHex(&line.tokens[0], &vram)) {
+                AddSymbol(map, &line.tokens[1], vram, flags);
+            }
+        } else {
+            inEntry = false;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Maps the file at path into memory and parses it with MapFile_ParseBuffer().
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int MapFile_Parse(MapFile* map, const char* path, const char* startMarker, int flags) {
+    int fd;
+    struct stat fileStat;
+    void* data;
+    int ret;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        fprintf(stderr, "Failed to open map file %s\n", path);
+        return -1;
+    }
+    if (fstat(fd, &fileStat) != 0) {
+        fprintf(stderr, "Failed to stat map file %s\n", path);
+        close(fd);
+        return -1;
+    }
+    if (fileStat.st_size == 0) {
+        close(fd);
+        return MapFile_ParseBuffer(map, "", 0, startMarker, flags);
+    }
+
+    data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s into memory\n", path);
+        return -1;
+    }
+    madvise(data, fileStat.st_size, MADV_SEQUENTIAL);
+
+    ret = MapFile_ParseBuffer(map, data, fileStat.st_size, startMarker, flags);
+
+    munmap(data, fileStat.st_size);
+    return ret;
+}
+
+void MapFile_Destroy(MapFile* map) {
+    if (map->snapshot != NULL) {
+        munmap(map->snapshot, map->snapshotSize);
+        memset(map, 0, sizeof(*map));
+        return;
+    }
+
+    free(map->strings);
+    free(map->stringOffsets);
+    free(map->sections);
+    free(map->entries);
+    free(map->symbols);
+    free(map->internTable);
+    free(map->internHashes);
+    memset(map, 0, sizeof(*map));
+}
+
+/**
+ * Heap-allocating versions of MapFile_Parse() and MapFile_Destroy(), for the Python bindings.
+ *
+ * Returns the parsed map, or NULL on failure.
+ */
+MapFile* MapFile_Load(const char* path, const char* startMarker, int flags) {
+    MapFile* map = malloc(sizeof(MapFile));
+
+    if (MapFile_Parse(map, path, startMarker, flags) != 0) {
+        free(map);
+        return NULL;
+    }
+    return map;
+}
+
+void MapFile_Free(MapFile* map) {
+    if (map != NULL) {
+        MapFile_Destroy(map);
+        free(map);
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Drop jump table labels (L followed by 8 uppercase hex digits) from the symbols */
+#define MAPFILE_FILTER_LABELS (1 << 0)
+
+/* Used for indices that do not refer to anything */
+#define MAPFILE_NONE 0xFFFFFFFF
+
+/* Output section, e.g. "..boot  0x80000460  0x6790 load address 0x00001060" */
+typedef struct {
+    uint32_t name; /* Index of string */
+    uint32_t firstEntry;
+    uint32_t entryCount;
+    uint32_t padding;
+    uint64_t vram;
+    uint64_t size;
+    uint64_t rom; /* Load address, or vram if the map does not give one */
+} MapSection;
+
+/* Input section contributed by one object file, e.g. " .text  0x80000460  0x60 build/src/boot/boot_main.o" */
+typedef struct {
+    uint32_t name;    /* Index of string holding the object file path */
+    uint32_t section; /* Index of string holding the input section name, e.g. ".text" */
+    uint32_t outputSection; /* Index into sections, or MAPFILE_NONE */
+    uint32_t firstSymbol;
+    uint32_t symbolCount;
+    uint32_t padding;
+    uint64_t vram;
+    uint64_t size;
+    uint64_t rom;
+} MapFileEntry;
+
+/* Symbol defined in a file entry, e.g. "                0x80000460                bootproc" */
+typedef struct {
+    uint32_t name;  /* Index of string */
+    uint32_t entry; /* Index into entries */
+    uint64_t vram;
+} MapSymbol;
+
+/**
+ * Parsed map file. Everything refers to other parts by index, so the arrays can be written out and read back as they
+ * are.
+ */
+typedef struct {
+    char* strings; /* Interned names, NUL-terminated, one after another */
+    size_t stringsSize;
+    size_t stringsCapacity;
+    uint32_t* stringOffsets; /* Offset in strings of each name, by index */
+    size_t stringCount;
+    size_t stringOffsetsCapacity;
+
+    MapSection* sections;
+    size_t sectionCount;
+    size_t sectionCapacity;
+
+    MapFileEntry* entries;
+    size_t entryCount;
+    size_t entryCapacity;
+
+    MapSymbol* symbols;
+    size_t symbolCount;
+    size_t symbolCapacity;
+
+    /* Open-addressing table of string indices + 1, 0 for empty */
+    uint32_t* internTable;
+    uint32_t* internHashes;
+    size_t internCapacity;
+
+    /* Mapping of the snapshot the arrays point into, if it was loaded from one. Such a map must not be added to. */
+    void* snapshot;
+    size_t snapshotSize;
+} MapFile;
+
+/* Start of a snapshot file, followed by the arrays of a MapFile at the given offsets */
+typedef struct {
+    char magic[8]; /* MAPFILE_SNAPSHOT_MAGIC */
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t contentHash; /* MapFile_HashContents() of the map text it was parsed from */
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t stringOffsetsOffset;
+    uint64_t stringCount;
+    uint64_t sectionsOffset;
+    uint64_t sectionCount;
+    uint64_t entriesOffset;
+    uint64_t entryCount;
+    uint64_t symbolsOffset;
+    uint64_t symbolCount;
+    uint64_t internTableOffset;
+    uint64_t internHashesOffset;
+    uint64_t internCapacity;
+} MapSnapshotHeader;
+
+#define MAPFILE_SNAPSHOT_MAGIC "MAPSNAP"
+#define MAPFILE_SNAPSHOT_VERSION 1
+
+int MapFile_ParseBuffer(MapFile* map, const char* data, size_t size, const char* startMarker, int flags);
+int MapFile_Parse(MapFile* map, const char* path, const char* startMarker, int flags);
+void MapFile_Destroy(MapFile* map);
+
+MapFile* MapFile_Load(const char* path, const char* startMarker, int flags);
+void MapFile_Free(MapFile* map);
+
+uint32_t MapFile_Intern(MapFile* map, const char* str, size_t length);
+uint32_t MapFile_FindString(const MapFile* map, const char* str);
+size_t MapFile_FindEntriesInSection(const MapFile* map, const char* sectionName, uint32_t* indices);
+const char* MapFile_GetString(const MapFile* map, uint32_t index);
+int MapFile_IsLabel(const char* name);
+
+uint64_t MapFile_HashContents(const char* data, size_t size, const char* startMarker, int flags);
+char* MapFile_GetSnapshotPath(const char* path, const char* startMarker, int flags);
+int MapFile_WriteSnapshot(const MapFile* map, const char* path, uint64_t contentHash);
+int MapFile_LoadSnapshot(MapFile* map, const char* path, uint64_t contentHash);
+int MapFile_ParseCached(MapFile* map, const char* path, const char* startMarker, int flags, const char* snapshotPath);
+MapFile* MapFile_LoadCached(const char* path, const char* startMarker, int flags, const char* snapshotPath);
@@ -0,0 +1,160 @@
+/**
+ * @file mapparse.c
+ * @brief Print the sections, file entries or symbols of a GNU ld map file as CSV.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapfile.h"
+
+typedef enum {
+    OUTPUT_SECTIONS,
+    OUTPUT_FILES,
+    OUTPUT_SYMBOLS,
+} OutputMode;
+
+void PrintSections(const MapFile* map) {
+    size_t i;
+
+    puts("Section,VRAM,Size,ROM,Files");
+    for (i = 0; i < map->sectionCount; i++) {
+        const MapSection* section = &map->sections[i];
+
+        printf("%s,%08llX,%llX,%08llX,%u\n", MapFile_GetString(map, section->name), (unsigned long long)section->vram,
+               (unsigned long long)section->size, (unsigned long long)section->rom, section->entryCount);
+    }
+}
+
+void PrintFiles(const MapFile* map, const char* sectionFilter) {
+    size_t i;
+
+    puts("Section,File,VRAM,Size,ROM,Symbols");
+    for (i = 0; i < map->entryCount; i++) {
+        const MapFileEntry* entry = &map->entries[i];
+        const char* section = MapFile_GetString(map, entry->section);
+
+        if (sectionFilter != NULL && strcmp(section, sectionFilter) != 0) {
+            continue;
+        }
+        printf("%s,%s,%08llX,%llX,%08llX,%u\n", section, MapFile_GetString(map, entry->name),
+               (unsigned long long)entry->vram, (unsigned long long)entry->size, (unsigned long long)entry->rom,
+               entry->symbolCount);
+    }
+}
+
+void PrintSymbols(const MapFile* map, const char* sectionFilter) {
+    size_t i;
+
+    puts("File,Section,Symbol,VRAM");
+    for (i = 0; i < map->symbolCount; i++) {
+        const MapSymbol* symbol = &map->symbols[i];
+        const MapFileEntry* entry = &map->entries[symbol->entry];
+        const char* section = MapFile_GetString(map, entry->section);
+
+        if (sectionFilter != NULL && strcmp(section, sectionFilter) != 0) {
+            continue;
+        }
+        printf("%s,%s,%s,%08llX\n", MapFile_GetString(map, entry->name), section,
+               MapFile_GetString(map, symbol->name), (unsigned long long)symbol->vram);
+    }
+}
+
+const struct option longOptions[] = {
+    { "filter-labels", no_argument, NULL, 'l' },
+    { "output", required_argument, NULL, 'o' },
+    { "start", required_argument, NULL, 's' },
+    { "section", required_argument, NULL, 't' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
+
+int main(int argc, char** argv) {
+    int opt;
+    int flags = 0;
+    OutputMode mode = OUTPUT_FILES;
+    const char* startMarker = NULL;
+    const char* sectionFilter = NULL;
+    static char outputBuffer[0x10000];
+    MapFile map;
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "lo:s:t:h", longOptions, &optionIndex)) == EOF) {
+            break;
+        }
+
+        switch (opt) {
+            case 'l':
+                flags |= MAPFILE_FILTER_LABELS;
+                break;
+
+            case 'o':
+                if (strcmp(optarg, "sections") == 0) {
+                    mode = OUTPUT_SECTIONS;
+                } else if (strcmp(optarg, "files") == 0) {
+                    mode = OUTPUT_FILES;
+                } else if (strcmp(optarg, "symbols") == 0) {
+                    mode = OUTPUT_SYMBOLS;
+                } else {
+                    fprintf(stderr, "-o expects sections, files or symbols, found %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 's':
+                startMarker = optarg;
+                break;
+
+            case 't':
+                sectionFilter = optarg;
+                break;
+
+            case 'h':
+                fprintf(stderr, "%s [-l] [-o MODE] [-s STRING] [-t SECTION] MAPFILE\n", argv[0]);
+                puts("Parses a GNU ld map file and prints its contents as CSV.\n"
+                     "Options:\n"
+                     "  -o, --output MODE      What to print: sections (output sections), files (input sections of\n"
+                     "                         each object file) or symbols. Default: files\n"
+                     "  -s, --start STRING     Start parsing at the first occurrence of STRING\n"
+                     "  -t, --section SECTION  Only print files and symbols from input sections named SECTION\n"
+                     "  -l, --filter-labels    Leave out jump table labels (L followed by 8 hex digits)\n"
+                     "  -h, --help             Display this message and exit.\n");
+                return 1;
+
+            default:
+                fprintf(stderr, "Getopt returned character code: 0x%X", opt);
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "%s [-l] [-o MODE] [-s STRING] [-t SECTION] MAPFILE\n", argv[0]);
+        return 1;
+    }
+
+    if (MapFile_Parse(&map, argv[optind], startMarker, flags) != 0) {
+        return 1;
+    }
+
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+    switch (mode) {
+        case OUTPUT_SECTIONS:
+            PrintSections(&map);
+            break;
+        case OUTPUT_FILES:
+            PrintFiles(&map, sectionFilter);
+            break;
+        case OUTPUT_SYMBOLS:
+            PrintSymbols(&map, sectionFilter);
+            break;
+    }
+    fflush(stdout);
+
+    MapFile_Destroy(&map);
+    return 0;
+}
@@ -0,0 +1,338 @@
+/**
+ * @file mapsnapshot.c
+ * @brief Binary snapshots of parsed map files, which can be mapped into memory and used without parsing anything.
+ *
+ * A snapshot is a MapSnapshotHeader followed by the arrays of a MapFile, each 8-byte aligned, in the byte order of the
+ * machine that wrote it. The header holds a hash of the map text it came from, so a stale snapshot is noticed and
+ * rewritten instead of being used.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include "mapfile.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+#define HASH_PRIME 0x100000001B3ull
+
+static uint64_t HashBytes(uint64_t hash, const char* data, size_t size) {
+    size_t i = 0;
+
+    /* A word at a time, folding the high half back in as multiplying only carries upwards */
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * HASH_PRIME;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ (uint8_t)data[i]) * HASH_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * Hashes the text of a map file together with the options it is parsed with, as everything the parsed map depends on.
+ */
+uint64_t MapFile_HashContents(const char* data, size_t size, const char* startMarker, int flags) {
+    uint64_t hash = 0xCBF29CE484222325ull ^ size;
+
+    hash = HashBytes(hash, data, size);
+    if (startMarker != NULL) {
+        hash = HashBytes(hash, startMarker, strlen(startMarker) + 1);
+    }
+    hash = (hash ^ (uint32_t)flags) * HASH_PRIME;
+    return hash ^ (hash >> 32);
+}
+
+/**
+ * Default place for the snapshot of the map at path: next to it, named after the options, since those change what is
+ * parsed.
+ *
+ * Returns a string to free().
+ */
+char* MapFile_GetSnapshotPath(const char* path, const char* startMarker, int flags) {
+    uint64_t optionsHash = MapFile_HashContents("", 0, startMarker, flags);
+    char* snapshotPath = malloc(strlen(path) + sizeof(".0123456789ABCDEF.snapshot"));
+
+    sprintf(snapshotPath, "%s.%016llX.snapshot", path, (unsigned long long)optionsHash);
+    return snapshotPath;
+}
+
+/* Maps the whole file at path read-only; an empty file gives a NULL mapping. Returns 0 on success, -1 on failure. */
+static int MapWholeFile(const char* path, void** data, size_t* size) {
+    int fd;
+    struct stat fileStat;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    *size = fileStat.st_size;
+    *data = NULL;
+    if (*size != 0) {
+        *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    return (*data == MAP_FAILED) ? -1 : 0;
+}
+
+static bool WriteArray(FILE* file, uint64_t* offset, uint64_t* arrayOffset, const void* data, size_t size) {
+    static const char zeros[8] = { 0 };
+    uint64_t padding = ALIGN8(*offset) - *offset;
+
+    if (fwrite(zeros, 1, padding, file) != padding || (size != 0 && fwrite(data, 1, size, file) != size)) {
+        return false;
+    }
+    *arrayOffset = *offset + padding;
+    *offset = *arrayOffset + size;
+    return true;
+}
+
+/**
+ * Writes map to a snapshot file at path. It is written to a temporary file first and renamed into place, so a
+ * snapshot being loaded by another process is never seen half-written.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int MapFile_WriteSnapshot(const MapFile* map, const char* path, uint64_t contentHash) {
+    MapSnapshotHeader header = { 0 };
+    char* tempPath = malloc(strlen(path) + sizeof(".tmp.") + 20);
+    uint64_t offset = sizeof(header);
+    FILE* file;
+    bool ok;
+
+    sprintf(tempPath, "%s.tmp.%ld", path, (long)getpid());
+    if ((file = fopen(tempPath, "wb")) == NULL) {
+        free(tempPath);
+        return -1;
+    }
+
+    memcpy(header.magic, MAPFILE_SNAPSHOT_MAGIC, sizeof(MAPFILE_SNAPSHOT_MAGIC));
+    header.version = MAPFILE_SNAPSHOT_VERSION;
+    header.headerSize = sizeof(header);
+    header.contentHash = contentHash;
+    header.stringsSize = map->stringsSize;
+    header.stringCount = map->stringCount;
+    header.sectionCount = map->sectionCount;
+    header.entryCount = map->entryCount;
+    header.symbolCount = map->symbolCount;
+    header.internCapacity = map->internCapacity;
+
+    /* Leave room for the header, and fill it in once the offsets are known */
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+         WriteArray(file, &offset, &header.stringsOffset, map->strings, map->stringsSize) &&
+         WriteArray(file, &offset, &header.stringOffsetsOffset, map->stringOffsets,
+                    map->stringCount * sizeof(uint32_t)) &&
+         WriteArray(file, &offset, &header.sectionsOffset, map->sections, map->sectionCount * sizeof(MapSection)) &&
+         WriteArray(file, &offset, &header.entriesOffset, map->entries, map->entryCount * sizeof(MapFileEntry)) &&
+         WriteArray(file, &offset, &header.symbolsOffset, map->symbols, map->symbolCount * sizeof(MapSymbol)) &&
+         WriteArray(file, &offset, &header.internTableOffset, map->internTable,
+                    map->internCapacity * sizeof(uint32_t)) &&
+         WriteArray(file, &offset, &header.internHashesOffset, map->internHashes,
+                    map->internCapacity * sizeof(uint32_t)) &&
+         fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tempPath, path) != 0) {
+        remove(tempPath);
+        free(tempPath);
+        return -1;
+    }
+    free(tempPath);
+    return 0;
+}
+
+/* Checks that count elements of size elementSize at offset lie inside a snapshot of snapshotSize bytes */
+static bool IsInSnapshot(uint64_t offset, uint64_t count, size_t elementSize, size_t snapshotSize) {
+    return offset % 8 == 0 && offset <= snapshotSize && count <= (snapshotSize - offset) / elementSize;
+}
+
+/* Whether first and count describe a range of an array of total elements */
+static bool IsRangeInBounds(uint64_t first, uint64_t count, uint64_t total) {
+    return first <= total && count <= total - first;
+}
+
+/* Checks that every index stored in the arrays of a snapshot, whose extents are valid, refers to something in it */
+static bool AreIndicesInBounds(const void* data, const MapSnapshotHeader* header) {
+    const MapSection* sections = (const MapSection*)((const char*)data + header->sectionsOffset);
+    const MapFileEntry* entries = (const MapFileEntry*)((const char*)data + header->entriesOffset);
+    const MapSymbol* symbols = (const MapSymbol*)((const char*)data + header->symbolsOffset);
+    const uint32_t* internTable = (const uint32_t*)((const char*)data + header->internTableOffset);
+    uint64_t emptySlots = 0;
+    uint64_t i;
+
+    for (i = 0; i < header->sectionCount; i++) {
+        if (sections[i].name >= header->stringCount ||
+            !IsRangeInBounds(sections[i].firstEntry, sections[i].entryCount, header->entryCount)) {
+            return false;
+        }
+    }
+    for (i = 0; i < header->entryCount; i++) {
+        if (entries[i].name >= header->stringCount || entries[i].section >= header->stringCount ||
+            (entries[i].outputSection != MAPFILE_NONE && entries[i].outputSection >= header->sectionCount) ||
+            !IsRangeInBounds(entries[i].firstSymbol, entries[i].symbolCount, header->symbolCount)) {
+            return false;
+        }
+    }
+    for (i = 0; i < header->symbolCount; i++) {
+        if (symbols[i].name >= header->stringCount || symbols[i].entry >= header->entryCount) {
+            return false;
+        }
+    }
+    /* String indices + 1, 0 for empty. Lookups stop at an empty slot, so there must be one */
+    for (i = 0; i < header->internCapacity; i++) {
+        if (internTable[i] > header->stringCount) {
+            return false;
+        }
+        emptySlots += internTable[i] == 0;
+    }
+    return emptySlots != 0;
+}
+
+/* Checks the header and bounds of a snapshot, and that it was made from a map text with hash contentHash */
+static bool IsValidSnapshot(const void* data, size_t size, uint64_t contentHash) {
+    const MapSnapshotHeader* header = data;
+    const char* strings;
+    const uint32_t* stringOffsets;
+    uint64_t i;
+
+    if (size < sizeof(*header) || memcmp(header->magic, MAPFILE_SNAPSHOT_MAGIC, sizeof(MAPFILE_SNAPSHOT_MAGIC)) != 0 ||
+        header->version != MAPFILE_SNAPSHOT_VERSION || header->headerSize != sizeof(*header) ||
+        header->contentHash != contentHash || !IsInSnapshot(header->stringsOffset, header->stringsSize, 1, size) ||
+        !IsInSnapshot(header->stringOffsetsOffset, header->stringCount, sizeof(uint32_t), size) ||
+        !IsInSnapshot(header->sectionsOffset, header->sectionCount, sizeof(MapSection), size) ||
+        !IsInSnapshot(header->entriesOffset, header->entryCount, sizeof(MapFileEntry), size) ||
+        !IsInSnapshot(header->symbolsOffset, header->symbolCount, sizeof(MapSymbol), size) ||
+        !IsInSnapshot(header->internTableOffset, header->internCapacity, sizeof(uint32_t), size) ||
+        !IsInSnapshot(header->internHashesOffset, header->internCapacity, sizeof(uint32_t), size) ||
+        header->internCapacity == 0 || (header->internCapacity & (header->internCapacity - 1)) != 0) {
+        return false;
+    }
+
+    /* Names must not run off the end of the string table */
+    strings = (const char*)data + header->stringsOffset;
+    stringOffsets = (const uint32_t*)((const char*)data + header->stringOffsetsOffset);
+    if (header->stringsSize != 0 && strings[header->stringsSize - 1] != '\0') {
+        return false;
+    }
+    for (i = 0; i < header->stringCount; i++) {
+        if (stringOffsets[i] >= header->stringsSize) {
+            return false;
+        }
+    }
+
+    return AreIndicesInBounds(data, header);
+}
+
+/**
+ * Maps the snapshot at path into memory and points the arrays of map into it, if it was made from a map text with
+ * hash contentHash.
+ *
+ * Returns 0 on success, -1 if the snapshot is missing, stale or invalid.
+ */
+int MapFile_LoadSnapshot(MapFile* map, const char* path, uint64_t contentHash) {
+    void* data;
+    size_t size;
+    const MapSnapshotHeader* header;
+
+    if (MapWholeFile(path, &data, &size) != 0) {
+        return -1;
+    }
+    if (!IsValidSnapshot(data, size, contentHash)) {
+        if (data != NULL) {
+            munmap(data, size);
+        }
+        return -1;
+    }
+
+    header = data;
+    memset(map, 0, sizeof(*map));
+    map->strings = (char*)data + header->stringsOffset;
+    map->stringsSize = map->stringsCapacity = header->stringsSize;
+    map->stringOffsets = (uint32_t*)((char*)data + header->stringOffsetsOffset);
+    map->stringCount = map->stringOffsetsCapacity = header->stringCount;
+    map->sections = (MapSection*)((char*)data + header->sectionsOffset);
+    map->sectionCount = map->sectionCapacity = header->sectionCount;
+    map->entries = (MapFileEntry*)((char*)data + header->entriesOffset);
+    map->entryCount = map->entryCapacity = header->entryCount;
+    map->symbols = (MapSymbol*)((char*)data + header->symbolsOffset);
+    map->symbolCount = map->symbolCapacity = header->symbolCount;
+    map->internTable = (uint32_t*)((char*)data + header->internTableOffset);
+    map->internHashes = (uint32_t*)((char*)data + header->internHashesOffset);
+    map->internCapacity = header->internCapacity;
+    map->snapshot = data;
+    map->snapshotSize = size;
+    return 0;
+}
+
+/**
+ * Like MapFile_Parse(), but loads the map from the snapshot at snapshotPath (or MapFile_GetSnapshotPath() if it is
+ * NULL) if it matches the map text, and otherwise parses the text and writes a new snapshot there for next time.
+ * Failing to write the snapshot is not an error.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int MapFile_ParseCached(MapFile* map, const char* path, const char* startMarker, int flags, const char* snapshotPath) {
+    char* defaultPath = NULL;
+    void* data;
+    size_t size;
+    uint64_t contentHash;
+    int ret = 0;
+
+    if (MapWholeFile(path, &data, &size) != 0) {
+        fprintf(stderr, "Failed to read map file %s\n", path);
+        return -1;
+    }
+    if (data != NULL) {
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+    if (snapshotPath == NULL) {
+        snapshotPath = defaultPath = MapFile_GetSnapshotPath(path, startMarker, flags);
+    }
+
+    contentHash = MapFile_HashContents((data != NULL) ? data : "", size, startMarker, flags);
+    if (MapFile_LoadSnapshot(map, snapshotPath, contentHash) != 0) {
+        ret = MapFile_ParseBuffer(map, (data != NULL) ? data : "", size, startMarker, flags);
+        if (ret == 0) {
+            MapFile_WriteSnapshot(map, snapshotPath, contentHash);
+        }
+    }
+
+    if (data != NULL) {
+        munmap(data, size);
+    }
+    free(defaultPath);
+    return ret;
+}
+
+/**
+ * Heap-allocating version of MapFile_ParseCached(), for the Python bindings. Free the result with MapFile_Free().
+ *
+ * Returns the map, or NULL on failure.
+ */
+MapFile* MapFile_LoadCached(const char* path, const char* startMarker, int flags, const char* snapshotPath) {
+    MapFile* map = malloc(sizeof(MapFile));
+
+    if (MapFile_ParseCached(map, path, startMarker, flags, snapshotPath) != 0) {
+        free(map);
+        return NULL;
+    }
+    return map;
+}
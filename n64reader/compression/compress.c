@@ -0,0 +1,408 @@
+/**
+ * Encoders for Yaz0 and MIO0.
+ *
+ * The Yaz0 encoder reproduces the output of the "greedy with lookahead" encoder used by the decomp projects' yaz0.c
+ * (itself derived from Nintendo's): at each position take the longest match in the previous 0x1000 bytes, capped at
+ * 0x111 bytes, preferring the earliest position if there is a tie; but if the match at the next position is at least
+ * 2 bytes longer, emit a literal and take that match instead.
+ *
+ * The reference encoder finds matches by comparing against every position in the window. Here a hash chain over the
+ * first 3 bytes of each position is used instead, so only positions that can give a usable match are examined, and a
+ * table of run lengths lets matches inside runs of a single byte (i.e. padding) be measured in constant time. Walking
+ * the chain from newest to oldest and accepting ties gives the same choice of match as the reference, so the output
+ * is byte-identical.
+ *
+ * MIO0 uses the same match finder and lookahead policy, with its shorter maximum length of 0x12.
+ */
+#include "compression.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WINDOW_SIZE 0x1000
+#define MIN_MATCH 3
+#define YAZ0_MAX_MATCH 0x111
+#define MIO0_MAX_MATCH 0x12
+
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+
+typedef struct {
+    const uint8_t* src;
+    size_t size;
+    size_t maxMatch;
+    size_t inserted;       /* Positions below this are in the chains */
+    int32_t* head;         /* Most recent position with each hash */
+    int32_t* prev;         /* Previous position with the same hash, indexed by position mod window size */
+    uint32_t* runLengths;  /* Number of copies of src[i] starting at i */
+    uint32_t* runStarts;   /* Number of copies of src[i] ending at i */
+    bool useReference;     /* Search the whole window instead of the chains */
+} MatchFinder;
+
+typedef struct {
+    size_t length;
+    size_t position;
+} Match;
+
+static inline uint32_t Hash3(const uint8_t* data) {
+    return ((data[0] << 16 | data[1] << 8 | data[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static bool MatchFinder_Init(MatchFinder* finder, const uint8_t* src, size_t size, size_t maxMatch,
+                             bool useReference) {
+    size_t i;
+
+    finder->src = src;
+    finder->size = size;
+    finder->maxMatch = maxMatch;
+    finder->inserted = 0;
+    finder->useReference = useReference;
+    finder->head = malloc(HASH_SIZE * sizeof(int32_t));
+    finder->prev = malloc(WINDOW_SIZE * sizeof(int32_t));
+    finder->runLengths = malloc((size + 1) * sizeof(uint32_t));
+    finder->runStarts = malloc((size + 1) * sizeof(uint32_t));
+
+    if (finder->head == NULL || finder->prev == NULL || finder->runLengths == NULL || finder->runStarts == NULL) {
+        free(finder->head);
+        free(finder->prev);
+        free(finder->runLengths);
+        free(finder->runStarts);
+        return false;
+    }
+
+    for (i = 0; i < HASH_SIZE; i++) {
+        finder->head[i] = -1;
+    }
+
+    finder->runLengths[size] = 0;
+    for (i = size; i-- > 0;) {
+        if (i + 1 < size && src[i] == src[i + 1]) {
+            finder->runLengths[i] = finder->runLengths[i + 1] + 1;
+        } else {
+            finder->runLengths[i] = 1;
+        }
+    }
+    for (i = 0; i < size; i++) {
+        if (i > 0 && src[i] == src[i - 1]) {
+            finder->runStarts[i] = finder->runStarts[i - 1] + 1;
+        } else {
+            finder->runStarts[i] = 1;
+        }
+    }
+    return true;
+}
+
+static void MatchFinder_Destroy(MatchFinder* finder) {
+    free(finder->head);
+    free(finder->prev);
+    free(finder->runLengths);
+    free(finder->runStarts);
+}
+
+/* Add every position before pos to the hash chains */
+static void MatchFinder_InsertUpTo(MatchFinder* finder, size_t pos) {
+    while (finder->inserted < pos) {
+        size_t i = finder->inserted++;
+
+        if (i + MIN_MATCH <= finder->size) {
+            uint32_t hash = Hash3(finder->src + i);
+
+            finder->prev[i % WINDOW_SIZE] = finder->head[hash];
+            finder->head[hash] = i;
+        }
+    }
+}
+
+/* Length of the common prefix of src + candidate and src + pos, up to maxLength */
+static inline size_t MatchLength(const MatchFinder* finder, size_t candidate, size_t pos, size_t maxLength) {
+    const uint8_t* src = finder->src;
+    size_t length = 0;
+
+    /* Runs of the same byte of different lengths match up to the shorter one */
+    if (src[candidate] == src[pos]) {
+        size_t candidateRun = finder->runLengths[candidate];
+        size_t posRun = finder->runLengths[pos];
+
+        length = candidateRun < posRun ? candidateRun : posRun;
+        if (candidateRun != posRun || length >= maxLength) {
+            return length < maxLength ? length : maxLength;
+        }
+    }
+
+    while (length + 8 <= maxLength) {
+        uint64_t a;
+        uint64_t b;
+
+        memcpy(&a, src + candidate + length, 8);
+        memcpy(&b, src + pos + length, 8);
+        if (a != b) {
+            break;
+        }
+        length += 8;
+    }
+    while (length < maxLength && src[candidate + length] == src[pos + length]) {
+        length++;
+    }
+    return length;
+}
+
+/**
+ * Find the longest match for the data at pos in the preceding window, taking the earliest one if there are several.
+ * Matches shorter than MIN_MATCH are reported as length 1, i.e. a literal.
+ */
+static Match MatchFinder_Search(MatchFinder* finder, size_t pos) {
+    Match best = { 1, 0 };
+    size_t windowStart = pos > WINDOW_SIZE ? pos - WINDOW_SIZE : 0;
+    size_t maxLength = finder->size - pos;
+
+    if (maxLength > finder->maxMatch) {
+        maxLength = finder->maxMatch;
+    }
+    if (maxLength < MIN_MATCH) {
+        return best;
+    }
+
+    if (finder->useReference) {
+        size_t candidate;
+
+        for (candidate = windowStart; candidate < pos; candidate++) {
+            size_t length = MatchLength(finder, candidate, pos, maxLength);
+
+            if (length > best.length) {
+                best.length = length;
+                best.position = candidate;
+            }
+        }
+    } else {
+        const uint32_t* runLengths = finder->runLengths;
+        int32_t candidate;
+
+        MatchFinder_InsertUpTo(finder, pos);
+        /* Newest to oldest, so take ties to end up with the earliest */
+        for (candidate = finder->head[Hash3(finder->src + pos)]; candidate >= (int32_t)windowStart;
+             candidate = finder->prev[candidate % WINDOW_SIZE]) {
+            size_t length;
+
+            /**
+             * Every position between the start of the run containing pos and the candidate matches for the same
+             * length, and they are consecutive in the chain, so go straight to the earliest of them in the window.
+             */
+            if ((size_t)candidate + runLengths[candidate] == pos + runLengths[pos]) {
+                size_t runStart = pos + 1 - finder->runStarts[pos];
+
+                candidate = runStart > windowStart ? runStart : windowStart;
+            }
+
+            length = MatchLength(finder, candidate, pos, maxLength);
+
+            if (length >= best.length && length >= MIN_MATCH) {
+                best.length = length;
+                best.position = candidate;
+            }
+        }
+    }
+
+    if (best.length < MIN_MATCH) {
+        best.length = 1;
+    }
+    return best;
+}
+
+typedef struct {
+    MatchFinder finder;
+    bool usePending; /* The previous call looked ahead and decided to use the next position's match */
+    Match pending;
+} LookaheadEncoder;
+
+/* Choose what to emit at pos: a match of length >= MIN_MATCH, or a literal (length 1). */
+static Match LookaheadEncoder_Next(LookaheadEncoder* encoder, size_t pos) {
+    Match match;
+
+    if (encoder->usePending) {
+        encoder->usePending = false;
+        return encoder->pending;
+    }
+
+    match = MatchFinder_Search(&encoder->finder, pos);
+    if (match.length >= MIN_MATCH) {
+        encoder->pending = MatchFinder_Search(&encoder->finder, pos + 1);
+        if (encoder->pending.length >= match.length + 2) {
+            encoder->usePending = true;
+            match.length = 1;
+        }
+    }
+    return match;
+}
+
+size_t Yaz0_GetMaxCompressedSize(size_t srcSize) {
+    /* Header, one code byte per 8 literals, padding */
+    return COMPRESSION_HEADER_SIZE + srcSize + (srcSize + 7) / 8 + 0x10;
+}
+
+static int Yaz0_CompressImpl(const uint8_t* src, size_t srcSize, uint8_t* dst, bool useReference) {
+    LookaheadEncoder encoder;
+    size_t srcPos = 0;
+    size_t codePos = COMPRESSION_HEADER_SIZE;
+    size_t dstPos = codePos + 1;
+    uint8_t codeByte = 0;
+    uint8_t bit = 0x80;
+
+    if (!MatchFinder_Init(&encoder.finder, src, srcSize, YAZ0_MAX_MATCH, useReference)) {
+        return -1;
+    }
+    encoder.usePending = false;
+
+    memcpy(dst, "Yaz0", 4);
+    dst[4] = srcSize >> 0x18;
+    dst[5] = srcSize >> 0x10;
+    dst[6] = srcSize >> 0x8;
+    dst[7] = srcSize;
+    memset(dst + 8, 0, 8);
+
+    while (srcPos < srcSize) {
+        Match match = LookaheadEncoder_Next(&encoder, srcPos);
+
+        if (match.length < MIN_MATCH) {
+            dst[dstPos++] = src[srcPos++];
+            codeByte |= bit;
+        } else {
+            size_t distance = srcPos - match.position - 1;
+
+            if (match.length >= 0x12) {
+                dst[dstPos++] = distance >> 8;
+                dst[dstPos++] = distance & 0xFF;
+                dst[dstPos++] = match.length - 0x12;
+            } else {
+                dst[dstPos++] = ((match.length - 2) << 4) | (distance >> 8);
+                dst[dstPos++] = distance & 0xFF;
+            }
+            srcPos += match.length;
+        }
+
+        bit >>= 1;
+        if (bit == 0) {
+            dst[codePos] = codeByte;
+            codePos = dstPos++;
+            codeByte = 0;
+            bit = 0x80;
+        }
+    }
+
+    /* Like the reference, this keeps the last code byte even if it ends up with no data after it */
+    dst[codePos] = codeByte;
+
+    /* Pad to 0x10 bytes */
+    while (dstPos % 0x10 != 0) {
+        dst[dstPos++] = 0;
+    }
+
+    MatchFinder_Destroy(&encoder.finder);
+    return dstPos;
+}
+
+/**
+ * Compress src as Yaz0 into dst, which must have space for Yaz0_GetMaxCompressedSize(srcSize) bytes. The output is
+ * padded to a multiple of 0x10 bytes.
+ *
+ * Returns number of bytes written, or -1 on failure.
+ */
+int Yaz0_Compress(const uint8_t* src, size_t srcSize, uint8_t* dst) {
+    return Yaz0_CompressImpl(src, srcSize, dst, false);
+}
+
+/* As Yaz0_Compress, but using the original exhaustive window search. Only useful for checking and benchmarking. */
+int Yaz0_CompressReference(const uint8_t* src, size_t srcSize, uint8_t* dst) {
+    return Yaz0_CompressImpl(src, srcSize, dst, true);
+}
+
+size_t Mio0_GetMaxCompressedSize(size_t srcSize) {
+    /* Header, one layout bit per literal rounded up to words, padding */
+    return COMPRESSION_HEADER_SIZE + srcSize + 4 * ((srcSize + 31) / 32) + 0x10;
+}
+
+static int Mio0_CompressImpl(const uint8_t* src, size_t srcSize, uint8_t* dst, bool useReference) {
+    LookaheadEncoder encoder;
+    size_t maxTokens = srcSize;
+    size_t layoutSize = 4 * ((maxTokens + 31) / 32);
+    uint8_t* layout = calloc(layoutSize + 4, 1);
+    uint8_t* compressed = malloc(2 * (srcSize / MIN_MATCH) + 2);
+    uint8_t* uncompressed = malloc(srcSize + 1);
+    size_t compressedSize = 0;
+    size_t uncompressedSize = 0;
+    size_t tokenCount = 0;
+    size_t srcPos = 0;
+    size_t dstPos;
+
+    if (layout == NULL || compressed == NULL || uncompressed == NULL ||
+        !MatchFinder_Init(&encoder.finder, src, srcSize, MIO0_MAX_MATCH, useReference)) {
+        free(layout);
+        free(compressed);
+        free(uncompressed);
+        return -1;
+    }
+    encoder.usePending = false;
+
+    while (srcPos < srcSize) {
+        Match match = LookaheadEncoder_Next(&encoder, srcPos);
+
+        if (match.length < MIN_MATCH) {
+            layout[tokenCount / 8] |= 0x80 >> (tokenCount % 8);
+            uncompressed[uncompressedSize++] = src[srcPos++];
+        } else {
+            size_t distance = srcPos - match.position - 1;
+
+            compressed[compressedSize++] = ((match.length - MIN_MATCH) << 4) | (distance >> 8);
+            compressed[compressedSize++] = distance & 0xFF;
+            srcPos += match.length;
+        }
+        tokenCount++;
+    }
+    MatchFinder_Destroy(&encoder.finder);
+
+    layoutSize = 4 * ((tokenCount + 31) / 32);
+
+    memcpy(dst, "MIO0", 4);
+    dst[4] = srcSize >> 0x18;
+    dst[5] = srcSize >> 0x10;
+    dst[6] = srcSize >> 0x8;
+    dst[7] = srcSize;
+    dstPos = COMPRESSION_HEADER_SIZE + layoutSize;
+    dst[8] = dstPos >> 0x18;
+    dst[9] = dstPos >> 0x10;
+    dst[10] = dstPos >> 0x8;
+    dst[11] = dstPos;
+    dstPos += compressedSize;
+    dst[12] = dstPos >> 0x18;
+    dst[13] = dstPos >> 0x10;
+    dst[14] = dstPos >> 0x8;
+    dst[15] = dstPos;
+
+    memcpy(dst + COMPRESSION_HEADER_SIZE, layout, layoutSize);
+    memcpy(dst + COMPRESSION_HEADER_SIZE + layoutSize, compressed, compressedSize);
+    memcpy(dst + dstPos, uncompressed, uncompressedSize);
+    dstPos += uncompressedSize;
+
+    while (dstPos % 0x10 != 0) {
+        dst[dstPos++] = 0;
+    }
+
+    free(layout);
+    free(compressed);
+    free(uncompressed);
+    return dstPos;
+}
+
+/**
+ * Compress src as MIO0 into dst, which must have space for Mio0_GetMaxCompressedSize(srcSize) bytes. The output is
+ * padded to a multiple of 0x10 bytes.
+ *
+ * Returns number of bytes written, or -1 on failure.
+ */
+int Mio0_Compress(const uint8_t* src, size_t srcSize, uint8_t* dst) {
+    return Mio0_CompressImpl(src, srcSize, dst, false);
+}
+
+int Mio0_CompressReference(const uint8_t* src, size_t srcSize, uint8_t* dst) {
+    return Mio0_CompressImpl(src, srcSize, dst, true);
+}
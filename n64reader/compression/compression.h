@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMPRESSION_HEADER_SIZE 0x10
+
+typedef enum {
+    COMPRESSION_NONE,
+    COMPRESSION_YAZ0,
+    COMPRESSION_MIO0,
+    COMPRESSION_YAY0,
+} CompressionType;
+
+extern const char* compressionNames[];
+
+CompressionType DetectCompression(const uint8_t* data, size_t size);
+size_t GetDecompressedSize(const uint8_t* data, size_t size);
+
+int Yaz0_Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+int Mio0_Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+int Yay0_Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+int Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+
+size_t Yaz0_GetMaxCompressedSize(size_t srcSize);
+int Yaz0_Compress(const uint8_t* src, size_t srcSize, uint8_t* dst);
+int Yaz0_CompressReference(const uint8_t* src, size_t srcSize, uint8_t* dst);
+size_t Mio0_GetMaxCompressedSize(size_t srcSize);
+int Mio0_Compress(const uint8_t* src, size_t srcSize, uint8_t* dst);
+int Mio0_CompressReference(const uint8_t* src, size_t srcSize, uint8_t* dst);
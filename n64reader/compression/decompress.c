@@ -0,0 +1,277 @@
+/**
+ * Decoders for the LZ-style compression formats used on the N64: Yaz0 (most EAD games), MIO0 (SM64, MK64, ...) and
+ * Yay0 (Paper Mario, Pokemon Stadium, ...).
+ *
+ * All share a 16-byte header with the magic at 0x0 and the big-endian decompressed size at 0x4, and all use 12-bit
+ * back-references of up to 0x1000 bytes. They differ in how the control bits, back-references and literals are laid
+ * out:
+ * - Yaz0 interleaves one control byte with up to 8 literals/references,
+ * - MIO0 and Yay0 keep the control bits as 32-bit words from 0x10 and the references and literals in separate streams
+ *   whose offsets are given at 0x8 and 0xC.
+ */
+#include "compression.h"
+
+#include <string.h>
+
+const char* compressionNames[] = { "none", "Yaz0", "MIO0", "Yay0" };
+
+static uint32_t ReadHeaderWord(const uint8_t* data) {
+    return ((uint32_t)data[0] << 0x18) | (data[1] << 0x10) | (data[2] << 0x8) | data[3];
+}
+
+CompressionType DetectCompression(const uint8_t* data, size_t size) {
+    if (size < COMPRESSION_HEADER_SIZE) {
+        return COMPRESSION_NONE;
+    }
+    if (memcmp(data, "Yaz0", 4) == 0) {
+        return COMPRESSION_YAZ0;
+    }
+    if (memcmp(data, "MIO0", 4) == 0) {
+        return COMPRESSION_MIO0;
+    }
+    if (memcmp(data, "Yay0", 4) == 0) {
+        return COMPRESSION_YAY0;
+    }
+    return COMPRESSION_NONE;
+}
+
+size_t GetDecompressedSize(const uint8_t* data, size_t size) {
+    if (DetectCompression(data, size) == COMPRESSION_NONE) {
+        return 0;
+    }
+    return ReadHeaderWord(data + 4);
+}
+
+/**
+ * Copy a back-reference. The source may overlap the destination (e.g. a distance of 1 is a run of one byte), in which
+ * case the copy must be done in order; otherwise copy in as large pieces as possible.
+ */
+static inline void CopyBackReference(uint8_t* dst, size_t distance, size_t length) {
+    const uint8_t* src = dst - distance;
+
+    if (distance >= length) {
+        memcpy(dst, src, length);
+    } else if (distance >= 8) {
+        while (length >= 8) {
+            memcpy(dst, src, 8);
+            dst += 8;
+            src += 8;
+            length -= 8;
+        }
+        while (length-- > 0) {
+            *dst++ = *src++;
+        }
+    } else {
+        while (length-- > 0) {
+            *dst++ = *src++;
+        }
+    }
+}
+
+/**
+ * Decompress Yaz0 data in src into dst, which must have space for at least the decompressed size in the header.
+ *
+ * Returns number of bytes written, or -1 if the data is malformed.
+ */
+int Yaz0_Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+    size_t decompressedSize = GetDecompressedSize(src, srcSize);
+    size_t srcPos = COMPRESSION_HEADER_SIZE;
+    size_t dstPos = 0;
+
+    if (DetectCompression(src, srcSize) != COMPRESSION_YAZ0 || decompressedSize > dstSize) {
+        return -1;
+    }
+
+    while (dstPos < decompressedSize) {
+        uint8_t codeByte;
+        int bit;
+
+        if (srcPos >= srcSize) {
+            return -1;
+        }
+        codeByte = src[srcPos++];
+
+        /* Fast path: a whole group of literals */
+        if (codeByte == 0xFF && srcPos + 8 <= srcSize && dstPos + 8 <= decompressedSize) {
+            memcpy(dst + dstPos, src + srcPos, 8);
+            srcPos += 8;
+            dstPos += 8;
+            continue;
+        }
+
+        for (bit = 0x80; bit != 0 && dstPos < decompressedSize; bit >>= 1) {
+            if (codeByte & bit) {
+                if (srcPos >= srcSize) {
+                    return -1;
+                }
+                dst[dstPos++] = src[srcPos++];
+            } else {
+                size_t distance;
+                size_t length;
+
+                if (srcPos + 2 > srcSize) {
+                    return -1;
+                }
+                distance = (((src[srcPos] & 0xF) << 8) | src[srcPos + 1]) + 1;
+                length = src[srcPos] >> 4;
+                srcPos += 2;
+
+                if (length == 0) {
+                    if (srcPos >= srcSize) {
+                        return -1;
+                    }
+                    length = src[srcPos++] + 0x12;
+                } else {
+                    length += 2;
+                }
+
+                if (distance > dstPos || dstPos + length > decompressedSize) {
+                    return -1;
+                }
+                CopyBackReference(dst + dstPos, distance, length);
+                dstPos += length;
+            }
+        }
+    }
+
+    return dstPos;
+}
+
+/**
+ * Decompress MIO0 data in src into dst, which must have space for at least the decompressed size in the header.
+ *
+ * Returns number of bytes written, or -1 if the data is malformed.
+ */
+int Mio0_Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+    size_t decompressedSize = GetDecompressedSize(src, srcSize);
+    size_t layoutPos = COMPRESSION_HEADER_SIZE;
+    size_t compressedPos;
+    size_t uncompressedPos;
+    size_t dstPos = 0;
+
+    if (DetectCompression(src, srcSize) != COMPRESSION_MIO0 || decompressedSize > dstSize) {
+        return -1;
+    }
+    compressedPos = ReadHeaderWord(src + 8);
+    uncompressedPos = ReadHeaderWord(src + 0xC);
+
+    while (dstPos < decompressedSize) {
+        uint32_t layoutWord;
+        uint32_t bit;
+
+        if (layoutPos + 4 > srcSize) {
+            return -1;
+        }
+        layoutWord = ReadHeaderWord(src + layoutPos);
+        layoutPos += 4;
+
+        for (bit = 0x80000000; bit != 0 && dstPos < decompressedSize; bit >>= 1) {
+            if (layoutWord & bit) {
+                if (uncompressedPos >= srcSize) {
+                    return -1;
+                }
+                dst[dstPos++] = src[uncompressedPos++];
+            } else {
+                size_t distance;
+                size_t length;
+
+                if (compressedPos + 2 > srcSize) {
+                    return -1;
+                }
+                distance = (((src[compressedPos] & 0xF) << 8) | src[compressedPos + 1]) + 1;
+                length = (src[compressedPos] >> 4) + 3;
+                compressedPos += 2;
+
+                if (distance > dstPos || dstPos + length > decompressedSize) {
+                    return -1;
+                }
+                CopyBackReference(dst + dstPos, distance, length);
+                dstPos += length;
+            }
+        }
+    }
+
+    return dstPos;
+}
+
+/**
+ * Decompress Yay0 data in src into dst, which must have space for at least the decompressed size in the header.
+ *
+ * Unlike MIO0, the long-reference length bytes are stored in the same stream as the literals.
+ *
+ * Returns number of bytes written, or -1 if the data is malformed.
+ */
+int Yay0_Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+    size_t decompressedSize = GetDecompressedSize(src, srcSize);
+    size_t layoutPos = COMPRESSION_HEADER_SIZE;
+    size_t linkPos;
+    size_t chunkPos;
+    size_t dstPos = 0;
+
+    if (DetectCompression(src, srcSize) != COMPRESSION_YAY0 || decompressedSize > dstSize) {
+        return -1;
+    }
+    linkPos = ReadHeaderWord(src + 8);
+    chunkPos = ReadHeaderWord(src + 0xC);
+
+    while (dstPos < decompressedSize) {
+        uint32_t layoutWord;
+        uint32_t bit;
+
+        if (layoutPos + 4 > srcSize) {
+            return -1;
+        }
+        layoutWord = ReadHeaderWord(src + layoutPos);
+        layoutPos += 4;
+
+        for (bit = 0x80000000; bit != 0 && dstPos < decompressedSize; bit >>= 1) {
+            if (layoutWord & bit) {
+                if (chunkPos >= srcSize) {
+                    return -1;
+                }
+                dst[dstPos++] = src[chunkPos++];
+            } else {
+                size_t distance;
+                size_t length;
+
+                if (linkPos + 2 > srcSize) {
+                    return -1;
+                }
+                distance = (((src[linkPos] & 0xF) << 8) | src[linkPos + 1]) + 1;
+                length = src[linkPos] >> 4;
+                linkPos += 2;
+
+                if (length == 0) {
+                    if (chunkPos >= srcSize) {
+                        return -1;
+                    }
+                    length = src[chunkPos++] + 0x12;
+                } else {
+                    length += 2;
+                }
+
+                if (distance > dstPos || dstPos + length > decompressedSize) {
+                    return -1;
+                }
+                CopyBackReference(dst + dstPos, distance, length);
+                dstPos += length;
+            }
+        }
+    }
+
+    return dstPos;
+}
+
+/* Decompress src with whichever decoder its header indicates */
+int Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+    switch (DetectCompression(src, srcSize)) {
+        case COMPRESSION_YAZ0:
+            return Yaz0_Decompress(src, srcSize, dst, dstSize);
+        case COMPRESSION_MIO0:
+            return Mio0_Decompress(src, srcSize, dst, dstSize);
+        case COMPRESSION_YAY0:
+            return Yay0_Decompress(src, srcSize, dst, dstSize);
+        default:
+            return -1;
+    }
+}
@@ -38,6 +38,12 @@
 
 // #include "libiberty.h"
 
+#include "crc32.h"
+
+#include <stdlib.h>
+
+#include "../workpool/workpool.h"
+
 /* This table was generated by the following program.
 
    #include <stdio.h>
@@ -143,3 +149,107 @@ unsigned int xcrc32(const unsigned char* buf, int len, unsigned int init) {
     }
     return crc;
 }
+
+/* Combining and parallel computation, which the above makes possible */
+
+#define CRC32_POLY 0x04c11db7
+
+/* Chunks smaller than this are not worth handing to another thread */
+#define CRC32_MIN_CHUNK_SIZE 0x40000
+
+/* Product of two polynomials modulo the CRC polynomial, most significant coefficient in bit 31 */
+static unsigned int xcrc32_multiply(unsigned int a, unsigned int b) {
+    unsigned int product = 0;
+    int i;
+
+    for (i = 31; i >= 0; i--) {
+        product = (product & 0x80000000) ? (product << 1) ^ CRC32_POLY : (product << 1);
+        if ((b >> i) & 1) {
+            product ^= a;
+        }
+    }
+    return product;
+}
+
+/* What crc becomes after len more zero bytes, i.e. crc * x^(8 * len) mod P, by repeated squaring */
+static unsigned int xcrc32_shift(unsigned int crc, size_t len) {
+    unsigned int power = 0x100; /* x^8, one byte */
+
+    while (len != 0) {
+        if (len & 1) {
+            crc = xcrc32_multiply(crc, power);
+        }
+        power = xcrc32_multiply(power, power);
+        len >>= 1;
+    }
+    return crc;
+}
+
+/**
+ * Given crc1, the CRC of a buffer A from any starting value, and crc2, the CRC of a buffer B of length len2 starting
+ * from 0, returns the CRC of A followed by B from A's starting value, as if computed in one go. Takes time logarithmic
+ * in len2, so CRCs of pieces can be computed separately, in any order, and put together afterwards.
+ */
+unsigned int xcrc32_combine(unsigned int crc1, unsigned int crc2, size_t len2) {
+    return xcrc32_shift(crc1, len2) ^ crc2;
+}
+
+typedef struct {
+    const unsigned char* buf;
+    size_t len;
+    size_t chunkSize;
+    unsigned int* crcs;
+} Crc32Job;
+
+static void xcrc32_chunk(void* arg, size_t index) {
+    Crc32Job* job = arg;
+    size_t start = index * job->chunkSize;
+    size_t len = (job->len - start < job->chunkSize) ? job->len - start : job->chunkSize;
+    unsigned int crc = 0;
+
+    /* xcrc32 takes an int length, so go in pieces that fit */
+    while (len > 0) {
+        int piece = (len > 0x40000000) ? 0x40000000 : (int)len;
+
+        crc = xcrc32(job->buf + start, piece, crc);
+        start += piece;
+        len -= piece;
+    }
+    job->crcs[index] = crc;
+}
+
+/**
+ * Same as xcrc32, but splits the buffer into chunks whose CRCs are computed on threadCount threads (or one per online
+ * CPU if threadCount <= 0) and then combined.
+ */
+unsigned int xcrc32_parallel(const unsigned char* buf, size_t len, unsigned int init, int threadCount) {
+    Crc32Job job;
+    size_t chunkCount;
+    unsigned int crc;
+    size_t i;
+
+    if (threadCount <= 0) {
+        threadCount = WorkPool_DefaultThreadCount();
+    }
+
+    /* A few chunks per thread, so that one slow thread does not hold up the rest */
+    job.buf = buf;
+    job.len = len;
+    job.chunkSize = len / (4 * (size_t)threadCount) + 1;
+    if (job.chunkSize < CRC32_MIN_CHUNK_SIZE) {
+        job.chunkSize = CRC32_MIN_CHUNK_SIZE;
+    }
+    chunkCount = (len + job.chunkSize - 1) / job.chunkSize;
+    job.crcs = malloc((chunkCount + 1) * sizeof(unsigned int));
+
+    WorkPool_ParallelFor(threadCount, chunkCount, xcrc32_chunk, &job);
+
+    /* The chunks were all started from 0, so the starting value is carried over the whole buffer by the combining */
+    crc = init;
+    for (i = 0; i < chunkCount; i++) {
+        crc = xcrc32_combine(crc, job.crcs[i], (i + 1 < chunkCount) ? job.chunkSize : len - i * job.chunkSize);
+    }
+
+    free(job.crcs);
+    return crc;
+}
@@ -1,3 +1,7 @@
 #pragma once
 
+#include <stddef.h>
+
 unsigned int xcrc32(const unsigned char* buf, int len, unsigned int init);
+unsigned int xcrc32_combine(unsigned int crc1, unsigned int crc2, size_t len2);
+unsigned int xcrc32_parallel(const unsigned char* buf, size_t len, unsigned int init, int threadCount);
@@ -0,0 +1,281 @@
+/**
+ * Reading 64DD disk images.
+ *
+ * A disk has 16 zones, 8 on each head, with fewer and shorter sectors on the inner tracks: blocks (two per track, 85
+ * sectors each) are 19720 bytes in the outermost zone and 9520 in the innermost. The order the zones are used in, and
+ * so the size of each logical block, depends on the disk type, 0-6, which says how much of the disk is writable. The
+ * type is in the system data, several copies of which are in the system area at the start of the disk, in zone 0
+ * whatever the type.
+ *
+ * Images are in LBA order, all 4316 logical blocks one after another, which is how retail disks are dumped. Blocks are
+ * read on demand through a small cache of recently-used ones, rather than loading all 64 MiB.
+ */
+#include "disk.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTORS_PER_BLOCK 85
+#define BLOCKS_PER_TRACK 2
+
+/* LBAs of the copies of the system data, on retail and development disks */
+static const uint32_t retailSystemLbas[] = { 0, 1, 8, 9 };
+static const uint32_t developmentSystemLbas[] = { 2, 3, 10, 11 };
+
+#define DISK_ID_LBA 14
+
+const char* diskRegionNames[] = { "Japan", "USA", "development" };
+
+static const uint32_t regionCodes[] = { 0xE848D316, 0x2263EE56 };
+
+static const uint16_t zoneSectorSizes[DISK_ZONE_COUNT] = {
+    232, 216, 208, 192, 176, 160, 144, 128, /* head 0, outermost first */
+    216, 208, 192, 176, 160, 144, 128, 112, /* head 1 */
+};
+
+/* Tracks in each zone that hold logical blocks. Each zone also has 12 spare tracks to stand in for defective ones */
+static const uint16_t zoneTracks[DISK_ZONE_COUNT] = {
+    146, 146, 137, 137, 137, 137, 137, 102, 146, 146, 137, 137, 137, 137, 137, 102,
+};
+
+/* The physical zone each logical zone is in, for each disk type */
+static const uint8_t vzoneToPzone[DISK_TYPE_COUNT][DISK_ZONE_COUNT] = {
+    { 0, 1, 2, 9, 8, 3, 4, 5, 6, 7, 15, 14, 13, 12, 11, 10 },
+    { 0, 1, 2, 3, 10, 9, 8, 4, 5, 6, 7, 15, 14, 13, 12, 11 },
+    { 0, 1, 2, 3, 4, 11, 10, 9, 8, 5, 6, 7, 15, 14, 13, 12 },
+    { 0, 1, 2, 3, 4, 5, 12, 11, 10, 9, 8, 6, 7, 15, 14, 13 },
+    { 0, 1, 2, 3, 4, 5, 6, 13, 12, 11, 10, 9, 8, 7, 15, 14 },
+    { 0, 1, 2, 3, 4, 5, 6, 7, 14, 13, 12, 11, 10, 9, 8, 15 },
+    { 0, 1, 2, 3, 4, 5, 6, 7, 15, 14, 13, 12, 11, 10, 9, 8 },
+};
+
+typedef struct {
+    uint32_t lba; /* UINT32_MAX if empty */
+    size_t size;
+    uint64_t lastUse;
+    uint8_t* data;
+} CacheSlot;
+
+struct DiskImage {
+    FILE* file;
+    DiskInfo info;
+    CacheSlot* slots;
+    size_t slotCount;
+    uint64_t clock;
+    DiskCacheStats stats;
+};
+
+/**
+ * Finds which zone a logical block is in and where it is in an image, for a disk of type diskType.
+ *
+ * Returns 0 on success, -1 if the type or LBA is out of range.
+ */
+int Disk_TranslateLba(uint8_t diskType, uint32_t lba, DiskLocation* location) {
+    uint32_t zoneStart = 0;
+    size_t offset = 0;
+    uint8_t vzone;
+
+    if (diskType >= DISK_TYPE_COUNT || lba >= DISK_LBA_COUNT) {
+        return -1;
+    }
+
+    for (vzone = 0; vzone < DISK_ZONE_COUNT; vzone++) {
+        uint8_t pzone = vzoneToPzone[diskType][vzone];
+        uint32_t blockCount = zoneTracks[pzone] * BLOCKS_PER_TRACK;
+        uint32_t blockSize = zoneSectorSizes[pzone] * SECTORS_PER_BLOCK;
+
+        if (lba < zoneStart + blockCount) {
+            location->vzone = vzone;
+            location->pzone = pzone;
+            location->head = pzone >= DISK_ZONE_COUNT / 2;
+            location->zoneLba = lba - zoneStart;
+            location->zoneBlocks = blockCount;
+            location->blockSize = blockSize;
+            location->offset = offset + (size_t)(lba - zoneStart) * blockSize;
+            return 0;
+        }
+        zoneStart += blockCount;
+        offset += (size_t)blockCount * blockSize;
+    }
+    return -1;
+}
+
+static uint32_t ReadBE32(const uint8_t* data) {
+    return ((uint32_t)data[0] << 0x18) | (data[1] << 0x10) | (data[2] << 0x8) | data[3];
+}
+
+/* Whether a block from the system area holds system data for region, and if so read it into info */
+static bool ReadSystemData(const uint8_t* data, DiskRegion region, DiskInfo* info) {
+    uint8_t zone;
+
+    if (region == DISK_REGION_DEVELOPMENT ? ReadBE32(data) != 0 : ReadBE32(data) != regionCodes[region]) {
+        return false;
+    }
+    if ((data[0x05] & 0xF) >= DISK_TYPE_COUNT) {
+        return false;
+    }
+
+    info->region = region;
+    info->diskType = data[0x05] & 0xF;
+    info->iplSize = (data[0x06] << 0x8) | data[0x07];
+    info->iplLoadAddress = ReadBE32(data + 0x1C);
+
+    /* The defect tracks of each zone are listed from 0x20, and 0x08 + zone is the index of the end of its list */
+    for (zone = 0; zone < DISK_ZONE_COUNT; zone++) {
+        uint8_t start = (zone == 0) ? 0 : data[0x07 + zone];
+        uint8_t end = data[0x08 + zone];
+
+        info->defectCounts[zone] = (end >= start) ? end - start : 0;
+    }
+    return true;
+}
+
+/* Looks for a valid copy of the system data, as on a retail disk and then as on a development one */
+static bool FindSystemData(DiskImage* disk) {
+    const uint8_t* data;
+    size_t size;
+    size_t i;
+    DiskRegion region;
+
+    /* The system area is in zone 0 on every type, so type 0 will do until the real one is known */
+    for (i = 0; i < sizeof(retailSystemLbas) / sizeof(retailSystemLbas[0]); i++) {
+        if ((data = DiskImage_ReadBlock(disk, retailSystemLbas[i], &size)) == NULL) {
+            continue;
+        }
+        for (region = DISK_REGION_JAPAN; region < DISK_REGION_DEVELOPMENT; region++) {
+            if (ReadSystemData(data, region, &disk->info)) {
+                disk->info.systemLba = retailSystemLbas[i];
+                return true;
+            }
+        }
+    }
+    for (i = 0; i < sizeof(developmentSystemLbas) / sizeof(developmentSystemLbas[0]); i++) {
+        data = DiskImage_ReadBlock(disk, developmentSystemLbas[i], &size);
+        if (data != NULL && ReadSystemData(data, DISK_REGION_DEVELOPMENT, &disk->info)) {
+            disk->info.systemLba = developmentSystemLbas[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+static int ReadDiskInfo(DiskImage* disk) {
+    const uint8_t* data;
+    size_t size;
+
+    if (!FindSystemData(disk) || (data = DiskImage_ReadBlock(disk, DISK_ID_LBA, &size)) == NULL) {
+        return -1;
+    }
+    memcpy(disk->info.gameCode, data, 4);
+    disk->info.gameCode[4] = '\0';
+    disk->info.version = data[0x04];
+    disk->info.diskNumber = data[0x05];
+    return 0;
+}
+
+/**
+ * Opens a disk image and reads its system area, keeping up to cacheBlocks blocks in memory at once.
+ *
+ * Returns NULL if the file cannot be read or is not a disk image.
+ */
+DiskImage* DiskImage_Open(const char* path, size_t cacheBlocks) {
+    DiskImage* disk;
+    long length;
+    size_t i;
+
+    if (cacheBlocks == 0) {
+        cacheBlocks = 1;
+    }
+
+    disk = calloc(1, sizeof(DiskImage));
+    if ((disk->file = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "Failed to open file %s\n", path);
+        free(disk);
+        return NULL;
+    }
+
+    fseek(disk->file, 0, SEEK_END);
+    length = ftell(disk->file);
+    if (length != DISK_IMAGE_SIZE) {
+        fprintf(stderr, "%s is 0x%lX bytes, not a 64DD disk image in LBA order (0x%X bytes)\n", path, length,
+                DISK_IMAGE_SIZE);
+        fclose(disk->file);
+        free(disk);
+        return NULL;
+    }
+
+    disk->slotCount = cacheBlocks;
+    disk->slots = calloc(cacheBlocks, sizeof(CacheSlot));
+    for (i = 0; i < cacheBlocks; i++) {
+        disk->slots[i].lba = UINT32_MAX;
+        disk->slots[i].data = malloc(DISK_MAX_BLOCK_SIZE);
+    }
+
+    if (ReadDiskInfo(disk) != 0) {
+        fprintf(stderr, "%s has no valid system data\n", path);
+        DiskImage_Close(disk);
+        return NULL;
+    }
+    return disk;
+}
+
+void DiskImage_Close(DiskImage* disk) {
+    size_t i;
+
+    for (i = 0; i < disk->slotCount; i++) {
+        free(disk->slots[i].data);
+    }
+    free(disk->slots);
+    fclose(disk->file);
+    free(disk);
+}
+
+const DiskInfo* DiskImage_GetInfo(const DiskImage* disk) {
+    return &disk->info;
+}
+
+/**
+ * Reads a logical block, from the cache if it is there, or else into the least recently used slot. The data is only
+ * valid until the slot is reused, i.e. after cacheBlocks more reads of other blocks.
+ *
+ * Returns the block, or NULL if the LBA is out of range or the read fails.
+ */
+const uint8_t* DiskImage_ReadBlock(DiskImage* disk, uint32_t lba, size_t* size) {
+    DiskLocation location;
+    CacheSlot* slot = &disk->slots[0];
+    size_t i;
+
+    for (i = 0; i < disk->slotCount; i++) {
+        if (disk->slots[i].lba == lba) {
+            disk->stats.hits++;
+            disk->slots[i].lastUse = ++disk->clock;
+            *size = disk->slots[i].size;
+            return disk->slots[i].data;
+        }
+        if (disk->slots[i].lastUse < slot->lastUse) {
+            slot = &disk->slots[i];
+        }
+    }
+
+    if (Disk_TranslateLba(disk->info.diskType, lba, &location) != 0) {
+        return NULL;
+    }
+
+    disk->stats.misses++;
+    slot->lba = UINT32_MAX;
+    if (fseek(disk->file, location.offset, SEEK_SET) != 0 ||
+        fread(slot->data, location.blockSize, 1, disk->file) != 1) {
+        return NULL;
+    }
+    slot->lba = lba;
+    slot->size = location.blockSize;
+    slot->lastUse = ++disk->clock;
+    *size = slot->size;
+    return slot->data;
+}
+
+DiskCacheStats DiskImage_GetCacheStats(const DiskImage* disk) {
+    return disk->stats;
+}
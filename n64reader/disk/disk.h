@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Size of an image with every logical block of a disk in LBA order, as retail disks are dumped */
+#define DISK_IMAGE_SIZE 0x3DEC800
+
+#define DISK_LBA_COUNT 4316
+#define DISK_ZONE_COUNT 16
+#define DISK_TYPE_COUNT 7
+#define DISK_MAX_BLOCK_SIZE (232 * 85)
+
+typedef enum {
+    DISK_REGION_JAPAN,
+    DISK_REGION_USA,
+    DISK_REGION_DEVELOPMENT,
+} DiskRegion;
+
+extern const char* diskRegionNames[];
+
+/* What the system area and disk ID say about the disk */
+typedef struct {
+    DiskRegion region;
+    uint8_t diskType;
+    uint32_t systemLba;      /* the copy of the system data that was used */
+    uint16_t iplSize;        /* in blocks */
+    uint32_t iplLoadAddress; /* in RDRAM */
+    uint8_t defectCounts[DISK_ZONE_COUNT];
+    char gameCode[5];
+    uint8_t version;
+    uint8_t diskNumber;
+} DiskInfo;
+
+/* Where a logical block is: its zones, and its offset in an image in LBA order */
+typedef struct {
+    uint8_t vzone; /* logical zone, in LBA order */
+    uint8_t pzone; /* physical zone, 0-7 on head 0 and 8-15 on head 1 */
+    uint8_t head;
+    uint32_t zoneLba; /* LBA relative to the start of the zone */
+    uint32_t zoneBlocks;
+    uint32_t blockSize;
+    size_t offset;
+} DiskLocation;
+
+int Disk_TranslateLba(uint8_t diskType, uint32_t lba, DiskLocation* location);
+
+typedef struct {
+    size_t hits;
+    size_t misses;
+} DiskCacheStats;
+
+typedef struct DiskImage DiskImage;
+
+DiskImage* DiskImage_Open(const char* path, size_t cacheBlocks);
+void DiskImage_Close(DiskImage* disk);
+const DiskInfo* DiskImage_GetInfo(const DiskImage* disk);
+const uint8_t* DiskImage_ReadBlock(DiskImage* disk, uint32_t lba, size_t* size);
+DiskCacheStats DiskImage_GetCacheStats(const DiskImage* disk);
@@ -0,0 +1,314 @@
+/**
+ * Rough classification of a ROM's contents, block by block, to help see where its code, compressed files, other data
+ * and padding are before splitting it up.
+ *
+ * Each block gets a byte histogram, from which come its Shannon entropy and the number of distinct bytes, and a score
+ * for how much of it looks like MIPS code: the fraction of its big-endian words that are instructions a compiler
+ * would plausibly emit, with register fields that make sense. Random or compressed data decodes to an instruction
+ * about 40% of the time by this measure, compiled code well over 90%. Words of all 0 or all 1 bits are left out, since
+ * they are as common in padding and zeroed data as nops are in code, but at least half of the words are always
+ * counted, so that a few stray words among padding cannot make a block code.
+ */
+#include "layout.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Blocks with at least this mipsScore are code */
+#define CODE_SCORE 0.85f
+
+/* Blocks with at least this many bits of entropy per byte that are not code are compressed */
+#define COMPRESSED_ENTROPY 7.2f
+
+const char* blockKindNames[] = { "fill", "code", "compressed", "data" };
+
+#define OPCODE(w) ((w) >> 26)
+#define RS(w) (((w) >> 21) & 0x1F)
+#define RT(w) (((w) >> 16) & 0x1F)
+#define RD(w) (((w) >> 11) & 0x1F)
+#define SA(w) (((w) >> 6) & 0x1F)
+#define FUNCT(w) ((w)&0x3F)
+
+static bool IsPlausibleSpecial(uint32_t word) {
+    switch (FUNCT(word)) {
+        case 0x00: /* sll */
+        case 0x02: /* srl */
+        case 0x03: /* sra */
+        case 0x38: /* dsll */
+        case 0x3A: /* dsrl */
+        case 0x3B: /* dsra */
+        case 0x3C: /* dsll32 */
+        case 0x3E: /* dsrl32 */
+        case 0x3F: /* dsra32 */
+            return RS(word) == 0 && RD(word) != 0;
+
+        case 0x04: /* sllv */
+        case 0x06: /* srlv */
+        case 0x07: /* srav */
+        case 0x14: /* dsllv */
+        case 0x16: /* dsrlv */
+        case 0x17: /* dsrav */
+        case 0x20: /* add */
+        case 0x21: /* addu */
+        case 0x22: /* sub */
+        case 0x23: /* subu */
+        case 0x24: /* and */
+        case 0x25: /* or */
+        case 0x26: /* xor */
+        case 0x27: /* nor */
+        case 0x2A: /* slt */
+        case 0x2B: /* sltu */
+        case 0x2C: /* dadd */
+        case 0x2D: /* daddu */
+        case 0x2E: /* dsub */
+        case 0x2F: /* dsubu */
+            return SA(word) == 0 && RD(word) != 0;
+
+        case 0x08: /* jr */
+            return RT(word) == 0 && RD(word) == 0 && SA(word) == 0;
+
+        case 0x09: /* jalr */
+            return RT(word) == 0 && SA(word) == 0;
+
+        case 0x0C: /* syscall */
+        case 0x0D: /* break */
+        case 0x34: /* teq, used for division by zero checks */
+            return true;
+
+        case 0x0F: /* sync */
+            return (word >> 6) == 0;
+
+        case 0x10: /* mfhi */
+        case 0x12: /* mflo */
+            return RS(word) == 0 && RT(word) == 0 && SA(word) == 0 && RD(word) != 0;
+
+        case 0x11: /* mthi */
+        case 0x13: /* mtlo */
+            return RT(word) == 0 && RD(word) == 0 && SA(word) == 0;
+
+        case 0x18: /* mult */
+        case 0x19: /* multu */
+        case 0x1A: /* div */
+        case 0x1B: /* divu */
+        case 0x1C: /* dmult */
+        case 0x1D: /* dmultu */
+        case 0x1E: /* ddiv */
+        case 0x1F: /* ddivu */
+            return RD(word) == 0 && SA(word) == 0;
+
+        default:
+            return false;
+    }
+}
+
+static bool IsPlausibleInstruction(uint32_t word) {
+    switch (OPCODE(word)) {
+        case 0x00:
+            return IsPlausibleSpecial(word);
+
+        case 0x01: /* bltz, bgez, bltzl, bgezl, and the al versions */
+            return (RT(word) & 0xC) == 0;
+
+        case 0x06: /* blez */
+        case 0x07: /* bgtz */
+        case 0x16: /* blezl */
+        case 0x17: /* bgtzl */
+            return RT(word) == 0;
+
+        case 0x0F: /* lui */
+            return RS(word) == 0;
+
+        case 0x11: /* cop1: mfc1, dmfc1, cfc1, mtc1, dmtc1, ctc1, bc1, and the s, d, w, l formats */
+            switch (RS(word)) {
+                case 0x00:
+                case 0x01:
+                case 0x02:
+                case 0x04:
+                case 0x05:
+                case 0x06:
+                case 0x08:
+                case 0x10:
+                case 0x11:
+                case 0x14:
+                case 0x15:
+                    return true;
+                default:
+                    return false;
+            }
+
+        case 0x02: /* j */
+        case 0x03: /* jal */
+        case 0x04: /* beq */
+        case 0x05: /* bne */
+        case 0x09: /* addiu */
+        case 0x0A: /* slti */
+        case 0x0B: /* sltiu */
+        case 0x0C: /* andi */
+        case 0x0D: /* ori */
+        case 0x0E: /* xori */
+        case 0x14: /* beql */
+        case 0x15: /* bnel */
+        case 0x20: /* lb */
+        case 0x21: /* lh */
+        case 0x23: /* lw */
+        case 0x24: /* lbu */
+        case 0x25: /* lhu */
+        case 0x28: /* sb */
+        case 0x29: /* sh */
+        case 0x2B: /* sw */
+        case 0x31: /* lwc1 */
+        case 0x35: /* ldc1 */
+        case 0x37: /* ld */
+        case 0x39: /* swc1 */
+        case 0x3D: /* sdc1 */
+        case 0x3F: /* sd */
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* Whether every byte of the block is the same as the first */
+static bool IsUniform(const uint8_t* data, size_t size) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    __m128i fill = _mm_set1_epi8(data[0]);
+
+    for (; i + 64 <= size; i += 64) {
+        __m128i same = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), fill),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i + 16)), fill)),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i + 32)), fill),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i + 48)), fill)));
+
+        if (_mm_movemask_epi8(same) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+
+    for (; i < size; i++) {
+        if (data[i] != data[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Counts the bytes of the block. Consecutive bytes are counted in separate tables, so that a run of one byte does not
+ * make each increment wait for the one before it.
+ */
+static void Histogram(const uint8_t* data, size_t size, uint32_t histogram[0x100]) {
+    uint32_t counts[4][0x100] = { 0 };
+    size_t i;
+    size_t b;
+
+    for (i = 0; i + 4 <= size; i += 4) {
+        counts[0][data[i]]++;
+        counts[1][data[i + 1]]++;
+        counts[2][data[i + 2]]++;
+        counts[3][data[i + 3]]++;
+    }
+    for (; i < size; i++) {
+        counts[0][data[i]]++;
+    }
+
+    for (b = 0; b < 0x100; b++) {
+        histogram[b] = counts[0][b] + counts[1][b] + counts[2][b] + counts[3][b];
+    }
+}
+
+/* cLogC[c] is c * log2(c), for every count up to blockSize */
+static void AnalyseBlock(const uint8_t* data, size_t size, const float* cLogC, BlockInfo* info) {
+    uint32_t histogram[0x100];
+    float sum = 0.0f;
+    size_t plausible = 0;
+    size_t filler = 0;
+    size_t words = size / 4;
+    size_t i;
+
+    memset(info, 0, sizeof(BlockInfo));
+
+    if (IsUniform(data, size)) {
+        info->kind = BLOCK_FILL;
+        info->fill = data[0];
+        info->symbols = 1;
+        return;
+    }
+
+    Histogram(data, size, histogram);
+    for (i = 0; i < 0x100; i++) {
+        sum += cLogC[histogram[i]];
+        info->symbols += histogram[i] != 0;
+    }
+    info->entropy = log2f(size) - sum / size;
+
+    for (i = 0; i + 4 <= size; i += 4) {
+        uint32_t word = ((uint32_t)data[i] << 0x18) | (data[i + 1] << 0x10) | (data[i + 2] << 0x8) | data[i + 3];
+
+        if (word == 0 || word == 0xFFFFFFFF) {
+            filler++;
+        } else {
+            plausible += IsPlausibleInstruction(word);
+        }
+    }
+    words = (words - filler > words / 2) ? words - filler : words / 2;
+    info->mipsScore = (words != 0) ? (float)plausible / words : 0.0f;
+
+    if (info->mipsScore >= CODE_SCORE) {
+        info->kind = BLOCK_CODE;
+    } else if (info->entropy >= COMPRESSED_ENTROPY) {
+        info->kind = BLOCK_COMPRESSED;
+    } else {
+        info->kind = BLOCK_DATA;
+    }
+}
+
+/**
+ * Splits a big-endian ROM into blocks of blockSize bytes (the last may be shorter) and analyses each one.
+ *
+ * Returns number of blocks, whose information is put in a newly-allocated array, which is NULL if there is not enough
+ * memory.
+ */
+size_t Layout_Analyse(const uint8_t* rom, size_t romSize, size_t blockSize, BlockInfo** blocks) {
+    size_t count = romSize / blockSize + (romSize % blockSize != 0);
+    float* cLogC = NULL;
+    size_t i;
+
+    *blocks = NULL;
+    if (blockSize < SIZE_MAX / sizeof(float)) {
+        cLogC = malloc((blockSize + 1) * sizeof(float));
+    }
+    if (cLogC == NULL) {
+        return 0;
+    }
+
+    cLogC[0] = 0.0f;
+    for (i = 1; i <= blockSize; i++) {
+        cLogC[i] = i * log2f(i);
+    }
+
+    *blocks = malloc((count + 1) * sizeof(BlockInfo));
+    if (*blocks == NULL) {
+        free(cLogC);
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        size_t offset = i * blockSize;
+
+        AnalyseBlock(rom + offset, (romSize - offset < blockSize) ? romSize - offset : blockSize, cLogC,
+                     &(*blocks)[i]);
+    }
+
+    free(cLogC);
+    return count;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LAYOUT_DEFAULT_BLOCK_SIZE 0x1000
+
+typedef enum {
+    BLOCK_FILL,       /* every byte the same, usually 00 or FF padding */
+    BLOCK_CODE,       /* mostly words that decode to plausible MIPS instructions */
+    BLOCK_COMPRESSED, /* close to 8 bits of entropy per byte: compressed, or otherwise incompressible */
+    BLOCK_DATA,       /* anything else: tables, textures, audio, ... */
+} BlockKind;
+
+extern const char* blockKindNames[];
+
+typedef struct {
+    BlockKind kind;
+    uint8_t fill;     /* the byte a BLOCK_FILL is filled with */
+    float entropy;    /* Shannon entropy in bits per byte */
+    float mipsScore;  /* fraction of words that are plausible instructions, not counting 0 and -1 */
+    uint16_t symbols; /* number of distinct byte values */
+} BlockInfo;
+
+size_t Layout_Analyse(const uint8_t* rom, size_t romSize, size_t blockSize, BlockInfo** blocks);
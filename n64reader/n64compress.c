@@ -0,0 +1,375 @@
+/**
+ * Compress files with Yaz0 or MIO0, several at once, for rebuilding compressed ROMs.
+ *
+ * The Yaz0 output is byte-identical to the decomp projects' reference encoder, so matching builds stay matching.
+ * Compressed files can be cached in a directory, keyed by the CRC and size of the input, so files that have not
+ * changed since the last build are never recompressed.
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compression/compression.h"
+#include "crc32/crc32.h"
+#include "romfile/romfile.h"
+#include "workpool/workpool.h"
+
+typedef enum {
+    FORMAT_YAZ0,
+    FORMAT_MIO0,
+} CompressFormat;
+
+typedef struct {
+    const char* name;
+    size_t (*getMaxCompressedSize)(size_t srcSize);
+    int (*compress)(const uint8_t* src, size_t srcSize, uint8_t* dst);
+    int (*compressReference)(const uint8_t* src, size_t srcSize, uint8_t* dst);
+} CompressFormatInfo;
+
+const CompressFormatInfo formatInfo[] = {
+    { "yaz0", Yaz0_GetMaxCompressedSize, Yaz0_Compress, Yaz0_CompressReference },
+    { "mio0", Mio0_GetMaxCompressedSize, Mio0_Compress, Mio0_CompressReference },
+};
+
+typedef struct {
+    char* inPath;
+    char* outPath;
+} FilePair;
+
+typedef struct {
+    const CompressFormatInfo* format;
+    const char* cacheDir;
+    bool useReference;
+    FilePair* files;
+    size_t fileCount;
+    atomic_int failures;
+    atomic_int cacheHits;
+    atomic_size_t inBytes;
+    atomic_size_t outBytes;
+} CompressJob;
+
+/* Allocate and run the compressor. Returns the compressed data, or NULL on failure. */
+uint8_t* CompressBuffer(const CompressFormatInfo* format, bool useReference, const uint8_t* src, size_t srcSize,
+                        size_t* compressedSize) {
+    uint8_t* dst = malloc(format->getMaxCompressedSize(srcSize));
+    int size;
+
+    if (dst == NULL) {
+        return NULL;
+    }
+    size = useReference ? format->compressReference(src, srcSize, dst) : format->compress(src, srcSize, dst);
+    if (size < 0) {
+        free(dst);
+        return NULL;
+    }
+    *compressedSize = size;
+    return dst;
+}
+
+/**
+ * Write to a temporary file and rename it, so that concurrent builds sharing a cache never see a partial file. The
+ * temporary file is named after the process and the file being compressed, since two files with the same contents
+ * can be stored from different threads at once.
+ */
+void StoreInCache(const char* cachePath, size_t index, const uint8_t* data, size_t size) {
+    char tempPath[4096];
+
+    snprintf(tempPath, sizeof(tempPath), "%s.%ld.%zu.tmp", cachePath, (long)getpid(), index);
+    if (WriteWholeFile(tempPath, data, size) == 0) {
+        rename(tempPath, cachePath);
+    } else {
+        remove(tempPath);
+    }
+}
+
+void CompressFile(void* arg, size_t index) {
+    CompressJob* job = arg;
+    const FilePair* pair = &job->files[index];
+    char cachePath[4096];
+    uint8_t* src;
+    size_t srcSize;
+    uint8_t* dst = NULL;
+    size_t dstSize;
+
+    if ((src = ReadWholeFile(pair->inPath, &srcSize)) == NULL) {
+        atomic_fetch_add(&job->failures, 1);
+        return;
+    }
+
+    if (job->cacheDir != NULL) {
+        uint32_t crc = xcrc32(src, srcSize, 0xFFFFFFFF);
+
+        snprintf(cachePath, sizeof(cachePath), "%s/%08X-%zX.%s", job->cacheDir, crc, srcSize, job->format->name);
+        if (access(cachePath, R_OK) == 0 && (dst = ReadWholeFile(cachePath, &dstSize)) != NULL) {
+            atomic_fetch_add(&job->cacheHits, 1);
+        }
+    }
+
+    if (dst == NULL) {
+        if ((dst = CompressBuffer(job->format, job->useReference, src, srcSize, &dstSize)) == NULL) {
+            fprintf(stderr, "Failed to compress %s\n", pair->inPath);
+            atomic_fetch_add(&job->failures, 1);
+            free(src);
+            return;
+        }
+        if (job->cacheDir != NULL) {
+            StoreInCache(cachePath, index, dst, dstSize);
+        }
+    }
+
+    if (WriteWholeFile(pair->outPath, dst, dstSize) != 0) {
+        atomic_fetch_add(&job->failures, 1);
+    }
+    atomic_fetch_add(&job->inBytes, srcSize);
+    atomic_fetch_add(&job->outBytes, dstSize);
+
+    free(dst);
+    free(src);
+}
+
+double GetTime(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* Compress each input with both match finders, check they agree, and report the times. */
+int RunBenchmark(CompressJob* job) {
+    double fastTotal = 0.0;
+    double referenceTotal = 0.0;
+    size_t inTotal = 0;
+    int mismatches = 0;
+    size_t i;
+
+    for (i = 0; i < job->fileCount; i++) {
+        uint8_t* src;
+        size_t srcSize;
+        uint8_t* fast;
+        uint8_t* reference;
+        size_t fastSize;
+        size_t referenceSize;
+        double start;
+        double fastTime;
+        double referenceTime;
+
+        if ((src = ReadWholeFile(job->files[i].inPath, &srcSize)) == NULL) {
+            return 1;
+        }
+
+        start = GetTime();
+        fast = CompressBuffer(job->format, false, src, srcSize, &fastSize);
+        fastTime = GetTime() - start;
+        start = GetTime();
+        reference = CompressBuffer(job->format, true, src, srcSize, &referenceSize);
+        referenceTime = GetTime() - start;
+
+        if (fast == NULL || reference == NULL) {
+            fprintf(stderr, "Failed to compress %s\n", job->files[i].inPath);
+            free(fast);
+            free(reference);
+            free(src);
+            return 1;
+        }
+
+        printf("%s: 0x%zX -> 0x%zX bytes, hash chain %.2f ms, reference %.2f ms%s\n", job->files[i].inPath, srcSize,
+               fastSize, fastTime * 1e3, referenceTime * 1e3,
+               (fastSize == referenceSize && memcmp(fast, reference, fastSize) == 0) ? "" : ", OUTPUT DIFFERS");
+        if (fastSize != referenceSize || memcmp(fast, reference, fastSize) != 0) {
+            mismatches++;
+        }
+
+        fastTotal += fastTime;
+        referenceTotal += referenceTime;
+        inTotal += srcSize;
+        free(fast);
+        free(reference);
+        free(src);
+    }
+
+    printf("Total: 0x%zX bytes, hash chain %.2f MiB/s, reference %.2f MiB/s, speedup %.1fx\n", inTotal,
+           inTotal / fastTotal / (1 << 20), inTotal / referenceTotal / (1 << 20), referenceTotal / fastTotal);
+    return mismatches != 0;
+}
+
+/* Read "IN OUT" pairs, one per line. Returns number of pairs added, or -1 on failure. */
+int ReadFileList(const char* listPath, FilePair** files, size_t* fileCount, size_t* capacity) {
+    FILE* listFile;
+    char line[8192];
+    int count = 0;
+
+    if ((listFile = fopen(listPath, "r")) == NULL) {
+        fprintf(stderr, "Failed to open file %s\n", listPath);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), listFile) != NULL) {
+        char* inPath = strtok(line, " \t\r\n");
+        char* outPath = strtok(NULL, " \t\r\n");
+
+        if (inPath == NULL || inPath[0] == '#') {
+            continue;
+        }
+        if (outPath == NULL) {
+            fprintf(stderr, "%s: no output file given for %s\n", listPath, inPath);
+            fclose(listFile);
+            return -1;
+        }
+        if (*fileCount == *capacity) {
+            *capacity = 2 * *capacity + 16;
+            *files = realloc(*files, *capacity * sizeof(FilePair));
+        }
+        (*files)[*fileCount].inPath = strdup(inPath);
+        (*files)[*fileCount].outPath = strdup(outPath);
+        (*fileCount)++;
+        count++;
+    }
+
+    fclose(listFile);
+    return count;
+}
+
+const struct option longOptions[] = {
+    { "benchmark", no_argument, NULL, 'b' },
+    { "cache", required_argument, NULL, 'c' },
+    { "format", required_argument, NULL, 'f' },
+    { "jobs", required_argument, NULL, 'j' },
+    { "list", required_argument, NULL, 'l' },
+    { "reference", no_argument, NULL, 'r' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
+
+int main(int argc, char** argv) {
+    int opt;
+    bool benchmark = false;
+    int threadCount = 0;
+    CompressJob job;
+    size_t capacity = 0;
+    size_t i;
+    int ret;
+
+    job.format = &formatInfo[FORMAT_YAZ0];
+    job.cacheDir = NULL;
+    job.useReference = false;
+    job.files = NULL;
+    job.fileCount = 0;
+    atomic_init(&job.failures, 0);
+    atomic_init(&job.cacheHits, 0);
+    atomic_init(&job.inBytes, 0);
+    atomic_init(&job.outBytes, 0);
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "bc:f:j:l:rh", longOptions, &optionIndex)) == EOF) {
+            break;
+        }
+
+        switch (opt) {
+            case 'b':
+                benchmark = true;
+                break;
+
+            case 'c':
+                job.cacheDir = optarg;
+                break;
+
+            case 'f':
+                if (strcasecmp(optarg, "yaz0") == 0) {
+                    job.format = &formatInfo[FORMAT_YAZ0];
+                } else if (strcasecmp(optarg, "mio0") == 0) {
+                    job.format = &formatInfo[FORMAT_MIO0];
+                } else {
+                    fprintf(stderr, "Unknown format \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'j':
+                if (sscanf(optarg, "%d", &threadCount) != 1) {
+                    fprintf(stderr, "-j expects a dec number, found %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'l':
+                if (ReadFileList(optarg, &job.files, &job.fileCount, &capacity) < 0) {
+                    return 1;
+                }
+                break;
+
+            case 'r':
+                job.useReference = true;
+                break;
+
+            case 'h':
+                fprintf(stderr, "%s [-f yaz0|mio0] [-j NUM] [-c DIR] [-l LIST] [IN OUT]...\n", argv[0]);
+                puts("Compresses each file IN to OUT. The Yaz0 output is identical to the reference encoder's and is\n"
+                     "padded to a multiple of 0x10 bytes.\n"
+                     "Options:\n"
+                     "  -f, --format FORMAT    Compression format, yaz0 (default) or mio0.\n"
+                     "  -j, --jobs NUM         Number of files to compress at once (default: one per CPU).\n"
+                     "  -c, --cache DIR        Reuse compressed files stored in DIR, keyed by input CRC and size,\n"
+                     "                         and store newly-compressed files there.\n"
+                     "  -l, --list FILE        Read further \"IN OUT\" pairs from FILE, one per line.\n"
+                     "  -r, --reference        Use the original exhaustive match search (slow).\n"
+                     "  -b, --benchmark        Compress each IN with both match searches, check the outputs are\n"
+                     "                         identical and report the times, without writing anything.\n"
+                     "  -h, --help             Display this message and exit.\n");
+                return 1;
+
+            default:
+                fprintf(stderr, "Getopt returned character code: 0x%X", opt);
+        }
+    }
+
+    for (; optind < argc; optind++) {
+        if (job.fileCount == capacity) {
+            capacity = 2 * capacity + 16;
+            job.files = realloc(job.files, capacity * sizeof(FilePair));
+        }
+        job.files[job.fileCount].inPath = strdup(argv[optind]);
+        if (benchmark) {
+            job.files[job.fileCount].outPath = NULL;
+        } else if (optind + 1 < argc) {
+            job.files[job.fileCount].outPath = strdup(argv[++optind]);
+        } else {
+            fprintf(stderr, "No output file given for %s\n", argv[optind]);
+            free(job.files[job.fileCount].inPath);
+            return 1;
+        }
+        job.fileCount++;
+    }
+
+    if (job.fileCount == 0) {
+        fprintf(stderr, "%s [-f yaz0|mio0] [-j NUM] [-c DIR] [-l LIST] [IN OUT]...\n", argv[0]);
+        fprintf(stderr, "No files provided. Exiting.\n");
+        return 1;
+    }
+
+    if (benchmark) {
+        ret = RunBenchmark(&job);
+    } else {
+        WorkPool_ParallelFor(threadCount, job.fileCount, CompressFile, &job);
+        if (job.cacheDir != NULL) {
+            fprintf(stderr, "%zu files, %d from cache, 0x%zX -> 0x%zX bytes\n", job.fileCount,
+                    atomic_load(&job.cacheHits), atomic_load(&job.inBytes), atomic_load(&job.outBytes));
+        }
+        ret = atomic_load(&job.failures) != 0;
+    }
+
+    for (i = 0; i < job.fileCount; i++) {
+        free(job.files[i].inPath);
+        free(job.files[i].outPath);
+    }
+    free(job.files);
+    return ret;
+}
@@ -0,0 +1,384 @@
+/**
+ * Decompress every compressed file in a ROM with a `dmadata`-style file table (OoT, MM, and others built on the same
+ * engine), producing a decompressed ROM image.
+ *
+ * The files are decompressed in parallel straight into their places in a preallocated output image, which is then
+ * written out in one go.
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compression/compression.h"
+#include "romfile/romfile.h"
+#include "workpool/workpool.h"
+
+#define DMA_ENTRY_SIZE 0x10
+
+/* The first entry of the table is always makerom, i.e. the header, IPL3 and entrypoint */
+static const uint8_t dmadataSignature[DMA_ENTRY_SIZE] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+typedef struct {
+    uint32_t vromStart;
+    uint32_t vromEnd;
+    uint32_t romStart; /* 0xFFFFFFFF if the file is not present in the ROM */
+    uint32_t romEnd;   /* 0 if the file is not compressed */
+} DmaEntry;
+
+typedef struct {
+    const uint8_t* rom;
+    size_t romSize;
+    uint8_t* out;
+    size_t outSize;
+    DmaEntry* entries;
+    size_t entryCount;
+    atomic_int failures;
+} DecompressJob;
+
+/**
+ * Look for the makerom entry on a 0x10-byte boundary.
+ *
+ * Returns the offset of the table, or -1 if not found.
+ */
+long FindDmadata(const uint8_t* rom, size_t romSize) {
+    size_t offset;
+
+    for (offset = 0x1000; offset + DMA_ENTRY_SIZE <= romSize; offset += DMA_ENTRY_SIZE) {
+        if (memcmp(rom + offset, dmadataSignature, DMA_ENTRY_SIZE) == 0) {
+            return offset;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Read entries until the all-zero terminator or the end of the ROM.
+ *
+ * Returns number of entries read into a newly-allocated array, which is NULL if it could not be allocated.
+ */
+size_t ReadDmadata(const uint8_t* rom, size_t romSize, size_t dmadataOffset, DmaEntry** entries) {
+    size_t count = 0;
+    size_t capacity = 0x800;
+    size_t offset;
+
+    if ((*entries = malloc(capacity * sizeof(DmaEntry))) == NULL) {
+        return 0;
+    }
+
+    for (offset = dmadataOffset; offset + DMA_ENTRY_SIZE <= romSize; offset += DMA_ENTRY_SIZE) {
+        DmaEntry entry;
+
+        entry.vromStart = ReadBE32(rom + offset + 0x0);
+        entry.vromEnd = ReadBE32(rom + offset + 0x4);
+        entry.romStart = ReadBE32(rom + offset + 0x8);
+        entry.romEnd = ReadBE32(rom + offset + 0xC);
+
+        if (entry.vromEnd == 0) {
+            break;
+        }
+        if (count == capacity) {
+            DmaEntry* grown = realloc(*entries, 2 * capacity * sizeof(DmaEntry));
+
+            if (grown == NULL) {
+                free(*entries);
+                *entries = NULL;
+                return 0;
+            }
+            *entries = grown;
+            capacity *= 2;
+        }
+        (*entries)[count++] = entry;
+    }
+
+    return count;
+}
+
+void DecompressEntry(void* arg, size_t index) {
+    DecompressJob* job = arg;
+    const DmaEntry* entry = &job->entries[index];
+    size_t size = entry->vromEnd - entry->vromStart;
+
+    if (entry->romStart == 0xFFFFFFFF || size == 0) {
+        return;
+    }
+    if (entry->vromEnd > job->outSize || entry->vromStart > entry->vromEnd) {
+        fprintf(stderr, "Entry %zu: VROM range %08X-%08X is invalid\n", index, entry->vromStart, entry->vromEnd);
+        atomic_fetch_add(&job->failures, 1);
+        return;
+    }
+
+    if (entry->romEnd == 0) {
+        if (entry->romStart + size > job->romSize) {
+            fprintf(stderr, "Entry %zu: ROM range %08X-%08zX is outside the ROM\n", index, entry->romStart,
+                    entry->romStart + size);
+            atomic_fetch_add(&job->failures, 1);
+            return;
+        }
+        memcpy(job->out + entry->vromStart, job->rom + entry->romStart, size);
+    } else {
+        if (entry->romEnd > job->romSize || entry->romStart >= entry->romEnd) {
+            fprintf(stderr, "Entry %zu: ROM range %08X-%08X is invalid\n", index, entry->romStart, entry->romEnd);
+            atomic_fetch_add(&job->failures, 1);
+            return;
+        }
+        if (Decompress(job->rom + entry->romStart, entry->romEnd - entry->romStart, job->out + entry->vromStart,
+                       size) < 0) {
+            fprintf(stderr, "Entry %zu: failed to decompress %s data at %08X\n", index,
+                    compressionNames[DetectCompression(job->rom + entry->romStart, entry->romEnd - entry->romStart)],
+                    entry->romStart);
+            atomic_fetch_add(&job->failures, 1);
+        }
+    }
+}
+
+/**
+ * Rewrite the copy of the table in the output so that every file is uncompressed and at its VROM address.
+ *
+ * Returns 0 on success, -1 if the table is not inside the output, which is reported.
+ */
+int UpdateDmadata(DecompressJob* job, size_t dmadataOffset) {
+    size_t outDmadataOffset = dmadataOffset;
+    size_t i;
+
+    /* Find where the table itself ended up */
+    for (i = 0; i < job->entryCount; i++) {
+        const DmaEntry* entry = &job->entries[i];
+
+        if (entry->romEnd == 0 && entry->romStart <= dmadataOffset &&
+            dmadataOffset < entry->romStart + (entry->vromEnd - entry->vromStart)) {
+            outDmadataOffset = dmadataOffset - entry->romStart + entry->vromStart;
+            break;
+        }
+    }
+
+    /* With a wrong -d, or a table that is not in an uncompressed file, it can be anywhere */
+    if (outDmadataOffset > job->outSize || job->entryCount > (job->outSize - outDmadataOffset) / DMA_ENTRY_SIZE) {
+        fprintf(stderr, "dmadata at %08zX does not fit in the decompressed ROM, which is %zX bytes\n",
+                outDmadataOffset, job->outSize);
+        return -1;
+    }
+
+    for (i = 0; i < job->entryCount; i++) {
+        uint8_t* out = job->out + outDmadataOffset + i * DMA_ENTRY_SIZE;
+
+        if (job->entries[i].romStart == 0xFFFFFFFF) {
+            continue;
+        }
+        WriteBE32(out + 0x8, job->entries[i].vromStart);
+        WriteBE32(out + 0xC, 0);
+    }
+    return 0;
+}
+
+double GetTime(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+double TimeDecompression(DecompressJob* job, int threadCount, int repeats) {
+    double best = 0.0;
+    int i;
+
+    for (i = 0; i < repeats; i++) {
+        double start = GetTime();
+        double elapsed;
+
+        WorkPool_ParallelFor(threadCount, job->entryCount, DecompressEntry, job);
+        elapsed = GetTime() - start;
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+void RunBenchmark(DecompressJob* job, int threadCount) {
+    size_t compressedBytes = 0;
+    size_t decompressedBytes = 0;
+    double singleTime;
+    double multiTime;
+    size_t i;
+
+    for (i = 0; i < job->entryCount; i++) {
+        if (job->entries[i].romStart != 0xFFFFFFFF && job->entries[i].romEnd != 0) {
+            compressedBytes += job->entries[i].romEnd - job->entries[i].romStart;
+            decompressedBytes += job->entries[i].vromEnd - job->entries[i].vromStart;
+        }
+    }
+
+    singleTime = TimeDecompression(job, 1, 3);
+    multiTime = TimeDecompression(job, threadCount, 3);
+
+    printf("Compressed files:  %zu bytes -> %zu bytes\n", compressedBytes, decompressedBytes);
+    printf("1 thread:          %8.2f ms  %8.2f MiB/s\n", singleTime * 1e3, decompressedBytes / singleTime / (1 << 20));
+    printf("%-2d threads:        %8.2f ms  %8.2f MiB/s\n", threadCount, multiTime * 1e3,
+           decompressedBytes / multiTime / (1 << 20));
+    printf("Speedup:           %8.2fx\n", singleTime / multiTime);
+}
+
+const struct option longOptions[] = {
+    { "benchmark", no_argument, NULL, 'b' },
+    { "dmadata", required_argument, NULL, 'd' },
+    { "jobs", required_argument, NULL, 'j' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
+
+int main(int argc, char** argv) {
+    int opt;
+    bool benchmark = false;
+    long dmadataOffset = -1;
+    int threadCount = 0;
+    uint8_t* rom;
+    size_t romSize;
+    DecompressJob job;
+    size_t i;
+    FILE* outFile;
+    bool written;
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "bd:j:h", longOptions, &optionIndex)) == EOF) {
+            break;
+        }
+
+        switch (opt) {
+            case 'b':
+                benchmark = true;
+                break;
+
+            case 'd': {
+                unsigned long offset;
+
+                if (sscanf(optarg, "%lX", &offset) != 1) {
+                    fprintf(stderr, "-d expects a hex number, found %s\n", optarg);
+                    return 1;
+                }
+                dmadataOffset = offset;
+                break;
+            }
+
+            case 'j':
+                if (sscanf(optarg, "%d", &threadCount) != 1) {
+                    fprintf(stderr, "-j expects a dec number, found %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'h':
+                fprintf(stderr, "%s [-b] [-d HEX] [-j NUM] ROMFILE [OUTFILE]\n", argv[0]);
+                puts("Decompresses every Yaz0/MIO0/Yay0 file in a ROM's dmadata file table and writes the\n"
+                     "decompressed ROM, with the table updated to match. Header checksums are not recalculated.\n"
+                     "Options:\n"
+                     "  -d, --dmadata HEX      Offset of the file table (default: search for it)\n"
+                     "  -j, --jobs NUM         Number of threads to use (default: one per CPU)\n"
+                     "  -b, --benchmark        Time decompression with one thread and with NUM threads instead of\n"
+                     "                         writing any output.\n"
+                     "  -h, --help             Display this message and exit.\n");
+                return 1;
+
+            default:
+                fprintf(stderr, "Getopt returned character code: 0x%X", opt);
+        }
+    }
+
+    if (optind >= argc || (!benchmark && optind + 1 >= argc)) {
+        fprintf(stderr, "%s [-b] [-d HEX] [-j NUM] ROMFILE [OUTFILE]\n", argv[0]);
+        return 1;
+    }
+    if (threadCount <= 0) {
+        threadCount = WorkPool_DefaultThreadCount();
+    }
+
+    if ((rom = ReadRom(argv[optind], &romSize, NULL)) == NULL) {
+        return 1;
+    }
+
+    if (dmadataOffset < 0 && (dmadataOffset = FindDmadata(rom, romSize)) < 0) {
+        fprintf(stderr, "Unable to find dmadata in %s. Specify its offset with -d.\n", argv[optind]);
+        free(rom);
+        return 1;
+    }
+
+    job.rom = rom;
+    job.romSize = romSize;
+    job.entryCount = ReadDmadata(rom, romSize, dmadataOffset, &job.entries);
+    if (job.entries == NULL) {
+        fprintf(stderr, "Failed to allocate buffer for dmadata\n");
+        free(rom);
+        return 1;
+    }
+    atomic_init(&job.failures, 0);
+
+    job.outSize = 0;
+    for (i = 0; i < job.entryCount; i++) {
+        if (job.entries[i].romStart != 0xFFFFFFFF && job.entries[i].vromEnd > job.outSize) {
+            job.outSize = job.entries[i].vromEnd;
+        }
+    }
+    job.outSize = (job.outSize + 0xF) & ~(size_t)0xF;
+    if ((job.out = calloc(job.outSize, 1)) == NULL) {
+        fprintf(stderr, "Failed to allocate buffer for the decompressed ROM\n");
+        free(job.entries);
+        free(rom);
+        return 1;
+    }
+
+    if (benchmark) {
+        RunBenchmark(&job, threadCount);
+    } else {
+        WorkPool_ParallelFor(threadCount, job.entryCount, DecompressEntry, &job);
+    }
+
+    if (atomic_load(&job.failures) > 0) {
+        fprintf(stderr, "%d files failed to decompress\n", atomic_load(&job.failures));
+        free(job.out);
+        free(job.entries);
+        free(rom);
+        return 1;
+    }
+
+    if (!benchmark) {
+        if (UpdateDmadata(&job, dmadataOffset) != 0) {
+            free(job.out);
+            free(job.entries);
+            free(rom);
+            return 1;
+        }
+
+        if ((outFile = fopen(argv[optind + 1], "wb")) == NULL) {
+            fprintf(stderr, "Failed to open file %s\n", argv[optind + 1]);
+            free(job.out);
+            free(job.entries);
+            free(rom);
+            return 1;
+        }
+        written = fwrite(job.out, job.outSize, 1, outFile) == 1;
+        /* Buffered data is only written out by fclose, which can fail too */
+        if (fclose(outFile) != 0) {
+            written = false;
+        }
+        if (!written) {
+            fprintf(stderr, "Failed to write file %s\n", argv[optind + 1]);
+            free(job.out);
+            free(job.entries);
+            free(rom);
+            return 1;
+        }
+    }
+
+    free(job.out);
+    free(job.entries);
+    free(rom);
+    return 0;
+}
@@ -1,12 +1,18 @@
+#define _GNU_SOURCE
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <endian.h>
 #include <getopt.h>
 #include <iconv.h>
+#include <time.h>
 
 #include "crc32/crc32.h"
+#include "disk/disk.h"
+#include "layout/layout.h"
+#include "romfile/romfile.h"
 
 #define ARRAY_COUNT(arr) (sizeof(arr) / sizeof(arr[0]))
 
@@ -90,22 +96,6 @@ typedef struct {
 #define REEND32(w) (w)
 #endif
 
-/* Length in words, i.e. uint32_t */
-void SwapBytes16(uint16_t* data, int length) {
-    int i;
-    for (i = 0; i < length / 2; i++) {
-        data[i] = ((data[i] & 0xFF) << 0x8) | (data[i] >> 0x8);
-    }
-}
-
-void SwapBytes32(uint32_t* data, int length) {
-    int i;
-    for (i = 0; i < length / 4; i++) {
-        data[i] = ((data[i] & 0xFF) << 0x18) | ((data[i] & 0xFF00) << 0x8) | ((data[i] & 0xFF0000) >> 0x8) |
-                  (data[i] >> 0x18);
-    }
-}
-
 void ReEndHeader(N64Header* header) {
     header->clockRate = REEND32(header->clockRate);
     header->entrypoint = REEND32(header->entrypoint);
@@ -134,19 +124,16 @@ const struct option longOptions[] = {
     { "utf-8", no_argument, NULL, 'u' },
     { "byteswapped", no_argument, NULL, 'v' },
     { "big-endian", no_argument, NULL, 'z' },
+    { "layout", no_argument, NULL, 'l' },
+    { "block-size", required_argument, NULL, 'b' },
+    { "json", no_argument, NULL, 'j' },
+    { "lba", required_argument, NULL, 'L' },
+    { "benchmark", no_argument, NULL, 'B' },
+    { "file-crc", no_argument, NULL, 'f' },
     { "help", no_argument, NULL, 'h' },
     { 0 },
 };
 
-typedef enum {
-    GOOD_ENDIAN,
-    BAD_ENDIAN,
-    UGLY_ENDIAN,
-    UNKNOWN_ENDIAN,
-} Endianness;
-
-const char* endiannessStrings[] = { "Big", "Little", "Middle", "Unknown" };
-
 #define HEADER_LENGTH (0x1000 - 0x40)
 
 /* Computes the crc32 of the IPL3 to determine which CIC is used. */
@@ -157,17 +144,7 @@ uint32_t ComputeHeaderCRC(FILE* romFile, Endianness endianness) {
     fseek(romFile, 0x40, SEEK_SET);
     fread(buffer, HEADER_LENGTH, 1, romFile);
 
-    switch (endianness) {
-        case GOOD_ENDIAN:
-        case UNKNOWN_ENDIAN:
-            break;
-        case BAD_ENDIAN:
-            SwapBytes32((uint32_t*)buffer, HEADER_LENGTH);
-            break;
-        case UGLY_ENDIAN:
-            SwapBytes16((uint16_t*)buffer, HEADER_LENGTH);
-            break;
-    }
+    NormaliseEndianness((uint8_t*)buffer, HEADER_LENGTH, endianness);
     for (i = 0; i < HEADER_LENGTH / sizeof(uint32_t); i++) {
         REEND32(buffer[i]);
     }
@@ -208,8 +185,178 @@ typedef enum {
     OUTPUT_DEFAULT,
     OUTPUT_CSV,
     OUTPUT_ASM,
+    OUTPUT_JSON,
 } OutputFormat;
 
+/**
+ * Prints the layout of a ROM as ranges of consecutive blocks of the same kind (and fill byte), with their average
+ * entropy and MIPS score, as CSV with a header row or as a JSON array.
+ */
+void PrintLayout(const BlockInfo* blocks, size_t blockCount, size_t blockSize, size_t romSize, OutputFormat format,
+                 char separator) {
+    size_t start;
+    size_t end;
+    bool first = true;
+
+    if (format == OUTPUT_JSON) {
+        puts("[");
+    } else {
+        printf("start%cend%ckind%cfill%centropy%cmips\n", separator, separator, separator, separator, separator);
+    }
+
+    for (start = 0; start < blockCount; start = end) {
+        const BlockInfo* block = &blocks[start];
+        double entropy = 0.0;
+        double mipsScore = 0.0;
+        size_t romEnd;
+        char fill[3] = "";
+
+        for (end = start; end < blockCount && blocks[end].kind == block->kind && blocks[end].fill == block->fill;
+             end++) {
+            entropy += blocks[end].entropy;
+            mipsScore += blocks[end].mipsScore;
+        }
+        entropy /= end - start;
+        mipsScore /= end - start;
+        romEnd = (end * blockSize < romSize) ? end * blockSize : romSize;
+        if (block->kind == BLOCK_FILL) {
+            sprintf(fill, "%02X", block->fill);
+        }
+
+        if (format == OUTPUT_JSON) {
+            printf("%s  { \"start\": %zu, \"end\": %zu, \"kind\": \"%s\", \"fill\": \"%s\", \"entropy\": %.2f, "
+                   "\"mips\": %.2f }",
+                   first ? "" : ",\n", start * blockSize, romEnd, blockKindNames[block->kind], fill, entropy,
+                   mipsScore);
+        } else {
+            printf("0x%06zX%c0x%06zX%c%s%c%s%c%.2f%c%.2f\n", start * blockSize, separator, romEnd, separator,
+                   blockKindNames[block->kind], separator, fill, separator, entropy, separator, mipsScore);
+        }
+        first = false;
+    }
+
+    if (format == OUTPUT_JSON) {
+        puts("\n]");
+    }
+}
+
+/* Blocks of a disk image kept in memory, enough for a file's worth of neighbouring reads */
+#define DISK_CACHE_BLOCKS 16
+
+void PrintDiskInfo(const char* path, const DiskInfo* info) {
+    DiskLocation zone;
+    uint32_t lba;
+    int i;
+
+    printf("File: %s\n", path);
+    printf("Disk image: 0x%X bytes (%d MB), %d blocks\n", DISK_IMAGE_SIZE, DISK_IMAGE_SIZE >> 20, DISK_LBA_COUNT);
+    putchar('\n');
+
+    printf("Region:            %s\n", diskRegionNames[info->region]);
+    printf("Disk type:         %d\n", info->diskType);
+    printf("System data:       LBA %u\n", info->systemLba);
+    printf("IPL size:          %u blocks\n", info->iplSize);
+    printf("IPL load address:  %08X\n", info->iplLoadAddress);
+    printf("Game code:         %s\n", info->gameCode);
+    printf("Country code:      %c: %s\n", info->gameCode[3],
+           FindDescriptionFromChar(info->gameCode[3], countryCharDescription));
+    printf("Version:           %d\n", info->version);
+    printf("Disk number:       %d\n", info->diskNumber);
+    printf("Defect tracks:    ");
+    for (i = 0; i < DISK_ZONE_COUNT; i++) {
+        printf(" %d", info->defectCounts[i]);
+    }
+    putchar('\n');
+    putchar('\n');
+
+    puts("Zone  Physical  Head  LBAs       Block size  Offset");
+    for (lba = 0; lba < DISK_LBA_COUNT; lba += zone.zoneBlocks) {
+        Disk_TranslateLba(info->diskType, lba, &zone);
+        printf("%4d  %8d  %4d  %4u-%-4u  %10u  0x%07zX\n", zone.vzone, zone.pzone, zone.head, lba,
+               lba + zone.zoneBlocks - 1, zone.blockSize, zone.offset);
+    }
+}
+
+double GetTime(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* Reads count LBAs through a fresh cache, in order or at random, and prints how fast that went */
+int TimeDiskReads(const char* path, const char* name, size_t count, bool sequential) {
+    DiskImage* disk = DiskImage_Open(path, DISK_CACHE_BLOCKS);
+    DiskCacheStats stats;
+    uint32_t seed = 1;
+    size_t bytes = 0;
+    double start;
+    double elapsed;
+    size_t i;
+
+    if (disk == NULL) {
+        return 1;
+    }
+
+    start = GetTime();
+    for (i = 0; i < count; i++) {
+        uint32_t lba;
+        size_t size;
+
+        if (sequential) {
+            lba = i % DISK_LBA_COUNT;
+        } else {
+            seed = seed * 1103515245 + 12345;
+            lba = (seed >> 8) % DISK_LBA_COUNT;
+        }
+        if (DiskImage_ReadBlock(disk, lba, &size) == NULL) {
+            fprintf(stderr, "Failed to read LBA %u\n", lba);
+            DiskImage_Close(disk);
+            return 1;
+        }
+        bytes += size;
+    }
+    elapsed = GetTime() - start;
+    stats = DiskImage_GetCacheStats(disk);
+
+    printf("%-11s %7zu blocks  %8.2f ms  %8.2f MiB/s  %8.0f blocks/s  %5.1f%% cache hits\n", name, count,
+           elapsed * 1e3, bytes / elapsed / (1 << 20), count / elapsed, 100.0 * stats.hits / count);
+    DiskImage_Close(disk);
+    return 0;
+}
+
+/* Prints what a disk image's system area says, or where an LBA is, or how fast blocks can be read */
+int ReadDisk(const char* path, long lba, bool benchmark) {
+    DiskImage* disk;
+    const DiskInfo* info;
+    DiskLocation location;
+
+    if (benchmark) {
+        /* Reading every block of the disk twice over, then the same number at random */
+        return TimeDiskReads(path, "Sequential:", 2 * DISK_LBA_COUNT, true) ||
+               TimeDiskReads(path, "Random:", 2 * DISK_LBA_COUNT, false);
+    }
+
+    if ((disk = DiskImage_Open(path, DISK_CACHE_BLOCKS)) == NULL) {
+        return 1;
+    }
+    info = DiskImage_GetInfo(disk);
+
+    if (lba < 0) {
+        PrintDiskInfo(path, info);
+    } else if (Disk_TranslateLba(info->diskType, lba, &location) != 0) {
+        fprintf(stderr, "LBA %ld is outside the disk, which has %d blocks\n", lba, DISK_LBA_COUNT);
+        DiskImage_Close(disk);
+        return 1;
+    } else {
+        printf("LBA %ld: block %u of zone %d (physical zone %d, head %d), 0x%X bytes at 0x%07zX\n", lba,
+               location.zoneLba, location.vzone, location.pzone, location.head, location.blockSize, location.offset);
+    }
+
+    DiskImage_Close(disk);
+    return 0;
+}
+
 int main(int argc, char** argv) {
     int opt;
     OutputFormat outputFormat = OUTPUT_DEFAULT;
@@ -219,10 +366,15 @@ int main(int argc, char** argv) {
     FILE* romFile;
     N64Header header;
     size_t romSize;
-    Endianness endianness;
+    Endianness endianness = UNKNOWN_ENDIAN;
     char separator = ',';
     char* entrypointString = "";
     bool useEntrypointString = false;
+    bool layout = false;
+    size_t blockSize = LAYOUT_DEFAULT_BLOCK_SIZE;
+    long lba = -1;
+    bool benchmark = false;
+    bool fileCrc = false;
 
     if (argc < 2) {
         fprintf(stderr, "%s -cu[n|v|z] -s SEP ROMFILE\n", argv[0]);
@@ -232,7 +384,7 @@ int main(int argc, char** argv) {
 
     while (true) {
         int optionIndex = 0;
-        if ((opt = getopt_long(argc, argv, "e:s:acnpuvzh", longOptions, &optionIndex)) == EOF) {
+        if ((opt = getopt_long(argc, argv, "e:s:b:L:acfjlnpuvzBh", longOptions, &optionIndex)) == EOF) {
             break;
         }
 
@@ -249,6 +401,36 @@ int main(int argc, char** argv) {
                 outputFormat = OUTPUT_CSV;
                 break;
 
+            case 'j':
+                outputFormat = OUTPUT_JSON;
+                break;
+
+            case 'l':
+                layout = true;
+                break;
+
+            case 'L':
+                if (sscanf(optarg, "%ld", &lba) != 1 || lba < 0) {
+                    fprintf(stderr, "--lba expects a dec number, found %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'B':
+                benchmark = true;
+                break;
+
+            case 'f':
+                fileCrc = true;
+                break;
+
+            case 'b':
+                if (sscanf(optarg, "%zX", &blockSize) != 1 || blockSize < 4) {
+                    fprintf(stderr, "--block-size expects a hex number of at least 4, found %s\n", optarg);
+                    return 1;
+                }
+                break;
+
             case 'e':
                 entrypointString = optarg;
                 useEntrypointString = true;
@@ -286,6 +468,20 @@ int main(int argc, char** argv) {
                      "\n"
                      "  -a, --asm              Output in asm format.\n"
                      "  -c, --csv              Output in csv format.\n"
+                     "  -f, --file-crc         Instead of the header, print the CRC32 of the whole file as gdb's qCRC\n"
+                     "                         computes it (polynomial 04C11DB7, not reflected, starting from\n"
+                     "                         FFFFFFFF), computed on all CPUs. Works on disk images too.\n"
+                     "  -j, --json             Output --layout as JSON.\n"
+                     "  -l, --layout           Instead of the header, print which ranges of the ROM look like code,\n"
+                     "                         compressed data, other data or padding, with their entropy and\n"
+                     "                         how much of them decodes to plausible MIPS instructions. CSV unless\n"
+                     "                         --json is given.\n"
+                     "  -b, --block-size HEX   Size of the blocks --layout classifies (default: 1000).\n"
+                     "\n"
+                     "64DD disk images (in LBA order, 0x3DEC800 bytes) are recognised by their size, and the\n"
+                     "system area and disk ID are printed instead of a header.\n"
+                     "  -L, --lba NUM          Print which zone logical block NUM of a disk image is in, and where.\n"
+                     "  -B, --benchmark        Time reading blocks of a disk image in order and at random.\n"
                      "  -n, --little-endian    Read input as little-endian.\n"
                      "  -p, --print-endian     Print endianness.\n"
                      "  -u, --utf-8            Convert image name to UTF-8.\n"
@@ -299,45 +495,87 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (optind >= argc) {
+        fprintf(stderr, "No ROM file provided. Exiting.\n");
+        return 1;
+    }
+
+    if (fileCrc) {
+        uint8_t* data = ReadWholeFile(argv[optind], &romSize);
+
+        if (data == NULL) {
+            return 1;
+        }
+        printf("%08X\n", xcrc32_parallel(data, romSize, 0xFFFFFFFF, 0));
+        free(data);
+        return 0;
+    }
+
+    if (layout) {
+        uint8_t* rom = ReadWholeFile(argv[optind], &romSize);
+        BlockInfo* blocks;
+        size_t blockCount;
+
+        if (rom == NULL) {
+            return 1;
+        }
+        if (romSize < 4) {
+            fprintf(stderr, "%s is too small to be a ROM\n", argv[optind]);
+            free(rom);
+            return 1;
+        }
+        if (!endianSpecified) {
+            endianness = DetectEndianness(rom);
+        }
+        NormaliseEndianness(rom, romSize, endianness);
+
+        /* A block bigger than the ROM is the whole ROM */
+        if (blockSize > romSize) {
+            blockSize = romSize;
+        }
+        blockCount = Layout_Analyse(rom, romSize, blockSize, &blocks);
+        if (blocks == NULL) {
+            fprintf(stderr, "Out of memory analysing %s\n", argv[optind]);
+            free(rom);
+            return 1;
+        }
+        PrintLayout(blocks, blockCount, blockSize, romSize, outputFormat, separator);
+
+        free(blocks);
+        free(rom);
+        return 0;
+    }
+
     romFile = fopen(argv[optind], "rb");
+    if (romFile == NULL) {
+        fprintf(stderr, "Failed to open file %s\n", argv[optind]);
+        return 1;
+    }
+    fseek(romFile, 0, SEEK_END);
+    if (ftell(romFile) == DISK_IMAGE_SIZE) {
+        fclose(romFile);
+        return ReadDisk(argv[optind], lba, benchmark);
+    }
+    if (lba >= 0 || benchmark) {
+        fprintf(stderr, "--lba and --benchmark can only be used with 64DD disk images\n");
+        fclose(romFile);
+        return 1;
+    }
+    fseek(romFile, 0, SEEK_SET);
     fread(&header, N64_HEADER_SIZE, 1, romFile);
     fseek(romFile, 0, SEEK_END);
     romSize = ftell(romFile);
 
     /* Guess endianness from first byte */
     if (!endianSpecified) {
-        switch (header.PIBSDDomain1Register[0]) {
-            case 0x80:
-                endianness = GOOD_ENDIAN;
-                break;
-
-            case 0x40:
-                endianness = BAD_ENDIAN;
-                break;
-
-            case 0x37:
-                endianness = UGLY_ENDIAN;
-                break;
-
-            default:
-                endianness = UNKNOWN_ENDIAN;
-                fprintf(stderr, "warning: unable to determine endianness from first byte of header: it is not one of "
-                                "0x80, 0x37, 0x40.\n  Recommend investigating the raw bytes with a hexdump.");
-                break;
+        endianness = DetectEndianness(header.PIBSDDomain1Register);
+        if (endianness == UNKNOWN_ENDIAN) {
+            fprintf(stderr, "warning: unable to determine endianness from first byte of header: it is not one of "
+                            "0x80, 0x37, 0x40.\n  Recommend investigating the raw bytes with a hexdump.");
         }
     }
 
-    switch (endianness) {
-        case GOOD_ENDIAN:
-        case UNKNOWN_ENDIAN:
-            break;
-        case BAD_ENDIAN:
-            SwapBytes32((uint32_t*)&header, sizeof(header));
-            break;
-        case UGLY_ENDIAN:
-            SwapBytes16((uint16_t*)&header, sizeof(header));
-            break;
-    }
+    NormaliseEndianness((uint8_t*)&header, sizeof(header), endianness);
 
     ReEndHeader(&header);
     {
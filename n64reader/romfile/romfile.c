@@ -0,0 +1,156 @@
+/**
+ * Helpers for reading whole ROM images into memory and normalising them to big-endian, shared by the n64reader tools.
+ */
+#include "romfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+const char* endiannessStrings[] = { "Big", "Little", "Middle", "Unknown" };
+
+/* Length in bytes */
+void SwapBytes16(uint16_t* data, size_t length) {
+    size_t i;
+    for (i = 0; i < length / 2; i++) {
+        data[i] = ((data[i] & 0xFF) << 0x8) | (data[i] >> 0x8);
+    }
+}
+
+void SwapBytes32(uint32_t* data, size_t length) {
+    size_t i;
+    for (i = 0; i < length / 4; i++) {
+        data[i] = ((data[i] & 0xFF) << 0x18) | ((data[i] & 0xFF00) << 0x8) | ((data[i] & 0xFF0000) >> 0x8) |
+                  (data[i] >> 0x18);
+    }
+}
+
+/* Guess endianness from first byte of the PI BSD Domain 1 register */
+Endianness DetectEndianness(const uint8_t* header) {
+    switch (header[0]) {
+        case 0x80:
+            return GOOD_ENDIAN;
+
+        case 0x40:
+            return BAD_ENDIAN;
+
+        case 0x37:
+            return UGLY_ENDIAN;
+
+        default:
+            return UNKNOWN_ENDIAN;
+    }
+}
+
+/* Rearrange data in-place so that it is big-endian */
+void NormaliseEndianness(uint8_t* data, size_t length, Endianness endianness) {
+    switch (endianness) {
+        case GOOD_ENDIAN:
+        case UNKNOWN_ENDIAN:
+            break;
+        case BAD_ENDIAN:
+            SwapBytes32((uint32_t*)data, length);
+            break;
+        case UGLY_ENDIAN:
+            SwapBytes16((uint16_t*)data, length);
+            break;
+    }
+}
+
+/**
+ * Reads an entire file into a newly-allocated buffer, which the caller must free.
+ *
+ * Returns NULL on failure.
+ */
+uint8_t* ReadWholeFile(const char* path, size_t* size) {
+    FILE* file;
+    uint8_t* buffer;
+    long length;
+
+    if ((file = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "Failed to open file %s\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    /* Pad to a whole number of words so the byteswapping functions can run over the entire buffer */
+    if (length < 0 || (buffer = calloc((((size_t)length + 3) & ~(size_t)3) + 4, 1)) == NULL) {
+        fprintf(stderr, "Failed to allocate buffer for %s\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    if (fread(buffer, 1, length, file) != (size_t)length) {
+        fprintf(stderr, "Failed to read file %s\n", path);
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    *size = length;
+    return buffer;
+}
+
+/**
+ * Writes size bytes of data to a file in one go.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int WriteWholeFile(const char* path, const uint8_t* data, size_t size) {
+    FILE* file;
+
+    if ((file = fopen(path, "wb")) == NULL) {
+        fprintf(stderr, "Failed to open file %s\n", path);
+        return -1;
+    }
+    if (size > 0 && fwrite(data, size, 1, file) != 1) {
+        fprintf(stderr, "Failed to write file %s\n", path);
+        fclose(file);
+        return -1;
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Failed to write file %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Reads a ROM image and converts it to big-endian. If endianness is not NULL, the detected original endianness is
+ * stored there.
+ */
+uint8_t* ReadRom(const char* path, size_t* size, Endianness* endianness) {
+    uint8_t* rom = ReadWholeFile(path, size);
+    Endianness detected;
+
+    if (rom == NULL) {
+        return NULL;
+    }
+
+    detected = (*size > 0) ? DetectEndianness(rom) : UNKNOWN_ENDIAN;
+    if (detected == UNKNOWN_ENDIAN) {
+        fprintf(stderr, "warning: unable to determine endianness of %s from first byte of header: it is not one of "
+                        "0x80, 0x37, 0x40. Assuming big-endian.\n",
+                path);
+    }
+    NormaliseEndianness(rom, *size, detected);
+
+    if (endianness != NULL) {
+        *endianness = detected;
+    }
+    return rom;
+}
+
+uint32_t ReadBE32(const uint8_t* data) {
+    return ((uint32_t)data[0] << 0x18) | (data[1] << 0x10) | (data[2] << 0x8) | data[3];
+}
+
+void WriteBE32(uint8_t* data, uint32_t value) {
+    data[0] = value >> 0x18;
+    data[1] = value >> 0x10;
+    data[2] = value >> 0x8;
+    data[3] = value;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    GOOD_ENDIAN,
+    BAD_ENDIAN,
+    UGLY_ENDIAN,
+    UNKNOWN_ENDIAN,
+} Endianness;
+
+extern const char* endiannessStrings[];
+
+void SwapBytes16(uint16_t* data, size_t length);
+void SwapBytes32(uint32_t* data, size_t length);
+
+Endianness DetectEndianness(const uint8_t* header);
+void NormaliseEndianness(uint8_t* data, size_t length, Endianness endianness);
+
+uint8_t* ReadWholeFile(const char* path, size_t* size);
+int WriteWholeFile(const char* path, const uint8_t* data, size_t size);
+uint8_t* ReadRom(const char* path, size_t* size, Endianness* endianness);
+
+uint32_t ReadBE32(const uint8_t* data);
+void WriteBE32(uint8_t* data, uint32_t value);
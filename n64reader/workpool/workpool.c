@@ -0,0 +1,325 @@
+/**
+ * A small work-stealing thread pool.
+ *
+ * Each worker owns a deque of tasks. Workers take their own tasks from the back (so recently-submitted, cache-warm
+ * subtasks run first) and, when they run dry, steal from the front of the other workers' deques (so the oldest,
+ * usually largest, pieces of work are the ones that migrate). Tasks submitted from inside a task go on the submitting
+ * worker's own deque; tasks submitted from outside the pool are dealt out round-robin.
+ *
+ * The deques are protected by a mutex each rather than being lock-free: the tasks in these tools are whole files or
+ * segments, so contention on the deques is negligible compared to the work done per task.
+ */
+#define _GNU_SOURCE
+#include "workpool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    WorkFunction func;
+    void* arg;
+} WorkTask;
+
+typedef struct {
+    pthread_mutex_t lock;
+    WorkTask* tasks; /* Ring buffer */
+    size_t capacity;
+    size_t head;
+    size_t count;
+} WorkDeque;
+
+typedef struct {
+    WorkPool* pool;
+    int index;
+} WorkerInfo;
+
+struct WorkPool {
+    int threadCount;
+    pthread_t* threads;
+    WorkerInfo* workers;
+    WorkDeque* deques;
+    atomic_long queued;  /* Tasks sitting in deques */
+    atomic_long pending; /* Tasks submitted but not yet finished */
+    atomic_uint nextDeque;
+    pthread_mutex_t lock;
+    pthread_cond_t workAvailable;
+    pthread_cond_t allDone;
+    bool quit;
+};
+
+static _Thread_local WorkPool* sCurrentPool = NULL;
+static _Thread_local int sWorkerIndex = -1;
+
+int WorkPool_DefaultThreadCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (count > 0) ? count : 1;
+}
+
+static void WorkDeque_Init(WorkDeque* deque) {
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->capacity = 16;
+    deque->tasks = malloc(deque->capacity * sizeof(WorkTask));
+    deque->head = 0;
+    deque->count = 0;
+}
+
+static void WorkDeque_Destroy(WorkDeque* deque) {
+    pthread_mutex_destroy(&deque->lock);
+    free(deque->tasks);
+}
+
+static void WorkDeque_PushBack(WorkDeque* deque, WorkTask task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        WorkTask* newTasks = malloc(2 * deque->capacity * sizeof(WorkTask));
+        size_t i;
+
+        for (i = 0; i < deque->count; i++) {
+            newTasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = newTasks;
+        deque->capacity *= 2;
+        deque->head = 0;
+    }
+    deque->tasks[(deque->head + deque->count) % deque->capacity] = task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static bool WorkDeque_PopBack(WorkDeque* deque, WorkTask* task) {
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        deque->count--;
+        *task = deque->tasks[(deque->head + deque->count) % deque->capacity];
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool WorkDeque_PopFront(WorkDeque* deque, WorkTask* task) {
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool WorkPool_TakeTask(WorkPool* pool, int self, WorkTask* task) {
+    int i;
+
+    if (WorkDeque_PopBack(&pool->deques[self], task)) {
+        return true;
+    }
+    for (i = 1; i < pool->threadCount; i++) {
+        if (WorkDeque_PopFront(&pool->deques[(self + i) % pool->threadCount], task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void* WorkPool_Worker(void* arg) {
+    WorkerInfo* info = arg;
+    WorkPool* pool = info->pool;
+    WorkTask task;
+
+    sCurrentPool = pool;
+    sWorkerIndex = info->index;
+
+    while (true) {
+        bool quit;
+
+        if (WorkPool_TakeTask(pool, info->index, &task)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            task.func(task.arg);
+
+            if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_broadcast(&pool->allDone);
+                pthread_mutex_unlock(&pool->lock);
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->queued) <= 0 && !pool->quit) {
+            pthread_cond_wait(&pool->workAvailable, &pool->lock);
+        }
+        quit = pool->quit && (atomic_load(&pool->queued) <= 0);
+        pthread_mutex_unlock(&pool->lock);
+
+        if (quit) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Start a pool with threadCount workers (or one per online CPU if threadCount <= 0).
+ *
+ * Returns NULL on failure.
+ */
+WorkPool* WorkPool_Create(int threadCount) {
+    WorkPool* pool = calloc(1, sizeof(WorkPool));
+    int i;
+
+    if (pool == NULL) {
+        return NULL;
+    }
+    if (threadCount <= 0) {
+        threadCount = WorkPool_DefaultThreadCount();
+    }
+
+    pool->threadCount = threadCount;
+    pool->threads = calloc(threadCount, sizeof(pthread_t));
+    pool->workers = calloc(threadCount, sizeof(WorkerInfo));
+    pool->deques = calloc(threadCount, sizeof(WorkDeque));
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->nextDeque, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->workAvailable, NULL);
+    pthread_cond_init(&pool->allDone, NULL);
+
+    for (i = 0; i < threadCount; i++) {
+        WorkDeque_Init(&pool->deques[i]);
+    }
+    for (i = 0; i < threadCount; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if (pthread_create(&pool->threads[i], NULL, WorkPool_Worker, &pool->workers[i]) != 0) {
+            fprintf(stderr, "Failed to create worker thread %d\n", i);
+            pool->threadCount = i;
+            WorkPool_Destroy(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+void WorkPool_Submit(WorkPool* pool, WorkFunction func, void* arg) {
+    WorkTask task = { func, arg };
+    int index;
+
+    if (sCurrentPool == pool) {
+        index = sWorkerIndex;
+    } else {
+        index = atomic_fetch_add(&pool->nextDeque, 1) % pool->threadCount;
+    }
+
+    atomic_fetch_add(&pool->pending, 1);
+    WorkDeque_PushBack(&pool->deques[index], task);
+    atomic_fetch_add(&pool->queued, 1);
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->workAvailable);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Block until every submitted task, including any they submitted in turn, has finished. */
+void WorkPool_Wait(WorkPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->pending) > 0) {
+        pthread_cond_wait(&pool->allDone, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Finish outstanding work, stop the workers and free the pool. */
+void WorkPool_Destroy(WorkPool* pool) {
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->workAvailable);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->threadCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (i = 0; i < pool->threadCount; i++) {
+        WorkDeque_Destroy(&pool->deques[i]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->workAvailable);
+    pthread_cond_destroy(&pool->allDone);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool->threads);
+    free(pool);
+}
+
+typedef struct {
+    WorkIndexFunction func;
+    void* arg;
+    size_t start;
+    size_t end;
+} WorkRange;
+
+static void WorkPool_RunRange(void* arg) {
+    WorkRange* range = arg;
+    size_t i;
+
+    for (i = range->start; i < range->end; i++) {
+        range->func(range->arg, i);
+    }
+}
+
+/**
+ * Call func(arg, i) for every i in [0, count) using threadCount threads (or one per online CPU if threadCount <= 0).
+ * The range is cut into several chunks per thread so that stealing can even out uneven per-index costs.
+ */
+void WorkPool_ParallelFor(int threadCount, size_t count, WorkIndexFunction func, void* arg) {
+    WorkPool* pool;
+    WorkRange* ranges;
+    size_t chunkSize;
+    size_t chunkCount;
+    size_t i;
+
+    if (threadCount <= 0) {
+        threadCount = WorkPool_DefaultThreadCount();
+    }
+    if (threadCount == 1 || count <= 1 || (pool = WorkPool_Create(threadCount)) == NULL) {
+        for (i = 0; i < count; i++) {
+            func(arg, i);
+        }
+        return;
+    }
+
+    chunkSize = count / (8 * (size_t)threadCount);
+    if (chunkSize == 0) {
+        chunkSize = 1;
+    }
+    chunkCount = (count + chunkSize - 1) / chunkSize;
+    ranges = malloc(chunkCount * sizeof(WorkRange));
+
+    for (i = 0; i < chunkCount; i++) {
+        ranges[i].func = func;
+        ranges[i].arg = arg;
+        ranges[i].start = i * chunkSize;
+        ranges[i].end = (i + 1) * chunkSize < count ? (i + 1) * chunkSize : count;
+        WorkPool_Submit(pool, WorkPool_RunRange, &ranges[i]);
+    }
+
+    WorkPool_Wait(pool);
+    WorkPool_Destroy(pool);
+    free(ranges);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef void (*WorkFunction)(void* arg);
+typedef void (*WorkIndexFunction)(void* arg, size_t index);
+
+typedef struct WorkPool WorkPool;
+
+int WorkPool_DefaultThreadCount(void);
+
+WorkPool* WorkPool_Create(int threadCount);
+void WorkPool_Submit(WorkPool* pool, WorkFunction func, void* arg);
+void WorkPool_Wait(WorkPool* pool);
+void WorkPool_Destroy(WorkPool* pool);
+
+void WorkPool_ParallelFor(int threadCount, size_t count, WorkIndexFunction func, void* arg);
@@ -0,0 +1,466 @@
+/**
+ * @file romdiff.c
+ * @brief Compares a built ROM against the base ROM and says which files and symbols the differences are in.
+ *
+ * Both ROMs are mapped into memory and converted to big-endian the same way n64reader does. The comparison skips over
+ * matching data 32 bytes at a time, and nearby differences are merged into ranges. With a map file, each range is
+ * looked up in the ROM intervals of the map's file entries, and the nearest symbol before it is given.
+ *
+ * SPDX-identifier: MIT
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "mapfile.h"
+#include "romfile/romfile.h"
+
+#define BLOCK_SIZE 32
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    Endianness endianness;
+} Rom;
+
+/* ROM addresses of a file entry of the map */
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint32_t entry;
+} RomInterval;
+
+typedef struct {
+    RomInterval* intervals; /* By start */
+    uint64_t* maxEnds;      /* Largest end of the intervals up to and including each one */
+    size_t count;
+} IntervalIndex;
+
+struct {
+    size_t gap;
+    size_t maxRanges;
+} gOptions = { 0x10, 0 };
+
+/**
+ * Maps a ROM image into memory and converts it to big-endian. The mapping is private, so only the pages that have to
+ * be swapped are copied.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int Rom_Open(Rom* rom, const char* path) {
+    int fd;
+    struct stat fileStat;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &fileStat) != 0) {
+        fprintf(stderr, "Failed to open file %s\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    rom->size = fileStat.st_size;
+    rom->data = NULL;
+    rom->endianness = UNKNOWN_ENDIAN;
+    if (rom->size != 0) {
+        rom->data = mmap(NULL, rom->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (rom->data == MAP_FAILED) {
+        fprintf(stderr, "Failed to read file %s\n", path);
+        return -1;
+    }
+    if (rom->data == NULL) {
+        return 0;
+    }
+
+    rom->endianness = DetectEndianness(rom->data);
+    if (rom->endianness == UNKNOWN_ENDIAN) {
+        fprintf(stderr, "warning: unable to determine endianness of %s from first byte of header: it is not one of "
+                        "0x80, 0x37, 0x40. Assuming big-endian.\n",
+                path);
+    }
+    madvise(rom->data, rom->size, MADV_SEQUENTIAL);
+    NormaliseEndianness(rom->data, rom->size & ~(size_t)3, rom->endianness);
+    return 0;
+}
+
+void Rom_Close(Rom* rom) {
+    if (rom->data != NULL) {
+        munmap(rom->data, rom->size);
+    }
+}
+
+#if defined(__SSE2__)
+/* Bit i is set if byte i of the two 32-byte blocks is the same */
+static inline uint32_t CompareBlocks(const uint8_t* a, const uint8_t* b) {
+    __m128i low = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+    __m128i high = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + 16)), _mm_loadu_si128((const __m128i*)(b + 16)));
+
+    return (uint32_t)_mm_movemask_epi8(low) | ((uint32_t)_mm_movemask_epi8(high) << 16);
+}
+#else
+static inline uint32_t CompareBlocks(const uint8_t* a, const uint8_t* b) {
+    uint32_t mask = 0;
+    size_t i;
+
+    for (i = 0; i < BLOCK_SIZE; i++) {
+        mask |= (uint32_t)(a[i] == b[i]) << i;
+    }
+    return mask;
+}
+#endif
+
+/**
+ * Finds the first offset from start on where a and b are the same (if same) or differ (if not).
+ *
+ * Returns the offset, or size if there is none.
+ */
+size_t FindNext(const uint8_t* a, const uint8_t* b, size_t start, size_t size, bool same) {
+    size_t offset = start;
+
+    for (; offset + BLOCK_SIZE <= size; offset += BLOCK_SIZE) {
+        uint32_t mask = CompareBlocks(a + offset, b + offset);
+
+        if (!same) {
+            mask = ~mask;
+        }
+        if (mask != 0) {
+            return offset + __builtin_ctz(mask);
+        }
+    }
+    for (; offset < size; offset++) {
+        if ((a[offset] == b[offset]) == same) {
+            return offset;
+        }
+    }
+    return size;
+}
+
+static int CompareIntervals(const void* a, const void* b) {
+    const RomInterval* intervalA = a;
+    const RomInterval* intervalB = b;
+
+    if (intervalA->start != intervalB->start) {
+        return (intervalA->start > intervalB->start) ? 1 : -1;
+    }
+    return (intervalA->entry > intervalB->entry) - (intervalA->entry < intervalB->entry);
+}
+
+/* Sections that take up no space in the ROM, even though the map gives them a ROM address */
+static bool IsNoLoadSection(const char* name) {
+    return strcmp(name, ".bss") == 0 || strncmp(name, ".bss.", 5) == 0 || strcmp(name, ".sbss") == 0 ||
+           strcmp(name, "COMMON") == 0 || strcmp(name, ".scommon") == 0;
+}
+
+/* Input sections that hold data loaded from the ROM, for output sections the map gives no load address */
+static bool IsLoadedSection(const char* name) {
+    static const char* const loadedPrefixes[] = {
+        ".text", ".data", ".rodata", ".rdata", ".late_rodata", ".sdata", ".lit4", ".lit8", ".init", ".fini",
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(loadedPrefixes) / sizeof(loadedPrefixes[0]); i++) {
+        if (strncmp(name, loadedPrefixes[i], strlen(loadedPrefixes[i])) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Whether an entry takes up space in the ROM. Sections that are not loaded at all, like .comment, .pdr and .mdebug,
+ * still get an address from the map, usually 0, which would put them over the header. ld only prints a load address
+ * for output sections that have one different from their VRAM, so those count as loaded; in the rest, such as the
+ * header's own at 0, only the usual code and data input sections do.
+ */
+static bool IsInRom(const MapFile* map, const MapFileEntry* entry) {
+    const char* sectionName = MapFile_GetString(map, entry->section);
+
+    if (entry->size == 0 || IsNoLoadSection(sectionName)) {
+        return false;
+    }
+    if (entry->outputSection != MAPFILE_NONE &&
+        map->sections[entry->outputSection].rom != map->sections[entry->outputSection].vram) {
+        return true;
+    }
+    return IsLoadedSection(sectionName);
+}
+
+void IntervalIndex_Build(IntervalIndex* index, const MapFile* map) {
+    size_t i;
+
+    index->intervals = malloc((map->entryCount + 1) * sizeof(RomInterval));
+    index->maxEnds = malloc((map->entryCount + 1) * sizeof(uint64_t));
+    index->count = 0;
+
+    for (i = 0; i < map->entryCount; i++) {
+        const MapFileEntry* entry = &map->entries[i];
+
+        if (!IsInRom(map, entry)) {
+            continue;
+        }
+        index->intervals[index->count].start = entry->rom;
+        index->intervals[index->count].end = entry->rom + entry->size;
+        index->intervals[index->count].entry = i;
+        index->count++;
+    }
+    qsort(index->intervals, index->count, sizeof(RomInterval), CompareIntervals);
+
+    for (i = 0; i < index->count; i++) {
+        index->maxEnds[i] = index->intervals[i].end;
+        if (i != 0 && index->maxEnds[i - 1] > index->maxEnds[i]) {
+            index->maxEnds[i] = index->maxEnds[i - 1];
+        }
+    }
+}
+
+void IntervalIndex_Destroy(IntervalIndex* index) {
+    free(index->intervals);
+    free(index->maxEnds);
+}
+
+/**
+ * Finds the file entry whose ROM interval holds offset; of overlapping ones, the one starting last.
+ *
+ * Returns the entry index, or MAPFILE_NONE if there is none.
+ */
+uint32_t IntervalIndex_Find(const IntervalIndex* index, uint64_t offset) {
+    size_t low = 0;
+    size_t high = index->count;
+
+    /* Number of intervals starting at or before offset */
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (index->intervals[middle].start <= offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    /* Only intervals before one whose running maximum end is past offset can hold it */
+    while (low > 0 && index->maxEnds[low - 1] > offset) {
+        low--;
+        if (offset < index->intervals[low].end) {
+            return index->intervals[low].entry;
+        }
+    }
+    return MAPFILE_NONE;
+}
+
+/* Prints the file, section and nearest symbol at or before offset, e.g. "build/src/foo.o(.text) func_80001234+0x10" */
+void PrintAttribution(const MapFile* map, const IntervalIndex* index, uint64_t offset) {
+    uint32_t entryIndex = IntervalIndex_Find(index, offset);
+    const MapFileEntry* entry;
+    const MapSymbol* nearest = NULL;
+    uint64_t vram;
+    size_t i;
+
+    if (entryIndex == MAPFILE_NONE) {
+        printf("(not in map)");
+        return;
+    }
+
+    entry = &map->entries[entryIndex];
+    vram = entry->vram + (offset - entry->rom);
+    for (i = 0; i < entry->symbolCount; i++) {
+        const MapSymbol* symbol = &map->symbols[entry->firstSymbol + i];
+
+        if (symbol->vram <= vram && (nearest == NULL || symbol->vram >= nearest->vram)) {
+            nearest = symbol;
+        }
+    }
+
+    printf("%s(%s)", MapFile_GetString(map, entry->name), MapFile_GetString(map, entry->section));
+    if (nearest != NULL) {
+        printf(" %s+0x%llX", MapFile_GetString(map, nearest->name), (unsigned long long)(vram - nearest->vram));
+    } else {
+        printf(" +0x%llX", (unsigned long long)(offset - entry->rom));
+    }
+}
+
+void PrintRange(const MapFile* map, const IntervalIndex* index, size_t start, size_t end) {
+    printf("%08zX-%08zX (0x%zX bytes)", start, end, end - start);
+    if (index != NULL) {
+        printf(": ");
+        PrintAttribution(map, index, start);
+        if (IntervalIndex_Find(index, end - 1) != IntervalIndex_Find(index, start)) {
+            printf(" .. ");
+            PrintAttribution(map, index, end - 1);
+        }
+    }
+    putchar('\n');
+}
+
+/**
+ * Prints the ranges where the ROMs differ, merging differences less than gOptions.gap bytes apart.
+ *
+ * Returns the number of ranges.
+ */
+size_t DiffRoms(const Rom* baseRom, const Rom* builtRom, const MapFile* map, const IntervalIndex* index) {
+    size_t size = (baseRom->size < builtRom->size) ? baseRom->size : builtRom->size;
+    size_t rangeCount = 0;
+    size_t start = FindNext(baseRom->data, builtRom->data, 0, size, false);
+
+    if (start < size) {
+        printf("First difference at 0x%zX: expected 0x%02X, found 0x%02X\n", start, baseRom->data[start],
+               builtRom->data[start]);
+    }
+
+    while (start < size) {
+        size_t end = start + 1;
+
+        while (true) {
+            size_t same = FindNext(baseRom->data, builtRom->data, end, size, true);
+            size_t next = FindNext(baseRom->data, builtRom->data, same, size, false);
+
+            if (next >= size || next - same >= gOptions.gap) {
+                end = same;
+                break;
+            }
+            end = next + 1;
+        }
+
+        rangeCount++;
+        if (gOptions.maxRanges == 0 || rangeCount <= gOptions.maxRanges) {
+            PrintRange(map, index, start, end);
+        }
+        start = FindNext(baseRom->data, builtRom->data, end, size, false);
+    }
+
+    if (gOptions.maxRanges != 0 && rangeCount > gOptions.maxRanges) {
+        printf("... %zu more ranges\n", rangeCount - gOptions.maxRanges);
+    }
+    return rangeCount;
+}
+
+const struct option longOptions[] = {
+    { "map", required_argument, NULL, 'm' },
+    { "start", required_argument, NULL, 's' },
+    { "gap", required_argument, NULL, 'g' },
+    { "max-ranges", required_argument, NULL, 'n' },
+    { "no-snapshot", no_argument, NULL, 'S' },
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+};
+
+int main(int argc, char** argv) {
+    int opt;
+    const char* mapPath = NULL;
+    const char* startMarker = NULL;
+    bool useSnapshot = true;
+    static char outputBuffer[0x10000];
+    Rom baseRom;
+    Rom builtRom;
+    MapFile map;
+    IntervalIndex index;
+    size_t rangeCount;
+    int ret;
+
+    while (true) {
+        int optionIndex = 0;
+        if ((opt = getopt_long(argc, argv, "m:s:g:n:Sh", longOptions, &optionIndex)) == EOF) {
+            break;
+        }
+
+        switch (opt) {
+            case 'm':
+                mapPath = optarg;
+                break;
+
+            case 's':
+                startMarker = optarg;
+                break;
+
+            case 'g':
+                gOptions.gap = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'n':
+                gOptions.maxRanges = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'S':
+                useSnapshot = false;
+                break;
+
+            case 'h':
+                fprintf(stderr, "%s [-m MAPFILE] [-s STRING] [-g BYTES] [-n NUM] [-S] BASEROM BUILTROM\n", argv[0]);
+                puts("Compares a built ROM with the base ROM, and prints the ranges where they differ.\n"
+                     "Either ROM may be in any byte order.\n"
+                     "Options:\n"
+                     "  -m, --map MAPFILE      Map file of the built ROM, to name the file and symbol of each range\n"
+                     "  -s, --start STRING     Start parsing the map at the first occurrence of STRING\n"
+                     "  -g, --gap BYTES        Merge differences fewer than BYTES apart (default: 0x10)\n"
+                     "  -n, --max-ranges NUM   Only print the first NUM ranges\n"
+                     "  -S, --no-snapshot      Parse the map file instead of loading the snapshot saved next to it,\n"
+                     "                         and do not save one\n"
+                     "  -h, --help             Display this message and exit.\n");
+                return 1;
+
+            default:
+                fprintf(stderr, "Getopt returned character code: 0x%X", opt);
+        }
+    }
+
+    if (argc - optind != 2) {
+        fprintf(stderr, "%s [-m MAPFILE] [-s STRING] [-g BYTES] [-n NUM] [-S] BASEROM BUILTROM\n", argv[0]);
+        return 2;
+    }
+    if (gOptions.gap == 0) {
+        gOptions.gap = 1;
+    }
+
+    if (Rom_Open(&baseRom, argv[optind]) != 0) {
+        return 2;
+    }
+    if (Rom_Open(&builtRom, argv[optind + 1]) != 0) {
+        Rom_Close(&baseRom);
+        return 2;
+    }
+    if (mapPath != NULL) {
+        ret = useSnapshot ? MapFile_ParseCached(&map, mapPath, startMarker, MAPFILE_FILTER_LABELS, NULL)
+                          : MapFile_Parse(&map, mapPath, startMarker, MAPFILE_FILTER_LABELS);
+        if (ret != 0) {
+            Rom_Close(&baseRom);
+            Rom_Close(&builtRom);
+            return 2;
+        }
+        IntervalIndex_Build(&index, &map);
+    }
+
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+    if (baseRom.endianness != builtRom.endianness) {
+        printf("Byte order differs: %s-endian base ROM, %s-endian built ROM\n", endiannessStrings[baseRom.endianness],
+               endiannessStrings[builtRom.endianness]);
+    }
+    rangeCount = DiffRoms(&baseRom, &builtRom, (mapPath != NULL) ? &map : NULL, (mapPath != NULL) ? &index : NULL);
+    if (baseRom.size != builtRom.size) {
+        printf("Size differs: 0x%zX bytes in base ROM, 0x%zX bytes in built ROM\n", baseRom.size, builtRom.size);
+    } else if (rangeCount == 0) {
+        printf("ROMs match\n");
+    }
+    fflush(stdout);
+
+    if (mapPath != NULL) {
+        IntervalIndex_Destroy(&index);
+        MapFile_Destroy(&map);
+    }
+    Rom_Close(&baseRom);
+    Rom_Close(&builtRom);
+    return (rangeCount == 0 && baseRom.size == builtRom.size) ? 0 : 1;
+}